@@ -75,6 +75,148 @@ typedef enum _XDP_MATCH_TYPE {
     // UDP port enabled in the port set.
     //
     XDP_MATCH_IPV6_UDP_PORT_SET,
+    //
+    // Match all TCP frames.
+    //
+    XDP_MATCH_TCP,
+    //
+    // Match frames with a specific TCP port number as their destination port.
+    // The port number is specified by field Port in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_TCP_DST,
+    //
+    // Match frames with a specific source and destination IPv4 addresses and TCP
+    // port numbers.
+    //
+    XDP_MATCH_IPV4_TCP_TUPLE,
+    //
+    // Match frames with a specific source and destination IPv6 addresses and TCP
+    // port numbers.
+    //
+    XDP_MATCH_IPV6_TCP_TUPLE,
+    //
+    // Match frames with a destination TCP port enabled in the port set.
+    //
+    XDP_MATCH_TCP_PORT_SET,
+    //
+    // Match IPv4 frames matching the destination address and the destination
+    // TCP port enabled in the port set.
+    //
+    XDP_MATCH_IPV4_TCP_PORT_SET,
+    //
+    // Match IPv6 frames matching the destination address and the destination
+    // TCP port enabled in the port set.
+    //
+    XDP_MATCH_IPV6_TCP_PORT_SET,
+    //
+    // Match TCP frames based on their control flags, using a flags mask.
+    // The flags mask is specified by field TcpFlags in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_TCP_FLAGS,
+    //
+    // Match IPv4 frames based on their source address, using an IP address mask.
+    // The address mask is specified by field IpMask in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_IPV4_SRC_MASK,
+    //
+    // Match IPv6 frames based on their source address, using an IP address mask.
+    // The address mask is specified by field IpMask in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_IPV6_SRC_MASK,
+    //
+    // Match frames with a specific UDP port number as their source port.
+    // The port number is specified by field Port in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_UDP_SRC,
+    //
+    // Match frames with a specific TCP port number as their source port.
+    // The port number is specified by field Port in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_TCP_SRC,
+    //
+    // Match frames with a source UDP port enabled in the port set.
+    //
+    XDP_MATCH_UDP_SRC_PORT_SET,
+    //
+    // Match frames with a source TCP port enabled in the port set.
+    //
+    XDP_MATCH_TCP_SRC_PORT_SET,
+    //
+    // Match UDP destination port and QUIC destination connection IDs in short
+    // header QUIC packets against the entries of a connection ID table,
+    // specified by field QuicCidTable in XDP_MATCH_PATTERN. The rule action
+    // must be XDP_PROGRAM_ACTION_REDIRECT with target type
+    // XDP_REDIRECT_TARGET_TYPE_QUIC_CID_TABLE; matching frames are redirected
+    // to the target of the matching table entry. The table is initially empty
+    // and its entries are updated with XdpProgramUpdateQuicCid.
+    //
+    XDP_MATCH_QUIC_FLOW_DST_CID_TABLE,
+    //
+    // Match frames whose header field is present in a map. The map and the
+    // field are specified by field Map in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_MAP,
+    //
+    // Match IPv4 frames whose source or destination address is present in an
+    // address set, specified by field IpAddressSet in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_IPV4_ADDRESS_SET,
+    //
+    // Match IPv6 frames whose source or destination address is present in an
+    // address set, specified by field IpAddressSet in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_IPV6_ADDRESS_SET,
+    //
+    // Match frames based on up to XDP_PAYLOAD_MATCH_MAX_LENGTH bytes at an
+    // offset from the start of a protocol layer, using a mask. The layer,
+    // offset, mask and value are specified by field Payload in
+    // XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_PAYLOAD,
+    //
+    // Match frames for which a bytecode program returns a non-zero value. The
+    // program is specified by field Bytecode in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_BYTECODE,
+    //
+    // Match frames by the VLAN identifiers of their 802.1Q or 802.1ad tags,
+    // specified by field Vlan in XDP_MATCH_PATTERN. Frames with up to two tags
+    // are parsed through the tags, so the other match types also apply to
+    // tagged frames.
+    //
+    XDP_MATCH_VLAN_ID,
+    //
+    // Match UDP frames encapsulating a VXLAN or GENEVE tunnel by the virtual
+    // network identifier, specified by field Tunnel in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_TUNNEL_VNI,
+    //
+    // Match UDP frames encapsulating a VXLAN or GENEVE tunnel by the virtual
+    // network identifier and the 5-tuple of the inner IPv4 packet, specified
+    // by field TunnelTuple in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_TUNNEL_IPV4_TUPLE,
+    //
+    // Match UDP frames encapsulating a VXLAN or GENEVE tunnel by the virtual
+    // network identifier and the 5-tuple of the inner IPv6 packet, specified
+    // by field TunnelTuple in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_TUNNEL_IPV6_TUPLE,
+    //
+    // Match frames by the destination address of their Ethernet header,
+    // specified by field MacAddress in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_ETH_DST,
+    //
+    // Match frames whose Ethernet destination address is present in an address
+    // set, specified by field MacAddressSet in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_ETH_DST_SET,
+    //
+    // Match frames by the EtherType following the Ethernet header and any VLAN
+    // tags, specified by field EtherType in XDP_MATCH_PATTERN.
+    //
+    XDP_MATCH_ETHERTYPE,
 } XDP_MATCH_TYPE;
 
 typedef union _XDP_INET_ADDR {
@@ -103,6 +245,21 @@ typedef struct _XDP_QUIC_FLOW {
     UCHAR CidData[QUIC_MAX_CID_LENGTH]; // Max allowed per QUIC v1 RFC
 } XDP_QUIC_FLOW;
 
+typedef struct _XDP_QUIC_CID_TABLE {
+    UINT16 UdpPort;
+    //
+    // Each table entry matches the CidLength bytes of the CID at CidOffset.
+    // CidLength must be non-zero, and CidOffset + CidLength must not exceed
+    // QUIC_MAX_CID_LENGTH.
+    //
+    UCHAR CidLength;
+    UCHAR CidOffset;
+    //
+    // Reserved for use by the XDP platform. Must be NULL.
+    //
+    VOID *Reserved;
+} XDP_QUIC_CID_TABLE;
+
 #define XDP_PORT_SET_BUFFER_SIZE ((MAXUINT16 + 1) / 8)
 
 typedef struct _XDP_PORT_SET {
@@ -120,6 +277,333 @@ typedef struct _XDP_IP_PORT_SET {
     XDP_PORT_SET PortSet;
 } XDP_IP_PORT_SET;
 
+//
+// Header fields used as the key of an XDP_MATCH_MAP rule.
+//
+typedef enum _XDP_MAP_KEY_FIELD {
+    XDP_MAP_KEY_FIELD_IPV4_SOURCE,
+    XDP_MAP_KEY_FIELD_IPV4_DESTINATION,
+    XDP_MAP_KEY_FIELD_IPV6_SOURCE,
+    XDP_MAP_KEY_FIELD_IPV6_DESTINATION,
+    XDP_MAP_KEY_FIELD_UDP_SOURCE,
+    XDP_MAP_KEY_FIELD_UDP_DESTINATION,
+    XDP_MAP_KEY_FIELD_TCP_SOURCE,
+    XDP_MAP_KEY_FIELD_TCP_DESTINATION,
+} XDP_MAP_KEY_FIELD;
+
+typedef struct _XDP_MAP_MATCH {
+    //
+    // A map handle created by XdpMapCreate. The map is referenced when the
+    // rule is created, and the handle need not remain open afterwards.
+    //
+    // The key is the field as it appears in the frame, in network order. Hash
+    // maps must have the key size of the field, and LPM maps the key size of an
+    // XDP_MAP_LPM_KEY holding the field. Array and bitmap maps support port
+    // fields only, and are indexed by the port represented in network order.
+    //
+    HANDLE Map;
+    XDP_MAP_KEY_FIELD KeyField;
+} XDP_MAP_MATCH;
+
+//
+// Match the source address of the frame instead of its destination address.
+//
+#define XDP_IP_ADDRESS_SET_FLAG_SOURCE          0x00000001
+
+//
+// Place a Bloom filter in front of the address set, so the lookup of most
+// addresses absent from the set reads a single cache line. Recommended for
+// large sets that most frames do not match.
+//
+#define XDP_IP_ADDRESS_SET_FLAG_BLOOM_FILTER    0x00000002
+
+#define XDP_IP_ADDRESS_SET_MAX_ADDRESSES 0x00400000
+
+typedef struct _XDP_IP_ADDRESS_SET {
+    //
+    // An array of IPv4 or IPv6 addresses, according to the match type. The
+    // array is captured when the rule is created and need not remain valid
+    // afterwards. Duplicate addresses are ignored.
+    //
+    CONST XDP_INET_ADDR *Addresses;
+    //
+    // The number of addresses in the array, from 1 to
+    // XDP_IP_ADDRESS_SET_MAX_ADDRESSES.
+    //
+    UINT32 AddressCount;
+    //
+    // A bitwise OR of XDP_IP_ADDRESS_SET_FLAG_* values.
+    //
+    UINT32 Flags;
+    //
+    // Reserved for use by the XDP platform. Must be NULL.
+    //
+    VOID *Reserved;
+} XDP_IP_ADDRESS_SET;
+
+//
+// Protocol layers whose start a payload match offset is relative to. Frames
+// without the layer do not match.
+//
+typedef enum _XDP_PAYLOAD_LAYER {
+    //
+    // The Ethernet header.
+    //
+    XDP_PAYLOAD_LAYER_L2,
+    //
+    // The IPv4 or IPv6 header.
+    //
+    XDP_PAYLOAD_LAYER_L3,
+    //
+    // The UDP or TCP header.
+    //
+    XDP_PAYLOAD_LAYER_L4,
+    //
+    // The UDP or TCP payload.
+    //
+    XDP_PAYLOAD_LAYER_L4_PAYLOAD,
+} XDP_PAYLOAD_LAYER;
+
+#define XDP_PAYLOAD_MATCH_MAX_LENGTH 16
+
+typedef struct _XDP_PAYLOAD_MATCH {
+    XDP_PAYLOAD_LAYER Layer;
+    UINT16 Offset;
+    //
+    // The number of bytes to match, from 1 to XDP_PAYLOAD_MATCH_MAX_LENGTH.
+    // Frames ending before Offset + Length bytes from the layer start do not
+    // match.
+    //
+    UINT16 Length;
+    //
+    // The bitwise AND operation is applied to the first Length bytes of the
+    // Mask field and the frame bytes. The result is compared to the Value
+    // field, whose bits outside the mask are ignored.
+    //
+    UCHAR Value[XDP_PAYLOAD_MATCH_MAX_LENGTH];
+    UCHAR Mask[XDP_PAYLOAD_MATCH_MAX_LENGTH];
+} XDP_PAYLOAD_MATCH;
+
+//
+// Bytecode instruction opcodes. A bytecode program operates on two 32-bit
+// registers, the accumulator A and the index X, both initially zero.
+//
+typedef enum _XDP_BYTECODE_OPCODE {
+    //
+    // Stop, and match the frame if Immediate is non-zero.
+    //
+    XDP_BYTECODE_OP_RETURN,
+    //
+    // A = Immediate.
+    //
+    XDP_BYTECODE_OP_LOAD_IMMEDIATE,
+    //
+    // A = the 1, 2 or 4 bytes at offset Immediate from the start of Layer,
+    // converted from network order. If the frame does not contain the layer or
+    // the bytes, the program stops and does not match the frame.
+    //
+    XDP_BYTECODE_OP_LOAD_8,
+    XDP_BYTECODE_OP_LOAD_16,
+    XDP_BYTECODE_OP_LOAD_32,
+    //
+    // As above, at offset X + Immediate from the start of Layer.
+    //
+    XDP_BYTECODE_OP_LOAD_INDEXED_8,
+    XDP_BYTECODE_OP_LOAD_INDEXED_16,
+    XDP_BYTECODE_OP_LOAD_INDEXED_32,
+    //
+    // A = A op Immediate. Shift counts must be less than 32, and additions
+    // wrap around.
+    //
+    XDP_BYTECODE_OP_AND,
+    XDP_BYTECODE_OP_OR,
+    XDP_BYTECODE_OP_LEFT_SHIFT,
+    XDP_BYTECODE_OP_RIGHT_SHIFT,
+    XDP_BYTECODE_OP_ADD,
+    //
+    // X = A.
+    //
+    XDP_BYTECODE_OP_MOVE_TO_INDEX,
+    //
+    // Skip JumpTrue instructions.
+    //
+    XDP_BYTECODE_OP_JUMP,
+    //
+    // Skip JumpTrue instructions if the comparison of A with Immediate holds,
+    // and JumpFalse instructions otherwise. JUMP_SET tests A & Immediate != 0.
+    //
+    XDP_BYTECODE_OP_JUMP_EQUAL,
+    XDP_BYTECODE_OP_JUMP_GREATER,
+    XDP_BYTECODE_OP_JUMP_GREATER_EQUAL,
+    XDP_BYTECODE_OP_JUMP_SET,
+} XDP_BYTECODE_OPCODE;
+
+typedef struct _XDP_BYTECODE_INSTRUCTION {
+    //
+    // An XDP_BYTECODE_OPCODE value.
+    //
+    UINT8 Opcode;
+    //
+    // An XDP_PAYLOAD_LAYER value for loads from the frame, and zero otherwise.
+    //
+    UINT8 Layer;
+    //
+    // The number of instructions skipped by jumps. Jumps are forward only and
+    // must not skip past the last instruction. Zero for other opcodes.
+    //
+    UINT8 JumpTrue;
+    UINT8 JumpFalse;
+    //
+    // The operand of the opcode. Zero for XDP_BYTECODE_OP_MOVE_TO_INDEX and
+    // XDP_BYTECODE_OP_JUMP. Load offsets must not exceed MAXUINT16.
+    //
+    UINT32 Immediate;
+} XDP_BYTECODE_INSTRUCTION;
+
+#define XDP_BYTECODE_MAX_INSTRUCTIONS 4096
+
+typedef struct _XDP_BYTECODE {
+    //
+    // An array of instructions, ending with XDP_BYTECODE_OP_RETURN. The
+    // program is verified and captured when the rule is created, and the array
+    // need not remain valid afterwards. Since jumps are forward only, every
+    // program terminates within InstructionCount steps.
+    //
+    CONST XDP_BYTECODE_INSTRUCTION *Instructions;
+    //
+    // The number of instructions, from 1 to XDP_BYTECODE_MAX_INSTRUCTIONS.
+    //
+    UINT32 InstructionCount;
+    //
+    // Reserved for use by the XDP platform. Must be NULL.
+    //
+    VOID *Reserved;
+} XDP_BYTECODE;
+
+//
+// TCP control flags, as they appear in the TCP header.
+//
+#define XDP_TCP_FLAG_FIN 0x01
+#define XDP_TCP_FLAG_SYN 0x02
+#define XDP_TCP_FLAG_RST 0x04
+#define XDP_TCP_FLAG_PSH 0x08
+#define XDP_TCP_FLAG_ACK 0x10
+#define XDP_TCP_FLAG_URG 0x20
+#define XDP_TCP_FLAG_ECE 0x40
+#define XDP_TCP_FLAG_CWR 0x80
+
+typedef struct _XDP_TCP_FLAGS {
+    //
+    // The bitwise AND operation is applied to the Mask field and the TCP
+    // flags of the frame. The result is compared to the Flags field. For
+    // example, a bare SYN is matched with Mask set to SYN | ACK | RST | FIN and
+    // Flags set to SYN.
+    //
+    UINT8 Mask;
+    UINT8 Flags;
+} XDP_TCP_FLAGS;
+
+typedef enum _XDP_TUNNEL_TYPE {
+    //
+    // VXLAN (RFC 7348), encapsulating an Ethernet frame.
+    //
+    XDP_TUNNEL_TYPE_VXLAN,
+    //
+    // GENEVE (RFC 8926), encapsulating an Ethernet frame or an IP packet.
+    //
+    XDP_TUNNEL_TYPE_GENEVE,
+} XDP_TUNNEL_TYPE;
+
+#define XDP_TUNNEL_VNI_MAX 0x00FFFFFF
+
+typedef struct _XDP_TUNNEL {
+    //
+    // The outer UDP destination port of the tunnel, in network order, for
+    // example 4789 for VXLAN and 6081 for GENEVE.
+    //
+    UINT16 UdpPort;
+    //
+    // The XDP_TUNNEL_TYPE of the tunnel.
+    //
+    UINT8 Type;
+    //
+    // The virtual network identifier, in host order, from 0 to
+    // XDP_TUNNEL_VNI_MAX.
+    //
+    UINT32 Vni;
+} XDP_TUNNEL;
+
+typedef struct _XDP_TUNNEL_TUPLE {
+    XDP_TUNNEL Tunnel;
+    //
+    // The addresses and ports of the inner packet, in network order.
+    //
+    XDP_TUPLE Tuple;
+    //
+    // The transport protocol of the inner packet, either IPPROTO_UDP or
+    // IPPROTO_TCP.
+    //
+    UINT8 Protocol;
+} XDP_TUNNEL_TUPLE;
+
+//
+// Also match the VLAN identifier of the inner tag of frames with two tags.
+//
+#define XDP_VLAN_MATCH_FLAG_INNER 0x00000001
+
+#define XDP_VLAN_ID_MAX 0x0FFF
+
+typedef struct _XDP_VLAN_MATCH {
+    //
+    // The VLAN identifier of the outermost tag, in host order, from 0 to
+    // XDP_VLAN_ID_MAX. Untagged frames do not match.
+    //
+    UINT16 VlanId;
+    //
+    // The VLAN identifier of the inner tag if XDP_VLAN_MATCH_FLAG_INNER is
+    // set, and zero otherwise.
+    //
+    UINT16 InnerVlanId;
+    //
+    // A bitwise OR of XDP_VLAN_MATCH_FLAG_* values.
+    //
+    UINT32 Flags;
+} XDP_VLAN_MATCH;
+
+typedef struct _XDP_MAC_ADDRESS {
+    UCHAR Address[6];
+} XDP_MAC_ADDRESS;
+
+//
+// Place a Bloom filter in front of the address set, so the lookup of most
+// addresses absent from the set reads a single cache line.
+//
+#define XDP_MAC_ADDRESS_SET_FLAG_BLOOM_FILTER 0x00000001
+
+#define XDP_MAC_ADDRESS_SET_MAX_ADDRESSES 0x00400000
+
+typedef struct _XDP_MAC_ADDRESS_SET {
+    //
+    // An array of Ethernet addresses. The array is captured when the rule is
+    // created and need not remain valid afterwards. Duplicate addresses are
+    // ignored.
+    //
+    CONST XDP_MAC_ADDRESS *Addresses;
+    //
+    // The number of addresses in the array, from 1 to
+    // XDP_MAC_ADDRESS_SET_MAX_ADDRESSES.
+    //
+    UINT32 AddressCount;
+    //
+    // A bitwise OR of XDP_MAC_ADDRESS_SET_FLAG_* values.
+    //
+    UINT32 Flags;
+    //
+    // Reserved for use by the XDP platform. Must be NULL.
+    //
+    VOID *Reserved;
+} XDP_MAC_ADDRESS_SET;
+
 //
 // Defines a pattern to match frames.
 //
@@ -145,13 +629,62 @@ typedef union _XDP_MATCH_PATTERN {
     //
     XDP_QUIC_FLOW QuicFlow;
     //
-    // Match on destination port.
+    // Match on UDP port and a table of QUIC connection IDs.
+    //
+    XDP_QUIC_CID_TABLE QuicCidTable;
+    //
+    // Match on destination or source port.
     //
     XDP_PORT_SET PortSet;
     //
     // Match on destination IP address and port.
     //
     XDP_IP_PORT_SET IpPortSet;
+    //
+    // Match on TCP control flags.
+    //
+    XDP_TCP_FLAGS TcpFlags;
+    //
+    // Match on a header field present in a map.
+    //
+    XDP_MAP_MATCH Map;
+    //
+    // Match on a source or destination IP address present in a set.
+    //
+    XDP_IP_ADDRESS_SET IpAddressSet;
+    //
+    // Match on masked bytes at an offset from a protocol layer.
+    //
+    XDP_PAYLOAD_MATCH Payload;
+    //
+    // Match on the result of a bytecode program.
+    //
+    XDP_BYTECODE Bytecode;
+    //
+    // Match on the VLAN identifiers of the frame.
+    //
+    XDP_VLAN_MATCH Vlan;
+    //
+    // Match on the virtual network identifier of a tunnel.
+    //
+    XDP_TUNNEL Tunnel;
+    //
+    // Match on the virtual network identifier of a tunnel and the 5-tuple of
+    // its inner packet.
+    //
+    XDP_TUNNEL_TUPLE TunnelTuple;
+    //
+    // Match on the Ethernet destination address.
+    //
+    XDP_MAC_ADDRESS MacAddress;
+    //
+    // Match on an Ethernet destination address present in a set.
+    //
+    XDP_MAC_ADDRESS_SET MacAddressSet;
+    //
+    // Match on the EtherType, in network order.
+    //
+    UINT16 EtherType;
 } XDP_MATCH_PATTERN;
 
 typedef enum _XDP_RULE_ACTION {
@@ -167,6 +700,22 @@ typedef enum _XDP_RULE_ACTION {
     // Frame must be redirected to the target specified in XDP_REDIRECT_PARAMS.
     //
     XDP_PROGRAM_ACTION_REDIRECT,
+    //
+    // Frame must be policed by the token buckets specified in
+    // XDP_RATE_LIMIT_PARAMS.
+    //
+    XDP_PROGRAM_ACTION_RATE_LIMIT,
+    //
+    // Frame must be allowed to continue. A copy of the frame is redirected to
+    // the target specified in XDP_SAMPLE_PARAMS at the sampling interval.
+    //
+    XDP_PROGRAM_ACTION_SAMPLE,
+    //
+    // Frame must be transmitted on the interface it was received on, as
+    // specified in XDP_L2FWD_PARAMS. Supported only on RX hooks of interfaces
+    // whose RX queues support the XDP_RX_ACTION_TX action.
+    //
+    XDP_PROGRAM_ACTION_L2FWD,
 } XDP_RULE_ACTION;
 
 //
@@ -177,13 +726,122 @@ typedef enum _XDP_REDIRECT_TARGET_TYPE {
     // Redirect frames to an XDP socket.
     //
     XDP_REDIRECT_TARGET_TYPE_XSK,
+    //
+    // Redirect frames to one of a group of XDP sockets, specified by
+    // XDP_XSK_GROUP. The socket is selected by hashing the frame's IP addresses
+    // and transport ports, so the frames of a flow are redirected to the same
+    // socket. Adding or removing a socket moves a minimal set of flows between
+    // sockets.
+    //
+    XDP_REDIRECT_TARGET_TYPE_XSK_GROUP,
+    //
+    // Redirect frames to the XDP socket of the connection ID table entry
+    // matched by an XDP_MATCH_QUIC_FLOW_DST_CID_TABLE rule. The target handle
+    // must be NULL.
+    //
+    XDP_REDIRECT_TARGET_TYPE_QUIC_CID_TABLE,
 } XDP_REDIRECT_TARGET_TYPE;
 
+#define XDP_XSK_GROUP_MAX_SOCKETS 64
+
+typedef struct _XDP_XSK_GROUP {
+    //
+    // An array of distinct XDP socket handles. The array is captured when the
+    // rule is created and need not remain valid afterwards.
+    //
+    CONST HANDLE *Sockets;
+    //
+    // The number of sockets in the array, from 1 to XDP_XSK_GROUP_MAX_SOCKETS.
+    //
+    UINT32 SocketCount;
+} XDP_XSK_GROUP;
+
 typedef struct _XDP_REDIRECT_PARAMS {
     XDP_REDIRECT_TARGET_TYPE TargetType;
-    HANDLE Target;
+    union {
+        HANDLE Target;
+        XDP_XSK_GROUP XskGroup;
+    };
 } XDP_REDIRECT_PARAMS;
 
+//
+// The maximum byte rate and byte burst size of a rate limit, in bytes. The
+// rate is about 4.4 terabits per second.
+//
+#define XDP_RATE_LIMIT_MAX_BYTES 0x0000008000000000ull
+
+//
+// Token buckets policing the frames matching a rule. A frame conforms if each
+// enabled bucket holds enough tokens for it: one token in the frame bucket,
+// and one token per frame byte in the byte bucket. Conforming frames consume
+// their tokens and take the conform action; other frames take the exceed
+// action. The buckets start full and refill at their rates up to their burst
+// sizes. Each program polices the frames of its own RX queue.
+//
+typedef struct _XDP_RATE_LIMIT_PARAMS {
+    //
+    // The refill rate and size of the frame bucket. A zero rate disables the
+    // bucket. A zero burst size allows one second at the rate.
+    //
+    UINT32 FramesPerSecond;
+    UINT32 FrameBurst;
+    //
+    // The refill rate and size of the byte bucket, each at most
+    // XDP_RATE_LIMIT_MAX_BYTES. A zero rate disables the bucket, but at least
+    // one bucket must be enabled. A zero burst size allows one second at the
+    // rate.
+    //
+    UINT64 BytesPerSecond;
+    UINT64 ByteBurst;
+    //
+    // The actions for conforming and excess frames. Each must be either
+    // XDP_PROGRAM_ACTION_DROP or XDP_PROGRAM_ACTION_PASS.
+    //
+    XDP_RULE_ACTION ConformAction;
+    XDP_RULE_ACTION ExceedAction;
+    //
+    // Reserved for use by the XDP platform. Must be NULL.
+    //
+    VOID *Reserved;
+} XDP_RATE_LIMIT_PARAMS;
+
+//
+// Samples the frames matching a rule. The first matching frame and every
+// Interval-th matching frame thereafter is copied to the redirect target; all
+// matching frames are allowed to continue. Each program samples the frames of
+// its own RX queue.
+//
+typedef struct _XDP_SAMPLE_PARAMS {
+    //
+    // The target receiving copies of the sampled frames.
+    //
+    XDP_REDIRECT_PARAMS Redirect;
+    //
+    // The sampling interval, in frames. Must be non-zero.
+    //
+    UINT32 Interval;
+    //
+    // Reserved for use by the XDP platform. Must be NULL.
+    //
+    VOID *Reserved;
+} XDP_SAMPLE_PARAMS;
+
+//
+// Swap the Ethernet source and destination addresses before transmitting the
+// frame. Frames too short to hold an Ethernet header are dropped.
+//
+#define XDP_L2FWD_FLAG_SWAP_MAC_ADDRESSES 0x00000001
+
+//
+// Transmits the frames matching a rule on the interface they were received on.
+//
+typedef struct _XDP_L2FWD_PARAMS {
+    //
+    // A bitmask of XDP_L2FWD_FLAG_* values.
+    //
+    UINT32 Flags;
+} XDP_L2FWD_PARAMS;
+
 //
 // XDP program rule.
 //
@@ -193,6 +851,9 @@ typedef struct _XDP_RULE {
     XDP_RULE_ACTION Action;
     union {
         XDP_REDIRECT_PARAMS Redirect;
+        XDP_RATE_LIMIT_PARAMS RateLimit;
+        XDP_SAMPLE_PARAMS Sample;
+        XDP_L2FWD_PARAMS L2Fwd;
     };
 } XDP_RULE;
 
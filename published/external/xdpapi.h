@@ -43,6 +43,29 @@ extern "C" {
 //
 #define XDP_CREATE_PROGRAM_FLAG_SHARE   0x4
 
+//
+// Maintain per-rule statistics, which can be queried using
+// XdpProgramGetStatistics.
+//
+#define XDP_CREATE_PROGRAM_FLAG_STATISTICS 0x8
+
+//
+// Periodically reorder rules that no frame can match together, so the rules
+// matching the most frames are evaluated first. Reordering never changes which
+// rule a frame matches. This flag cannot be combined with
+// XDP_CREATE_PROGRAM_FLAG_SHARE.
+//
+#define XDP_CREATE_PROGRAM_FLAG_ADAPTIVE_ORDER 0x10
+
+//
+// Apply the rule matched by the first fragment of an IP datagram to the later
+// fragments of the datagram, which carry no transport header. A bounded number
+// of recent datagrams is tracked, and fragments arriving ahead of the first
+// fragment or after it expires are inspected on their own. This flag cannot be
+// combined with XDP_CREATE_PROGRAM_FLAG_SHARE.
+//
+#define XDP_CREATE_PROGRAM_FLAG_TRACK_FRAGMENTS 0x20
+
 HRESULT
 XDPAPI
 XdpCreateProgram(
@@ -55,6 +78,226 @@ XdpCreateProgram(
     _Out_ HANDLE *Program
     );
 
+typedef struct _XDP_RULE_STATISTICS {
+    //
+    // Number of frames matching the rule.
+    //
+    UINT64 FramesMatched;
+
+    //
+    // Number of bytes of the frames matching the rule, including every buffer
+    // of fragmented frames.
+    //
+    UINT64 BytesMatched;
+} XDP_RULE_STATISTICS;
+
+//
+// Query the statistics of a program created with
+// XDP_CREATE_PROGRAM_FLAG_STATISTICS. One XDP_RULE_STATISTICS element is
+// returned for each rule, in rule order. If the input RuleStatisticsSize is too
+// small, HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER) will be returned. Call
+// with a NULL RuleStatistics to get the length.
+//
+HRESULT
+XDPAPI
+XdpProgramGetStatistics(
+    _In_ HANDLE Program,
+    _Out_opt_ XDP_RULE_STATISTICS *RuleStatistics,
+    _Inout_ UINT32 *RuleStatisticsSize
+    );
+
+typedef enum _XDP_PROGRAM_RULE_OPERATION {
+    //
+    // Insert a rule before the rule at the specified index. If the index equals
+    // the number of rules, the rule is appended.
+    //
+    XDP_PROGRAM_RULE_OPERATION_ADD,
+    //
+    // Remove the rule at the specified index.
+    //
+    XDP_PROGRAM_RULE_OPERATION_REMOVE,
+    //
+    // Replace the rule at the specified index.
+    //
+    XDP_PROGRAM_RULE_OPERATION_REPLACE,
+} XDP_PROGRAM_RULE_OPERATION;
+
+//
+// Update a single rule of an attached program. The data path observes either
+// the previous or the updated ruleset, never a partial update. The rule is
+// ignored for XDP_PROGRAM_RULE_OPERATION_REMOVE. If the program maintains
+// statistics, added and replacing rules start with zeroed statistics.
+//
+// N.B. Programs whose only rule redirects all frames to an XSK cannot be
+// updated.
+//
+HRESULT
+XDPAPI
+XdpProgramUpdateRule(
+    _In_ HANDLE Program,
+    _In_ XDP_PROGRAM_RULE_OPERATION Operation,
+    _In_ UINT32 RuleIndex,
+    _In_opt_ CONST XDP_RULE *Rule
+    );
+
+typedef struct _XDP_FLOW_CACHE_STATISTICS {
+    //
+    // Number of UDP and TCP frames whose matching rule was found in the cache.
+    //
+    UINT64 Hits;
+
+    //
+    // Number of UDP and TCP frames whose matching rule was not found in the
+    // cache and was cached after evaluating the rules.
+    //
+    UINT64 Misses;
+} XDP_FLOW_CACHE_STATISTICS;
+
+//
+// Query the flow cache counters of the RX queue the program is attached to.
+// The RX queue caches the rule matched by recent UDP and TCP flows while every
+// rule of the attached program matches on IP addresses and transport ports
+// only. The counters are shared by all programs attached to the RX queue.
+//
+HRESULT
+XDPAPI
+XdpProgramGetFlowCacheStatistics(
+    _In_ HANDLE Program,
+    _Out_ XDP_FLOW_CACHE_STATISTICS *Statistics
+    );
+
+typedef enum _XDP_QUIC_CID_OPERATION {
+    //
+    // Add an entry for the connection ID, or replace the target of the
+    // existing entry.
+    //
+    XDP_QUIC_CID_OPERATION_SET,
+    //
+    // Remove the entry for the connection ID. The target is ignored.
+    //
+    XDP_QUIC_CID_OPERATION_DELETE,
+} XDP_QUIC_CID_OPERATION;
+
+//
+// Update a single entry of the connection ID table of an
+// XDP_MATCH_QUIC_FLOW_DST_CID_TABLE rule of an attached program. The length of
+// the connection ID must equal the CidLength of the table, and the target must
+// be an XDP socket bound to the RX queue of the program. Entries are updated
+// without recompiling the program's rules.
+//
+HRESULT
+XDPAPI
+XdpProgramUpdateQuicCid(
+    _In_ HANDLE Program,
+    _In_ XDP_QUIC_CID_OPERATION Operation,
+    _In_ UINT32 RuleIndex,
+    _In_reads_bytes_(CidLength) CONST UCHAR *Cid,
+    _In_ UINT32 CidLength,
+    _In_opt_ HANDLE Target
+    );
+
+
+//
+// Map API.
+//
+// Maps are key/value stores shared by any number of XDP_MATCH_MAP rules, in any
+// number of programs. Elements are updated from user mode without recompiling
+// the rules; the data path reads maps without locks, and observes each
+// element update atomically.
+//
+
+typedef enum _XDP_MAP_TYPE {
+    //
+    // A hash table holding up to MaxEntries keys.
+    //
+    XDP_MAP_TYPE_HASH,
+    //
+    // An array of MaxEntries elements, indexed by a UINT32 key. An element is
+    // present from the time it is updated until it is deleted.
+    //
+    XDP_MAP_TYPE_ARRAY,
+    //
+    // A longest prefix match table holding up to MaxEntries prefixes. Keys are
+    // XDP_MAP_LPM_KEY structs, and the key size includes the PrefixLength
+    // field. Lookups return the element of the longest prefix matching the
+    // data of the key.
+    //
+    XDP_MAP_TYPE_LPM,
+    //
+    // A bitmap of MaxEntries bits, indexed by a UINT32 key. Bitmap maps have no
+    // values.
+    //
+    XDP_MAP_TYPE_BITMAP,
+} XDP_MAP_TYPE;
+
+typedef struct _XDP_MAP_LPM_KEY {
+    //
+    // The number of leading bits of Data forming the prefix.
+    //
+    UINT32 PrefixLength;
+    UCHAR Data[ANYSIZE_ARRAY];
+} XDP_MAP_LPM_KEY;
+
+#define XDP_MAP_MAX_KEY_SIZE 64
+#define XDP_MAP_MAX_VALUE_SIZE 64
+#define XDP_MAP_MAX_ENTRIES 0x00100000
+
+//
+// Create a map. The key size must be sizeof(UINT32) for array and bitmap maps,
+// and the value size must be zero for bitmap maps.
+//
+HRESULT
+XDPAPI
+XdpMapCreate(
+    _In_ XDP_MAP_TYPE Type,
+    _In_ UINT32 KeySize,
+    _In_ UINT32 ValueSize,
+    _In_ UINT32 MaxEntries,
+    _Out_ HANDLE *Map
+    );
+
+//
+// Add an element to the map, or replace the value of the existing element.
+// The key and value sizes must equal those of the map. Fails with
+// HRESULT_FROM_WIN32(ERROR_NOT_ENOUGH_QUOTA) if a hash or LPM map already holds
+// MaxEntries elements.
+//
+HRESULT
+XDPAPI
+XdpMapUpdateElement(
+    _In_ HANDLE Map,
+    _In_reads_bytes_(KeySize) CONST VOID *Key,
+    _In_ UINT32 KeySize,
+    _In_reads_bytes_opt_(ValueSize) CONST VOID *Value,
+    _In_ UINT32 ValueSize
+    );
+
+//
+// Remove an element from the map. Fails with HRESULT_FROM_WIN32(ERROR_NOT_FOUND)
+// if the element is not present.
+//
+HRESULT
+XDPAPI
+XdpMapDeleteElement(
+    _In_ HANDLE Map,
+    _In_reads_bytes_(KeySize) CONST VOID *Key,
+    _In_ UINT32 KeySize
+    );
+
+//
+// Query the value of an element of the map. Fails with
+// HRESULT_FROM_WIN32(ERROR_NOT_FOUND) if the element is not present.
+//
+HRESULT
+XDPAPI
+XdpMapLookupElement(
+    _In_ HANDLE Map,
+    _In_reads_bytes_(KeySize) CONST VOID *Key,
+    _In_ UINT32 KeySize,
+    _Out_writes_bytes_opt_(ValueSize) VOID *Value,
+    _In_ UINT32 ValueSize
+    );
+
 
 //
 // Interface API.
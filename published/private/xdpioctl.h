@@ -10,6 +10,7 @@
 //
 
 #include <afxdp.h>
+#include <xdpapi.h>
 #include <xdp/program.h>
 #include <xdpifmode.h>
 
@@ -24,6 +25,7 @@ typedef enum _XDP_OBJECT_TYPE {
     XDP_OBJECT_TYPE_PROGRAM,
     XDP_OBJECT_TYPE_XSK,
     XDP_OBJECT_TYPE_INTERFACE,
+    XDP_OBJECT_TYPE_MAP,
 } XDP_OBJECT_TYPE;
 
 //
@@ -55,6 +57,16 @@ typedef struct _XDP_INTERFACE_OPEN {
     UINT32 IfIndex;
 } XDP_INTERFACE_OPEN;
 
+//
+// Parameters for creating an XDP_OBJECT_TYPE_MAP.
+//
+typedef struct _XDP_MAP_OPEN {
+    XDP_MAP_TYPE Type;
+    UINT32 KeySize;
+    UINT32 ValueSize;
+    UINT32 MaxEntries;
+} XDP_MAP_OPEN;
+
 //
 // IOCTLs supported by an interface file handle.
 //
@@ -65,6 +77,60 @@ typedef struct _XDP_INTERFACE_OPEN {
 #define IOCTL_INTERFACE_OFFLOAD_RSS_GET_CAPABILITIES \
     CTL_CODE(FILE_DEVICE_NETWORK, 2, METHOD_BUFFERED, FILE_WRITE_ACCESS)
 
+//
+// IOCTLs supported by a program file handle.
+//
+#define IOCTL_PROGRAM_GET_STATISTICS \
+    CTL_CODE(FILE_DEVICE_NETWORK, 0, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+#define IOCTL_PROGRAM_UPDATE_RULE \
+    CTL_CODE(FILE_DEVICE_NETWORK, 1, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+#define IOCTL_PROGRAM_GET_FLOW_CACHE_STATISTICS \
+    CTL_CODE(FILE_DEVICE_NETWORK, 2, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+#define IOCTL_PROGRAM_UPDATE_QUIC_CID \
+    CTL_CODE(FILE_DEVICE_NETWORK, 3, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// Input struct for IOCTL_PROGRAM_UPDATE_RULE
+//
+typedef struct _XDP_PROGRAM_UPDATE_RULE_IN {
+    XDP_PROGRAM_RULE_OPERATION Operation;
+    UINT32 RuleIndex;
+    XDP_RULE Rule;
+} XDP_PROGRAM_UPDATE_RULE_IN;
+
+//
+// Input struct for IOCTL_PROGRAM_UPDATE_QUIC_CID
+//
+typedef struct _XDP_PROGRAM_UPDATE_QUIC_CID_IN {
+    XDP_QUIC_CID_OPERATION Operation;
+    UINT32 RuleIndex;
+    UINT32 CidLength;
+    UCHAR CidData[QUIC_MAX_CID_LENGTH];
+    HANDLE Target;
+} XDP_PROGRAM_UPDATE_QUIC_CID_IN;
+
+//
+// IOCTLs supported by a map file handle.
+//
+#define IOCTL_MAP_UPDATE_ELEMENT \
+    CTL_CODE(FILE_DEVICE_NETWORK, 0, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+#define IOCTL_MAP_DELETE_ELEMENT \
+    CTL_CODE(FILE_DEVICE_NETWORK, 1, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+#define IOCTL_MAP_LOOKUP_ELEMENT \
+    CTL_CODE(FILE_DEVICE_NETWORK, 2, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+//
+// Input struct for IOCTL_MAP_UPDATE_ELEMENT, IOCTL_MAP_DELETE_ELEMENT and
+// IOCTL_MAP_LOOKUP_ELEMENT. The value is used only by updates; lookups return
+// the value in the output buffer.
+//
+typedef struct _XDP_MAP_ELEMENT_IN {
+    UINT32 KeySize;
+    UINT32 ValueSize;
+    UCHAR Key[XDP_MAP_MAX_KEY_SIZE];
+    UCHAR Value[XDP_MAP_MAX_VALUE_SIZE];
+} XDP_MAP_ELEMENT_IN;
+
 //
 // Define IOCTLs supported by an XSK file handle.
 //
@@ -129,6 +129,10 @@ XdpIrpCreate(
         CreateRoutine = XdpIrpCreateInterface;
         break;
 
+    case XDP_OBJECT_TYPE_MAP:
+        CreateRoutine = XdpIrpCreateMap;
+        break;
+
     default:
         Status = STATUS_INVALID_PARAMETER;
         goto Exit;
@@ -386,6 +390,7 @@ XdpStop(
 
     XskStop();
     XdpIfStop();
+    XdpProgramStop();
     XdpTxStop();
     XdpRxStop();
     XdpPollStop();
@@ -457,6 +462,11 @@ XdpStart(
         goto Exit;
     }
 
+    Status = XdpProgramStart();
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
     Status = XdpIfStart();
     if (!NT_SUCCESS(Status)) {
         goto Exit;
@@ -0,0 +1,984 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+//
+// This module implements map file object routines. Maps are shared by the
+// rules of any number of programs and are read by the data path without
+// locks. Updates are serialized by a push lock and follow the read-copy-update
+// pattern: an updated element is replaced by a copy, and replaced or deleted
+// elements are freed once no data path can still reference them.
+//
+
+#include "precomp.h"
+#include "map.tmh"
+
+#define XDP_MAP_HASH_MIN_BUCKETS 16
+
+typedef struct _XDP_MAP_ENTRY {
+    struct _XDP_MAP_ENTRY *Next;
+    XDP_LIFETIME_ENTRY DeleteEntry;
+    UINT32 Hash;
+    //
+    // The key followed by the value. Array elements hold the value only.
+    //
+    UCHAR Data[0];
+} XDP_MAP_ENTRY;
+
+typedef struct _XDP_MAP {
+    XDP_FILE_OBJECT_HEADER Header;
+    XDP_REFERENCE_COUNT ReferenceCount;
+    XDP_MAP_TYPE Type;
+    UINT32 KeySize;
+    UINT32 ValueSize;
+    UINT32 MaxEntries;
+
+    //
+    // Serializes updates.
+    //
+    EX_PUSH_LOCK Lock;
+    UINT32 EntryCount;
+
+    union {
+        //
+        // Hash and LPM maps. LPM maps store each prefix as a key with the bits
+        // beyond the prefix cleared, and count the prefixes of each length.
+        //
+        struct {
+            XDP_MAP_ENTRY **Buckets;
+            UINT32 BucketMask;
+            UINT32 *PrefixCounts;
+        };
+        //
+        // Array maps.
+        //
+        XDP_MAP_ENTRY **Elements;
+        //
+        // Bitmap maps.
+        //
+        LONG *Bits;
+    };
+} XDP_MAP;
+
+static XDP_FILE_IRP_ROUTINE XdpIrpMapDeviceIoControl;
+static XDP_FILE_IRP_ROUTINE XdpIrpMapClose;
+static XDP_FILE_DISPATCH XdpMapFileDispatch = {
+    .IoControl  = XdpIrpMapDeviceIoControl,
+    .Close = XdpIrpMapClose,
+};
+
+static
+UINT32
+XdpMapHash(
+    _In_reads_bytes_(KeySize) CONST UCHAR *Key,
+    _In_ UINT32 KeySize
+    )
+{
+    //
+    // FNV-1a.
+    //
+    UINT32 Hash = 0x811c9dc5;
+
+    for (UINT32 Index = 0; Index < KeySize; Index++) {
+        Hash = (Hash ^ Key[Index]) * 0x01000193;
+    }
+
+    return Hash;
+}
+
+static
+XDP_MAP_ENTRY **
+XdpMapHashFindLink(
+    _In_ XDP_MAP *Map,
+    _In_reads_bytes_(Map->KeySize) CONST UCHAR *Key,
+    _In_ UINT32 Hash
+    )
+{
+    XDP_MAP_ENTRY **Link = &Map->Buckets[Hash & Map->BucketMask];
+    XDP_MAP_ENTRY *Entry;
+
+    //
+    // Returns the link to the entry with the key, or the link terminating the
+    // bucket if there is none.
+    //
+    while ((Entry = ReadPointerAcquire(Link)) != NULL) {
+        if (Entry->Hash == Hash && RtlEqualMemory(Entry->Data, Key, Map->KeySize)) {
+            break;
+        }
+
+        Link = &Entry->Next;
+    }
+
+    return Link;
+}
+
+static
+XDP_MAP_ENTRY *
+XdpMapHashFind(
+    _In_ XDP_MAP *Map,
+    _In_reads_bytes_(Map->KeySize) CONST UCHAR *Key
+    )
+{
+    return ReadPointerAcquire(XdpMapHashFindLink(Map, Key, XdpMapHash(Key, Map->KeySize)));
+}
+
+static
+VOID
+XdpMapMaskPrefix(
+    _Inout_updates_bytes_(DataSize) UCHAR *Data,
+    _In_ UINT32 DataSize,
+    _In_ UINT32 PrefixLength
+    )
+{
+    for (UINT32 Index = PrefixLength / 8; Index < DataSize; Index++) {
+        if (Index == PrefixLength / 8 && (PrefixLength % 8) != 0) {
+            Data[Index] &= (UCHAR)(0xff << (8 - (PrefixLength % 8)));
+        } else {
+            Data[Index] = 0;
+        }
+    }
+}
+
+static
+XDP_MAP_ENTRY *
+XdpMapLpmFind(
+    _In_ XDP_MAP *Map,
+    _In_reads_bytes_(Map->KeySize - sizeof(UINT32)) CONST UCHAR *Data,
+    _In_ UINT32 MaxPrefixLength
+    )
+{
+    UCHAR KeyBuffer[XDP_MAP_MAX_KEY_SIZE];
+    XDP_MAP_LPM_KEY *Key = (XDP_MAP_LPM_KEY *)KeyBuffer;
+    UINT32 DataSize = Map->KeySize - FIELD_OFFSET(XDP_MAP_LPM_KEY, Data);
+    UINT32 PrefixLength = MaxPrefixLength + 1;
+
+    ASSERT(MaxPrefixLength <= DataSize * 8);
+
+    RtlCopyMemory(Key->Data, Data, DataSize);
+
+    //
+    // Probe the prefix lengths present in the map, longest first. The data is
+    // masked progressively, since each probed prefix is shorter than the last.
+    //
+    while (PrefixLength-- > 0) {
+        XDP_MAP_ENTRY *Entry;
+
+        if (ReadULongNoFence((ULONG *)&Map->PrefixCounts[PrefixLength]) == 0) {
+            continue;
+        }
+
+        Key->PrefixLength = PrefixLength;
+        XdpMapMaskPrefix(Key->Data, DataSize, PrefixLength);
+
+        Entry = XdpMapHashFind(Map, KeyBuffer);
+        if (Entry != NULL) {
+            return Entry;
+        }
+    }
+
+    return NULL;
+}
+
+static
+BOOLEAN
+XdpMapTestBit(
+    _In_ XDP_MAP *Map,
+    _In_ UINT32 Index
+    )
+{
+    return (ReadNoFence(&Map->Bits[Index >> 5]) >> (Index & 0x1f)) & 0x1;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+XdpMapContainsField(
+    XDP_MAP *Map,
+    CONST UCHAR *Field,
+    UINT32 FieldSize
+    )
+{
+    UINT32 Index;
+
+    switch (Map->Type) {
+    case XDP_MAP_TYPE_HASH:
+        ASSERT(FieldSize == Map->KeySize);
+        return XdpMapHashFind(Map, Field) != NULL;
+
+    case XDP_MAP_TYPE_LPM:
+        return XdpMapLpmFind(Map, Field, FieldSize * 8) != NULL;
+
+    case XDP_MAP_TYPE_ARRAY:
+        ASSERT(FieldSize == sizeof(UINT16));
+        Index = *(UNALIGNED UINT16 *)Field;
+        return Index < Map->MaxEntries && ReadPointerAcquire(&Map->Elements[Index]) != NULL;
+
+    case XDP_MAP_TYPE_BITMAP:
+        ASSERT(FieldSize == sizeof(UINT16));
+        Index = *(UNALIGNED UINT16 *)Field;
+        return Index < Map->MaxEntries && XdpMapTestBit(Map, Index);
+
+    default:
+        ASSERT(FALSE);
+        return FALSE;
+    }
+}
+
+static
+VOID
+XdpMapFreeEntry(
+    _In_ XDP_LIFETIME_ENTRY *Entry
+    )
+{
+    XDP_MAP_ENTRY *MapEntry = CONTAINING_RECORD(Entry, XDP_MAP_ENTRY, DeleteEntry);
+
+    ExFreePoolWithTag(MapEntry, XDP_POOLTAG_MAP);
+}
+
+static
+VOID
+XdpMapDelete(
+    _In_ XDP_MAP *Map
+    )
+{
+    TraceInfo(TRACE_CORE, "Map=%p delete", Map);
+
+    switch (Map->Type) {
+    case XDP_MAP_TYPE_HASH:
+    case XDP_MAP_TYPE_LPM:
+        if (Map->Buckets != NULL) {
+            for (UINT32 Index = 0; Index <= Map->BucketMask; Index++) {
+                while (Map->Buckets[Index] != NULL) {
+                    XDP_MAP_ENTRY *Entry = Map->Buckets[Index];
+
+                    Map->Buckets[Index] = Entry->Next;
+                    ExFreePoolWithTag(Entry, XDP_POOLTAG_MAP);
+                }
+            }
+
+            ExFreePoolWithTag(Map->Buckets, XDP_POOLTAG_MAP);
+        }
+
+        if (Map->PrefixCounts != NULL) {
+            ExFreePoolWithTag(Map->PrefixCounts, XDP_POOLTAG_MAP);
+        }
+        break;
+
+    case XDP_MAP_TYPE_ARRAY:
+        if (Map->Elements != NULL) {
+            for (UINT32 Index = 0; Index < Map->MaxEntries; Index++) {
+                if (Map->Elements[Index] != NULL) {
+                    ExFreePoolWithTag(Map->Elements[Index], XDP_POOLTAG_MAP);
+                }
+            }
+
+            ExFreePoolWithTag(Map->Elements, XDP_POOLTAG_MAP);
+        }
+        break;
+
+    case XDP_MAP_TYPE_BITMAP:
+        if (Map->Bits != NULL) {
+            ExFreePoolWithTag(Map->Bits, XDP_POOLTAG_MAP);
+        }
+        break;
+
+    default:
+        ASSERT(FALSE);
+        break;
+    }
+
+    ExFreePoolWithTag(Map, XDP_POOLTAG_MAP);
+}
+
+static
+VOID
+XdpMapReference(
+    _In_ XDP_MAP *Map
+    )
+{
+    XdpIncrementReferenceCount(&Map->ReferenceCount);
+}
+
+_Use_decl_annotations_
+VOID
+XdpMapDereference(
+    XDP_MAP *Map
+    )
+{
+    if (XdpDecrementReferenceCount(&Map->ReferenceCount)) {
+        XdpMapDelete(Map);
+    }
+}
+
+_Use_decl_annotations_
+NTSTATUS
+XdpMapReferenceByHandle(
+    HANDLE Handle,
+    KPROCESSOR_MODE RequestorMode,
+    XDP_MAP **Map
+    )
+{
+    NTSTATUS Status;
+    FILE_OBJECT *FileObject = NULL;
+
+    *Map = NULL;
+
+    Status =
+        XdpReferenceObjectByHandle(
+            Handle, XDP_OBJECT_TYPE_MAP, RequestorMode, FILE_GENERIC_WRITE, &FileObject);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    *Map = FileObject->FsContext;
+    XdpMapReference(*Map);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceInfo(TRACE_CORE, "Map=%p Status=%!STATUS!", *Map, Status);
+
+    if (FileObject != NULL) {
+        ObDereferenceObject(FileObject);
+    }
+
+    return Status;
+}
+
+_Use_decl_annotations_
+BOOLEAN
+XdpMapIsFieldSizeValid(
+    XDP_MAP *Map,
+    UINT32 FieldSize
+    )
+{
+    switch (Map->Type) {
+    case XDP_MAP_TYPE_HASH:
+        return FieldSize == Map->KeySize;
+
+    case XDP_MAP_TYPE_LPM:
+        return FieldSize == Map->KeySize - FIELD_OFFSET(XDP_MAP_LPM_KEY, Data);
+
+    case XDP_MAP_TYPE_ARRAY:
+    case XDP_MAP_TYPE_BITMAP:
+        return FieldSize == sizeof(UINT16);
+
+    default:
+        ASSERT(FALSE);
+        return FALSE;
+    }
+}
+
+static
+NTSTATUS
+XdpMapValidateParams(
+    _In_ CONST XDP_MAP_OPEN *Params
+    )
+{
+    if (Params->MaxEntries == 0 || Params->MaxEntries > XDP_MAP_MAX_ENTRIES ||
+        Params->ValueSize > XDP_MAP_MAX_VALUE_SIZE) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    switch (Params->Type) {
+    case XDP_MAP_TYPE_HASH:
+        if (Params->KeySize == 0 || Params->KeySize > XDP_MAP_MAX_KEY_SIZE) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        break;
+
+    case XDP_MAP_TYPE_LPM:
+        if (Params->KeySize <= FIELD_OFFSET(XDP_MAP_LPM_KEY, Data) ||
+            Params->KeySize > XDP_MAP_MAX_KEY_SIZE) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        break;
+
+    case XDP_MAP_TYPE_ARRAY:
+        if (Params->KeySize != sizeof(UINT32)) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        break;
+
+    case XDP_MAP_TYPE_BITMAP:
+        if (Params->KeySize != sizeof(UINT32) || Params->ValueSize != 0) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        break;
+
+    default:
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XdpMapAllocateStorage(
+    _Inout_ XDP_MAP *Map
+    )
+{
+    NTSTATUS Status;
+    UINT32 BucketCount;
+
+    switch (Map->Type) {
+    case XDP_MAP_TYPE_HASH:
+    case XDP_MAP_TYPE_LPM:
+        //
+        // Size the buckets for a full map, so elements are never rehashed.
+        //
+        Status =
+            RtlUInt32RoundUpToPowerOfTwo(
+                max(Map->MaxEntries, XDP_MAP_HASH_MIN_BUCKETS), &BucketCount);
+        if (!NT_SUCCESS(Status)) {
+            return Status;
+        }
+
+        Map->Buckets =
+            ExAllocatePoolZero(
+                NonPagedPoolNx, sizeof(*Map->Buckets) * BucketCount, XDP_POOLTAG_MAP);
+        if (Map->Buckets == NULL) {
+            return STATUS_NO_MEMORY;
+        }
+
+        Map->BucketMask = BucketCount - 1;
+
+        if (Map->Type == XDP_MAP_TYPE_LPM) {
+            UINT32 MaxPrefixLength = (Map->KeySize - FIELD_OFFSET(XDP_MAP_LPM_KEY, Data)) * 8;
+
+            Map->PrefixCounts =
+                ExAllocatePoolZero(
+                    NonPagedPoolNx, sizeof(*Map->PrefixCounts) * (MaxPrefixLength + 1),
+                    XDP_POOLTAG_MAP);
+            if (Map->PrefixCounts == NULL) {
+                return STATUS_NO_MEMORY;
+            }
+        }
+        break;
+
+    case XDP_MAP_TYPE_ARRAY:
+        Map->Elements =
+            ExAllocatePoolZero(
+                NonPagedPoolNx, sizeof(*Map->Elements) * Map->MaxEntries, XDP_POOLTAG_MAP);
+        if (Map->Elements == NULL) {
+            return STATUS_NO_MEMORY;
+        }
+        break;
+
+    case XDP_MAP_TYPE_BITMAP:
+        Map->Bits =
+            ExAllocatePoolZero(
+                NonPagedPoolNx, sizeof(*Map->Bits) * ((Map->MaxEntries + 31) / 32),
+                XDP_POOLTAG_MAP);
+        if (Map->Bits == NULL) {
+            return STATUS_NO_MEMORY;
+        }
+        break;
+
+    default:
+        ASSERT(FALSE);
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+_Use_decl_annotations_
+NTSTATUS
+XdpIrpCreateMap(
+    IRP *Irp,
+    IO_STACK_LOCATION *IrpSp,
+    UCHAR Disposition,
+    VOID *InputBuffer,
+    SIZE_T InputBufferLength
+    )
+{
+    NTSTATUS Status;
+    CONST XDP_MAP_OPEN *Params = NULL;
+    XDP_MAP *Map = NULL;
+
+    UNREFERENCED_PARAMETER(Irp);
+
+    if (Disposition != FILE_CREATE || InputBufferLength < sizeof(*Params)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+    Params = InputBuffer;
+
+    TraceEnter(
+        TRACE_CORE, "Type=%u KeySize=%u ValueSize=%u MaxEntries=%u",
+        Params->Type, Params->KeySize, Params->ValueSize, Params->MaxEntries);
+
+    Status = XdpMapValidateParams(Params);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Map = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Map), XDP_POOLTAG_MAP);
+    if (Map == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    Map->Header.ObjectType = XDP_OBJECT_TYPE_MAP;
+    Map->Header.Dispatch = &XdpMapFileDispatch;
+    XdpInitializeReferenceCount(&Map->ReferenceCount);
+    Map->Type = Params->Type;
+    Map->KeySize = Params->KeySize;
+    Map->ValueSize = Params->ValueSize;
+    Map->MaxEntries = Params->MaxEntries;
+    ExInitializePushLock(&Map->Lock);
+
+    Status = XdpMapAllocateStorage(Map);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    IrpSp->FileObject->FsContext = Map;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (!NT_SUCCESS(Status) && Map != NULL) {
+        XdpMapDereference(Map);
+        Map = NULL;
+    }
+
+    TraceInfo(TRACE_CORE, "Map=%p create Status=%!STATUS!", Map, Status);
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+static
+_Requires_exclusive_lock_held_(&Map->Lock)
+NTSTATUS
+XdpMapUpdateHashElement(
+    _In_ XDP_MAP *Map,
+    _In_reads_bytes_(Map->KeySize) CONST UCHAR *Key,
+    _In_reads_bytes_(Map->ValueSize) CONST UCHAR *Value
+    )
+{
+    UINT32 Hash = XdpMapHash(Key, Map->KeySize);
+    XDP_MAP_ENTRY **Link = XdpMapHashFindLink(Map, Key, Hash);
+    XDP_MAP_ENTRY *OldEntry = *Link;
+    XDP_MAP_ENTRY *NewEntry;
+
+    if (OldEntry == NULL && Map->EntryCount >= Map->MaxEntries) {
+        return STATUS_QUOTA_EXCEEDED;
+    }
+
+    NewEntry =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, sizeof(*NewEntry) + Map->KeySize + Map->ValueSize,
+            XDP_POOLTAG_MAP);
+    if (NewEntry == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    NewEntry->Hash = Hash;
+    RtlCopyMemory(NewEntry->Data, Key, Map->KeySize);
+    RtlCopyMemory(NewEntry->Data + Map->KeySize, Value, Map->ValueSize);
+
+    //
+    // Publish the initialized entry in place of the old entry, or at the end
+    // of the bucket.
+    //
+    if (OldEntry != NULL) {
+        NewEntry->Next = OldEntry->Next;
+        WritePointerRelease(Link, NewEntry);
+        XdpLifetimeDelete(XdpMapFreeEntry, &OldEntry->DeleteEntry);
+    } else {
+        WritePointerRelease(Link, NewEntry);
+        Map->EntryCount++;
+
+        if (Map->Type == XDP_MAP_TYPE_LPM) {
+            CONST XDP_MAP_LPM_KEY *LpmKey = (CONST XDP_MAP_LPM_KEY *)Key;
+            WriteULongNoFence(
+                (ULONG *)&Map->PrefixCounts[LpmKey->PrefixLength],
+                Map->PrefixCounts[LpmKey->PrefixLength] + 1);
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+_Requires_exclusive_lock_held_(&Map->Lock)
+NTSTATUS
+XdpMapDeleteHashElement(
+    _In_ XDP_MAP *Map,
+    _In_reads_bytes_(Map->KeySize) CONST UCHAR *Key
+    )
+{
+    XDP_MAP_ENTRY **Link = XdpMapHashFindLink(Map, Key, XdpMapHash(Key, Map->KeySize));
+    XDP_MAP_ENTRY *OldEntry = *Link;
+
+    if (OldEntry == NULL) {
+        return STATUS_NOT_FOUND;
+    }
+
+    //
+    // Unlink the entry. Concurrent readers may still be traversing the entry,
+    // whose link remains valid until the entry is freed.
+    //
+    WritePointerRelease(Link, OldEntry->Next);
+    Map->EntryCount--;
+
+    if (Map->Type == XDP_MAP_TYPE_LPM) {
+        CONST XDP_MAP_LPM_KEY *LpmKey = (CONST XDP_MAP_LPM_KEY *)Key;
+        WriteULongNoFence(
+            (ULONG *)&Map->PrefixCounts[LpmKey->PrefixLength],
+            Map->PrefixCounts[LpmKey->PrefixLength] - 1);
+    }
+
+    XdpLifetimeDelete(XdpMapFreeEntry, &OldEntry->DeleteEntry);
+
+    return STATUS_SUCCESS;
+}
+
+static
+_Requires_exclusive_lock_held_(&Map->Lock)
+NTSTATUS
+XdpMapUpdateArrayElement(
+    _In_ XDP_MAP *Map,
+    _In_ UINT32 Index,
+    _In_reads_bytes_(Map->ValueSize) CONST UCHAR *Value
+    )
+{
+    XDP_MAP_ENTRY *OldEntry = Map->Elements[Index];
+    XDP_MAP_ENTRY *NewEntry;
+
+    NewEntry =
+        ExAllocatePoolZero(NonPagedPoolNx, sizeof(*NewEntry) + Map->ValueSize, XDP_POOLTAG_MAP);
+    if (NewEntry == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    RtlCopyMemory(NewEntry->Data, Value, Map->ValueSize);
+    WritePointerRelease(&Map->Elements[Index], NewEntry);
+
+    if (OldEntry != NULL) {
+        XdpLifetimeDelete(XdpMapFreeEntry, &OldEntry->DeleteEntry);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+_Requires_exclusive_lock_held_(&Map->Lock)
+NTSTATUS
+XdpMapDeleteArrayElement(
+    _In_ XDP_MAP *Map,
+    _In_ UINT32 Index
+    )
+{
+    XDP_MAP_ENTRY *OldEntry = Map->Elements[Index];
+
+    if (OldEntry == NULL) {
+        return STATUS_NOT_FOUND;
+    }
+
+    WritePointerRelease(&Map->Elements[Index], NULL);
+    XdpLifetimeDelete(XdpMapFreeEntry, &OldEntry->DeleteEntry);
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XdpMapNormalizeKey(
+    _In_ XDP_MAP *Map,
+    _Inout_updates_bytes_(Map->KeySize) UCHAR *Key,
+    _Out_ UINT32 *Index
+    )
+{
+    XDP_MAP_LPM_KEY *LpmKey;
+    UINT32 DataSize;
+
+    *Index = 0;
+
+    switch (Map->Type) {
+    case XDP_MAP_TYPE_LPM:
+        //
+        // Clear the bits beyond the prefix, so each prefix has a single key.
+        //
+        LpmKey = (XDP_MAP_LPM_KEY *)Key;
+        DataSize = Map->KeySize - FIELD_OFFSET(XDP_MAP_LPM_KEY, Data);
+        if (LpmKey->PrefixLength > DataSize * 8) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        XdpMapMaskPrefix(LpmKey->Data, DataSize, LpmKey->PrefixLength);
+        break;
+
+    case XDP_MAP_TYPE_ARRAY:
+    case XDP_MAP_TYPE_BITMAP:
+        *Index = *(UNALIGNED UINT32 *)Key;
+        if (*Index >= Map->MaxEntries) {
+            return STATUS_INVALID_PARAMETER;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XdpIrpMapUpdateElement(
+    _In_ XDP_MAP *Map,
+    _Inout_ XDP_MAP_ELEMENT_IN *ElementIn
+    )
+{
+    NTSTATUS Status;
+    UINT32 Index;
+
+    if (ElementIn->KeySize != Map->KeySize || ElementIn->ValueSize != Map->ValueSize) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    Status = XdpMapNormalizeKey(Map, ElementIn->Key, &Index);
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    RtlAcquirePushLockExclusive(&Map->Lock);
+
+    switch (Map->Type) {
+    case XDP_MAP_TYPE_HASH:
+    case XDP_MAP_TYPE_LPM:
+        Status = XdpMapUpdateHashElement(Map, ElementIn->Key, ElementIn->Value);
+        break;
+
+    case XDP_MAP_TYPE_ARRAY:
+        Status = XdpMapUpdateArrayElement(Map, Index, ElementIn->Value);
+        break;
+
+    case XDP_MAP_TYPE_BITMAP:
+        InterlockedOr(&Map->Bits[Index >> 5], 1ul << (Index & 0x1f));
+        Status = STATUS_SUCCESS;
+        break;
+
+    default:
+        ASSERT(FALSE);
+        Status = STATUS_INVALID_PARAMETER;
+        break;
+    }
+
+    RtlReleasePushLockExclusive(&Map->Lock);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XdpIrpMapDeleteElement(
+    _In_ XDP_MAP *Map,
+    _Inout_ XDP_MAP_ELEMENT_IN *ElementIn
+    )
+{
+    NTSTATUS Status;
+    UINT32 Index;
+
+    if (ElementIn->KeySize != Map->KeySize) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    Status = XdpMapNormalizeKey(Map, ElementIn->Key, &Index);
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    RtlAcquirePushLockExclusive(&Map->Lock);
+
+    switch (Map->Type) {
+    case XDP_MAP_TYPE_HASH:
+    case XDP_MAP_TYPE_LPM:
+        Status = XdpMapDeleteHashElement(Map, ElementIn->Key);
+        break;
+
+    case XDP_MAP_TYPE_ARRAY:
+        Status = XdpMapDeleteArrayElement(Map, Index);
+        break;
+
+    case XDP_MAP_TYPE_BITMAP:
+        if (XdpMapTestBit(Map, Index)) {
+            InterlockedAnd(&Map->Bits[Index >> 5], ~(1ul << (Index & 0x1f)));
+            Status = STATUS_SUCCESS;
+        } else {
+            Status = STATUS_NOT_FOUND;
+        }
+        break;
+
+    default:
+        ASSERT(FALSE);
+        Status = STATUS_INVALID_PARAMETER;
+        break;
+    }
+
+    RtlReleasePushLockExclusive(&Map->Lock);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XdpIrpMapLookupElement(
+    _In_ XDP_MAP *Map,
+    _Inout_ XDP_MAP_ELEMENT_IN *ElementIn,
+    _Out_writes_bytes_(OutputBufferLength) VOID *OutputBuffer,
+    _In_ SIZE_T OutputBufferLength,
+    _Out_ SIZE_T *BytesReturned
+    )
+{
+    NTSTATUS Status;
+    XDP_MAP_ENTRY *Entry = NULL;
+    CONST UCHAR *Value = NULL;
+    UINT32 Index;
+
+    *BytesReturned = 0;
+
+    if (ElementIn->KeySize != Map->KeySize || OutputBufferLength != Map->ValueSize) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    Status = XdpMapNormalizeKey(Map, ElementIn->Key, &Index);
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    RtlAcquirePushLockShared(&Map->Lock);
+
+    switch (Map->Type) {
+    case XDP_MAP_TYPE_HASH:
+        Entry = XdpMapHashFind(Map, ElementIn->Key);
+        if (Entry != NULL) {
+            Value = Entry->Data + Map->KeySize;
+        }
+        break;
+
+    case XDP_MAP_TYPE_LPM:
+        Entry =
+            XdpMapLpmFind(
+                Map, ((XDP_MAP_LPM_KEY *)ElementIn->Key)->Data,
+                ((XDP_MAP_LPM_KEY *)ElementIn->Key)->PrefixLength);
+        if (Entry != NULL) {
+            Value = Entry->Data + Map->KeySize;
+        }
+        break;
+
+    case XDP_MAP_TYPE_ARRAY:
+        Entry = Map->Elements[Index];
+        if (Entry != NULL) {
+            Value = Entry->Data;
+        }
+        break;
+
+    case XDP_MAP_TYPE_BITMAP:
+        if (XdpMapTestBit(Map, Index)) {
+            Value = ElementIn->Value;
+        }
+        break;
+
+    default:
+        ASSERT(FALSE);
+        break;
+    }
+
+    if (Value != NULL) {
+        RtlCopyMemory(OutputBuffer, Value, Map->ValueSize);
+        *BytesReturned = Map->ValueSize;
+        Status = STATUS_SUCCESS;
+    } else {
+        Status = STATUS_NOT_FOUND;
+    }
+
+    RtlReleasePushLockShared(&Map->Lock);
+
+    return Status;
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+_IRQL_requires_same_
+NTSTATUS
+XdpIrpMapClose(
+    _Inout_ IRP *Irp,
+    _Inout_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    XDP_MAP *Map = IrpSp->FileObject->FsContext;
+
+    UNREFERENCED_PARAMETER(Irp);
+
+    TraceEnter(TRACE_CORE, "Map=%p", Map);
+
+    //
+    // Rules referencing the map keep it alive after its handle is closed.
+    //
+    XdpMapDereference(Map);
+
+    TraceExitSuccess(TRACE_CORE);
+
+    return STATUS_SUCCESS;
+}
+
+_Use_decl_annotations_
+NTSTATUS
+XdpIrpMapDeviceIoControl(
+    IRP *Irp,
+    IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    ULONG IoControlCode = IrpSp->Parameters.DeviceIoControl.IoControlCode;
+    XDP_MAP *Map = IrpSp->FileObject->FsContext;
+    XDP_MAP_ELEMENT_IN ElementIn;
+
+    TraceEnter(TRACE_CORE, "Map=%p", Map);
+
+    Irp->IoStatus.Information = 0;
+
+    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(ElementIn)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    //
+    // Capture the input, since lookups return the value in the same system
+    // buffer.
+    //
+    RtlCopyMemory(&ElementIn, Irp->AssociatedIrp.SystemBuffer, sizeof(ElementIn));
+
+    switch (IoControlCode) {
+    case IOCTL_MAP_UPDATE_ELEMENT:
+        Status = XdpIrpMapUpdateElement(Map, &ElementIn);
+        break;
+    case IOCTL_MAP_DELETE_ELEMENT:
+        Status = XdpIrpMapDeleteElement(Map, &ElementIn);
+        break;
+    case IOCTL_MAP_LOOKUP_ELEMENT:
+        Status =
+            XdpIrpMapLookupElement(
+                Map, &ElementIn, Irp->AssociatedIrp.SystemBuffer,
+                IrpSp->Parameters.DeviceIoControl.OutputBufferLength,
+                &Irp->IoStatus.Information);
+        break;
+    default:
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+Exit:
+
+    TraceInfo(TRACE_CORE, "Map=%p Ioctl=%u Status=%!STATUS!", Map, IoControlCode, Status);
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
@@ -0,0 +1,56 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+#pragma once
+
+typedef struct _XDP_MAP XDP_MAP;
+
+//
+// Data path routines.
+//
+
+//
+// Returns whether the frame header field is present in the map. Deleted map
+// elements are freed only after a DPC has run on every processor, so the data
+// path reads them at DISPATCH_LEVEL without locks.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+XdpMapContainsField(
+    _In_ XDP_MAP *Map,
+    _In_reads_bytes_(FieldSize) CONST UCHAR *Field,
+    _In_ UINT32 FieldSize
+    );
+
+//
+// Control path routines.
+//
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+XdpMapReferenceByHandle(
+    _In_ HANDLE Handle,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Out_ XDP_MAP **Map
+    );
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+XdpMapDereference(
+    _In_ XDP_MAP *Map
+    );
+
+//
+// Returns whether frame header fields of the given size can be looked up in
+// the map.
+//
+_IRQL_requires_max_(PASSIVE_LEVEL)
+BOOLEAN
+XdpMapIsFieldSizeValid(
+    _In_ XDP_MAP *Map,
+    _In_ UINT32 FieldSize
+    );
+
+XDP_FILE_CREATE_ROUTINE XdpIrpCreateMap;
@@ -33,6 +33,7 @@
 #include <xdpetw.h>
 #include <xdpif.h>
 #include <xdpioctl.h>
+#include <xdplifetime.h>
 #include <xdplwf.h>
 #include <xdpnmrprovider.h>
 #include <xdppollshim.h>
@@ -40,6 +41,7 @@
 #include <xdpregistry.h>
 #include <xdprtl.h>
 #include <xdprxqueue_internal.h>
+#include <xdptimer.h>
 #include <xdptrace.h>
 #include <xdptxqueue_internal.h>
 #include <xdpversion.h>
@@ -51,6 +53,7 @@
 #include "bind.h"
 #include "dispatch.h"
 #include "extensionset.h"
+#include "map.h"
 #include "offload.h"
 #include "program.h"
 #include "queue.h"
@@ -36,15 +36,69 @@ typedef struct QUIC_HEADER_INVARIANT {
         } SHORT_HDR;
     };
 } QUIC_HEADER_INVARIANT;
+
+//
+// The VXLAN (RFC 7348) and GENEVE (RFC 8926) headers have the same size and
+// carry the 24-bit virtual network identifier at the same offset. The first
+// byte holds the VXLAN flags or the GENEVE version and option length, and the
+// protocol type is defined only for GENEVE.
+//
+typedef struct _XDP_PROGRAM_TUNNEL_HEADER {
+    UINT8 FlagsOrOptionLength;
+    UINT8 Reserved0;
+    UINT16 ProtocolType;
+    UINT8 Vni[3];
+    UINT8 Reserved1;
+} XDP_PROGRAM_TUNNEL_HEADER;
 #pragma pack(pop)
 
+#define XDP_PROGRAM_VXLAN_FLAG_VNI 0x08
+#define XDP_PROGRAM_GENEVE_VERSION_MASK 0xC0
+#define XDP_PROGRAM_GENEVE_OPTION_LENGTH_MASK 0x3F
+#define XDP_PROGRAM_ETHERNET_TYPE_TEB 0x6558
+
+//
+// The parser skips up to this many 802.1Q or 802.1ad tags following the
+// Ethernet header, which covers single-tagged and QinQ frames.
+//
+#define XDP_PROGRAM_MAX_VLAN_TAGS 2
+
+//
+// The parser skips up to this many IPv6 extension headers to find the upper
+// layer protocol; frames with longer chains match no transport rules. The
+// limit is configured by the XdpIpv6ExtensionHeaderLimit registry value, and
+// zero disables extension header traversal.
+//
+#define XDP_PROGRAM_DEFAULT_IPV6_EXTENSION_HEADER_LIMIT 8
+#define XDP_PROGRAM_MAX_IPV6_EXTENSION_HEADER_LIMIT 32
+
+static XDP_REG_WATCHER_CLIENT_ENTRY XdpProgramRegWatcherEntry;
+static UINT32 XdpProgramIpv6ExtensionHeaderLimit =
+    XDP_PROGRAM_DEFAULT_IPV6_EXTENSION_HEADER_LIMIT;
+
+//
+// Every IPv6 extension header spans at least 8 bytes, which include its length.
+//
+#define XDP_PROGRAM_IPV6_EXTENSION_HEADER_MIN_LENGTH 8
+
 typedef struct _XDP_PROGRAM_FRAME_STORAGE {
     ETHERNET_HEADER EthHdr;
+    VLAN_TAG VlanTags[XDP_PROGRAM_MAX_VLAN_TAGS];
     union {
         IPV4_HEADER Ip4Hdr;
         IPV6_HEADER Ip6Hdr;
     };
-    UDP_HDR UdpHdr;
+    union {
+        UDP_HDR UdpHdr;
+        TCP_HDR TcpHdr;
+    };
+    //
+    // The inner IP header of a tunnel is always copied here.
+    //
+    union {
+        IPV4_HEADER TunnelInnerIp4Hdr;
+        IPV6_HEADER TunnelInnerIp6Hdr;
+    };
     // Invariant header + 1 for SourceCidLength + 2x CIDS
     UINT8 QuicStorage[
         sizeof(QUIC_HEADER_INVARIANT) +
@@ -65,32 +119,450 @@ typedef struct _XDP_PROGRAM_FRAME_CACHE {
         struct {
             UINT32 EthCached : 1;
             UINT32 EthValid : 1;
+            UINT32 VlanCached : 1;
+            UINT32 VlanValid : 1;
             UINT32 Ip4Cached : 1;
             UINT32 Ip4Valid : 1;
             UINT32 Ip6Cached : 1;
             UINT32 Ip6Valid : 1;
+            UINT32 Ip6ExtValid : 1;
             UINT32 UdpCached : 1;
             UINT32 UdpValid : 1;
+            UINT32 TcpCached : 1;
+            UINT32 TcpValid : 1;
             UINT32 TransportPayloadCached : 1;
             UINT32 TransportPayloadValid : 1;
             UINT32 QuicCached : 1;
             UINT32 QuicValid : 1;
             UINT32 QuicIsLongHeader : 1;
+            UINT32 TunnelCached : 1;
+            UINT32 TunnelValid : 1;
+            UINT32 TunnelInnerIp4Valid : 1;
+            UINT32 TunnelInnerIp6Valid : 1;
+            UINT32 TunnelInnerPortsValid : 1;
+            UINT32 IpFragment : 1;
+            UINT32 IpLaterFragment : 1;
+            UINT32 FragmentFlowHashValid : 1;
         };
         UINT32 Flags;
     };
 
     ETHERNET_HEADER *EthHdr;
+
+    //
+    // The VLAN tags following the Ethernet header, if any, and the EtherType of
+    // the payload following them. Valid if VlanValid is set.
+    //
+    VLAN_TAG *VlanTags;
+    UINT8 VlanTagCount;
+    UINT16 EthType;
+
     union {
         IPV4_HEADER *Ip4Hdr;
         IPV6_HEADER *Ip6Hdr;
     };
-    UDP_HDR *UdpHdr;
+
+    //
+    // The total length of the extension headers following the IPv6 header and
+    // the upper layer protocol following them. Valid if Ip6ExtValid is set.
+    //
+    UINT32 Ip6ExtLength;
+    UINT8 Ip6ExtNextHeader;
+
+    //
+    // The identity of the datagram the frame is a fragment of, if IpFragment
+    // is set. Only the first fragment carries the transport header.
+    //
+    UINT32 IpFragmentId;
+    UINT8 IpFragmentProtocol;
+
+    //
+    // The flow hash of the first fragment of the datagram, which steers later
+    // fragments. Valid if FragmentFlowHashValid is set.
+    //
+    UINT32 FragmentFlowHash;
+
+    union {
+        UDP_HDR *UdpHdr;
+        TCP_HDR *TcpHdr;
+    };
     UINT8 QuicCidLength;
     CONST UINT8* QuicCid; // Src CID for long header, Dest CID for short header
     XDP_PROGRAM_PAYLOAD_CACHE TransportPayload;
+
+    //
+    // The tunnel encapsulated in the UDP payload, parsed as TunnelType on
+    // demand. The inner ports are valid for both UDP and TCP.
+    //
+    UINT8 TunnelType;
+    UINT8 TunnelInnerProtocol;
+    UINT16 TunnelInnerSourcePort;
+    UINT16 TunnelInnerDestinationPort;
+    UINT32 TunnelVni;
+    union {
+        IPV4_HEADER *TunnelInnerIp4Hdr;
+        IPV6_HEADER *TunnelInnerIp6Hdr;
+    };
+
+    //
+    // The target of the connection ID table entry matched by the frame. Valid
+    // only while the action of the matching rule is applied.
+    //
+    HANDLE QuicCidTarget;
 } XDP_PROGRAM_FRAME_CACHE;
 
+//
+// Parsed headers and storage for discontiguous headers of each frame in an
+// inspection batch. The RX queue data path is serialized, so each RX queue
+// owns one.
+//
+typedef struct _XDP_INSPECT_BATCH {
+    XDP_PROGRAM_FRAME_CACHE FrameCache[XDP_INSPECT_BATCH_SIZE];
+    XDP_PROGRAM_FRAME_STORAGE FrameStorage[XDP_INSPECT_BATCH_SIZE];
+} XDP_INSPECT_BATCH;
+
+#define XDP_PROGRAM_RULE_INDEX_NONE MAXUINT32
+
+#define XDP_PROGRAM_MATCH_TYPE_COUNT (XDP_MATCH_ETHERTYPE + 1)
+
+typedef struct _XDP_PROGRAM_HASH_ENTRY {
+    UINT32 Hash;
+    UINT32 RuleIndex;
+} XDP_PROGRAM_HASH_ENTRY;
+
+//
+// An open-addressed (linear probing) table of exact-match rules. Each distinct
+// key maps to the lowest index of the rules with that key; the key itself is
+// not stored and is compared against the rule pattern instead.
+//
+typedef struct _XDP_PROGRAM_HASH_TABLE {
+    XDP_PROGRAM_HASH_ENTRY *Buckets;
+    UINT32 BucketMask;
+    UINT32 EntryCount;
+} XDP_PROGRAM_HASH_TABLE;
+
+#define XDP_PROGRAM_LPM_ROOT_STRIDE 16
+#define XDP_PROGRAM_LPM_NODE_STRIDE 4
+#define XDP_PROGRAM_LPM_NODE_SIZE (1 << XDP_PROGRAM_LPM_NODE_STRIDE)
+
+//
+// Prefix rules are compiled into a trie only if there are enough of them to
+// amortize the root table; fewer rules are cheaper to evaluate linearly.
+//
+#define XDP_PROGRAM_LPM_MIN_RULES 16
+
+typedef struct _XDP_PROGRAM_LPM_ENTRY {
+    UINT32 RuleIndex;
+    UINT32 Child;
+} XDP_PROGRAM_LPM_ENTRY;
+
+//
+// A multibit trie of address prefixes, consisting of a root table
+// indexed by the leading 16 address bits and nodes indexed by each successive
+// 4 bits. Each entry stores the lowest index of the rules whose prefixes end
+// within the entry's stride and cover the entry, so the lowest-indexed matching
+// rule is the minimum along a single path, taking at most one memory access per
+// level. Nodes are stored in a single array and referenced by index; node 0 is
+// unused and denotes the absence of a child.
+//
+typedef struct _XDP_PROGRAM_LPM {
+    XDP_PROGRAM_LPM_ENTRY *Root;
+    XDP_PROGRAM_LPM_ENTRY *Nodes;
+    UINT32 NodeCount;
+    UINT32 NodeCapacity;
+    UINT32 RuleCount;
+    UINT32 MaxDepth;
+} XDP_PROGRAM_LPM;
+
+//
+// Frames are classified by their valid protocol headers once parsed; each
+// class has its own sequence of the rules that can possibly match it.
+//
+typedef enum _XDP_PROGRAM_FRAME_CLASS {
+    XDP_PROGRAM_FRAME_CLASS_OTHER,
+    XDP_PROGRAM_FRAME_CLASS_IPV4,
+    XDP_PROGRAM_FRAME_CLASS_IPV4_UDP,
+    XDP_PROGRAM_FRAME_CLASS_IPV4_TCP,
+    XDP_PROGRAM_FRAME_CLASS_IPV6,
+    XDP_PROGRAM_FRAME_CLASS_IPV6_UDP,
+    XDP_PROGRAM_FRAME_CLASS_IPV6_TCP,
+    XDP_PROGRAM_FRAME_CLASS_COUNT
+} XDP_PROGRAM_FRAME_CLASS;
+
+#define XDP_PROGRAM_FRAME_CLASS_BIT(Class) (1ui32 << (Class))
+#define XDP_PROGRAM_FRAME_CLASS_ALL ((1ui32 << XDP_PROGRAM_FRAME_CLASS_COUNT) - 1)
+#define XDP_PROGRAM_FRAME_CLASS_IPV4_ALL \
+    (XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_IPV4) | \
+     XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_IPV4_UDP) | \
+     XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_IPV4_TCP))
+#define XDP_PROGRAM_FRAME_CLASS_IPV6_ALL \
+    (XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_IPV6) | \
+     XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_IPV6_UDP) | \
+     XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_IPV6_TCP))
+#define XDP_PROGRAM_FRAME_CLASS_UDP_ALL \
+    (XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_IPV4_UDP) | \
+     XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_IPV6_UDP))
+#define XDP_PROGRAM_FRAME_CLASS_TCP_ALL \
+    (XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_IPV4_TCP) | \
+     XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_IPV6_TCP))
+
+typedef struct _XDP_PROGRAM_RULE_SEQUENCE {
+    UINT32 RuleCount;
+    UINT32 *RuleIndexes;
+
+    //
+    // If the sequence has been reordered by hit rate, the lowest rule index at
+    // or after each position of the sequence; NULL if the sequence is in
+    // ascending rule index order.
+    //
+    UINT32 *MinRuleIndexes;
+} XDP_PROGRAM_RULE_SEQUENCE;
+
+//
+// Lookup structures built from the program ruleset on the control path. The
+// data path uses them to find the lowest-indexed matching rule without
+// evaluating every rule; if a program has no compiled state, the data path
+// evaluates the rules linearly.
+//
+typedef struct _XDP_PROGRAM_COMPILED {
+    XDP_PROGRAM_HASH_TABLE UdpDst;
+    XDP_PROGRAM_HASH_TABLE Ipv4UdpTuple;
+    XDP_PROGRAM_HASH_TABLE Ipv6UdpTuple;
+    XDP_PROGRAM_HASH_TABLE TcpDst;
+    XDP_PROGRAM_HASH_TABLE Ipv4TcpTuple;
+    XDP_PROGRAM_HASH_TABLE Ipv6TcpTuple;
+    XDP_PROGRAM_HASH_TABLE UdpSrc;
+    XDP_PROGRAM_HASH_TABLE TcpSrc;
+    XDP_PROGRAM_LPM Ipv4DstLpm;
+    XDP_PROGRAM_LPM Ipv6DstLpm;
+    XDP_PROGRAM_LPM Ipv4SrcLpm;
+    XDP_PROGRAM_LPM Ipv6SrcLpm;
+    UINT32 IndexedRuleCount;
+
+    //
+    // Whether any rule inspects frame headers; if not, frames are not parsed
+    // and are evaluated as XDP_PROGRAM_FRAME_CLASS_OTHER.
+    //
+    BOOLEAN ParseRequired;
+
+    //
+    // Whether every rule is matched by the frame class, IP addresses and
+    // transport ports alone, so the rule matched by a UDP or TCP frame can be
+    // cached per flow.
+    //
+    BOOLEAN FlowCacheEnabled;
+
+    //
+    // For each frame class, the rules not covered by any index that can match
+    // frames of the class, in ascending rule index order.
+    //
+    XDP_PROGRAM_RULE_SEQUENCE Sequences[XDP_PROGRAM_FRAME_CLASS_COUNT];
+    UINT32 *RuleIndexStorage;
+
+    //
+    // For programs that adapt their rule order, the number of frames matched by
+    // each sequenced rule, indexed by rule index, and the storage for the
+    // minimum rule indexes of reordered sequences. The RX queue data path is
+    // serialized, so the counters are updated without interlocked operations.
+    //
+    UINT64 *RuleHits;
+    UINT32 *MinRuleIndexStorage;
+} XDP_PROGRAM_COMPILED;
+
+//
+// The interval between attempts to reorder the rules of adaptive programs, and
+// the number of sequenced rule matches required for an attempt to proceed.
+//
+#define XDP_PROGRAM_REORDER_INTERVAL_MS 1000
+#define XDP_PROGRAM_REORDER_MIN_HITS 1024
+
+//
+// Bounds the pairwise disjointness checks performed when grouping rules.
+//
+#define XDP_PROGRAM_REORDER_MAX_GROUP_SIZE 64
+
+//
+// Token buckets are measured in units of 1/XDP_PROGRAM_RATE_LIMIT_SCALE tokens,
+// the interrupt time resolution, so a rate in tokens per second is also the
+// refill in units per interrupt time tick.
+//
+#define XDP_PROGRAM_RATE_LIMIT_SCALE 10000000ui64
+
+//
+// The token buckets of a rate limit rule, referenced by the rule. The RX queue
+// data path is serialized, so the buckets are updated without interlocked
+// operations.
+//
+// Each refill is computed over at most the fill time of the bucket, the ticks
+// an empty bucket takes to fill. This bounds the product of the rate and the
+// elapsed time by the capacity plus the rate, which with the maximum rates and
+// burst sizes cannot overflow.
+//
+typedef struct _XDP_PROGRAM_RATE_LIMITER {
+    UINT64 UpdateTime;
+    UINT64 FrameTokens;
+    UINT64 ByteTokens;
+    UINT64 FrameCapacity;
+    UINT64 ByteCapacity;
+    UINT64 FrameFillTime;
+    UINT64 ByteFillTime;
+} XDP_PROGRAM_RATE_LIMITER;
+
+C_ASSERT(
+    XDP_RATE_LIMIT_MAX_BYTES * XDP_PROGRAM_RATE_LIMIT_SCALE <=
+        (MAXUINT64 - XDP_RATE_LIMIT_MAX_BYTES) / 2);
+
+//
+// The sampling state of a sample rule, referenced by the rule.
+//
+typedef struct _XDP_PROGRAM_SAMPLER {
+    UINT32 Countdown;
+} XDP_PROGRAM_SAMPLER;
+
+//
+// The size of an XSK group's lookup table. A prime much larger than
+// XDP_XSK_GROUP_MAX_SOCKETS keeps the sockets' shares of the table even.
+//
+#define XDP_PROGRAM_XSK_GROUP_LOOKUP_SIZE 4099
+
+//
+// Marks lookup table entries not yet claimed by a socket during population.
+//
+#define XDP_PROGRAM_XSK_GROUP_ENTRY_NONE MAXUINT8
+
+C_ASSERT(XDP_XSK_GROUP_MAX_SOCKETS <= XDP_PROGRAM_XSK_GROUP_ENTRY_NONE);
+
+//
+// An XSK group, referenced by a redirect rule. Each lookup table entry holds
+// the index of a socket. The table is populated using the Maglev consistent
+// hashing scheme: each socket claims entries in the order of its own
+// permutation of the table, so membership changes only move the entries
+// claimed by the sockets added or removed.
+//
+typedef struct _XDP_PROGRAM_XSK_GROUP {
+    UINT32 SocketCount;
+    HANDLE Sockets[XDP_XSK_GROUP_MAX_SOCKETS];
+    UINT8 Lookup[XDP_PROGRAM_XSK_GROUP_LOOKUP_SIZE];
+} XDP_PROGRAM_XSK_GROUP;
+
+#define XDP_PROGRAM_QUIC_CID_TABLE_MIN_BUCKETS 16
+
+//
+// The bucket array stops growing at this size, after which chains lengthen.
+//
+#define XDP_PROGRAM_QUIC_CID_TABLE_MAX_BUCKETS 0x00400000
+
+//
+// Each entry has two chain links. A bucket array chains the entries through
+// one of them, so a larger bucket array can be chained through the other link
+// while the data path still walks the current bucket array.
+//
+#define XDP_PROGRAM_QUIC_CID_LINK_COUNT 2
+
+typedef struct _XDP_PROGRAM_QUIC_CID_ENTRY {
+    struct _XDP_PROGRAM_QUIC_CID_ENTRY *Next[XDP_PROGRAM_QUIC_CID_LINK_COUNT];
+    HANDLE Target;
+    UINT32 Hash;
+    UCHAR CidData[QUIC_MAX_CID_LENGTH];
+} XDP_PROGRAM_QUIC_CID_ENTRY;
+
+typedef struct _XDP_PROGRAM_QUIC_CID_BUCKETS {
+    UINT32 BucketMask;
+    UINT32 LinkIndex;
+    XDP_PROGRAM_QUIC_CID_ENTRY *Heads[ANYSIZE_ARRAY];
+} XDP_PROGRAM_QUIC_CID_BUCKETS;
+
+//
+// A connection ID table, referenced by a XDP_MATCH_QUIC_FLOW_DST_CID_TABLE
+// rule. Each bucket holds a chain of entries, each of which references the XSK
+// receiving the frames of its connection ID. Entries are inserted and removed
+// in place while the RX queue data path is synchronized, so the rules need not
+// be recompiled. A grown bucket array is built outside the synchronization and
+// published by replacing the bucket array pointer.
+//
+typedef struct _XDP_PROGRAM_QUIC_CID_TABLE {
+    XDP_PROGRAM_QUIC_CID_BUCKETS *Buckets;
+    UINT32 EntryCount;
+} XDP_PROGRAM_QUIC_CID_TABLE;
+
+//
+// Bloom filter blocks are cache line sized and aligned. Each address sets
+// XDP_PROGRAM_BLOOM_HASH_COUNT bits of a single block, so testing an address
+// reads one cache line.
+//
+#define XDP_PROGRAM_BLOOM_BLOCK_SIZE 64
+#define XDP_PROGRAM_BLOOM_BLOCK_BITS (XDP_PROGRAM_BLOOM_BLOCK_SIZE * 8)
+#define XDP_PROGRAM_BLOOM_BITS_PER_ADDRESS 12
+#define XDP_PROGRAM_BLOOM_HASH_COUNT 6
+
+typedef struct _XDP_PROGRAM_BLOOM_BLOCK {
+    UINT64 Bits[XDP_PROGRAM_BLOOM_BLOCK_BITS / 64];
+} XDP_PROGRAM_BLOOM_BLOCK;
+
+C_ASSERT(sizeof(XDP_PROGRAM_BLOOM_BLOCK) == XDP_PROGRAM_BLOOM_BLOCK_SIZE);
+
+//
+// An address set, referenced by a XDP_MATCH_IPV4_ADDRESS_SET,
+// XDP_MATCH_IPV6_ADDRESS_SET or XDP_MATCH_ETH_DST_SET rule. The addresses are
+// stored inline in a flat slot array probed linearly, which is at most three
+// quarters full. The all-zero address marks empty slots, so its membership is
+// tracked separately. The set is immutable once the rule is created.
+//
+typedef struct _XDP_PROGRAM_ADDRESS_SET {
+    UCHAR *Slots;
+    UINT32 SlotMask;
+    UINT32 AddressLength;
+    BOOLEAN ContainsZero;
+    UINT32 BloomBlockMask;
+    XDP_PROGRAM_BLOOM_BLOCK *BloomBlocks;
+    VOID *BloomAllocation;
+} XDP_PROGRAM_ADDRESS_SET;
+
+//
+// A verified copy of the instructions of a XDP_MATCH_BYTECODE rule.
+//
+typedef struct _XDP_PROGRAM_BYTECODE {
+    UINT32 InstructionCount;
+    XDP_BYTECODE_INSTRUCTION Instructions[ANYSIZE_ARRAY];
+} XDP_PROGRAM_BYTECODE;
+
+//
+// The fragment table of a program created with
+// XDP_CREATE_PROGRAM_FLAG_TRACK_FRAGMENTS records the rule matched by the first
+// fragment of recent IP datagrams, so later fragments, which carry no transport
+// header, follow the same rule. Each bucket holds a few entries keyed by the
+// datagram identity; entries expire after a timeout measured in interrupt
+// time, and inserts replace the entry closest to expiring, so the table has a
+// fixed size. The RX queue data path is serialized, so the table is updated
+// without interlocked operations.
+//
+#define XDP_PROGRAM_FRAGMENT_TABLE_BUCKETS 256
+#define XDP_PROGRAM_FRAGMENT_BUCKET_ENTRIES 4
+#define XDP_PROGRAM_FRAGMENT_TIMEOUT (RTL_SEC_TO_100NANOSEC(2))
+
+typedef struct _XDP_PROGRAM_FRAGMENT_KEY {
+    UINT8 SourceAddress[16];
+    UINT8 DestinationAddress[16];
+    UINT32 Id;
+    UINT8 Protocol;
+    BOOLEAN IsIpv6;
+} XDP_PROGRAM_FRAGMENT_KEY;
+
+C_ASSERT(sizeof(XDP_PROGRAM_FRAGMENT_KEY) % sizeof(UINT32) == 0);
+
+typedef struct _XDP_PROGRAM_FRAGMENT_ENTRY {
+    XDP_PROGRAM_FRAGMENT_KEY Key;
+    UINT64 ExpirationTime;
+    UINT32 ProgramGeneration;
+    UINT32 RuleIndex;
+    UINT32 FlowHash;
+} XDP_PROGRAM_FRAGMENT_ENTRY;
+
+typedef struct _XDP_PROGRAM_FRAGMENT_TABLE {
+    XDP_PROGRAM_FRAGMENT_ENTRY
+        Buckets[XDP_PROGRAM_FRAGMENT_TABLE_BUCKETS][XDP_PROGRAM_FRAGMENT_BUCKET_ENTRIES];
+} XDP_PROGRAM_FRAGMENT_TABLE;
+
 typedef struct _XDP_PROGRAM {
     //
     // Storage for discontiguous headers.
@@ -98,8 +570,33 @@ typedef struct _XDP_PROGRAM {
     XDP_PROGRAM_FRAME_STORAGE FrameStorage;
 
     DECLSPEC_CACHEALIGN
+    XDP_PROGRAM_COMPILED *Compiled;
+
+    //
+    // Incremented on the data path whenever the ruleset changes, which
+    // invalidates the flow cache of the RX queue.
+    //
+    UINT32 Generation;
+
+    //
+    // For each rule, the statistics updated when the rule matches a frame, or
+    // NULL if the program does not maintain statistics. The RX queue data path
+    // is serialized, so the statistics are updated without interlocked
+    // operations.
+    //
+    XDP_RULE_STATISTICS **RuleStatistics;
     UINT32 RuleCount;
-    XDP_RULE Rules[0];
+
+    //
+    // The fragment table, or NULL if the program does not track fragments.
+    //
+    XDP_PROGRAM_FRAGMENT_TABLE *FragmentTable;
+
+    //
+    // The rules are published together with the compiled lookup structures and
+    // the statistics map, so the data path always observes a consistent set.
+    //
+    XDP_RULE *Rules;
 } XDP_PROGRAM;
 
 //
@@ -216,9 +713,20 @@ XdpParseFragmentedEthernet(
             VirtualAddressExtension, &Storage->EthHdr, sizeof(Storage->EthHdr), &Cache->EthHdr);
 }
 
+static
+BOOLEAN
+XdpIsVlanEthType(
+    _In_ UINT16 EthType
+    )
+{
+    return
+        EthType == RtlUshortByteSwap(ETHERNET_TYPE_802_1Q) ||
+        EthType == RtlUshortByteSwap(ETHERNET_TYPE_802_1AD);
+}
+
 static
 VOID
-XdpParseFragmentedIp4(
+XdpParseFragmentedVlan(
     _In_ XDP_FRAME *Frame,
     _Inout_ XDP_BUFFER **Buffer,
     _Inout_ UINT32 *BufferDataOffset,
@@ -226,19 +734,39 @@ XdpParseFragmentedIp4(
     _Inout_ UINT32 *FragmentsRemaining,
     _In_ XDP_RING *FragmentRing,
     _In_ XDP_EXTENSION *VirtualAddressExtension,
-    _Out_ XDP_PROGRAM_FRAME_CACHE *Cache,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *Cache,
     _Inout_ XDP_PROGRAM_FRAME_STORAGE *Storage
     )
 {
-    Cache->Ip4Valid =
-        XdpGetContiguousHeader(
-            Frame, Buffer, BufferDataOffset, FragmentIndex, FragmentsRemaining, FragmentRing,
-            VirtualAddressExtension, &Storage->Ip4Hdr, sizeof(Storage->Ip4Hdr), &Cache->Ip4Hdr);
+    //
+    // The tags are always copied into storage, since consecutive tags may be
+    // split across buffers and the data path indexes them as an array.
+    //
+    Cache->EthType = Cache->EthHdr->Type;
+    Cache->VlanTags = Storage->VlanTags;
+    Cache->VlanTagCount = 0;
+
+    while (Cache->VlanTagCount < RTL_NUMBER_OF(Storage->VlanTags) &&
+            XdpIsVlanEthType(Cache->EthType)) {
+        VLAN_TAG *Tag;
+
+        if (!XdpGetContiguousHeader(
+                Frame, Buffer, BufferDataOffset, FragmentIndex, FragmentsRemaining,
+                FragmentRing, VirtualAddressExtension, &Storage->VlanTags[Cache->VlanTagCount],
+                sizeof(*Tag), &Tag)) {
+            return;
+        }
+
+        Storage->VlanTags[Cache->VlanTagCount++] = *Tag;
+        Cache->EthType = Tag->Type;
+    }
+
+    Cache->VlanValid = TRUE;
 }
 
 static
 VOID
-XdpParseFragmentedIp6(
+XdpParseFragmentedIp4(
     _In_ XDP_FRAME *Frame,
     _Inout_ XDP_BUFFER **Buffer,
     _Inout_ UINT32 *BufferDataOffset,
@@ -250,15 +778,42 @@ XdpParseFragmentedIp6(
     _Inout_ XDP_PROGRAM_FRAME_STORAGE *Storage
     )
 {
-    Cache->Ip6Valid =
+    Cache->Ip4Valid =
         XdpGetContiguousHeader(
             Frame, Buffer, BufferDataOffset, FragmentIndex, FragmentsRemaining, FragmentRing,
-            VirtualAddressExtension, &Storage->Ip6Hdr, sizeof(Storage->Ip6Hdr), &Cache->Ip6Hdr);
+            VirtualAddressExtension, &Storage->Ip4Hdr, sizeof(Storage->Ip4Hdr), &Cache->Ip4Hdr);
+}
+
+//
+// Returns the protocol of the transport header following the IPv4 header, and
+// records the identity of fragments. Fragments other than the first do not
+// carry the transport header, so their protocol is reported as IPPROTO_NONE.
+//
+static
+IPPROTO
+XdpParseIp4Protocol(
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *Cache
+    )
+{
+    CONST IPV4_HEADER *Ip4Hdr = Cache->Ip4Hdr;
+
+    if (Ip4Hdr->MoreFragments || (Ip4Hdr->FlagsAndOffset & IP4_OFF_MASK) != 0) {
+        Cache->IpFragment = TRUE;
+        Cache->IpLaterFragment = (Ip4Hdr->FlagsAndOffset & IP4_OFF_MASK) != 0;
+        Cache->IpFragmentId = Ip4Hdr->Identification;
+        Cache->IpFragmentProtocol = Ip4Hdr->Protocol;
+
+        if (Cache->IpLaterFragment) {
+            return IPPROTO_NONE;
+        }
+    }
+
+    return Ip4Hdr->Protocol;
 }
 
 static
 VOID
-XdpParseFragmentedUdp(
+XdpParseFragmentedIp6(
     _In_ XDP_FRAME *Frame,
     _Inout_ XDP_BUFFER **Buffer,
     _Inout_ UINT32 *BufferDataOffset,
@@ -270,74 +825,304 @@ XdpParseFragmentedUdp(
     _Inout_ XDP_PROGRAM_FRAME_STORAGE *Storage
     )
 {
-    Cache->UdpValid =
+    Cache->Ip6Valid =
         XdpGetContiguousHeader(
             Frame, Buffer, BufferDataOffset, FragmentIndex, FragmentsRemaining, FragmentRing,
-            VirtualAddressExtension, &Storage->UdpHdr, sizeof(Storage->UdpHdr), &Cache->UdpHdr);
+            VirtualAddressExtension, &Storage->Ip6Hdr, sizeof(Storage->Ip6Hdr), &Cache->Ip6Hdr);
 }
 
 static
-VOID
-XdpParseFragmentedFrame(
-    _In_ XDP_FRAME *Frame,
-    _In_ XDP_RING *FragmentRing,
-    _In_ XDP_EXTENSION *FragmentExtension,
-    _In_ UINT32 FragmentIndex,
-    _In_ XDP_EXTENSION *VirtualAddressExtension,
-    _Inout_ XDP_PROGRAM_FRAME_CACHE *Cache,
-    _Inout_ XDP_PROGRAM_FRAME_STORAGE *Storage
+BOOLEAN
+XdpIsIpv6ExtensionHeader(
+    _In_ UINT8 NextHeader
     )
 {
-    XDP_BUFFER *Buffer = &Frame->Buffer;
-    UINT32 BufferDataOffset = 0;
-    UINT32 FragmentCount;
-    IPPROTO IpProto = IPPROTO_MAX;
+    switch (NextHeader) {
+    case IPPROTO_HOPOPTS:
+    case IPPROTO_ROUTING:
+    case IPPROTO_FRAGMENT:
+    case IPPROTO_DSTOPTS:
+    case IPPROTO_AH:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
 
-    //
-    // The first buffer is stored in the frame ring, so bias the fragment index
-    // so the initial increment yields the first buffer in the fragment ring.
-    //
-    FragmentIndex--;
-    FragmentCount = XdpGetFragmentExtension(Frame, FragmentExtension)->FragmentBufferCount;
+//
+// Returns the length of an IPv6 extension header and the type of the header
+// following it, and records the identity of fragments. Fragments other than
+// the first do not carry the upper layer header, so their next header is
+// reported as IPPROTO_NONE.
+//
+static
+UINT32
+XdpParseIpv6ExtensionHeader(
+    _In_ UINT8 HeaderType,
+    _In_reads_bytes_(XDP_PROGRAM_IPV6_EXTENSION_HEADER_MIN_LENGTH) CONST UCHAR *Header,
+    _Out_ UINT8 *NextHeader,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *Cache
+    )
+{
+    CONST IPV6_EXTENSION_HEADER *ExtHdr = (CONST IPV6_EXTENSION_HEADER *)Header;
 
-    if (!Cache->EthValid) {
-        XdpParseFragmentedEthernet(
-            Frame, &Buffer, &BufferDataOffset, &FragmentIndex, &FragmentCount, FragmentRing,
-            VirtualAddressExtension, Cache, Storage);
+    if (HeaderType == IPPROTO_FRAGMENT) {
+        CONST IPV6_FRAGMENT_HEADER *FragHdr = (CONST IPV6_FRAGMENT_HEADER *)Header;
+        BOOLEAN IsLaterFragment = (FragHdr->OffsetAndFlags & IP6F_OFF_MASK) != 0;
 
-        if (!Cache->EthValid) {
-            return;
+        //
+        // The outermost fragment header identifies the datagram.
+        //
+        if (!Cache->IpFragment) {
+            Cache->IpFragment = TRUE;
+            Cache->IpLaterFragment = IsLaterFragment;
+            Cache->IpFragmentId = FragHdr->Id;
+            Cache->IpFragmentProtocol = FragHdr->NextHeader;
         }
-    }
 
-    if (Cache->EthHdr->Type == RtlUshortByteSwap(ETHERNET_TYPE_IPV4)) {
-        if (!Cache->Ip4Valid) {
-            XdpParseFragmentedIp4(
-                Frame, &Buffer, &BufferDataOffset, &FragmentIndex, &FragmentCount, FragmentRing,
-                VirtualAddressExtension, Cache, Storage);
+        *NextHeader = IsLaterFragment ? IPPROTO_NONE : FragHdr->NextHeader;
+        return sizeof(*FragHdr);
+    }
 
-            if (!Cache->Ip4Valid) {
-                return;
-            }
-        }
-        IpProto = Cache->Ip4Hdr->Protocol;
-    } else if (Cache->EthHdr->Type == RtlUshortByteSwap(ETHERNET_TYPE_IPV6)) {
-        if (!Cache->Ip6Valid) {
-            XdpParseFragmentedIp6(
-                Frame, &Buffer, &BufferDataOffset, &FragmentIndex, &FragmentCount, FragmentRing,
-                VirtualAddressExtension, Cache, Storage);
+    *NextHeader = ExtHdr->NextHeader;
 
-            if (!Cache->Ip6Valid) {
-                return;
-            }
-        }
-        IpProto = Cache->Ip6Hdr->NextHeader;
-    } else {
-        return;
+    //
+    // The authentication header length is in 4-byte units minus two; the other
+    // extension header lengths are in 8-byte units minus one.
+    //
+    if (HeaderType == IPPROTO_AH) {
+        return (ExtHdr->Length + 2) * 4;
     }
 
-    if (IpProto == IPPROTO_UDP && !Cache->UdpValid) {
-        XdpParseFragmentedUdp(
+    return (ExtHdr->Length + 1) * 8;
+}
+
+static
+_Success_(return != FALSE)
+BOOLEAN
+XdpSkipFragmentedBytes(
+    _Inout_ XDP_BUFFER **Buffer,
+    _Inout_ UINT32 *BufferDataOffset,
+    _Inout_ UINT32 *FragmentIndex,
+    _Inout_ UINT32 *FragmentsRemaining,
+    _In_ XDP_RING *FragmentRing,
+    _In_ UINT32 Length
+    )
+{
+    while (Length > 0) {
+        UINT32 SkipLength = min(Length, (*Buffer)->DataLength - *BufferDataOffset);
+
+        //
+        // If the current buffer is depleted, advance to the next fragment.
+        //
+        if (SkipLength == 0) {
+            if (*FragmentsRemaining == 0) {
+                return FALSE;
+            }
+
+            *FragmentIndex = (*FragmentIndex + 1) & FragmentRing->Mask;
+            *FragmentsRemaining -= 1;
+            *Buffer = XdpRingGetElement(FragmentRing, *FragmentIndex);
+            *BufferDataOffset = 0;
+            continue;
+        }
+
+        *BufferDataOffset += SkipLength;
+        Length -= SkipLength;
+    }
+
+    return TRUE;
+}
+
+static
+VOID
+XdpParseFragmentedIp6Extensions(
+    _In_ XDP_FRAME *Frame,
+    _Inout_ XDP_BUFFER **Buffer,
+    _Inout_ UINT32 *BufferDataOffset,
+    _Inout_ UINT32 *FragmentIndex,
+    _Inout_ UINT32 *FragmentsRemaining,
+    _In_ XDP_RING *FragmentRing,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *Cache
+    )
+{
+    UINT32 HeaderLimit = XdpProgramIpv6ExtensionHeaderLimit;
+    UINT32 HeaderCount = 0;
+    UINT8 NextHeader = Cache->Ip6Hdr->NextHeader;
+
+    //
+    // Only the fixed part of each header is read; the remainder is skipped.
+    //
+    Cache->Ip6ExtLength = 0;
+
+    while (XdpIsIpv6ExtensionHeader(NextHeader)) {
+        UCHAR HeaderStorage[XDP_PROGRAM_IPV6_EXTENSION_HEADER_MIN_LENGTH];
+        UCHAR *Header;
+        UINT32 HeaderLength;
+
+        if (HeaderCount++ == HeaderLimit) {
+            NextHeader = IPPROTO_NONE;
+            break;
+        }
+
+        if (!XdpGetContiguousHeader(
+                Frame, Buffer, BufferDataOffset, FragmentIndex, FragmentsRemaining,
+                FragmentRing, VirtualAddressExtension, HeaderStorage, sizeof(HeaderStorage),
+                &Header)) {
+            return;
+        }
+
+        HeaderLength = XdpParseIpv6ExtensionHeader(NextHeader, Header, &NextHeader, Cache);
+
+        if (!XdpSkipFragmentedBytes(
+                Buffer, BufferDataOffset, FragmentIndex, FragmentsRemaining, FragmentRing,
+                HeaderLength - sizeof(HeaderStorage))) {
+            return;
+        }
+
+        Cache->Ip6ExtLength += HeaderLength;
+    }
+
+    Cache->Ip6ExtNextHeader = NextHeader;
+    Cache->Ip6ExtValid = TRUE;
+}
+
+static
+VOID
+XdpParseFragmentedUdp(
+    _In_ XDP_FRAME *Frame,
+    _Inout_ XDP_BUFFER **Buffer,
+    _Inout_ UINT32 *BufferDataOffset,
+    _Inout_ UINT32 *FragmentIndex,
+    _Inout_ UINT32 *FragmentsRemaining,
+    _In_ XDP_RING *FragmentRing,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Out_ XDP_PROGRAM_FRAME_CACHE *Cache,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *Storage
+    )
+{
+    Cache->UdpValid =
+        XdpGetContiguousHeader(
+            Frame, Buffer, BufferDataOffset, FragmentIndex, FragmentsRemaining, FragmentRing,
+            VirtualAddressExtension, &Storage->UdpHdr, sizeof(Storage->UdpHdr), &Cache->UdpHdr);
+}
+
+static
+VOID
+XdpParseFragmentedTcp(
+    _In_ XDP_FRAME *Frame,
+    _Inout_ XDP_BUFFER **Buffer,
+    _Inout_ UINT32 *BufferDataOffset,
+    _Inout_ UINT32 *FragmentIndex,
+    _Inout_ UINT32 *FragmentsRemaining,
+    _In_ XDP_RING *FragmentRing,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Out_ XDP_PROGRAM_FRAME_CACHE *Cache,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *Storage
+    )
+{
+    Cache->TcpValid =
+        XdpGetContiguousHeader(
+            Frame, Buffer, BufferDataOffset, FragmentIndex, FragmentsRemaining, FragmentRing,
+            VirtualAddressExtension, &Storage->TcpHdr, sizeof(Storage->TcpHdr), &Cache->TcpHdr);
+}
+
+static
+VOID
+XdpParseFragmentedFrame(
+    _In_ XDP_FRAME *Frame,
+    _In_ XDP_RING *FragmentRing,
+    _In_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *Cache,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *Storage
+    )
+{
+    XDP_BUFFER *Buffer = &Frame->Buffer;
+    UINT32 BufferDataOffset = 0;
+    UINT32 FragmentCount;
+    IPPROTO IpProto = IPPROTO_MAX;
+
+    //
+    // The first buffer is stored in the frame ring, so bias the fragment index
+    // so the initial increment yields the first buffer in the fragment ring.
+    //
+    FragmentIndex--;
+    FragmentCount = XdpGetFragmentExtension(Frame, FragmentExtension)->FragmentBufferCount;
+
+    //
+    // Headers already parsed from the first buffer are skipped.
+    //
+    if (!Cache->EthValid) {
+        XdpParseFragmentedEthernet(
+            Frame, &Buffer, &BufferDataOffset, &FragmentIndex, &FragmentCount, FragmentRing,
+            VirtualAddressExtension, Cache, Storage);
+
+        if (!Cache->EthValid) {
+            return;
+        }
+    } else {
+        BufferDataOffset += sizeof(*Cache->EthHdr);
+    }
+
+    if (!Cache->VlanValid) {
+        XdpParseFragmentedVlan(
+            Frame, &Buffer, &BufferDataOffset, &FragmentIndex, &FragmentCount, FragmentRing,
+            VirtualAddressExtension, Cache, Storage);
+
+        if (!Cache->VlanValid) {
+            return;
+        }
+    } else {
+        BufferDataOffset += Cache->VlanTagCount * sizeof(*Cache->VlanTags);
+    }
+
+    if (Cache->EthType == RtlUshortByteSwap(ETHERNET_TYPE_IPV4)) {
+        if (!Cache->Ip4Valid) {
+            XdpParseFragmentedIp4(
+                Frame, &Buffer, &BufferDataOffset, &FragmentIndex, &FragmentCount, FragmentRing,
+                VirtualAddressExtension, Cache, Storage);
+
+            if (!Cache->Ip4Valid) {
+                return;
+            }
+        } else {
+            BufferDataOffset += sizeof(*Cache->Ip4Hdr);
+        }
+        IpProto = XdpParseIp4Protocol(Cache);
+    } else if (Cache->EthType == RtlUshortByteSwap(ETHERNET_TYPE_IPV6)) {
+        if (!Cache->Ip6Valid) {
+            XdpParseFragmentedIp6(
+                Frame, &Buffer, &BufferDataOffset, &FragmentIndex, &FragmentCount, FragmentRing,
+                VirtualAddressExtension, Cache, Storage);
+
+            if (!Cache->Ip6Valid) {
+                return;
+            }
+        } else {
+            BufferDataOffset += sizeof(*Cache->Ip6Hdr);
+        }
+
+        if (!Cache->Ip6ExtValid) {
+            XdpParseFragmentedIp6Extensions(
+                Frame, &Buffer, &BufferDataOffset, &FragmentIndex, &FragmentCount, FragmentRing,
+                VirtualAddressExtension, Cache);
+
+            if (!Cache->Ip6ExtValid) {
+                return;
+            }
+        } else {
+            BufferDataOffset += Cache->Ip6ExtLength;
+        }
+        IpProto = Cache->Ip6ExtNextHeader;
+    } else {
+        return;
+    }
+
+    if (IpProto == IPPROTO_UDP && !Cache->UdpValid) {
+        XdpParseFragmentedUdp(
             Frame, &Buffer, &BufferDataOffset, &FragmentIndex, &FragmentCount, FragmentRing,
             VirtualAddressExtension, Cache, Storage);
         if (Cache->UdpValid) {
@@ -348,6 +1133,10 @@ XdpParseFragmentedFrame(
             Cache->TransportPayload.IsFragmentedBuffer = TRUE;
             Cache->TransportPayloadValid = TRUE;
         }
+    } else if (IpProto == IPPROTO_TCP && !Cache->TcpValid) {
+        XdpParseFragmentedTcp(
+            Frame, &Buffer, &BufferDataOffset, &FragmentIndex, &FragmentCount, FragmentRing,
+            VirtualAddressExtension, Cache, Storage);
     }
 }
 
@@ -367,14 +1156,19 @@ XdpParseFrame(
     UCHAR *Va;
     IPPROTO IpProto = IPPROTO_MAX;
     UINT32 Offset = 0;
+    UINT32 HeaderLimit;
+    UINT32 HeaderCount = 0;
 
     //
-    // This routine always attempts to parse Ethernet through UDP headers.
+    // This routine always attempts to parse Ethernet and VLAN tags through UDP
+    // or TCP headers.
     //
     Cache->EthCached = TRUE;
+    Cache->VlanCached = TRUE;
     Cache->Ip4Cached = TRUE;
     Cache->Ip6Cached = TRUE;
     Cache->UdpCached = TRUE;
+    Cache->TcpCached = TRUE;
     Cache->TransportPayloadCached = TRUE;
 
     //
@@ -382,6 +1176,16 @@ XdpParseFrame(
     // there's not enough data in the first buffer, fall back to handling
     // discontiguous headers via the fragment ring.
     //
+    // test/parsebench measures this path against SSE2 and wide load
+    // classifiers for untagged, unfragmented IP frames. With the headers
+    // cached, the wide load classifier is about 15% faster on UDP frames
+    // (12.9-14.7 vs 15.1-17.7 ns per frame). The same fast path placed ahead
+    // of the Ethernet checks below showed no consistent gain, since here the
+    // cost is dominated by filling the frame cache and by the first access to
+    // the headers, which XdpInspectBatch overlaps by prefetching; it was not
+    // taken. parsebench mirrors this path, so changes here must be reflected
+    // in its scalar parser and its table of known frames.
+    //
 
     Buffer = &Frame->Buffer;
     Va = XdpGetVirtualAddressExtension(Buffer, VirtualAddressExtension)->VirtualAddress;
@@ -394,15 +1198,27 @@ XdpParseFrame(
     Cache->EthValid = TRUE;
     Offset += sizeof(*Cache->EthHdr);
 
-    if (Cache->EthHdr->Type == RtlUshortByteSwap(ETHERNET_TYPE_IPV4)) {
+    Cache->EthType = Cache->EthHdr->Type;
+    Cache->VlanTags = (VLAN_TAG *)&Va[Offset];
+    Cache->VlanTagCount = 0;
+    while (Cache->VlanTagCount < XDP_PROGRAM_MAX_VLAN_TAGS && XdpIsVlanEthType(Cache->EthType)) {
+        if (Buffer->DataLength < Offset + sizeof(*Cache->VlanTags)) {
+            goto BufferTooSmall;
+        }
+        Cache->EthType = Cache->VlanTags[Cache->VlanTagCount++].Type;
+        Offset += sizeof(*Cache->VlanTags);
+    }
+    Cache->VlanValid = TRUE;
+
+    if (Cache->EthType == RtlUshortByteSwap(ETHERNET_TYPE_IPV4)) {
         if (Buffer->DataLength < Offset + sizeof(*Cache->Ip4Hdr)) {
             goto BufferTooSmall;
         }
         Cache->Ip4Hdr = (IPV4_HEADER *)&Va[Offset];
         Cache->Ip4Valid = TRUE;
         Offset += sizeof(*Cache->Ip4Hdr);
-        IpProto = Cache->Ip4Hdr->Protocol;
-    } else if (Cache->EthHdr->Type == RtlUshortByteSwap(ETHERNET_TYPE_IPV6)) {
+        IpProto = XdpParseIp4Protocol(Cache);
+    } else if (Cache->EthType == RtlUshortByteSwap(ETHERNET_TYPE_IPV6)) {
         if (Buffer->DataLength < Offset + sizeof(*Cache->Ip6Hdr)) {
             goto BufferTooSmall;
         }
@@ -410,6 +1226,36 @@ XdpParseFrame(
         Cache->Ip6Valid = TRUE;
         Offset += sizeof(*Cache->Ip6Hdr);
         IpProto = Cache->Ip6Hdr->NextHeader;
+
+        //
+        // Skip the extension headers preceding the upper layer protocol, up to
+        // the configured chain length.
+        //
+        HeaderLimit = XdpProgramIpv6ExtensionHeaderLimit;
+        Cache->Ip6ExtLength = 0;
+        while (XdpIsIpv6ExtensionHeader((UINT8)IpProto)) {
+            UINT8 NextHeader;
+            UINT32 HeaderLength;
+
+            if (HeaderCount++ == HeaderLimit) {
+                IpProto = IPPROTO_NONE;
+                break;
+            }
+
+            if (Buffer->DataLength < Offset + XDP_PROGRAM_IPV6_EXTENSION_HEADER_MIN_LENGTH) {
+                goto BufferTooSmall;
+            }
+            HeaderLength =
+                XdpParseIpv6ExtensionHeader((UINT8)IpProto, &Va[Offset], &NextHeader, Cache);
+            if (Buffer->DataLength < Offset + HeaderLength) {
+                goto BufferTooSmall;
+            }
+            Offset += HeaderLength;
+            Cache->Ip6ExtLength += HeaderLength;
+            IpProto = NextHeader;
+        }
+        Cache->Ip6ExtNextHeader = (UINT8)IpProto;
+        Cache->Ip6ExtValid = TRUE;
     } else {
         return;
     }
@@ -425,6 +1271,12 @@ XdpParseFrame(
         Cache->TransportPayload.BufferDataOffset = Offset;
         Cache->TransportPayload.IsFragmentedBuffer = FALSE;
         Cache->TransportPayloadValid = TRUE;
+    } else if (IpProto == IPPROTO_TCP) {
+        if (Buffer->DataLength < Offset + sizeof(*Cache->TcpHdr)) {
+            goto BufferTooSmall;
+        }
+        Cache->TcpHdr = (TCP_HDR *)&Va[Offset];
+        Cache->TcpValid = TRUE;
     }
 
     return;
@@ -475,7 +1327,7 @@ UdpTupleMatch(
     _In_ CONST XDP_TUPLE *Tuple
     )
 {
-    if (Cache->EthHdr->Type == RtlUshortByteSwap(ETHERNET_TYPE_IPV4)) {
+    if (Cache->EthType == RtlUshortByteSwap(ETHERNET_TYPE_IPV4)) {
         return
             Type == XDP_MATCH_IPV4_UDP_TUPLE &&
             Cache->UdpHdr->uh_sport == Tuple->SourcePort &&
@@ -492,6 +1344,31 @@ UdpTupleMatch(
     }
 }
 
+static
+BOOLEAN
+TcpTupleMatch(
+    _In_ XDP_MATCH_TYPE Type,
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *Cache,
+    _In_ CONST XDP_TUPLE *Tuple
+    )
+{
+    if (Cache->EthType == RtlUshortByteSwap(ETHERNET_TYPE_IPV4)) {
+        return
+            Type == XDP_MATCH_IPV4_TCP_TUPLE &&
+            Cache->TcpHdr->th_sport == Tuple->SourcePort &&
+            Cache->TcpHdr->th_dport == Tuple->DestinationPort &&
+            IN4_ADDR_EQUAL(&Cache->Ip4Hdr->SourceAddress, &Tuple->SourceAddress.Ipv4) &&
+            IN4_ADDR_EQUAL(&Cache->Ip4Hdr->DestinationAddress, &Tuple->DestinationAddress.Ipv4);
+    } else { // IPv6
+        return
+            Type == XDP_MATCH_IPV6_TCP_TUPLE &&
+            Cache->TcpHdr->th_sport == Tuple->SourcePort &&
+            Cache->TcpHdr->th_dport == Tuple->DestinationPort &&
+            IN6_ADDR_EQUAL(&Cache->Ip6Hdr->SourceAddress, &Tuple->SourceAddress.Ipv6) &&
+            IN6_ADDR_EQUAL(&Cache->Ip6Hdr->DestinationAddress, &Tuple->DestinationAddress.Ipv6);
+    }
+}
+
 static
 BOOLEAN
 QuicCidMatch(
@@ -511,61 +1388,219 @@ QuicCidMatch(
 }
 
 static
-_Success_(return != FALSE)
-BOOLEAN
-XdpParseQuicHeaderPayload(
-    _In_ CONST UINT8 *Payload,
-    _In_ UINT32 DataLength,
-    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache
+UINT32
+XdpProgramHashQuicCid(
+    _In_reads_bytes_(CidLength) CONST UINT8 *Cid,
+    _In_ UINT32 CidLength
+    );
+
+static
+HANDLE
+QuicCidTableLookup(
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *QuicHeader,
+    _In_ CONST XDP_QUIC_CID_TABLE *TablePattern
     )
 {
-    CONST QUIC_HEADER_INVARIANT* QuicHdr = (CONST QUIC_HEADER_INVARIANT*)Payload;
-
-    if (DataLength < RTL_SIZEOF_THROUGH_FIELD(QUIC_HEADER_INVARIANT, COMMON_HDR)) {
-        return FALSE;
+    CONST XDP_PROGRAM_QUIC_CID_TABLE *Table = TablePattern->Reserved;
+    CONST XDP_PROGRAM_QUIC_CID_BUCKETS *Buckets = Table->Buckets;
+    CONST XDP_PROGRAM_QUIC_CID_ENTRY *Entry;
+    CONST UINT8 *Cid;
+    UINT32 Hash;
+
+    if (QuicHeader->QuicIsLongHeader) {
+        return NULL;
+    }
+    ASSERT(TablePattern->CidOffset + TablePattern->CidLength <= QUIC_MAX_CID_LENGTH);
+    if (QuicHeader->QuicCidLength < TablePattern->CidOffset + TablePattern->CidLength) {
+        return NULL;
     }
 
-    if (QuicHdr->COMMON_HDR.IsLongHeader) {
-        if (DataLength < RTL_SIZEOF_THROUGH_FIELD(QUIC_HEADER_INVARIANT, LONG_HDR)) {
-            return FALSE;
-        }
-        if (DataLength <
-                RTL_SIZEOF_THROUGH_FIELD(QUIC_HEADER_INVARIANT, LONG_HDR) +
-                QuicHdr->LONG_HDR.DestCidLength + sizeof(UCHAR)) {
-            return FALSE;
-        }
-        FrameCache->QuicCidLength =
-            QuicHdr->LONG_HDR.DestCid[QuicHdr->LONG_HDR.DestCidLength];
-        if (DataLength <
-                RTL_SIZEOF_THROUGH_FIELD(QUIC_HEADER_INVARIANT, LONG_HDR) +
-                QuicHdr->LONG_HDR.DestCidLength +
-                sizeof(UCHAR) +
-                FrameCache->QuicCidLength) {
-            return FALSE;
+    Cid = &QuicHeader->QuicCid[TablePattern->CidOffset];
+    Hash = XdpProgramHashQuicCid(Cid, TablePattern->CidLength);
+
+    for (Entry = Buckets->Heads[Hash & Buckets->BucketMask];
+         Entry != NULL;
+         Entry = Entry->Next[Buckets->LinkIndex]) {
+        if (Entry->Hash == Hash && memcmp(Entry->CidData, Cid, TablePattern->CidLength) == 0) {
+            return Entry->Target;
         }
-        FrameCache->QuicCid =
-            QuicHdr->LONG_HDR.DestCid +
-            QuicHdr->LONG_HDR.DestCidLength +
-            sizeof(UCHAR);
-        FrameCache->QuicValid = TRUE;
-        FrameCache->QuicIsLongHeader = TRUE;
-        return TRUE;
     }
 
-    FrameCache->QuicCidLength =
-        (UINT8)min(
-            DataLength - RTL_SIZEOF_THROUGH_FIELD(QUIC_HEADER_INVARIANT, SHORT_HDR),
-            QUIC_MAX_CID_LENGTH);
-    FrameCache->QuicCid = QuicHdr->SHORT_HDR.DestCid;
-    FrameCache->QuicValid = TRUE;
-    FrameCache->QuicIsLongHeader = FALSE;
-    return FrameCache->QuicCidLength == QUIC_MAX_CID_LENGTH;
+    return NULL;
 }
 
 static
-VOID
-XdpParseFragmentedQuicHeader(
-    _In_ XDP_FRAME *Frame,
+UINT32
+XdpProgramHashAddress(
+    _In_reads_bytes_(AddressLength) CONST UCHAR *Address,
+    _In_ UINT32 AddressLength
+    );
+
+static
+BOOLEAN
+XdpProgramIsAddressEqual(
+    _In_reads_bytes_(AddressLength) CONST UCHAR *Address,
+    _In_reads_bytes_(AddressLength) CONST UCHAR *OtherAddress,
+    _In_ UINT32 AddressLength
+    )
+{
+    if (AddressLength == sizeof(IN_ADDR)) {
+        return IN4_ADDR_EQUAL((CONST IN_ADDR *)Address, (CONST IN_ADDR *)OtherAddress);
+    }
+
+    if (AddressLength == sizeof(XDP_MAC_ADDRESS)) {
+        return
+            *(UNALIGNED CONST UINT32 *)Address == *(UNALIGNED CONST UINT32 *)OtherAddress &&
+            *(UNALIGNED CONST UINT16 *)&Address[4] == *(UNALIGNED CONST UINT16 *)&OtherAddress[4];
+    }
+
+    ASSERT(AddressLength == sizeof(IN6_ADDR));
+    return IN6_ADDR_EQUAL((CONST IN6_ADDR *)Address, (CONST IN6_ADDR *)OtherAddress);
+}
+
+static
+BOOLEAN
+XdpProgramIsAddressZero(
+    _In_reads_bytes_(AddressLength) CONST UCHAR *Address,
+    _In_ UINT32 AddressLength
+    )
+{
+    if (AddressLength == sizeof(IN_ADDR)) {
+        return IN4_IS_ADDR_UNSPECIFIED((CONST IN_ADDR *)Address);
+    }
+
+    if (AddressLength == sizeof(XDP_MAC_ADDRESS)) {
+        return
+            *(UNALIGNED CONST UINT32 *)Address == 0 &&
+            *(UNALIGNED CONST UINT16 *)&Address[4] == 0;
+    }
+
+    ASSERT(AddressLength == sizeof(IN6_ADDR));
+    return IN6_IS_ADDR_UNSPECIFIED((CONST IN6_ADDR *)Address);
+}
+
+//
+// Returns the Bloom filter block of an address hash, and the double hashing
+// base and step of the bit positions within the block. The slot index consumes
+// the low bits of the hash, so the block is selected by its rotated bits and
+// the bit positions by the high bits of its multiplicative rehash.
+//
+static
+XDP_PROGRAM_BLOOM_BLOCK *
+XdpProgramGetBloomBlock(
+    _In_ CONST XDP_PROGRAM_ADDRESS_SET *Set,
+    _In_ UINT32 Hash,
+    _Out_ UINT32 *BitIndex,
+    _Out_ UINT32 *BitStep
+    )
+{
+    UINT32 Rehash = Hash * 0x9e3779b1;
+
+    *BitIndex = Rehash >> 23;
+    *BitStep = ((Rehash >> 14) & (XDP_PROGRAM_BLOOM_BLOCK_BITS - 1)) | 1;
+    return &Set->BloomBlocks[RotateLeft32(Hash, 16) & Set->BloomBlockMask];
+}
+
+static
+BOOLEAN
+XdpProgramAddressSetContains(
+    _In_ CONST XDP_PROGRAM_ADDRESS_SET *Set,
+    _In_reads_bytes_(Set->AddressLength) CONST UCHAR *Address
+    )
+{
+    CONST UCHAR *Slot;
+    UINT32 Hash;
+    UINT32 SlotIndex;
+
+    Hash = XdpProgramHashAddress(Address, Set->AddressLength);
+
+    if (Set->BloomBlocks != NULL) {
+        CONST XDP_PROGRAM_BLOOM_BLOCK *Block;
+        UINT32 BitIndex;
+        UINT32 BitStep;
+
+        Block = XdpProgramGetBloomBlock(Set, Hash, &BitIndex, &BitStep);
+
+        for (UINT32 i = 0; i < XDP_PROGRAM_BLOOM_HASH_COUNT; i++) {
+            if ((Block->Bits[BitIndex / 64] & (1ui64 << (BitIndex % 64))) == 0) {
+                return FALSE;
+            }
+            BitIndex = (BitIndex + BitStep) & (XDP_PROGRAM_BLOOM_BLOCK_BITS - 1);
+        }
+    }
+
+    for (SlotIndex = Hash & Set->SlotMask;; SlotIndex = (SlotIndex + 1) & Set->SlotMask) {
+        Slot = &Set->Slots[(SIZE_T)SlotIndex * Set->AddressLength];
+
+        if (XdpProgramIsAddressEqual(Slot, Address, Set->AddressLength)) {
+            //
+            // The all-zero address matches the first empty slot.
+            //
+            return !XdpProgramIsAddressZero(Address, Set->AddressLength) || Set->ContainsZero;
+        }
+
+        if (XdpProgramIsAddressZero(Slot, Set->AddressLength)) {
+            return FALSE;
+        }
+    }
+}
+
+static
+_Success_(return != FALSE)
+BOOLEAN
+XdpParseQuicHeaderPayload(
+    _In_ CONST UINT8 *Payload,
+    _In_ UINT32 DataLength,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    CONST QUIC_HEADER_INVARIANT* QuicHdr = (CONST QUIC_HEADER_INVARIANT*)Payload;
+
+    if (DataLength < RTL_SIZEOF_THROUGH_FIELD(QUIC_HEADER_INVARIANT, COMMON_HDR)) {
+        return FALSE;
+    }
+
+    if (QuicHdr->COMMON_HDR.IsLongHeader) {
+        if (DataLength < RTL_SIZEOF_THROUGH_FIELD(QUIC_HEADER_INVARIANT, LONG_HDR)) {
+            return FALSE;
+        }
+        if (DataLength <
+                RTL_SIZEOF_THROUGH_FIELD(QUIC_HEADER_INVARIANT, LONG_HDR) +
+                QuicHdr->LONG_HDR.DestCidLength + sizeof(UCHAR)) {
+            return FALSE;
+        }
+        FrameCache->QuicCidLength =
+            QuicHdr->LONG_HDR.DestCid[QuicHdr->LONG_HDR.DestCidLength];
+        if (DataLength <
+                RTL_SIZEOF_THROUGH_FIELD(QUIC_HEADER_INVARIANT, LONG_HDR) +
+                QuicHdr->LONG_HDR.DestCidLength +
+                sizeof(UCHAR) +
+                FrameCache->QuicCidLength) {
+            return FALSE;
+        }
+        FrameCache->QuicCid =
+            QuicHdr->LONG_HDR.DestCid +
+            QuicHdr->LONG_HDR.DestCidLength +
+            sizeof(UCHAR);
+        FrameCache->QuicValid = TRUE;
+        FrameCache->QuicIsLongHeader = TRUE;
+        return TRUE;
+    }
+
+    FrameCache->QuicCidLength =
+        (UINT8)min(
+            DataLength - RTL_SIZEOF_THROUGH_FIELD(QUIC_HEADER_INVARIANT, SHORT_HDR),
+            QUIC_MAX_CID_LENGTH);
+    FrameCache->QuicCid = QuicHdr->SHORT_HDR.DestCid;
+    FrameCache->QuicValid = TRUE;
+    FrameCache->QuicIsLongHeader = FALSE;
+    return FrameCache->QuicCidLength == QUIC_MAX_CID_LENGTH;
+}
+
+static
+VOID
+XdpParseFragmentedQuicHeader(
+    _In_ XDP_FRAME *Frame,
     _In_ XDP_RING *FragmentRing,
     _In_ XDP_EXTENSION *FragmentExtension,
     _In_ UINT32 FragmentIndex,
@@ -640,1048 +1675,6616 @@ BufferTooSmall:
 }
 
 static
+_Success_(return != FALSE)
 BOOLEAN
-XdpTestBit(
-    _In_ CONST UINT8 *BitMap,
-    _In_ UINT32 Index
+XdpReadPayload(
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ CONST XDP_PROGRAM_PAYLOAD_CACHE *Payload,
+    _In_ UINT32 Offset,
+    _In_ UINT32 Length,
+    _Out_writes_bytes_(Length) UCHAR *Data
     )
 {
-    return (ReadUCharNoFence(&BitMap[Index >> 3]) >> (Index & 0x7)) & 0x1;
+    XDP_BUFFER *Buffer = Payload->Buffer;
+    UINT32 BufferDataOffset = Payload->BufferDataOffset + Offset;
+    UINT32 FragmentCount = 0;
+    VOID *Bytes;
+
+    if (Payload->IsFragmentedBuffer) {
+        FragmentIndex = Payload->FragmentIndex;
+        FragmentCount = Payload->FragmentCount;
+    } else if (FragmentRing != NULL) {
+        ASSERT(FragmentExtension);
+        //
+        // The first buffer is stored in the frame ring, so bias the fragment index
+        // so the initial increment yields the first buffer in the fragment ring.
+        //
+        FragmentIndex--;
+        FragmentCount = XdpGetFragmentExtension(Frame, FragmentExtension)->FragmentBufferCount;
+    }
+
+    //
+    // Skip the buffers preceding the offset.
+    //
+    while (BufferDataOffset > Buffer->DataLength) {
+        if (FragmentCount == 0) {
+            return FALSE;
+        }
+
+        BufferDataOffset -= Buffer->DataLength;
+        FragmentIndex = (FragmentIndex + 1) & FragmentRing->Mask;
+        FragmentCount--;
+        Buffer = XdpRingGetElement(FragmentRing, FragmentIndex);
+    }
+
+    if (!XdpGetContiguousHeader(
+            Frame, &Buffer, &BufferDataOffset, &FragmentIndex, &FragmentCount, FragmentRing,
+            VirtualAddressExtension, Data, Length, &Bytes)) {
+        return FALSE;
+    }
+
+    if (Bytes != Data) {
+        RtlCopyMemory(Data, Bytes, Length);
+    }
+
+    return TRUE;
 }
 
-_IRQL_requires_max_(DISPATCH_LEVEL)
-XDP_RX_ACTION
-XdpInspect(
-    _In_ XDP_PROGRAM *Program,
-    _In_ XDP_REDIRECT_CONTEXT *RedirectContext,
-    _In_ XDP_RING *FrameRing,
-    _In_ UINT32 FrameIndex,
+//
+// Parses the tunnel header and the inner headers through the transport ports
+// from the UDP payload. Tunnel matches are evaluated after the outer headers
+// have been parsed, so the rarely needed inner headers are only read on
+// demand, and always copied.
+//
+static
+VOID
+XdpParseTunnel(
+    _In_ XDP_FRAME *Frame,
     _In_opt_ XDP_RING *FragmentRing,
     _In_opt_ XDP_EXTENSION *FragmentExtension,
     _In_ UINT32 FragmentIndex,
-    _In_ XDP_EXTENSION *VirtualAddressExtension
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ XDP_TUNNEL_TYPE TunnelType,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *FrameStore,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache
     )
 {
-    XDP_RX_ACTION Action = XDP_RX_ACTION_PASS;
-    XDP_PROGRAM_FRAME_CACHE FrameCache;
-    XDP_FRAME *Frame;
-    BOOLEAN Matched = FALSE;
+    CONST XDP_PROGRAM_PAYLOAD_CACHE *Payload = &FrameCache->TransportPayload;
+    XDP_PROGRAM_TUNNEL_HEADER TunnelHdr;
+    UINT32 Offset = 0;
+    UINT16 EthType;
+    UINT8 IpProto;
+    UINT16 Ports[2];
+
+    FrameCache->TunnelCached = TRUE;
+    FrameCache->TunnelValid = FALSE;
+    FrameCache->TunnelInnerIp4Valid = FALSE;
+    FrameCache->TunnelInnerIp6Valid = FALSE;
+    FrameCache->TunnelInnerPortsValid = FALSE;
+    FrameCache->TunnelType = (UINT8)TunnelType;
+
+    if (!XdpReadPayload(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            Payload, Offset, sizeof(TunnelHdr), (UCHAR *)&TunnelHdr)) {
+        return;
+    }
+    Offset += sizeof(TunnelHdr);
 
-    ASSERT(FrameIndex <= FrameRing->Mask);
-    ASSERT(
-        (FragmentRing == NULL && FragmentIndex == 0) ||
-        (FragmentRing && FragmentIndex <= FragmentRing->Mask));
+    if (TunnelType == XDP_TUNNEL_TYPE_VXLAN) {
+        if ((TunnelHdr.FlagsOrOptionLength & XDP_PROGRAM_VXLAN_FLAG_VNI) == 0) {
+            return;
+        }
+        EthType = RtlUshortByteSwap(XDP_PROGRAM_ETHERNET_TYPE_TEB);
+    } else {
+        if ((TunnelHdr.FlagsOrOptionLength & XDP_PROGRAM_GENEVE_VERSION_MASK) != 0) {
+            return;
+        }
+        Offset += (TunnelHdr.FlagsOrOptionLength & XDP_PROGRAM_GENEVE_OPTION_LENGTH_MASK) * 4;
+        EthType = TunnelHdr.ProtocolType;
+    }
 
-    XdpInitializeFrameCache(&FrameCache);
-    Frame = XdpRingGetElement(FrameRing, FrameIndex);
+    FrameCache->TunnelVni =
+        ((UINT32)TunnelHdr.Vni[0] << 16) | ((UINT32)TunnelHdr.Vni[1] << 8) | TunnelHdr.Vni[2];
+    FrameCache->TunnelValid = TRUE;
 
-    for (ULONG RuleIndex = 0; RuleIndex < Program->RuleCount; RuleIndex++) {
-        XDP_RULE *Rule = &Program->Rules[RuleIndex];
+    //
+    // Skip the inner Ethernet header and its VLAN tags, if any.
+    //
+    if (EthType == RtlUshortByteSwap(XDP_PROGRAM_ETHERNET_TYPE_TEB)) {
+        ETHERNET_HEADER EthHdr;
 
-        //
-        // Check the match conditions.
-        //
+        if (!XdpReadPayload(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                Payload, Offset, sizeof(EthHdr), (UCHAR *)&EthHdr)) {
+            return;
+        }
+        Offset += sizeof(EthHdr);
+        EthType = EthHdr.Type;
 
-        switch (Rule->Match) {
-        case XDP_MATCH_ALL:
-            Matched = TRUE;
-            break;
+        for (UINT32 i = 0; i < XDP_PROGRAM_MAX_VLAN_TAGS && XdpIsVlanEthType(EthType); i++) {
+            VLAN_TAG Tag;
 
-        case XDP_MATCH_UDP:
-            if (!FrameCache.UdpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.UdpValid) {
-                Matched = TRUE;
+            if (!XdpReadPayload(
+                    Frame, FragmentRing, FragmentExtension, FragmentIndex,
+                    VirtualAddressExtension, Payload, Offset, sizeof(Tag), (UCHAR *)&Tag)) {
+                return;
             }
-            break;
+            Offset += sizeof(Tag);
+            EthType = Tag.Type;
+        }
+    }
 
-        case XDP_MATCH_UDP_DST:
-            if (!FrameCache.UdpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.UdpValid &&
-                FrameCache.UdpHdr->uh_dport == Rule->Pattern.Port) {
-                Matched = TRUE;
-            }
-            break;
+    if (EthType == RtlUshortByteSwap(ETHERNET_TYPE_IPV4)) {
+        if (!XdpReadPayload(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                Payload, Offset, sizeof(FrameStore->TunnelInnerIp4Hdr),
+                (UCHAR *)&FrameStore->TunnelInnerIp4Hdr)) {
+            return;
+        }
+        Offset += sizeof(FrameStore->TunnelInnerIp4Hdr);
+        FrameCache->TunnelInnerIp4Hdr = &FrameStore->TunnelInnerIp4Hdr;
+        FrameCache->TunnelInnerIp4Valid = TRUE;
+        IpProto = FrameStore->TunnelInnerIp4Hdr.Protocol;
+    } else if (EthType == RtlUshortByteSwap(ETHERNET_TYPE_IPV6)) {
+        if (!XdpReadPayload(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                Payload, Offset, sizeof(FrameStore->TunnelInnerIp6Hdr),
+                (UCHAR *)&FrameStore->TunnelInnerIp6Hdr)) {
+            return;
+        }
+        Offset += sizeof(FrameStore->TunnelInnerIp6Hdr);
+        FrameCache->TunnelInnerIp6Hdr = &FrameStore->TunnelInnerIp6Hdr;
+        FrameCache->TunnelInnerIp6Valid = TRUE;
+        IpProto = FrameStore->TunnelInnerIp6Hdr.NextHeader;
+    } else {
+        return;
+    }
 
-        case XDP_MATCH_IPV4_DST_MASK:
-            if (!FrameCache.Ip4Cached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.Ip4Valid &&
-                Ipv4PrefixMatch(
-                    &FrameCache.Ip4Hdr->DestinationAddress, &Rule->Pattern.IpMask.Address.Ipv4,
-                    &Rule->Pattern.IpMask.Mask.Ipv4)) {
-                Matched = TRUE;
-            }
-            break;
+    //
+    // The UDP and TCP headers both start with the source and destination
+    // ports.
+    //
+    if ((IpProto != IPPROTO_UDP && IpProto != IPPROTO_TCP) ||
+        !XdpReadPayload(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            Payload, Offset, sizeof(Ports), (UCHAR *)Ports)) {
+        return;
+    }
 
-        case XDP_MATCH_IPV6_DST_MASK:
-            if (!FrameCache.Ip6Cached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.Ip6Valid &&
-                Ipv6PrefixMatch(
-                    &FrameCache.Ip6Hdr->DestinationAddress,
-                    &Rule->Pattern.IpMask.Address.Ipv6,
-                    &Rule->Pattern.IpMask.Mask.Ipv6)) {
-                Matched = TRUE;
-            }
-            break;
+    FrameCache->TunnelInnerProtocol = IpProto;
+    FrameCache->TunnelInnerSourcePort = Ports[0];
+    FrameCache->TunnelInnerDestinationPort = Ports[1];
+    FrameCache->TunnelInnerPortsValid = TRUE;
+}
 
-        case XDP_MATCH_QUIC_FLOW_SRC_CID:
-        case XDP_MATCH_QUIC_FLOW_DST_CID:
-            if (!FrameCache.UdpCached || !FrameCache.TransportPayloadCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
+static
+BOOLEAN
+XdpTunnelMatch(
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ CONST XDP_TUNNEL *Tunnel,
+    _Inout_ XDP_PROGRAM_FRAME_STORAGE *FrameStore,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    if (!FrameCache->UdpValid || !FrameCache->TransportPayloadValid ||
+        FrameCache->UdpHdr->uh_dport != Tunnel->UdpPort) {
+        return FALSE;
+    }
 
-            if (!FrameCache.UdpValid || !FrameCache.TransportPayloadValid ||
-                FrameCache.UdpHdr->uh_dport != Rule->Pattern.QuicFlow.UdpPort) {
-                break;
-            }
+    if (!FrameCache->TunnelCached || FrameCache->TunnelType != Tunnel->Type) {
+        XdpParseTunnel(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            (XDP_TUNNEL_TYPE)Tunnel->Type, FrameStore, FrameCache);
+    }
 
-            if (!FrameCache.QuicCached) {
-                XdpParseQuicHeader(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache.TransportPayload, &Program->FrameStorage, &FrameCache);
-            }
+    return FrameCache->TunnelValid && FrameCache->TunnelVni == Tunnel->Vni;
+}
 
-            if (FrameCache.QuicValid &&
-                QuicCidMatch(
-                    Rule->Match,
-                    &FrameCache,
-                    &Rule->Pattern.QuicFlow)) {
-                Matched = TRUE;
-            }
-            break;
+static
+BOOLEAN
+XdpTunnelTupleMatch(
+    _In_ XDP_MATCH_TYPE Type,
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _In_ CONST XDP_TUNNEL_TUPLE *TunnelTuple
+    )
+{
+    CONST XDP_TUPLE *Tuple = &TunnelTuple->Tuple;
 
-        case XDP_MATCH_IPV4_UDP_TUPLE:
-        case XDP_MATCH_IPV6_UDP_TUPLE:
-            if (!FrameCache.UdpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.UdpValid &&
-                UdpTupleMatch(
-                    Rule->Match,
-                    &FrameCache,
-                    &Rule->Pattern.Tuple)) {
-                Matched = TRUE;
-            }
-            break;
+    if (!FrameCache->TunnelInnerPortsValid ||
+        FrameCache->TunnelInnerProtocol != TunnelTuple->Protocol ||
+        FrameCache->TunnelInnerSourcePort != Tuple->SourcePort ||
+        FrameCache->TunnelInnerDestinationPort != Tuple->DestinationPort) {
+        return FALSE;
+    }
 
-        case XDP_MATCH_UDP_PORT_SET:
-            if (!FrameCache.UdpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.UdpValid &&
-                XdpTestBit(Rule->Pattern.PortSet.PortSet, FrameCache.UdpHdr->uh_dport)) {
-                Matched = TRUE;
-            }
-            break;
+    if (Type == XDP_MATCH_TUNNEL_IPV4_TUPLE) {
+        return
+            FrameCache->TunnelInnerIp4Valid &&
+            IN4_ADDR_EQUAL(
+                &FrameCache->TunnelInnerIp4Hdr->SourceAddress, &Tuple->SourceAddress.Ipv4) &&
+            IN4_ADDR_EQUAL(
+                &FrameCache->TunnelInnerIp4Hdr->DestinationAddress,
+                &Tuple->DestinationAddress.Ipv4);
+    } else {
+        return
+            FrameCache->TunnelInnerIp6Valid &&
+            IN6_ADDR_EQUAL(
+                &FrameCache->TunnelInnerIp6Hdr->SourceAddress, &Tuple->SourceAddress.Ipv6) &&
+            IN6_ADDR_EQUAL(
+                &FrameCache->TunnelInnerIp6Hdr->DestinationAddress,
+                &Tuple->DestinationAddress.Ipv6);
+    }
+}
 
-        case XDP_MATCH_IPV4_UDP_PORT_SET:
-            if (!FrameCache.UdpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.Ip4Valid &&
-                IN4_ADDR_EQUAL(
-                    &FrameCache.Ip4Hdr->DestinationAddress,
-                    &Rule->Pattern.IpPortSet.Address.Ipv4) &&
-                FrameCache.UdpValid &&
-                XdpTestBit(Rule->Pattern.IpPortSet.PortSet.PortSet, FrameCache.UdpHdr->uh_dport)) {
-                Matched = TRUE;
-            }
-            break;
+static
+_Success_(return != FALSE)
+BOOLEAN
+XdpGetPayloadLayer(
+    _In_ XDP_FRAME *Frame,
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _In_ XDP_PAYLOAD_LAYER Layer,
+    _Out_ XDP_PROGRAM_PAYLOAD_CACHE *Payload,
+    _Out_ UINT32 *LayerOffset
+    )
+{
+    Payload->Buffer = &Frame->Buffer;
+    Payload->BufferDataOffset = 0;
+    Payload->IsFragmentedBuffer = FALSE;
+    *LayerOffset = 0;
 
-        case XDP_MATCH_IPV6_UDP_PORT_SET:
-            if (!FrameCache.UdpCached) {
-                XdpParseFrame(
-                    Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
-                    &FrameCache, &Program->FrameStorage);
-            }
-            if (FrameCache.Ip6Valid &&
-                IN6_ADDR_EQUAL(
-                    &FrameCache.Ip6Hdr->DestinationAddress,
-                    &Rule->Pattern.IpPortSet.Address.Ipv6) &&
-                FrameCache.UdpValid &&
-                XdpTestBit(Rule->Pattern.IpPortSet.PortSet.PortSet, FrameCache.UdpHdr->uh_dport)) {
-                Matched = TRUE;
-            }
-            break;
+    //
+    // The layer offsets follow the fixed header sizes assumed by the parser,
+    // plus any VLAN tags and IPv6 extension headers it skipped; L3 and L4 are
+    // valid only if the tags are.
+    //
+    switch (Layer) {
+    case XDP_PAYLOAD_LAYER_L2:
+        return TRUE;
 
-        default:
-            ASSERT(FALSE);
-            break;
+    case XDP_PAYLOAD_LAYER_L3:
+        if (!FrameCache->Ip4Valid && !FrameCache->Ip6Valid) {
+            return FALSE;
         }
+        *LayerOffset =
+            sizeof(ETHERNET_HEADER) + FrameCache->VlanTagCount * sizeof(VLAN_TAG);
+        return TRUE;
 
-        if (Matched) {
-            //
-            // Apply the action.
-            //
-            switch (Rule->Action) {
+    case XDP_PAYLOAD_LAYER_L4:
+    case XDP_PAYLOAD_LAYER_L4_PAYLOAD:
+        if (!FrameCache->UdpValid && !FrameCache->TcpValid) {
+            return FALSE;
+        }
 
-            case XDP_PROGRAM_ACTION_REDIRECT:
-                XdpRedirect(
-                    RedirectContext, FrameIndex, FragmentIndex, Rule->Redirect.TargetType,
-                    Rule->Redirect.Target);
+        if (Layer == XDP_PAYLOAD_LAYER_L4_PAYLOAD && FrameCache->TransportPayloadValid) {
+            *Payload = FrameCache->TransportPayload;
+            return TRUE;
+        }
 
-                Action = XDP_RX_ACTION_DROP;
-                break;
+        *LayerOffset =
+            sizeof(ETHERNET_HEADER) + FrameCache->VlanTagCount * sizeof(VLAN_TAG) +
+            (FrameCache->Ip4Valid ?
+                sizeof(IPV4_HEADER) : sizeof(IPV6_HEADER) + FrameCache->Ip6ExtLength);
 
-            case XDP_PROGRAM_ACTION_DROP:
-                Action = XDP_RX_ACTION_DROP;
-                break;
+        if (Layer == XDP_PAYLOAD_LAYER_L4_PAYLOAD) {
+            if (FrameCache->UdpValid) {
+                *LayerOffset += sizeof(UDP_HDR);
+            } else if (FrameCache->TcpHdr->th_len * 4 >= sizeof(TCP_HDR)) {
+                *LayerOffset += FrameCache->TcpHdr->th_len * 4;
+            } else {
+                return FALSE;
+            }
+        }
+        return TRUE;
 
-            case XDP_PROGRAM_ACTION_PASS:
-                Action = XDP_RX_ACTION_PASS;
-                break;
+    default:
+        ASSERT(FALSE);
+        return FALSE;
+    }
+}
 
-            default:
-                ASSERT(FALSE);
-                break;
-            }
+static
+BOOLEAN
+XdpVlanMatch(
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _In_ CONST XDP_VLAN_MATCH *Match
+    )
+{
+    if (!FrameCache->VlanValid || FrameCache->VlanTagCount == 0) {
+        return FALSE;
+    }
 
-            break;
-        }
+    if ((RtlUshortByteSwap(FrameCache->VlanTags[0].Tag) & XDP_VLAN_ID_MAX) != Match->VlanId) {
+        return FALSE;
     }
 
-    return Action;
+    if (Match->Flags & XDP_VLAN_MATCH_FLAG_INNER) {
+        return
+            FrameCache->VlanTagCount > 1 &&
+            (RtlUshortByteSwap(FrameCache->VlanTags[1].Tag) & XDP_VLAN_ID_MAX) ==
+                Match->InnerVlanId;
+    }
+
+    return TRUE;
 }
 
-_IRQL_requires_max_(DISPATCH_LEVEL)
-VOID *
-XdpProgramGetXskBypassTarget(
-    _In_ XDP_PROGRAM *Program
+static
+BOOLEAN
+XdpPayloadMatch(
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _In_ CONST XDP_PAYLOAD_MATCH *Match
     )
 {
-    ASSERT(XdpProgramCanXskBypass(Program));
-    return Program->Rules[0].Redirect.Target;
+    XDP_PROGRAM_PAYLOAD_CACHE Payload;
+    UINT32 LayerOffset;
+    UINT64 Data64[XDP_PAYLOAD_MATCH_MAX_LENGTH / sizeof(UINT64)] = {0};
+    CONST UINT64 *Value64 = (CONST UINT64 *)Match->Value;
+    CONST UINT64 *Mask64 = (CONST UINT64 *)Match->Mask;
+
+    if (!XdpGetPayloadLayer(Frame, FrameCache, Match->Layer, &Payload, &LayerOffset) ||
+        !XdpReadPayload(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            &Payload, LayerOffset + Match->Offset, Match->Length, (UCHAR *)Data64)) {
+        return FALSE;
+    }
+
+    //
+    // The mask and value are zeroed beyond the match length, so compare the
+    // whole pattern a word at a time.
+    //
+    C_ASSERT(XDP_PAYLOAD_MATCH_MAX_LENGTH == 2 * sizeof(UINT64));
+    C_ASSERT(FIELD_OFFSET(XDP_PAYLOAD_MATCH, Value) % sizeof(UINT64) == 0);
+    return
+        ((Data64[0] & Mask64[0]) == Value64[0]) &
+        ((Data64[1] & Mask64[1]) == Value64[1]);
 }
 
 //
-// Control path routines.
+// Returns whether the opcode loads from the frame, and if so the load size and
+// whether the load is indexed.
 //
+static
+_Success_(return != FALSE)
+BOOLEAN
+XdpBytecodeIsLoad(
+    _In_ UINT8 Opcode,
+    _Out_ UINT32 *Size,
+    _Out_ BOOLEAN *Indexed
+    )
+{
+    switch (Opcode) {
+    case XDP_BYTECODE_OP_LOAD_8:
+    case XDP_BYTECODE_OP_LOAD_INDEXED_8:
+        *Size = sizeof(UINT8);
+        break;
+    case XDP_BYTECODE_OP_LOAD_16:
+    case XDP_BYTECODE_OP_LOAD_INDEXED_16:
+        *Size = sizeof(UINT16);
+        break;
+    case XDP_BYTECODE_OP_LOAD_32:
+    case XDP_BYTECODE_OP_LOAD_INDEXED_32:
+        *Size = sizeof(UINT32);
+        break;
+    default:
+        return FALSE;
+    }
 
-typedef struct _XDP_PROGRAM_OBJECT {
-    XDP_FILE_OBJECT_HEADER Header;
-    XDP_BINDING_HANDLE IfHandle;
-    XDP_RX_QUEUE *RxQueue;
-    XDP_RX_QUEUE_NOTIFICATION_ENTRY RxQueueNotificationEntry;
-    LIST_ENTRY SharingLink;
-    ULONG_PTR CreatedByPid;
-
-    union {
-        struct {
-            UINT32 SharingEnabled : 1;
-            UINT32 IsMetaProgram : 1;
-        };
-        UINT32 Value;
-    } Flags;
+    *Indexed =
+        Opcode == XDP_BYTECODE_OP_LOAD_INDEXED_8 ||
+        Opcode == XDP_BYTECODE_OP_LOAD_INDEXED_16 ||
+        Opcode == XDP_BYTECODE_OP_LOAD_INDEXED_32;
+    return TRUE;
+}
 
-    XDP_PROGRAM Program;
-} XDP_PROGRAM_OBJECT;
+static
+_Success_(return != FALSE)
+BOOLEAN
+XdpBytecodeLoad(
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _In_ XDP_PAYLOAD_LAYER Layer,
+    _In_ UINT32 Offset,
+    _In_ UINT32 Size,
+    _Out_ UINT32 *Value
+    )
+{
+    XDP_PROGRAM_PAYLOAD_CACHE Payload;
+    UINT32 LayerOffset;
+    UCHAR Data[sizeof(UINT32)];
 
-typedef struct _XDP_PROGRAM_WORKITEM {
-    XDP_BINDING_WORKITEM Bind;
-    XDP_HOOK_ID HookId;
-    UINT32 QueueId;
-    XDP_PROGRAM_OBJECT *ProgramObject;
+    if (!XdpGetPayloadLayer(Frame, FrameCache, Layer, &Payload, &LayerOffset) ||
+        !XdpReadPayload(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            &Payload, LayerOffset + Offset, Size, Data)) {
+        return FALSE;
+    }
 
-    KEVENT CompletionEvent;
-    NTSTATUS CompletionStatus;
-} XDP_PROGRAM_WORKITEM;
+    switch (Size) {
+    case sizeof(UINT8):
+        *Value = Data[0];
+        break;
+    case sizeof(UINT16):
+        *Value = RtlUshortByteSwap(*(UNALIGNED UINT16 *)Data);
+        break;
+    default:
+        ASSERT(Size == sizeof(UINT32));
+        *Value = RtlUlongByteSwap(*(UNALIGNED UINT32 *)Data);
+        break;
+    }
 
-static XDP_FILE_IRP_ROUTINE XdpIrpProgramClose;
-static XDP_FILE_DISPATCH XdpProgramFileDispatch = {
-    .Close = XdpIrpProgramClose,
-};
+    return TRUE;
+}
 
+//
+// Interprets a bytecode program verified by XdpProgramVerifyBytecode, which
+// guarantees every instruction is well formed, every jump lands on a later
+// instruction, and the last instruction returns.
+//
 static
-VOID
-XdpProgramTraceObject(
-    _In_ CONST XDP_PROGRAM_OBJECT *ProgramObject
+BOOLEAN
+XdpBytecodeMatch(
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _In_ CONST XDP_PROGRAM_BYTECODE *Bytecode
     )
 {
-    TraceInfo(
-        TRACE_CORE, "Program=%p CreatedByPid=%Iu Flags=0x%x",
-        ProgramObject, ProgramObject->CreatedByPid, ProgramObject->Flags.Value);
+    UINT32 A = 0;
+    UINT32 X = 0;
+    UINT32 Size;
+    UINT32 Offset;
+    BOOLEAN Indexed;
 
-    for (UINT32 i = 0; i < ProgramObject->Program.RuleCount; i++) {
-        CONST XDP_RULE *Rule = &ProgramObject->Program.Rules[i];
+    for (UINT32 Pc = 0;; Pc++) {
+        CONST XDP_BYTECODE_INSTRUCTION *Instruction = &Bytecode->Instructions[Pc];
 
-        switch (Rule->Match) {
-        case XDP_MATCH_ALL:
-            TraceInfo(TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_ALL", ProgramObject, i);
+        ASSERT(Pc < Bytecode->InstructionCount);
+
+        switch (Instruction->Opcode) {
+        case XDP_BYTECODE_OP_RETURN:
+            return Instruction->Immediate != 0;
+
+        case XDP_BYTECODE_OP_LOAD_IMMEDIATE:
+            A = Instruction->Immediate;
             break;
 
-        case XDP_MATCH_UDP:
-            TraceInfo(TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_UDP", ProgramObject, i);
+        case XDP_BYTECODE_OP_LOAD_8:
+        case XDP_BYTECODE_OP_LOAD_16:
+        case XDP_BYTECODE_OP_LOAD_32:
+        case XDP_BYTECODE_OP_LOAD_INDEXED_8:
+        case XDP_BYTECODE_OP_LOAD_INDEXED_16:
+        case XDP_BYTECODE_OP_LOAD_INDEXED_32:
+            XdpBytecodeIsLoad(Instruction->Opcode, &Size, &Indexed);
+            Offset = Instruction->Immediate;
+
+            //
+            // The verifier limits load offsets to 16 bits. Limit the index
+            // likewise, so the sum cannot overflow.
+            //
+            if (Indexed) {
+                if (X > MAXUINT16) {
+                    return FALSE;
+                }
+                Offset += X;
+            }
+
+            if (!XdpBytecodeLoad(
+                    Frame, FragmentRing, FragmentExtension, FragmentIndex,
+                    VirtualAddressExtension, FrameCache, Instruction->Layer, Offset, Size, &A)) {
+                return FALSE;
+            }
             break;
 
-        case XDP_MATCH_UDP_DST:
-            TraceInfo(
-                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_UDP_DST Port=%u",
-                ProgramObject, i, ntohs(Rule->Pattern.Port));
+        case XDP_BYTECODE_OP_AND:
+            A &= Instruction->Immediate;
             break;
 
-        case XDP_MATCH_IPV4_DST_MASK:
-            TraceInfo(
-                TRACE_CORE,
-                "Program=%p Rule[%u]=XDP_MATCH_IPV4_DST_MASK Ip=%!IPADDR! Mask=%!IPADDR!",
-                ProgramObject, i, Rule->Pattern.IpMask.Address.Ipv4.s_addr,
-                Rule->Pattern.IpMask.Mask.Ipv4.s_addr);
+        case XDP_BYTECODE_OP_OR:
+            A |= Instruction->Immediate;
             break;
 
-        case XDP_MATCH_IPV6_DST_MASK:
-            TraceInfo(
-                TRACE_CORE,
-                "Program=%p Rule[%u]=XDP_MATCH_IPV6_DST_MASK Ip=%!IPV6ADDR! Mask=%!IPV6ADDR!",
-                ProgramObject, i, Rule->Pattern.IpMask.Address.Ipv6.u.Byte,
-                Rule->Pattern.IpMask.Mask.Ipv6.u.Byte);
+        case XDP_BYTECODE_OP_LEFT_SHIFT:
+            A <<= Instruction->Immediate;
             break;
 
-        case XDP_MATCH_QUIC_FLOW_SRC_CID:
-            TraceInfo(
-                TRACE_CORE,
-                "Program=%p Rule[%u]=XDP_MATCH_QUIC_FLOW_SRC_CID "
-                "Port=%u CidOffset=%u CidLength=%u CidData=%!HEXDUMP!",
-                ProgramObject, i, ntohs(Rule->Pattern.QuicFlow.UdpPort),
-                Rule->Pattern.QuicFlow.CidOffset, Rule->Pattern.QuicFlow.CidLength,
-                WppHexDump(Rule->Pattern.QuicFlow.CidData, Rule->Pattern.QuicFlow.CidLength));
+        case XDP_BYTECODE_OP_RIGHT_SHIFT:
+            A >>= Instruction->Immediate;
             break;
 
-        case XDP_MATCH_QUIC_FLOW_DST_CID:
-            TraceInfo(
-                TRACE_CORE,
-                "Program=%p Rule[%u]=XDP_MATCH_QUIC_FLOW_DST_CID "
-                "Port=%u CidOffset=%u CidLength=%u CidData=%!HEXDUMP!",
-                ProgramObject, i, ntohs(Rule->Pattern.QuicFlow.UdpPort),
-                Rule->Pattern.QuicFlow.CidOffset, Rule->Pattern.QuicFlow.CidLength,
-                WppHexDump(Rule->Pattern.QuicFlow.CidData, Rule->Pattern.QuicFlow.CidLength));
+        case XDP_BYTECODE_OP_ADD:
+            A += Instruction->Immediate;
             break;
 
-        case XDP_MATCH_IPV4_UDP_TUPLE:
-            TraceInfo(
-                TRACE_CORE,
-                "Program=%p Rule[%u]=XDP_MATCH_IPV4_UDP_TUPLE "
-                "Source=%!IPADDR!:%u Destination=%!IPADDR!:%u",
-                ProgramObject, i, Rule->Pattern.Tuple.SourceAddress.Ipv4.s_addr,
-                ntohs(Rule->Pattern.Tuple.SourcePort),
-                Rule->Pattern.Tuple.DestinationAddress.Ipv4.s_addr,
-                ntohs(Rule->Pattern.Tuple.DestinationPort));
+        case XDP_BYTECODE_OP_MOVE_TO_INDEX:
+            X = A;
             break;
 
-        case XDP_MATCH_IPV6_UDP_TUPLE:
-            TraceInfo(
-                TRACE_CORE,
-                "Program=%p Rule[%u]=XDP_MATCH_IPV6_UDP_TUPLE "
-                "Source=[%!IPV6ADDR!]:%u Destination=[%!IPV6ADDR!]:%u",
-                ProgramObject, i, Rule->Pattern.Tuple.SourceAddress.Ipv6.u.Byte,
-                ntohs(Rule->Pattern.Tuple.SourcePort),
-                Rule->Pattern.Tuple.DestinationAddress.Ipv6.u.Byte,
-                ntohs(Rule->Pattern.Tuple.DestinationPort));
+        case XDP_BYTECODE_OP_JUMP:
+            Pc += Instruction->JumpTrue;
             break;
 
-        case XDP_MATCH_UDP_PORT_SET:
-            TraceInfo(
-                TRACE_CORE,
-                "Program=%p Rule[%u]=XDP_MATCH_UDP_PORT_SET PortSet=?",
-                ProgramObject, i);
+        case XDP_BYTECODE_OP_JUMP_EQUAL:
+            Pc += (A == Instruction->Immediate) ? Instruction->JumpTrue : Instruction->JumpFalse;
             break;
 
-        case XDP_MATCH_IPV4_UDP_PORT_SET:
-            TraceInfo(
-                TRACE_CORE,
-                "Program=%p Rule[%u]=XDP_MATCH_IPV4_UDP_PORT_SET "
-                "Destination=%!IPADDR! PortSet=?",
-                ProgramObject, i, Rule->Pattern.IpPortSet.Address.Ipv4.s_addr);
+        case XDP_BYTECODE_OP_JUMP_GREATER:
+            Pc += (A > Instruction->Immediate) ? Instruction->JumpTrue : Instruction->JumpFalse;
             break;
 
-        case XDP_MATCH_IPV6_UDP_PORT_SET:
-            TraceInfo(
-                TRACE_CORE,
-                "Program=%p Rule[%u]=XDP_MATCH_IPV6_UDP_PORT_SET "
-                "Destination=%!IPV6ADDR! PortSet=?",
-                ProgramObject, i, Rule->Pattern.IpPortSet.Address.Ipv6.u.Byte);
+        case XDP_BYTECODE_OP_JUMP_GREATER_EQUAL:
+            Pc += (A >= Instruction->Immediate) ? Instruction->JumpTrue : Instruction->JumpFalse;
+            break;
+
+        case XDP_BYTECODE_OP_JUMP_SET:
+            Pc +=
+                (A & Instruction->Immediate) != 0 ?
+                    Instruction->JumpTrue : Instruction->JumpFalse;
             break;
 
         default:
             ASSERT(FALSE);
-            break;
+            return FALSE;
         }
+    }
+}
 
-        switch (Rule->Action) {
-        case XDP_PROGRAM_ACTION_DROP:
-            TraceInfo(
-                TRACE_CORE, "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_DROP",
-                ProgramObject, i);
+static
+BOOLEAN
+XdpTestBit(
+    _In_ CONST UINT8 *BitMap,
+    _In_ UINT32 Index
+    )
+{
+    return (ReadUCharNoFence(&BitMap[Index >> 3]) >> (Index & 0x7)) & 0x1;
+}
+
+static
+BOOLEAN
+XdpGetMapKeyField(
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _In_ XDP_MAP_KEY_FIELD KeyField,
+    _Out_ CONST UCHAR **Field,
+    _Out_ UINT32 *FieldSize
+    )
+{
+    switch (KeyField) {
+    case XDP_MAP_KEY_FIELD_IPV4_SOURCE:
+    case XDP_MAP_KEY_FIELD_IPV4_DESTINATION:
+        if (!FrameCache->Ip4Valid) {
+            return FALSE;
+        }
+        *Field =
+            (KeyField == XDP_MAP_KEY_FIELD_IPV4_SOURCE) ?
+                (CONST UCHAR *)&FrameCache->Ip4Hdr->SourceAddress :
+                (CONST UCHAR *)&FrameCache->Ip4Hdr->DestinationAddress;
+        *FieldSize = sizeof(IN_ADDR);
+        return TRUE;
+
+    case XDP_MAP_KEY_FIELD_IPV6_SOURCE:
+    case XDP_MAP_KEY_FIELD_IPV6_DESTINATION:
+        if (!FrameCache->Ip6Valid) {
+            return FALSE;
+        }
+        *Field =
+            (KeyField == XDP_MAP_KEY_FIELD_IPV6_SOURCE) ?
+                (CONST UCHAR *)&FrameCache->Ip6Hdr->SourceAddress :
+                (CONST UCHAR *)&FrameCache->Ip6Hdr->DestinationAddress;
+        *FieldSize = sizeof(IN6_ADDR);
+        return TRUE;
+
+    case XDP_MAP_KEY_FIELD_UDP_SOURCE:
+    case XDP_MAP_KEY_FIELD_UDP_DESTINATION:
+        if (!FrameCache->UdpValid) {
+            return FALSE;
+        }
+        *Field =
+            (KeyField == XDP_MAP_KEY_FIELD_UDP_SOURCE) ?
+                (CONST UCHAR *)&FrameCache->UdpHdr->uh_sport :
+                (CONST UCHAR *)&FrameCache->UdpHdr->uh_dport;
+        *FieldSize = sizeof(UINT16);
+        return TRUE;
+
+    case XDP_MAP_KEY_FIELD_TCP_SOURCE:
+    case XDP_MAP_KEY_FIELD_TCP_DESTINATION:
+        if (!FrameCache->TcpValid) {
+            return FALSE;
+        }
+        *Field =
+            (KeyField == XDP_MAP_KEY_FIELD_TCP_SOURCE) ?
+                (CONST UCHAR *)&FrameCache->TcpHdr->th_sport :
+                (CONST UCHAR *)&FrameCache->TcpHdr->th_dport;
+        *FieldSize = sizeof(UINT16);
+        return TRUE;
+
+    default:
+        ASSERT(FALSE);
+        return FALSE;
+    }
+}
+
+static
+BOOLEAN
+XdpMatchParsedRule(
+    _In_ XDP_PROGRAM *Program,
+    _In_ CONST XDP_RULE *Rule,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    BOOLEAN Matched = FALSE;
+
+    switch (Rule->Match) {
+    case XDP_MATCH_ALL:
+        Matched = TRUE;
+        break;
+
+    case XDP_MATCH_UDP:
+        if (FrameCache->UdpValid) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_UDP_DST:
+        if (FrameCache->UdpValid &&
+            FrameCache->UdpHdr->uh_dport == Rule->Pattern.Port) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV4_DST_MASK:
+        if (FrameCache->Ip4Valid &&
+            Ipv4PrefixMatch(
+                &FrameCache->Ip4Hdr->DestinationAddress, &Rule->Pattern.IpMask.Address.Ipv4,
+                &Rule->Pattern.IpMask.Mask.Ipv4)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV6_DST_MASK:
+        if (FrameCache->Ip6Valid &&
+            Ipv6PrefixMatch(
+                &FrameCache->Ip6Hdr->DestinationAddress,
+                &Rule->Pattern.IpMask.Address.Ipv6,
+                &Rule->Pattern.IpMask.Mask.Ipv6)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_QUIC_FLOW_DST_CID:
+        if (!FrameCache->UdpValid || !FrameCache->TransportPayloadValid ||
+            FrameCache->UdpHdr->uh_dport != Rule->Pattern.QuicFlow.UdpPort) {
+            break;
+        }
+
+        if (!FrameCache->QuicCached) {
+            XdpParseQuicHeader(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                &FrameCache->TransportPayload, &Program->FrameStorage, FrameCache);
+        }
+
+        if (FrameCache->QuicValid &&
+            QuicCidMatch(
+                Rule->Match,
+                FrameCache,
+                &Rule->Pattern.QuicFlow)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_QUIC_FLOW_DST_CID_TABLE:
+        if (!FrameCache->UdpValid || !FrameCache->TransportPayloadValid ||
+            FrameCache->UdpHdr->uh_dport != Rule->Pattern.QuicCidTable.UdpPort) {
             break;
+        }
+
+        if (!FrameCache->QuicCached) {
+            XdpParseQuicHeader(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                &FrameCache->TransportPayload, &Program->FrameStorage, FrameCache);
+        }
+
+        if (FrameCache->QuicValid) {
+            FrameCache->QuicCidTarget =
+                QuicCidTableLookup(FrameCache, &Rule->Pattern.QuicCidTable);
+            if (FrameCache->QuicCidTarget != NULL) {
+                Matched = TRUE;
+            }
+        }
+        break;
+
+    case XDP_MATCH_IPV4_UDP_TUPLE:
+    case XDP_MATCH_IPV6_UDP_TUPLE:
+        if (FrameCache->UdpValid &&
+            UdpTupleMatch(
+                Rule->Match,
+                FrameCache,
+                &Rule->Pattern.Tuple)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_UDP_PORT_SET:
+        if (FrameCache->UdpValid &&
+            XdpTestBit(Rule->Pattern.PortSet.PortSet, FrameCache->UdpHdr->uh_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV4_UDP_PORT_SET:
+        if (FrameCache->Ip4Valid &&
+            IN4_ADDR_EQUAL(
+                &FrameCache->Ip4Hdr->DestinationAddress,
+                &Rule->Pattern.IpPortSet.Address.Ipv4) &&
+            FrameCache->UdpValid &&
+            XdpTestBit(Rule->Pattern.IpPortSet.PortSet.PortSet, FrameCache->UdpHdr->uh_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV6_UDP_PORT_SET:
+        if (FrameCache->Ip6Valid &&
+            IN6_ADDR_EQUAL(
+                &FrameCache->Ip6Hdr->DestinationAddress,
+                &Rule->Pattern.IpPortSet.Address.Ipv6) &&
+            FrameCache->UdpValid &&
+            XdpTestBit(Rule->Pattern.IpPortSet.PortSet.PortSet, FrameCache->UdpHdr->uh_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_TCP:
+        if (FrameCache->TcpValid) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_TCP_DST:
+        if (FrameCache->TcpValid &&
+            FrameCache->TcpHdr->th_dport == Rule->Pattern.Port) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV4_TCP_TUPLE:
+    case XDP_MATCH_IPV6_TCP_TUPLE:
+        if (FrameCache->TcpValid &&
+            TcpTupleMatch(
+                Rule->Match,
+                FrameCache,
+                &Rule->Pattern.Tuple)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_TCP_PORT_SET:
+        if (FrameCache->TcpValid &&
+            XdpTestBit(Rule->Pattern.PortSet.PortSet, FrameCache->TcpHdr->th_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV4_TCP_PORT_SET:
+        if (FrameCache->Ip4Valid &&
+            IN4_ADDR_EQUAL(
+                &FrameCache->Ip4Hdr->DestinationAddress,
+                &Rule->Pattern.IpPortSet.Address.Ipv4) &&
+            FrameCache->TcpValid &&
+            XdpTestBit(Rule->Pattern.IpPortSet.PortSet.PortSet, FrameCache->TcpHdr->th_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV6_TCP_PORT_SET:
+        if (FrameCache->Ip6Valid &&
+            IN6_ADDR_EQUAL(
+                &FrameCache->Ip6Hdr->DestinationAddress,
+                &Rule->Pattern.IpPortSet.Address.Ipv6) &&
+            FrameCache->TcpValid &&
+            XdpTestBit(Rule->Pattern.IpPortSet.PortSet.PortSet, FrameCache->TcpHdr->th_dport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_TCP_FLAGS:
+        if (FrameCache->TcpValid &&
+            (FrameCache->TcpHdr->th_flags & Rule->Pattern.TcpFlags.Mask) ==
+                Rule->Pattern.TcpFlags.Flags) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV4_SRC_MASK:
+        if (FrameCache->Ip4Valid &&
+            Ipv4PrefixMatch(
+                &FrameCache->Ip4Hdr->SourceAddress, &Rule->Pattern.IpMask.Address.Ipv4,
+                &Rule->Pattern.IpMask.Mask.Ipv4)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV6_SRC_MASK:
+        if (FrameCache->Ip6Valid &&
+            Ipv6PrefixMatch(
+                &FrameCache->Ip6Hdr->SourceAddress,
+                &Rule->Pattern.IpMask.Address.Ipv6,
+                &Rule->Pattern.IpMask.Mask.Ipv6)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_UDP_SRC:
+        if (FrameCache->UdpValid &&
+            FrameCache->UdpHdr->uh_sport == Rule->Pattern.Port) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_TCP_SRC:
+        if (FrameCache->TcpValid &&
+            FrameCache->TcpHdr->th_sport == Rule->Pattern.Port) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_UDP_SRC_PORT_SET:
+        if (FrameCache->UdpValid &&
+            XdpTestBit(Rule->Pattern.PortSet.PortSet, FrameCache->UdpHdr->uh_sport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_TCP_SRC_PORT_SET:
+        if (FrameCache->TcpValid &&
+            XdpTestBit(Rule->Pattern.PortSet.PortSet, FrameCache->TcpHdr->th_sport)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_MAP:
+    {
+        CONST UCHAR *Field;
+        UINT32 FieldSize;
+
+        if (XdpGetMapKeyField(FrameCache, Rule->Pattern.Map.KeyField, &Field, &FieldSize) &&
+            XdpMapContainsField(Rule->Pattern.Map.Map, Field, FieldSize)) {
+            Matched = TRUE;
+        }
+        break;
+    }
+
+    case XDP_MATCH_IPV4_ADDRESS_SET:
+        if (FrameCache->Ip4Valid &&
+            XdpProgramAddressSetContains(
+                Rule->Pattern.IpAddressSet.Reserved,
+                (Rule->Pattern.IpAddressSet.Flags & XDP_IP_ADDRESS_SET_FLAG_SOURCE) ?
+                    (CONST UCHAR *)&FrameCache->Ip4Hdr->SourceAddress :
+                    (CONST UCHAR *)&FrameCache->Ip4Hdr->DestinationAddress)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_IPV6_ADDRESS_SET:
+        if (FrameCache->Ip6Valid &&
+            XdpProgramAddressSetContains(
+                Rule->Pattern.IpAddressSet.Reserved,
+                (Rule->Pattern.IpAddressSet.Flags & XDP_IP_ADDRESS_SET_FLAG_SOURCE) ?
+                    (CONST UCHAR *)&FrameCache->Ip6Hdr->SourceAddress :
+                    (CONST UCHAR *)&FrameCache->Ip6Hdr->DestinationAddress)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_PAYLOAD:
+        if (XdpPayloadMatch(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, &Rule->Pattern.Payload)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_BYTECODE:
+        if (XdpBytecodeMatch(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, Rule->Pattern.Bytecode.Reserved)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_VLAN_ID:
+        if (XdpVlanMatch(FrameCache, &Rule->Pattern.Vlan)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_TUNNEL_VNI:
+        if (XdpTunnelMatch(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                &Rule->Pattern.Tunnel, &Program->FrameStorage, FrameCache)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_TUNNEL_IPV4_TUPLE:
+    case XDP_MATCH_TUNNEL_IPV6_TUPLE:
+        if (XdpTunnelMatch(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                &Rule->Pattern.TunnelTuple.Tunnel, &Program->FrameStorage, FrameCache) &&
+            XdpTunnelTupleMatch(Rule->Match, FrameCache, &Rule->Pattern.TunnelTuple)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_ETH_DST:
+        if (FrameCache->EthValid &&
+            XdpProgramIsAddressEqual(
+                (CONST UCHAR *)&FrameCache->EthHdr->Destination,
+                Rule->Pattern.MacAddress.Address, sizeof(Rule->Pattern.MacAddress))) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_ETH_DST_SET:
+        if (FrameCache->EthValid &&
+            XdpProgramAddressSetContains(
+                Rule->Pattern.MacAddressSet.Reserved,
+                (CONST UCHAR *)&FrameCache->EthHdr->Destination)) {
+            Matched = TRUE;
+        }
+        break;
+
+    case XDP_MATCH_ETHERTYPE:
+        if (FrameCache->VlanValid && FrameCache->EthType == Rule->Pattern.EtherType) {
+            Matched = TRUE;
+        }
+        break;
+
+    default:
+        ASSERT(FALSE);
+        break;
+    }
+
+    return Matched;
+}
+
+static
+BOOLEAN
+XdpMatchRule(
+    _In_ XDP_PROGRAM *Program,
+    _In_ CONST XDP_RULE *Rule,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    //
+    // Parse the Ethernet through transport headers once, when the first rule
+    // that inspects them is evaluated.
+    //
+    if (Rule->Match != XDP_MATCH_ALL && !FrameCache->UdpCached) {
+        XdpParseFrame(
+            Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+            FrameCache, &Program->FrameStorage);
+    }
+
+    return
+        XdpMatchParsedRule(
+            Program, Rule, Frame, FragmentRing, FragmentExtension, FragmentIndex,
+            VirtualAddressExtension, FrameCache);
+}
+
+static
+UINT32
+XdpProgramHashMix(
+    _In_ UINT32 Hash,
+    _In_ UINT32 Value
+    )
+{
+    Value *= 0xcc9e2d51;
+    Value = RotateLeft32(Value, 15);
+    Value *= 0x1b873593;
+
+    Hash ^= Value;
+    Hash = RotateLeft32(Hash, 13);
+    return Hash * 5 + 0xe6546b64;
+}
+
+static
+UINT32
+XdpProgramHashFinalize(
+    _In_ UINT32 Hash
+    )
+{
+    Hash ^= Hash >> 16;
+    Hash *= 0x85ebca6b;
+    Hash ^= Hash >> 13;
+    Hash *= 0xc2b2ae35;
+    Hash ^= Hash >> 16;
+    return Hash;
+}
+
+static
+UINT32
+XdpProgramHashPort(
+    _In_ UINT16 Port
+    )
+{
+    return XdpProgramHashFinalize(XdpProgramHashMix(0, Port));
+}
+
+static
+UINT32
+XdpProgramHashQuicCid(
+    _In_reads_bytes_(CidLength) CONST UINT8 *Cid,
+    _In_ UINT32 CidLength
+    )
+{
+    UINT32 Hash = CidLength;
+
+    for (UINT32 Offset = 0; Offset < CidLength; Offset += sizeof(UINT32)) {
+        UINT32 Value = 0;
+
+        RtlCopyMemory(&Value, &Cid[Offset], min(sizeof(Value), CidLength - Offset));
+        Hash = XdpProgramHashMix(Hash, Value);
+    }
+
+    return XdpProgramHashFinalize(Hash);
+}
+
+static
+UINT32
+XdpProgramHashIpv4Tuple(
+    _In_ CONST IN_ADDR *SourceAddress,
+    _In_ CONST IN_ADDR *DestinationAddress,
+    _In_ UINT16 SourcePort,
+    _In_ UINT16 DestinationPort
+    )
+{
+    UINT32 Hash = 0;
+
+    Hash = XdpProgramHashMix(Hash, SourceAddress->s_addr);
+    Hash = XdpProgramHashMix(Hash, DestinationAddress->s_addr);
+    Hash = XdpProgramHashMix(Hash, ((UINT32)SourcePort << 16) | DestinationPort);
+    return XdpProgramHashFinalize(Hash);
+}
+
+static
+UINT32
+XdpProgramHashIpv6Tuple(
+    _In_ CONST IN6_ADDR *SourceAddress,
+    _In_ CONST IN6_ADDR *DestinationAddress,
+    _In_ UINT16 SourcePort,
+    _In_ UINT16 DestinationPort
+    )
+{
+    CONST UINT32 *Source32 = (CONST UINT32 *)SourceAddress;
+    CONST UINT32 *Destination32 = (CONST UINT32 *)DestinationAddress;
+    UINT32 Hash = 0;
+
+    for (UINT32 i = 0; i < sizeof(IN6_ADDR) / sizeof(UINT32); i++) {
+        Hash = XdpProgramHashMix(Hash, Source32[i]);
+        Hash = XdpProgramHashMix(Hash, Destination32[i]);
+    }
+    Hash = XdpProgramHashMix(Hash, ((UINT32)SourcePort << 16) | DestinationPort);
+    return XdpProgramHashFinalize(Hash);
+}
+
+static
+UINT32
+XdpProgramHashAddress(
+    _In_reads_bytes_(AddressLength) CONST UCHAR *Address,
+    _In_ UINT32 AddressLength
+    )
+{
+    UINT32 Hash = 0;
+    UINT32 Offset;
+
+    for (Offset = 0; Offset + sizeof(UINT32) <= AddressLength; Offset += sizeof(UINT32)) {
+        Hash = XdpProgramHashMix(Hash, *(UNALIGNED CONST UINT32 *)&Address[Offset]);
+    }
+
+    if (Offset < AddressLength) {
+        //
+        // Ethernet addresses end with a 16-bit word.
+        //
+        ASSERT(AddressLength - Offset == sizeof(UINT16));
+        Hash = XdpProgramHashMix(Hash, *(UNALIGNED CONST UINT16 *)&Address[Offset]);
+    }
+
+    return XdpProgramHashFinalize(Hash);
+}
+
+static
+UINT64
+XdpGetFrameLength(
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex
+    )
+{
+    UINT64 FrameLength = Frame->Buffer.DataLength;
+
+    if (FragmentRing != NULL) {
+        UINT32 FragmentCount =
+            XdpGetFragmentExtension(Frame, FragmentExtension)->FragmentBufferCount;
+
+        for (UINT32 i = 0; i < FragmentCount; i++) {
+            XDP_BUFFER *Buffer =
+                XdpRingGetElement(FragmentRing, (FragmentIndex + i) & FragmentRing->Mask);
+            FrameLength += Buffer->DataLength;
+        }
+    }
+
+    return FrameLength;
+}
+
+static
+VOID
+XdpUpdateRuleStatistics(
+    _Inout_opt_ XDP_RULE_STATISTICS *Statistics,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex
+    )
+{
+    //
+    // Rules merged from shared programs without statistics have no counters.
+    //
+    if (Statistics == NULL) {
+        return;
+    }
+
+    Statistics->FramesMatched++;
+    Statistics->BytesMatched +=
+        XdpGetFrameLength(Frame, FragmentRing, FragmentExtension, FragmentIndex);
+}
+
+static
+XDP_RULE_ACTION
+XdpRateLimit(
+    _In_ CONST XDP_RATE_LIMIT_PARAMS *Params,
+    _In_ UINT64 FrameLength
+    )
+{
+    XDP_PROGRAM_RATE_LIMITER *Limiter = Params->Reserved;
+    UINT64 CurrentTime = KeQueryInterruptTime();
+    UINT64 Elapsed = CurrentTime - Limiter->UpdateTime;
+    UINT64 FrameCost = XDP_PROGRAM_RATE_LIMIT_SCALE;
+    UINT64 ByteCost = FrameLength * XDP_PROGRAM_RATE_LIMIT_SCALE;
+
+    Limiter->UpdateTime = CurrentTime;
+    Limiter->FrameTokens =
+        min(Limiter->FrameTokens +
+                Params->FramesPerSecond * min(Elapsed, Limiter->FrameFillTime),
+            Limiter->FrameCapacity);
+    Limiter->ByteTokens =
+        min(Limiter->ByteTokens + Params->BytesPerSecond * min(Elapsed, Limiter->ByteFillTime),
+            Limiter->ByteCapacity);
+
+    if ((Params->FramesPerSecond > 0 && Limiter->FrameTokens < FrameCost) ||
+        (Params->BytesPerSecond > 0 && Limiter->ByteTokens < ByteCost)) {
+        return Params->ExceedAction;
+    }
+
+    if (Params->FramesPerSecond > 0) {
+        Limiter->FrameTokens -= FrameCost;
+    }
+
+    if (Params->BytesPerSecond > 0) {
+        Limiter->ByteTokens -= ByteCost;
+    }
+
+    return Params->ConformAction;
+}
+
+static
+BOOLEAN
+XdpSample(
+    _In_ CONST XDP_SAMPLE_PARAMS *Params
+    )
+{
+    XDP_PROGRAM_SAMPLER *Sampler = Params->Reserved;
+
+    if (--Sampler->Countdown > 0) {
+        return FALSE;
+    }
+
+    Sampler->Countdown = Params->Interval;
+    return TRUE;
+}
+
+static
+UINT32
+XdpProgramHashFlow(
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    UINT16 SourcePort = 0;
+    UINT16 DestinationPort = 0;
+
+    //
+    // Later fragments carry no ports, so they hash as their first fragment.
+    //
+    if (FrameCache->FragmentFlowHashValid) {
+        return FrameCache->FragmentFlowHash;
+    }
+
+    if (FrameCache->UdpValid) {
+        SourcePort = FrameCache->UdpHdr->uh_sport;
+        DestinationPort = FrameCache->UdpHdr->uh_dport;
+    } else if (FrameCache->TcpValid) {
+        SourcePort = FrameCache->TcpHdr->th_sport;
+        DestinationPort = FrameCache->TcpHdr->th_dport;
+    }
+
+    if (FrameCache->Ip4Valid) {
+        return
+            XdpProgramHashIpv4Tuple(
+                &FrameCache->Ip4Hdr->SourceAddress, &FrameCache->Ip4Hdr->DestinationAddress,
+                SourcePort, DestinationPort);
+    } else if (FrameCache->Ip6Valid) {
+        return
+            XdpProgramHashIpv6Tuple(
+                &FrameCache->Ip6Hdr->SourceAddress, &FrameCache->Ip6Hdr->DestinationAddress,
+                SourcePort, DestinationPort);
+    } else {
+        return 0;
+    }
+}
+
+static
+VOID
+XdpRedirectFrame(
+    _In_ XDP_PROGRAM *Program,
+    _In_ CONST XDP_REDIRECT_PARAMS *Redirect,
+    _In_ XDP_REDIRECT_CONTEXT *RedirectContext,
+    _In_ XDP_FRAME *Frame,
+    _In_ UINT32 FrameIndex,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    XDP_REDIRECT_TARGET_TYPE TargetType = Redirect->TargetType;
+    VOID *Target = Redirect->Target;
+
+    if (TargetType == XDP_REDIRECT_TARGET_TYPE_XSK_GROUP) {
+        CONST XDP_PROGRAM_XSK_GROUP *Group = Target;
+        UINT32 Hash;
+
+        if (!FrameCache->UdpCached) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache, &Program->FrameStorage);
+        }
+
+        Hash = XdpProgramHashFlow(FrameCache);
+        Target = Group->Sockets[Group->Lookup[Hash % XDP_PROGRAM_XSK_GROUP_LOOKUP_SIZE]];
+        TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    } else if (TargetType == XDP_REDIRECT_TARGET_TYPE_QUIC_CID_TABLE) {
+        ASSERT(FrameCache->QuicCidTarget != NULL);
+        Target = FrameCache->QuicCidTarget;
+        TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    }
+
+    XdpRedirect(RedirectContext, FrameIndex, FragmentIndex, TargetType, Target);
+}
+
+static
+BOOLEAN
+XdpL2Fwd(
+    _In_ CONST XDP_L2FWD_PARAMS *Params,
+    _In_ XDP_FRAME *Frame,
+    _In_ XDP_EXTENSION *VirtualAddressExtension
+    )
+{
+    XDP_BUFFER *Buffer = &Frame->Buffer;
+    ETHERNET_HEADER *EthHdr;
+    UCHAR Destination[sizeof(EthHdr->Destination)];
+
+    if (!(Params->Flags & XDP_L2FWD_FLAG_SWAP_MAC_ADDRESSES)) {
+        return TRUE;
+    }
+
+    if (Buffer->DataLength < sizeof(*EthHdr)) {
+        return FALSE;
+    }
+
+    //
+    // Rewrite the addresses in place. The cached frame headers may point to a
+    // copy of a discontiguous header, so they are not used here.
+    //
+    EthHdr =
+        (ETHERNET_HEADER *)
+            (XdpGetVirtualAddressExtension(Buffer, VirtualAddressExtension)->VirtualAddress +
+                Buffer->DataOffset);
+    RtlCopyMemory(Destination, &EthHdr->Destination, sizeof(Destination));
+    RtlCopyMemory(&EthHdr->Destination, &EthHdr->Source, sizeof(EthHdr->Destination));
+    RtlCopyMemory(&EthHdr->Source, Destination, sizeof(EthHdr->Source));
+
+    return TRUE;
+}
+
+static
+XDP_RX_ACTION
+XdpApplyRuleAction(
+    _In_ XDP_PROGRAM *Program,
+    _In_ CONST XDP_RULE *Rule,
+    _In_ XDP_REDIRECT_CONTEXT *RedirectContext,
+    _In_ XDP_FRAME *Frame,
+    _In_ UINT32 FrameIndex,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    XDP_RX_ACTION Action = XDP_RX_ACTION_PASS;
+    XDP_RULE_ACTION RuleAction = Rule->Action;
+
+    if (RuleAction == XDP_PROGRAM_ACTION_RATE_LIMIT) {
+        RuleAction =
+            XdpRateLimit(
+                &Rule->RateLimit,
+                XdpGetFrameLength(Frame, FragmentRing, FragmentExtension, FragmentIndex));
+    }
+
+    switch (RuleAction) {
+
+    case XDP_PROGRAM_ACTION_REDIRECT:
+        XdpRedirectFrame(
+            Program, &Rule->Redirect, RedirectContext, Frame, FrameIndex, FragmentRing,
+            FragmentExtension, FragmentIndex, VirtualAddressExtension, FrameCache);
+
+        Action = XDP_RX_ACTION_DROP;
+        break;
+
+    case XDP_PROGRAM_ACTION_SAMPLE:
+        //
+        // Redirected frames are copied into the target when the RX queue
+        // flushes, before any frame is returned to the interface, so the frame
+        // can also be allowed to continue.
+        //
+        if (XdpSample(&Rule->Sample)) {
+            XdpRedirectFrame(
+                Program, &Rule->Sample.Redirect, RedirectContext, Frame, FrameIndex,
+                FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                FrameCache);
+        }
+
+        Action = XDP_RX_ACTION_PASS;
+        break;
+
+    case XDP_PROGRAM_ACTION_L2FWD:
+        Action =
+            XdpL2Fwd(&Rule->L2Fwd, Frame, VirtualAddressExtension) ?
+                XDP_RX_ACTION_TX : XDP_RX_ACTION_DROP;
+        break;
+
+    case XDP_PROGRAM_ACTION_DROP:
+        Action = XDP_RX_ACTION_DROP;
+        break;
+
+    case XDP_PROGRAM_ACTION_PASS:
+        Action = XDP_RX_ACTION_PASS;
+        break;
+
+    default:
+        ASSERT(FALSE);
+        break;
+    }
+
+    return Action;
+}
+
+static
+BOOLEAN
+XdpProgramHashKeyMatch(
+    _In_ CONST XDP_RULE *Rule,
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    switch (Rule->Match) {
+    case XDP_MATCH_UDP_DST:
+        ASSERT(FrameCache->UdpValid);
+        return FrameCache->UdpHdr->uh_dport == Rule->Pattern.Port;
+
+    case XDP_MATCH_IPV4_UDP_TUPLE:
+    case XDP_MATCH_IPV6_UDP_TUPLE:
+        ASSERT(FrameCache->UdpValid);
+        return UdpTupleMatch(Rule->Match, FrameCache, &Rule->Pattern.Tuple);
+
+    case XDP_MATCH_TCP_DST:
+        ASSERT(FrameCache->TcpValid);
+        return FrameCache->TcpHdr->th_dport == Rule->Pattern.Port;
+
+    case XDP_MATCH_IPV4_TCP_TUPLE:
+    case XDP_MATCH_IPV6_TCP_TUPLE:
+        ASSERT(FrameCache->TcpValid);
+        return TcpTupleMatch(Rule->Match, FrameCache, &Rule->Pattern.Tuple);
+
+    case XDP_MATCH_UDP_SRC:
+        ASSERT(FrameCache->UdpValid);
+        return FrameCache->UdpHdr->uh_sport == Rule->Pattern.Port;
+
+    case XDP_MATCH_TCP_SRC:
+        ASSERT(FrameCache->TcpValid);
+        return FrameCache->TcpHdr->th_sport == Rule->Pattern.Port;
+
+    default:
+        ASSERT(FALSE);
+        return FALSE;
+    }
+}
+
+static
+UINT32
+XdpProgramHashLookup(
+    _In_ CONST XDP_PROGRAM_HASH_TABLE *Table,
+    _In_ CONST XDP_RULE *Rules,
+    _In_ UINT32 Hash,
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    UINT32 Bucket = Hash & Table->BucketMask;
+
+    while (Table->Buckets[Bucket].RuleIndex != XDP_PROGRAM_RULE_INDEX_NONE) {
+        CONST XDP_PROGRAM_HASH_ENTRY *Entry = &Table->Buckets[Bucket];
+
+        if (Entry->Hash == Hash && XdpProgramHashKeyMatch(&Rules[Entry->RuleIndex], FrameCache)) {
+            return Entry->RuleIndex;
+        }
+
+        Bucket = (Bucket + 1) & Table->BucketMask;
+    }
+
+    return XDP_PROGRAM_RULE_INDEX_NONE;
+}
+
+static
+UINT32
+XdpProgramLpmGetBits(
+    _In_ CONST UINT8 *Address,
+    _In_ UINT32 BitOffset
+    )
+{
+    //
+    // Returns the 4 address bits starting at the given nibble-aligned offset.
+    //
+    ASSERT(BitOffset % XDP_PROGRAM_LPM_NODE_STRIDE == 0);
+    return (Address[BitOffset / 8] >> (4 - (BitOffset % 8))) & 0xF;
+}
+
+static
+UINT32
+XdpProgramLpmLookup(
+    _In_ CONST XDP_PROGRAM_LPM *Lpm,
+    _In_ CONST UINT8 *Address
+    )
+{
+    CONST XDP_PROGRAM_LPM_ENTRY *Entry;
+    UINT32 BestRuleIndex;
+    UINT32 BitOffset = XDP_PROGRAM_LPM_ROOT_STRIDE;
+
+    Entry = &Lpm->Root[((UINT32)Address[0] << 8) | Address[1]];
+    BestRuleIndex = Entry->RuleIndex;
+
+    while (Entry->Child != 0) {
+        Entry =
+            &Lpm->Nodes[
+                Entry->Child * XDP_PROGRAM_LPM_NODE_SIZE +
+                XdpProgramLpmGetBits(Address, BitOffset)];
+        BestRuleIndex = min(BestRuleIndex, Entry->RuleIndex);
+        BitOffset += XDP_PROGRAM_LPM_NODE_STRIDE;
+    }
+
+    return BestRuleIndex;
+}
+
+static
+XDP_PROGRAM_FRAME_CLASS
+XdpProgramGetFrameClass(
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    if (FrameCache->Ip4Valid) {
+        return
+            FrameCache->UdpValid ? XDP_PROGRAM_FRAME_CLASS_IPV4_UDP :
+            FrameCache->TcpValid ? XDP_PROGRAM_FRAME_CLASS_IPV4_TCP :
+                XDP_PROGRAM_FRAME_CLASS_IPV4;
+    } else if (FrameCache->Ip6Valid) {
+        return
+            FrameCache->UdpValid ? XDP_PROGRAM_FRAME_CLASS_IPV6_UDP :
+            FrameCache->TcpValid ? XDP_PROGRAM_FRAME_CLASS_IPV6_TCP :
+                XDP_PROGRAM_FRAME_CLASS_IPV6;
+    } else {
+        return XDP_PROGRAM_FRAME_CLASS_OTHER;
+    }
+}
+
+static
+UINT32
+XdpInspectTransportIndexes(
+    _In_ XDP_PROGRAM *Program,
+    _In_ CONST XDP_PROGRAM_HASH_TABLE *DstTable,
+    _In_ CONST XDP_PROGRAM_HASH_TABLE *SrcTable,
+    _In_ CONST XDP_PROGRAM_HASH_TABLE *Ipv4TupleTable,
+    _In_ CONST XDP_PROGRAM_HASH_TABLE *Ipv6TupleTable,
+    _In_ UINT16 SourcePort,
+    _In_ UINT16 DestinationPort,
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    UINT32 BestRuleIndex = XDP_PROGRAM_RULE_INDEX_NONE;
+    UINT32 RuleIndex;
+
+    if (DstTable->EntryCount > 0) {
+        RuleIndex =
+            XdpProgramHashLookup(
+                DstTable, Program->Rules, XdpProgramHashPort(DestinationPort), FrameCache);
+        BestRuleIndex = min(BestRuleIndex, RuleIndex);
+    }
+
+    if (SrcTable->EntryCount > 0) {
+        RuleIndex =
+            XdpProgramHashLookup(
+                SrcTable, Program->Rules, XdpProgramHashPort(SourcePort), FrameCache);
+        BestRuleIndex = min(BestRuleIndex, RuleIndex);
+    }
+
+    if (FrameCache->Ip4Valid && Ipv4TupleTable->EntryCount > 0) {
+        RuleIndex =
+            XdpProgramHashLookup(
+                Ipv4TupleTable, Program->Rules,
+                XdpProgramHashIpv4Tuple(
+                    &FrameCache->Ip4Hdr->SourceAddress, &FrameCache->Ip4Hdr->DestinationAddress,
+                    SourcePort, DestinationPort),
+                FrameCache);
+        BestRuleIndex = min(BestRuleIndex, RuleIndex);
+    } else if (FrameCache->Ip6Valid && Ipv6TupleTable->EntryCount > 0) {
+        RuleIndex =
+            XdpProgramHashLookup(
+                Ipv6TupleTable, Program->Rules,
+                XdpProgramHashIpv6Tuple(
+                    &FrameCache->Ip6Hdr->SourceAddress, &FrameCache->Ip6Hdr->DestinationAddress,
+                    SourcePort, DestinationPort),
+                FrameCache);
+        BestRuleIndex = min(BestRuleIndex, RuleIndex);
+    }
+
+    return BestRuleIndex;
+}
+
+static
+UINT32
+XdpInspectIndexes(
+    _In_ XDP_PROGRAM *Program,
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    CONST XDP_PROGRAM_COMPILED *Compiled = Program->Compiled;
+    UINT32 BestRuleIndex = XDP_PROGRAM_RULE_INDEX_NONE;
+    UINT32 RuleIndex;
+
+    //
+    // Find the lowest-indexed rule that matches the frame via the exact-match
+    // and prefix indexes. Each index yields at most one candidate per frame.
+    //
+
+    if (FrameCache->Ip4Valid) {
+        if (Compiled->Ipv4DstLpm.Root != NULL) {
+            RuleIndex =
+                XdpProgramLpmLookup(
+                    &Compiled->Ipv4DstLpm,
+                    (CONST UINT8 *)&FrameCache->Ip4Hdr->DestinationAddress);
+            BestRuleIndex = min(BestRuleIndex, RuleIndex);
+        }
+
+        if (Compiled->Ipv4SrcLpm.Root != NULL) {
+            RuleIndex =
+                XdpProgramLpmLookup(
+                    &Compiled->Ipv4SrcLpm, (CONST UINT8 *)&FrameCache->Ip4Hdr->SourceAddress);
+            BestRuleIndex = min(BestRuleIndex, RuleIndex);
+        }
+    } else if (FrameCache->Ip6Valid) {
+        if (Compiled->Ipv6DstLpm.Root != NULL) {
+            RuleIndex =
+                XdpProgramLpmLookup(
+                    &Compiled->Ipv6DstLpm,
+                    (CONST UINT8 *)&FrameCache->Ip6Hdr->DestinationAddress);
+            BestRuleIndex = min(BestRuleIndex, RuleIndex);
+        }
+
+        if (Compiled->Ipv6SrcLpm.Root != NULL) {
+            RuleIndex =
+                XdpProgramLpmLookup(
+                    &Compiled->Ipv6SrcLpm, (CONST UINT8 *)&FrameCache->Ip6Hdr->SourceAddress);
+            BestRuleIndex = min(BestRuleIndex, RuleIndex);
+        }
+    }
+
+    if (FrameCache->UdpValid) {
+        RuleIndex =
+            XdpInspectTransportIndexes(
+                Program, &Compiled->UdpDst, &Compiled->UdpSrc, &Compiled->Ipv4UdpTuple,
+                &Compiled->Ipv6UdpTuple, FrameCache->UdpHdr->uh_sport,
+                FrameCache->UdpHdr->uh_dport, FrameCache);
+        BestRuleIndex = min(BestRuleIndex, RuleIndex);
+    } else if (FrameCache->TcpValid) {
+        RuleIndex =
+            XdpInspectTransportIndexes(
+                Program, &Compiled->TcpDst, &Compiled->TcpSrc, &Compiled->Ipv4TcpTuple,
+                &Compiled->Ipv6TcpTuple, FrameCache->TcpHdr->th_sport,
+                FrameCache->TcpHdr->th_dport, FrameCache);
+        BestRuleIndex = min(BestRuleIndex, RuleIndex);
+    }
+
+    return BestRuleIndex;
+}
+
+static
+UINT32
+XdpInspectCompiledRules(
+    _In_ XDP_PROGRAM *Program,
+    _In_ XDP_PROGRAM_FRAME_CLASS FrameClass,
+    _In_ XDP_FRAME *Frame,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    CONST XDP_PROGRAM_COMPILED *Compiled = Program->Compiled;
+    CONST XDP_PROGRAM_RULE_SEQUENCE *Sequence;
+    UINT32 MatchedRuleIndex = XDP_PROGRAM_RULE_INDEX_NONE;
+
+    //
+    // Look up the indexed rules, then evaluate the remaining rules applicable
+    // to the frame's class in order until reaching the indexed candidate, if
+    // any. This yields the same result as evaluating every rule in order.
+    //
+    if (Compiled->IndexedRuleCount > 0) {
+        MatchedRuleIndex = XdpInspectIndexes(Program, FrameCache);
+    }
+
+    Sequence = &Compiled->Sequences[FrameClass];
+
+    for (UINT32 i = 0; i < Sequence->RuleCount; i++) {
+        UINT32 RuleIndex = Sequence->RuleIndexes[i];
+
+        if (RuleIndex >= MatchedRuleIndex) {
+            //
+            // Reordered sequences ascend only from one group of disjoint rules
+            // to the next, so skip ahead until no remaining rule can precede
+            // the indexed candidate.
+            //
+            if (Sequence->MinRuleIndexes == NULL ||
+                Sequence->MinRuleIndexes[i] >= MatchedRuleIndex) {
+                break;
+            }
+
+            continue;
+        }
+
+        if (XdpMatchParsedRule(
+                Program, &Program->Rules[RuleIndex], Frame, FragmentRing, FragmentExtension,
+                FragmentIndex, VirtualAddressExtension, FrameCache)) {
+            MatchedRuleIndex = RuleIndex;
+            break;
+        }
+    }
+
+    return MatchedRuleIndex;
+}
+
+static
+VOID
+XdpProgramGetFlowCacheKey(
+    _In_ XDP_PROGRAM_FRAME_CLASS FrameClass,
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _Out_ XDP_FLOW_CACHE_KEY *Key
+    )
+{
+    RtlZeroMemory(Key, sizeof(*Key));
+    Key->FrameClass = FrameClass;
+
+    if (FrameCache->Ip4Valid) {
+        C_ASSERT(sizeof(FrameCache->Ip4Hdr->SourceAddress) <= sizeof(Key->SourceAddress));
+        RtlCopyMemory(
+            Key->SourceAddress, &FrameCache->Ip4Hdr->SourceAddress,
+            sizeof(FrameCache->Ip4Hdr->SourceAddress));
+        RtlCopyMemory(
+            Key->DestinationAddress, &FrameCache->Ip4Hdr->DestinationAddress,
+            sizeof(FrameCache->Ip4Hdr->DestinationAddress));
+    } else {
+        C_ASSERT(sizeof(FrameCache->Ip6Hdr->SourceAddress) == sizeof(Key->SourceAddress));
+        RtlCopyMemory(
+            Key->SourceAddress, &FrameCache->Ip6Hdr->SourceAddress,
+            sizeof(FrameCache->Ip6Hdr->SourceAddress));
+        RtlCopyMemory(
+            Key->DestinationAddress, &FrameCache->Ip6Hdr->DestinationAddress,
+            sizeof(FrameCache->Ip6Hdr->DestinationAddress));
+    }
+
+    if (FrameCache->UdpValid) {
+        Key->SourcePort = FrameCache->UdpHdr->uh_sport;
+        Key->DestinationPort = FrameCache->UdpHdr->uh_dport;
+    } else {
+        Key->SourcePort = FrameCache->TcpHdr->th_sport;
+        Key->DestinationPort = FrameCache->TcpHdr->th_dport;
+    }
+}
+
+static
+VOID
+XdpProgramGetFragmentKey(
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _Out_ XDP_PROGRAM_FRAGMENT_KEY *Key
+    )
+{
+    RtlZeroMemory(Key, sizeof(*Key));
+    Key->Id = FrameCache->IpFragmentId;
+    Key->Protocol = FrameCache->IpFragmentProtocol;
+
+    if (FrameCache->Ip4Valid) {
+        C_ASSERT(sizeof(FrameCache->Ip4Hdr->SourceAddress) <= sizeof(Key->SourceAddress));
+        RtlCopyMemory(
+            Key->SourceAddress, &FrameCache->Ip4Hdr->SourceAddress,
+            sizeof(FrameCache->Ip4Hdr->SourceAddress));
+        RtlCopyMemory(
+            Key->DestinationAddress, &FrameCache->Ip4Hdr->DestinationAddress,
+            sizeof(FrameCache->Ip4Hdr->DestinationAddress));
+    } else {
+        C_ASSERT(sizeof(FrameCache->Ip6Hdr->SourceAddress) == sizeof(Key->SourceAddress));
+        RtlCopyMemory(
+            Key->SourceAddress, &FrameCache->Ip6Hdr->SourceAddress,
+            sizeof(FrameCache->Ip6Hdr->SourceAddress));
+        RtlCopyMemory(
+            Key->DestinationAddress, &FrameCache->Ip6Hdr->DestinationAddress,
+            sizeof(FrameCache->Ip6Hdr->DestinationAddress));
+        Key->IsIpv6 = TRUE;
+    }
+}
+
+static
+XDP_PROGRAM_FRAGMENT_ENTRY *
+XdpProgramGetFragmentBucket(
+    _In_ XDP_PROGRAM_FRAGMENT_TABLE *FragmentTable,
+    _In_ CONST XDP_PROGRAM_FRAGMENT_KEY *Key
+    )
+{
+    CONST UINT32 *Key32 = (CONST UINT32 *)Key;
+    UINT32 Hash = 0;
+
+    for (UINT32 i = 0; i < sizeof(*Key) / sizeof(UINT32); i++) {
+        Hash = XdpProgramHashMix(Hash, Key32[i]);
+    }
+
+    Hash = XdpProgramHashFinalize(Hash);
+    return FragmentTable->Buckets[Hash % XDP_PROGRAM_FRAGMENT_TABLE_BUCKETS];
+}
+
+//
+// Finds the unexpired entry recorded by the first fragment of the datagram
+// the frame is a later fragment of, under the current ruleset.
+//
+static
+CONST XDP_PROGRAM_FRAGMENT_ENTRY *
+XdpProgramFindFragment(
+    _In_ XDP_PROGRAM *Program,
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    XDP_PROGRAM_FRAGMENT_KEY Key;
+    CONST XDP_PROGRAM_FRAGMENT_ENTRY *Bucket;
+    UINT64 CurrentTime = KeQueryInterruptTime();
+
+    ASSERT(FrameCache->IpLaterFragment);
+
+    XdpProgramGetFragmentKey(FrameCache, &Key);
+    Bucket = XdpProgramGetFragmentBucket(Program->FragmentTable, &Key);
+
+    for (UINT32 i = 0; i < XDP_PROGRAM_FRAGMENT_BUCKET_ENTRIES; i++) {
+        CONST XDP_PROGRAM_FRAGMENT_ENTRY *Entry = &Bucket[i];
+
+        if (Entry->ExpirationTime > CurrentTime &&
+            Entry->ProgramGeneration == Program->Generation &&
+            RtlEqualMemory(&Entry->Key, &Key, sizeof(Key))) {
+            return Entry;
+        }
+    }
+
+    return NULL;
+}
+
+//
+// Records the rule matched by the first fragment of a datagram, replacing any
+// entry of the same datagram, else the entry of the bucket closest to expiring.
+//
+static
+VOID
+XdpProgramTrackFragment(
+    _In_ XDP_PROGRAM *Program,
+    _In_ CONST XDP_PROGRAM_FRAME_CACHE *FrameCache,
+    _In_ UINT32 RuleIndex
+    )
+{
+    XDP_PROGRAM_FRAGMENT_KEY Key;
+    XDP_PROGRAM_FRAGMENT_ENTRY *Bucket;
+    XDP_PROGRAM_FRAGMENT_ENTRY *Entry;
+
+    ASSERT(FrameCache->IpFragment && !FrameCache->IpLaterFragment);
+
+    XdpProgramGetFragmentKey(FrameCache, &Key);
+    Bucket = XdpProgramGetFragmentBucket(Program->FragmentTable, &Key);
+    Entry = &Bucket[0];
+
+    for (UINT32 i = 0; i < XDP_PROGRAM_FRAGMENT_BUCKET_ENTRIES; i++) {
+        if (RtlEqualMemory(&Bucket[i].Key, &Key, sizeof(Key))) {
+            Entry = &Bucket[i];
+            break;
+        }
+
+        if (Bucket[i].ExpirationTime < Entry->ExpirationTime) {
+            Entry = &Bucket[i];
+        }
+    }
+
+    Entry->Key = Key;
+    Entry->ExpirationTime = KeQueryInterruptTime() + XDP_PROGRAM_FRAGMENT_TIMEOUT;
+    Entry->ProgramGeneration = Program->Generation;
+    Entry->RuleIndex = RuleIndex;
+    Entry->FlowHash = XdpProgramHashFlow(FrameCache);
+}
+
+static
+BOOLEAN
+XdpProgramIsFragmentTrackable(
+    _In_ XDP_PROGRAM *Program,
+    _In_ UINT32 RuleIndex
+    )
+{
+    CONST XDP_RULE *Rule;
+
+    if (RuleIndex == XDP_PROGRAM_RULE_INDEX_NONE) {
+        return TRUE;
+    }
+
+    //
+    // The connection ID table target of a frame is resolved while matching
+    // its QUIC header, which later fragments do not carry.
+    //
+    Rule = &Program->Rules[RuleIndex];
+    return
+        Rule->Action != XDP_PROGRAM_ACTION_REDIRECT ||
+        Rule->Redirect.TargetType != XDP_REDIRECT_TARGET_TYPE_QUIC_CID_TABLE;
+}
+
+static
+XDP_RX_ACTION
+XdpInspectCompiled(
+    _In_ XDP_PROGRAM *Program,
+    _Inout_ XDP_FLOW_CACHE *FlowCache,
+    _In_ XDP_REDIRECT_CONTEXT *RedirectContext,
+    _In_ XDP_FRAME *Frame,
+    _In_ UINT32 FrameIndex,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _Inout_ XDP_PROGRAM_FRAME_CACHE *FrameCache
+    )
+{
+    CONST XDP_PROGRAM_COMPILED *Compiled = Program->Compiled;
+    XDP_PROGRAM_FRAME_CLASS FrameClass = XDP_PROGRAM_FRAME_CLASS_OTHER;
+    CONST XDP_PROGRAM_FRAGMENT_ENTRY *FragmentEntry = NULL;
+    UINT32 MatchedRuleIndex;
+
+    //
+    // The frame has already been parsed if the program requires it.
+    //
+    if (Compiled->ParseRequired) {
+        FrameClass = XdpProgramGetFrameClass(FrameCache);
+    }
+
+    if (FrameCache->IpLaterFragment && Program->FragmentTable != NULL) {
+        FragmentEntry = XdpProgramFindFragment(Program, FrameCache);
+    }
+
+    if (FragmentEntry != NULL) {
+        //
+        // Later fragments follow the rule matched by their first fragment.
+        //
+        MatchedRuleIndex = FragmentEntry->RuleIndex;
+        FrameCache->FragmentFlowHash = FragmentEntry->FlowHash;
+        FrameCache->FragmentFlowHashValid = TRUE;
+    } else if (Compiled->FlowCacheEnabled && (FrameCache->UdpValid || FrameCache->TcpValid)) {
+        XDP_FLOW_CACHE_KEY Key;
+        XDP_FLOW_CACHE_ENTRY *Entry;
+
+        if (FlowCache->ProgramGeneration != Program->Generation) {
+            XdpProgramResetFlowCache(Program, FlowCache);
+        }
+
+        //
+        // The cached rule index also records flows matching no rule. Rule
+        // actions are applied to every frame, since some actions are stateful.
+        //
+        XdpProgramGetFlowCacheKey(FrameClass, FrameCache, &Key);
+        Entry =
+            &FlowCache->Entries[XdpProgramHashFlow(FrameCache) & (XDP_FLOW_CACHE_SIZE - 1)];
+
+        if (Entry->Generation == FlowCache->Generation &&
+            RtlEqualMemory(&Entry->Key, &Key, sizeof(Key))) {
+            FlowCache->Hits++;
+            MatchedRuleIndex = Entry->RuleIndex;
+        } else {
+            FlowCache->Misses++;
+            MatchedRuleIndex =
+                XdpInspectCompiledRules(
+                    Program, FrameClass, Frame, FragmentRing, FragmentExtension, FragmentIndex,
+                    VirtualAddressExtension, FrameCache);
+            Entry->Key = Key;
+            Entry->Generation = FlowCache->Generation;
+            Entry->RuleIndex = MatchedRuleIndex;
+        }
+    } else {
+        MatchedRuleIndex =
+            XdpInspectCompiledRules(
+                Program, FrameClass, Frame, FragmentRing, FragmentExtension, FragmentIndex,
+                VirtualAddressExtension, FrameCache);
+    }
+
+    if (FrameCache->IpFragment && !FrameCache->IpLaterFragment &&
+        Program->FragmentTable != NULL &&
+        XdpProgramIsFragmentTrackable(Program, MatchedRuleIndex)) {
+        XdpProgramTrackFragment(Program, FrameCache, MatchedRuleIndex);
+    }
+
+    if (MatchedRuleIndex == XDP_PROGRAM_RULE_INDEX_NONE) {
+        return XDP_RX_ACTION_PASS;
+    }
+
+    //
+    // Count hits regardless of whether the rule was found by evaluating the
+    // rules, the flow cache or the fragment table, so the hottest rules are
+    // reordered even when their frames are served from the flow cache.
+    //
+    if (Compiled->RuleHits != NULL) {
+        Compiled->RuleHits[MatchedRuleIndex]++;
+    }
+
+    if (Program->RuleStatistics != NULL) {
+        XdpUpdateRuleStatistics(
+            Program->RuleStatistics[MatchedRuleIndex], Frame, FragmentRing, FragmentExtension,
+            FragmentIndex);
+    }
+
+    return
+        XdpApplyRuleAction(
+            Program, &Program->Rules[MatchedRuleIndex], RedirectContext, Frame, FrameIndex,
+            FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension, FrameCache);
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+XDP_RX_ACTION
+XdpInspect(
+    _In_ XDP_PROGRAM *Program,
+    _Inout_ XDP_FLOW_CACHE *FlowCache,
+    _In_ XDP_REDIRECT_CONTEXT *RedirectContext,
+    _In_ XDP_RING *FrameRing,
+    _In_ UINT32 FrameIndex,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_ UINT32 FragmentIndex,
+    _In_ XDP_EXTENSION *VirtualAddressExtension
+    )
+{
+    CONST XDP_PROGRAM_COMPILED *Compiled = Program->Compiled;
+    XDP_PROGRAM_FRAME_CACHE FrameCache;
+    XDP_FRAME *Frame;
+
+    ASSERT(FrameIndex <= FrameRing->Mask);
+    ASSERT(
+        (FragmentRing == NULL && FragmentIndex == 0) ||
+        (FragmentRing && FragmentIndex <= FragmentRing->Mask));
+
+    XdpInitializeFrameCache(&FrameCache);
+    Frame = XdpRingGetElement(FrameRing, FrameIndex);
+
+    if (Compiled != NULL) {
+        if (Compiled->ParseRequired) {
+            XdpParseFrame(
+                Frame, FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                &FrameCache, &Program->FrameStorage);
+        }
+
+        return
+            XdpInspectCompiled(
+                Program, FlowCache, RedirectContext, Frame, FrameIndex, FragmentRing,
+                FragmentExtension, FragmentIndex, VirtualAddressExtension, &FrameCache);
+    }
+
+    for (UINT32 RuleIndex = 0; RuleIndex < Program->RuleCount; RuleIndex++) {
+        if (XdpMatchRule(
+                Program, &Program->Rules[RuleIndex], Frame, FragmentRing, FragmentExtension,
+                FragmentIndex, VirtualAddressExtension, &FrameCache)) {
+            if (Program->RuleStatistics != NULL) {
+                XdpUpdateRuleStatistics(
+                    Program->RuleStatistics[RuleIndex], Frame, FragmentRing, FragmentExtension,
+                    FragmentIndex);
+            }
+
+            return
+                XdpApplyRuleAction(
+                    Program, &Program->Rules[RuleIndex], RedirectContext, Frame, FrameIndex,
+                    FragmentRing, FragmentExtension, FragmentIndex, VirtualAddressExtension,
+                    &FrameCache);
+        }
+    }
+
+    return XDP_RX_ACTION_PASS;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpInspectBatch(
+    _In_ XDP_PROGRAM *Program,
+    _Inout_ XDP_FLOW_CACHE *FlowCache,
+    _Inout_ XDP_INSPECT_BATCH *InspectBatch,
+    _In_ XDP_REDIRECT_CONTEXT *RedirectContext,
+    _In_ XDP_RING *FrameRing,
+    _In_reads_(FrameCount) CONST UINT32 *FrameIndexes,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_reads_(FrameCount) CONST UINT32 *FragmentIndexes,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_range_(1, XDP_INSPECT_BATCH_SIZE) UINT32 FrameCount,
+    _Out_writes_(FrameCount) XDP_RX_ACTION *Actions
+    )
+{
+    CONST XDP_PROGRAM_COMPILED *Compiled = Program->Compiled;
+
+    ASSERT(FrameCount > 0 && FrameCount <= XDP_INSPECT_BATCH_SIZE);
+
+    if (Compiled == NULL || !Compiled->ParseRequired) {
+        //
+        // Frame headers are either not inspected or parsed on demand, so
+        // there is nothing to gain from staging the batch.
+        //
+        for (UINT32 i = 0; i < FrameCount; i++) {
+            Actions[i] =
+                XdpInspect(
+                    Program, FlowCache, RedirectContext, FrameRing, FrameIndexes[i],
+                    FragmentRing, FragmentExtension, FragmentIndexes[i],
+                    VirtualAddressExtension);
+        }
+
+        return;
+    }
+
+    //
+    // Issue prefetches for the L2-L4 headers of every frame up front, so the
+    // cache misses of the whole batch overlap rather than stalling each frame
+    // in turn.
+    //
+    for (UINT32 i = 0; i < FrameCount; i++) {
+        XDP_FRAME *Frame = XdpRingGetElement(FrameRing, FrameIndexes[i]);
+        XDP_BUFFER *Buffer = &Frame->Buffer;
+        UCHAR *Va = XdpGetVirtualAddressExtension(Buffer, VirtualAddressExtension)->VirtualAddress;
+
+        Va += Buffer->DataOffset;
+        PreFetchCacheLine(PF_TEMPORAL_LEVEL_1, Va);
+        PreFetchCacheLine(
+            PF_TEMPORAL_LEVEL_1,
+            Va + sizeof(ETHERNET_HEADER) + sizeof(IPV6_HEADER) + sizeof(UDP_HDR) - 1);
+    }
+
+    //
+    // Parse every frame into its own cache entry. Headers copied out of
+    // discontiguous buffers must remain valid until the frame's rules are
+    // evaluated, so each frame also has its own header storage.
+    //
+    for (UINT32 i = 0; i < FrameCount; i++) {
+        ASSERT(FrameIndexes[i] <= FrameRing->Mask);
+        ASSERT(
+            (FragmentRing == NULL && FragmentIndexes[i] == 0) ||
+            (FragmentRing && FragmentIndexes[i] <= FragmentRing->Mask));
+
+        XdpInitializeFrameCache(&InspectBatch->FrameCache[i]);
+        XdpParseFrame(
+            XdpRingGetElement(FrameRing, FrameIndexes[i]), FragmentRing, FragmentExtension,
+            FragmentIndexes[i], VirtualAddressExtension, &InspectBatch->FrameCache[i],
+            &InspectBatch->FrameStorage[i]);
+    }
+
+    for (UINT32 i = 0; i < FrameCount; i++) {
+        Actions[i] =
+            XdpInspectCompiled(
+                Program, FlowCache, RedirectContext,
+                XdpRingGetElement(FrameRing, FrameIndexes[i]), FrameIndexes[i], FragmentRing,
+                FragmentExtension, FragmentIndexes[i], VirtualAddressExtension,
+                &InspectBatch->FrameCache[i]);
+    }
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramResetFlowCache(
+    _In_ XDP_PROGRAM *Program,
+    _Inout_ XDP_FLOW_CACHE *FlowCache
+    )
+{
+    //
+    // Entries of previous generations are ignored. If the generation wraps,
+    // clear the entries so none of them appears current.
+    //
+    if (++FlowCache->Generation == 0) {
+        RtlZeroMemory(FlowCache->Entries, sizeof(FlowCache->Entries));
+        FlowCache->Generation = 1;
+    }
+
+    FlowCache->ProgramGeneration = Program->Generation;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID *
+XdpProgramGetXskBypassTarget(
+    _In_ XDP_PROGRAM *Program
+    )
+{
+    ASSERT(XdpProgramCanXskBypass(Program));
+    return Program->Rules[0].Redirect.Target;
+}
+
+//
+// Control path routines.
+//
+
+typedef struct _XDP_PROGRAM_OBJECT {
+    XDP_FILE_OBJECT_HEADER Header;
+    XDP_BINDING_HANDLE IfHandle;
+    XDP_RX_QUEUE *RxQueue;
+    XDP_RX_QUEUE_NOTIFICATION_ENTRY RxQueueNotificationEntry;
+    LIST_ENTRY SharingLink;
+    ULONG_PTR CreatedByPid;
+
+    union {
+        struct {
+            UINT32 SharingEnabled : 1;
+            UINT32 IsMetaProgram : 1;
+            UINT32 StatisticsEnabled : 1;
+            UINT32 AdaptiveOrder : 1;
+        };
+        UINT32 Value;
+    } Flags;
+
+    //
+    // Periodically reorders the rules of programs created with
+    // XDP_CREATE_PROGRAM_FLAG_ADAPTIVE_ORDER.
+    //
+    XDP_TIMER *ReorderTimer;
+
+    //
+    // The total hits of the compiled ruleset after the last reorder attempt,
+    // and the program generation the attempt observed.
+    //
+    UINT64 ReorderBaseHits;
+    UINT32 ReorderGeneration;
+
+    //
+    // Storage for the per-rule statistics map of the program, one element per
+    // allocated rule.
+    //
+    XDP_RULE_STATISTICS **RuleStatisticsStorage;
+
+    //
+    // The rules and the statistics map are initially stored after the object.
+    // Rule updates are staged in a spare buffer of the same layout, which is
+    // then swapped with the active buffer on the data path. Each buffer holds
+    // up to its capacity of rules.
+    //
+    UINT32 RuleCapacity;
+    UINT32 StagedRuleCapacity;
+    XDP_RULE *StagedRules;
+    XDP_RULE_STATISTICS **StagedRuleStatistics;
+
+    //
+    // Serializes rule updates with statistics queries.
+    //
+    EX_PUSH_LOCK Lock;
+
+    XDP_PROGRAM Program;
+} XDP_PROGRAM_OBJECT;
+
+typedef struct _XDP_PROGRAM_RULE_UPDATE {
+    XDP_PROGRAM_RULE_OPERATION Operation;
+    UINT32 RuleIndex;
+
+    //
+    // The captured rule and its statistics, if any, for additions and
+    // replacements. Ownership is transferred to the program on success.
+    //
+    XDP_RULE Rule;
+    XDP_RULE_STATISTICS *Statistics;
+} XDP_PROGRAM_RULE_UPDATE;
+
+typedef struct _XDP_PROGRAM_QUIC_CID_UPDATE {
+    XDP_QUIC_CID_OPERATION Operation;
+    UINT32 RuleIndex;
+    UINT32 CidLength;
+    UCHAR CidData[QUIC_MAX_CID_LENGTH];
+
+    //
+    // The referenced target for XDP_QUIC_CID_OPERATION_SET. Ownership is
+    // transferred to the connection ID table on success.
+    //
+    HANDLE Target;
+} XDP_PROGRAM_QUIC_CID_UPDATE;
+
+typedef struct _XDP_PROGRAM_WORKITEM {
+    XDP_BINDING_WORKITEM Bind;
+    XDP_HOOK_ID HookId;
+    UINT32 QueueId;
+    XDP_PROGRAM_OBJECT *ProgramObject;
+    XDP_PROGRAM_RULE_UPDATE *RuleUpdate;
+    XDP_PROGRAM_QUIC_CID_UPDATE *QuicCidUpdate;
+
+    KEVENT CompletionEvent;
+    NTSTATUS CompletionStatus;
+} XDP_PROGRAM_WORKITEM;
+
+static XDP_FILE_IRP_ROUTINE XdpIrpProgramDeviceIoControl;
+static XDP_FILE_IRP_ROUTINE XdpIrpProgramClose;
+static XDP_FILE_DISPATCH XdpProgramFileDispatch = {
+    .IoControl = XdpIrpProgramDeviceIoControl,
+    .Close = XdpIrpProgramClose,
+};
+
+static
+VOID
+XdpProgramTraceObject(
+    _In_ CONST XDP_PROGRAM_OBJECT *ProgramObject
+    )
+{
+    TraceInfo(
+        TRACE_CORE, "Program=%p CreatedByPid=%Iu Flags=0x%x",
+        ProgramObject, ProgramObject->CreatedByPid, ProgramObject->Flags.Value);
+
+    for (UINT32 i = 0; i < ProgramObject->Program.RuleCount; i++) {
+        CONST XDP_RULE *Rule = &ProgramObject->Program.Rules[i];
+
+        switch (Rule->Match) {
+        case XDP_MATCH_ALL:
+            TraceInfo(TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_ALL", ProgramObject, i);
+            break;
+
+        case XDP_MATCH_UDP:
+            TraceInfo(TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_UDP", ProgramObject, i);
+            break;
+
+        case XDP_MATCH_UDP_DST:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_UDP_DST Port=%u",
+                ProgramObject, i, ntohs(Rule->Pattern.Port));
+            break;
+
+        case XDP_MATCH_IPV4_DST_MASK:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV4_DST_MASK Ip=%!IPADDR! Mask=%!IPADDR!",
+                ProgramObject, i, Rule->Pattern.IpMask.Address.Ipv4.s_addr,
+                Rule->Pattern.IpMask.Mask.Ipv4.s_addr);
+            break;
+
+        case XDP_MATCH_IPV6_DST_MASK:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV6_DST_MASK Ip=%!IPV6ADDR! Mask=%!IPV6ADDR!",
+                ProgramObject, i, Rule->Pattern.IpMask.Address.Ipv6.u.Byte,
+                Rule->Pattern.IpMask.Mask.Ipv6.u.Byte);
+            break;
+
+        case XDP_MATCH_QUIC_FLOW_SRC_CID:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_QUIC_FLOW_SRC_CID "
+                "Port=%u CidOffset=%u CidLength=%u CidData=%!HEXDUMP!",
+                ProgramObject, i, ntohs(Rule->Pattern.QuicFlow.UdpPort),
+                Rule->Pattern.QuicFlow.CidOffset, Rule->Pattern.QuicFlow.CidLength,
+                WppHexDump(Rule->Pattern.QuicFlow.CidData, Rule->Pattern.QuicFlow.CidLength));
+            break;
+
+        case XDP_MATCH_QUIC_FLOW_DST_CID:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_QUIC_FLOW_DST_CID "
+                "Port=%u CidOffset=%u CidLength=%u CidData=%!HEXDUMP!",
+                ProgramObject, i, ntohs(Rule->Pattern.QuicFlow.UdpPort),
+                Rule->Pattern.QuicFlow.CidOffset, Rule->Pattern.QuicFlow.CidLength,
+                WppHexDump(Rule->Pattern.QuicFlow.CidData, Rule->Pattern.QuicFlow.CidLength));
+            break;
+
+        case XDP_MATCH_QUIC_FLOW_DST_CID_TABLE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_QUIC_FLOW_DST_CID_TABLE "
+                "Port=%u CidOffset=%u CidLength=%u",
+                ProgramObject, i, ntohs(Rule->Pattern.QuicCidTable.UdpPort),
+                Rule->Pattern.QuicCidTable.CidOffset, Rule->Pattern.QuicCidTable.CidLength);
+            break;
+
+        case XDP_MATCH_IPV4_UDP_TUPLE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV4_UDP_TUPLE "
+                "Source=%!IPADDR!:%u Destination=%!IPADDR!:%u",
+                ProgramObject, i, Rule->Pattern.Tuple.SourceAddress.Ipv4.s_addr,
+                ntohs(Rule->Pattern.Tuple.SourcePort),
+                Rule->Pattern.Tuple.DestinationAddress.Ipv4.s_addr,
+                ntohs(Rule->Pattern.Tuple.DestinationPort));
+            break;
+
+        case XDP_MATCH_IPV6_UDP_TUPLE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV6_UDP_TUPLE "
+                "Source=[%!IPV6ADDR!]:%u Destination=[%!IPV6ADDR!]:%u",
+                ProgramObject, i, Rule->Pattern.Tuple.SourceAddress.Ipv6.u.Byte,
+                ntohs(Rule->Pattern.Tuple.SourcePort),
+                Rule->Pattern.Tuple.DestinationAddress.Ipv6.u.Byte,
+                ntohs(Rule->Pattern.Tuple.DestinationPort));
+            break;
+
+        case XDP_MATCH_UDP_PORT_SET:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_UDP_PORT_SET PortSet=?",
+                ProgramObject, i);
+            break;
+
+        case XDP_MATCH_IPV4_UDP_PORT_SET:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV4_UDP_PORT_SET "
+                "Destination=%!IPADDR! PortSet=?",
+                ProgramObject, i, Rule->Pattern.IpPortSet.Address.Ipv4.s_addr);
+            break;
+
+        case XDP_MATCH_IPV6_UDP_PORT_SET:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV6_UDP_PORT_SET "
+                "Destination=%!IPV6ADDR! PortSet=?",
+                ProgramObject, i, Rule->Pattern.IpPortSet.Address.Ipv6.u.Byte);
+            break;
+
+        case XDP_MATCH_TCP:
+            TraceInfo(TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_TCP", ProgramObject, i);
+            break;
+
+        case XDP_MATCH_TCP_DST:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_TCP_DST Port=%u",
+                ProgramObject, i, ntohs(Rule->Pattern.Port));
+            break;
+
+        case XDP_MATCH_IPV4_TCP_TUPLE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV4_TCP_TUPLE "
+                "Source=%!IPADDR!:%u Destination=%!IPADDR!:%u",
+                ProgramObject, i, Rule->Pattern.Tuple.SourceAddress.Ipv4.s_addr,
+                ntohs(Rule->Pattern.Tuple.SourcePort),
+                Rule->Pattern.Tuple.DestinationAddress.Ipv4.s_addr,
+                ntohs(Rule->Pattern.Tuple.DestinationPort));
+            break;
+
+        case XDP_MATCH_IPV6_TCP_TUPLE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV6_TCP_TUPLE "
+                "Source=[%!IPV6ADDR!]:%u Destination=[%!IPV6ADDR!]:%u",
+                ProgramObject, i, Rule->Pattern.Tuple.SourceAddress.Ipv6.u.Byte,
+                ntohs(Rule->Pattern.Tuple.SourcePort),
+                Rule->Pattern.Tuple.DestinationAddress.Ipv6.u.Byte,
+                ntohs(Rule->Pattern.Tuple.DestinationPort));
+            break;
+
+        case XDP_MATCH_TCP_PORT_SET:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_TCP_PORT_SET PortSet=?",
+                ProgramObject, i);
+            break;
+
+        case XDP_MATCH_IPV4_TCP_PORT_SET:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV4_TCP_PORT_SET "
+                "Destination=%!IPADDR! PortSet=?",
+                ProgramObject, i, Rule->Pattern.IpPortSet.Address.Ipv4.s_addr);
+            break;
+
+        case XDP_MATCH_IPV6_TCP_PORT_SET:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV6_TCP_PORT_SET "
+                "Destination=%!IPV6ADDR! PortSet=?",
+                ProgramObject, i, Rule->Pattern.IpPortSet.Address.Ipv6.u.Byte);
+            break;
+
+        case XDP_MATCH_TCP_FLAGS:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_TCP_FLAGS Mask=0x%x Flags=0x%x",
+                ProgramObject, i, Rule->Pattern.TcpFlags.Mask, Rule->Pattern.TcpFlags.Flags);
+            break;
+
+        case XDP_MATCH_IPV4_SRC_MASK:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV4_SRC_MASK Ip=%!IPADDR! Mask=%!IPADDR!",
+                ProgramObject, i, Rule->Pattern.IpMask.Address.Ipv4.s_addr,
+                Rule->Pattern.IpMask.Mask.Ipv4.s_addr);
+            break;
+
+        case XDP_MATCH_IPV6_SRC_MASK:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV6_SRC_MASK Ip=%!IPV6ADDR! Mask=%!IPV6ADDR!",
+                ProgramObject, i, Rule->Pattern.IpMask.Address.Ipv6.u.Byte,
+                Rule->Pattern.IpMask.Mask.Ipv6.u.Byte);
+            break;
+
+        case XDP_MATCH_UDP_SRC:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_UDP_SRC Port=%u",
+                ProgramObject, i, ntohs(Rule->Pattern.Port));
+            break;
+
+        case XDP_MATCH_TCP_SRC:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_TCP_SRC Port=%u",
+                ProgramObject, i, ntohs(Rule->Pattern.Port));
+            break;
+
+        case XDP_MATCH_UDP_SRC_PORT_SET:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_UDP_SRC_PORT_SET PortSet=?",
+                ProgramObject, i);
+            break;
+
+        case XDP_MATCH_TCP_SRC_PORT_SET:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_TCP_SRC_PORT_SET PortSet=?",
+                ProgramObject, i);
+            break;
+
+        case XDP_MATCH_MAP:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_MAP Map=%p KeyField=%u",
+                ProgramObject, i, Rule->Pattern.Map.Map, Rule->Pattern.Map.KeyField);
+            break;
+
+        case XDP_MATCH_IPV4_ADDRESS_SET:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV4_ADDRESS_SET AddressCount=%u Flags=0x%x",
+                ProgramObject, i, Rule->Pattern.IpAddressSet.AddressCount,
+                Rule->Pattern.IpAddressSet.Flags);
+            break;
+
+        case XDP_MATCH_IPV6_ADDRESS_SET:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_IPV6_ADDRESS_SET AddressCount=%u Flags=0x%x",
+                ProgramObject, i, Rule->Pattern.IpAddressSet.AddressCount,
+                Rule->Pattern.IpAddressSet.Flags);
+            break;
+
+        case XDP_MATCH_PAYLOAD:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_PAYLOAD Layer=%u Offset=%u Length=%u "
+                "Value=%!HEXDUMP! Mask=%!HEXDUMP!",
+                ProgramObject, i, Rule->Pattern.Payload.Layer, Rule->Pattern.Payload.Offset,
+                Rule->Pattern.Payload.Length,
+                WppHexDump(Rule->Pattern.Payload.Value, Rule->Pattern.Payload.Length),
+                WppHexDump(Rule->Pattern.Payload.Mask, Rule->Pattern.Payload.Length));
+            break;
+
+        case XDP_MATCH_BYTECODE:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_BYTECODE InstructionCount=%u",
+                ProgramObject, i, Rule->Pattern.Bytecode.InstructionCount);
+            break;
+
+        case XDP_MATCH_VLAN_ID:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_VLAN_ID VlanId=%u InnerVlanId=%u Flags=0x%x",
+                ProgramObject, i, Rule->Pattern.Vlan.VlanId, Rule->Pattern.Vlan.InnerVlanId,
+                Rule->Pattern.Vlan.Flags);
+            break;
+
+        case XDP_MATCH_TUNNEL_VNI:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_TUNNEL_VNI UdpPort=%u Type=%u Vni=%u",
+                ProgramObject, i, ntohs(Rule->Pattern.Tunnel.UdpPort),
+                Rule->Pattern.Tunnel.Type, Rule->Pattern.Tunnel.Vni);
+            break;
+
+        case XDP_MATCH_TUNNEL_IPV4_TUPLE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_TUNNEL_IPV4_TUPLE UdpPort=%u Type=%u Vni=%u "
+                "Protocol=%u Source=%!IPADDR!:%u Destination=%!IPADDR!:%u",
+                ProgramObject, i, ntohs(Rule->Pattern.TunnelTuple.Tunnel.UdpPort),
+                Rule->Pattern.TunnelTuple.Tunnel.Type, Rule->Pattern.TunnelTuple.Tunnel.Vni,
+                Rule->Pattern.TunnelTuple.Protocol,
+                Rule->Pattern.TunnelTuple.Tuple.SourceAddress.Ipv4.s_addr,
+                ntohs(Rule->Pattern.TunnelTuple.Tuple.SourcePort),
+                Rule->Pattern.TunnelTuple.Tuple.DestinationAddress.Ipv4.s_addr,
+                ntohs(Rule->Pattern.TunnelTuple.Tuple.DestinationPort));
+            break;
+
+        case XDP_MATCH_TUNNEL_IPV6_TUPLE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_TUNNEL_IPV6_TUPLE UdpPort=%u Type=%u Vni=%u "
+                "Protocol=%u Source=[%!IPV6ADDR!]:%u Destination=[%!IPV6ADDR!]:%u",
+                ProgramObject, i, ntohs(Rule->Pattern.TunnelTuple.Tunnel.UdpPort),
+                Rule->Pattern.TunnelTuple.Tunnel.Type, Rule->Pattern.TunnelTuple.Tunnel.Vni,
+                Rule->Pattern.TunnelTuple.Protocol,
+                Rule->Pattern.TunnelTuple.Tuple.SourceAddress.Ipv6.u.Byte,
+                ntohs(Rule->Pattern.TunnelTuple.Tuple.SourcePort),
+                Rule->Pattern.TunnelTuple.Tuple.DestinationAddress.Ipv6.u.Byte,
+                ntohs(Rule->Pattern.TunnelTuple.Tuple.DestinationPort));
+            break;
+
+        case XDP_MATCH_ETH_DST:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_ETH_DST MacAddress=%!HEXDUMP!",
+                ProgramObject, i,
+                WppHexDump(Rule->Pattern.MacAddress.Address, sizeof(Rule->Pattern.MacAddress)));
+            break;
+
+        case XDP_MATCH_ETH_DST_SET:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u]=XDP_MATCH_ETH_DST_SET AddressCount=%u Flags=0x%x",
+                ProgramObject, i, Rule->Pattern.MacAddressSet.AddressCount,
+                Rule->Pattern.MacAddressSet.Flags);
+            break;
+
+        case XDP_MATCH_ETHERTYPE:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u]=XDP_MATCH_ETHERTYPE EtherType=0x%x",
+                ProgramObject, i, ntohs(Rule->Pattern.EtherType));
+            break;
+
+        default:
+            ASSERT(FALSE);
+            break;
+        }
+
+        switch (Rule->Action) {
+        case XDP_PROGRAM_ACTION_DROP:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_DROP",
+                ProgramObject, i);
+            break;
+
+        case XDP_PROGRAM_ACTION_PASS:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_PASS",
+                ProgramObject, i);
+            break;
+
+        case XDP_PROGRAM_ACTION_REDIRECT:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_REDIRECT "
+                "TargetType=%!REDIRECT_TARGET_TYPE! Target=%p",
+                ProgramObject, i, Rule->Redirect.TargetType, Rule->Redirect.Target);
+            break;
+
+        case XDP_PROGRAM_ACTION_RATE_LIMIT:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_RATE_LIMIT "
+                "FramesPerSecond=%u FrameBurst=%u BytesPerSecond=%llu ByteBurst=%llu "
+                "ConformAction=%u ExceedAction=%u",
+                ProgramObject, i, Rule->RateLimit.FramesPerSecond, Rule->RateLimit.FrameBurst,
+                Rule->RateLimit.BytesPerSecond, Rule->RateLimit.ByteBurst,
+                Rule->RateLimit.ConformAction, Rule->RateLimit.ExceedAction);
+            break;
+
+        case XDP_PROGRAM_ACTION_SAMPLE:
+            TraceInfo(
+                TRACE_CORE,
+                "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_SAMPLE "
+                "TargetType=%!REDIRECT_TARGET_TYPE! Target=%p Interval=%u",
+                ProgramObject, i, Rule->Sample.Redirect.TargetType, Rule->Sample.Redirect.Target,
+                Rule->Sample.Interval);
+            break;
+
+        case XDP_PROGRAM_ACTION_L2FWD:
+            TraceInfo(
+                TRACE_CORE, "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_L2FWD Flags=0x%x",
+                ProgramObject, i, Rule->L2Fwd.Flags);
+            break;
+
+        default:
+            ASSERT(FALSE);
+            break;
+        }
+    }
+}
+
+static
+BOOLEAN
+XdpProgramRuleKeyEqual(
+    _In_ CONST XDP_RULE *Rule,
+    _In_ CONST XDP_RULE *OtherRule
+    )
+{
+    CONST XDP_TUPLE *Tuple = &Rule->Pattern.Tuple;
+    CONST XDP_TUPLE *OtherTuple = &OtherRule->Pattern.Tuple;
+
+    ASSERT(Rule->Match == OtherRule->Match);
+
+    switch (Rule->Match) {
+    case XDP_MATCH_UDP_DST:
+    case XDP_MATCH_TCP_DST:
+    case XDP_MATCH_UDP_SRC:
+    case XDP_MATCH_TCP_SRC:
+        return Rule->Pattern.Port == OtherRule->Pattern.Port;
+
+    case XDP_MATCH_IPV4_UDP_TUPLE:
+    case XDP_MATCH_IPV4_TCP_TUPLE:
+        return
+            Tuple->SourcePort == OtherTuple->SourcePort &&
+            Tuple->DestinationPort == OtherTuple->DestinationPort &&
+            IN4_ADDR_EQUAL(&Tuple->SourceAddress.Ipv4, &OtherTuple->SourceAddress.Ipv4) &&
+            IN4_ADDR_EQUAL(&Tuple->DestinationAddress.Ipv4, &OtherTuple->DestinationAddress.Ipv4);
+
+    case XDP_MATCH_IPV6_UDP_TUPLE:
+    case XDP_MATCH_IPV6_TCP_TUPLE:
+        return
+            Tuple->SourcePort == OtherTuple->SourcePort &&
+            Tuple->DestinationPort == OtherTuple->DestinationPort &&
+            IN6_ADDR_EQUAL(&Tuple->SourceAddress.Ipv6, &OtherTuple->SourceAddress.Ipv6) &&
+            IN6_ADDR_EQUAL(&Tuple->DestinationAddress.Ipv6, &OtherTuple->DestinationAddress.Ipv6);
+
+    default:
+        ASSERT(FALSE);
+        return FALSE;
+    }
+}
+
+static
+NTSTATUS
+XdpProgramAllocateHashTable(
+    _Inout_ XDP_PROGRAM_HASH_TABLE *Table,
+    _In_ UINT32 MaxEntryCount
+    )
+{
+    UINT32 BucketCount;
+    SIZE_T AllocationSize;
+    NTSTATUS Status;
+
+    if (MaxEntryCount == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    //
+    // Keep the table at most half full so probe sequences stay short and
+    // always terminate at an empty bucket.
+    //
+    Status = RtlUInt32Mult(MaxEntryCount, 2, &BucketCount);
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    Status = RtlUInt32RoundUpToPowerOfTwo(BucketCount, &BucketCount);
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    Status = RtlSizeTMult(sizeof(*Table->Buckets), BucketCount, &AllocationSize);
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    Table->Buckets = ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, XDP_POOLTAG_PROGRAM);
+    if (Table->Buckets == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    for (UINT32 i = 0; i < BucketCount; i++) {
+        Table->Buckets[i].RuleIndex = XDP_PROGRAM_RULE_INDEX_NONE;
+    }
+
+    Table->BucketMask = BucketCount - 1;
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+XdpProgramFreeHashTable(
+    _Inout_ XDP_PROGRAM_HASH_TABLE *Table
+    )
+{
+    if (Table->Buckets != NULL) {
+        ExFreePoolWithTag(Table->Buckets, XDP_POOLTAG_PROGRAM);
+        Table->Buckets = NULL;
+    }
+}
+
+static
+VOID
+XdpProgramHashInsert(
+    _Inout_ XDP_PROGRAM_HASH_TABLE *Table,
+    _In_ CONST XDP_RULE *Rules,
+    _In_ UINT32 RuleIndex,
+    _In_ UINT32 Hash
+    )
+{
+    UINT32 Bucket = Hash & Table->BucketMask;
+
+    ASSERT(Table->Buckets != NULL);
+
+    while (Table->Buckets[Bucket].RuleIndex != XDP_PROGRAM_RULE_INDEX_NONE) {
+        CONST XDP_PROGRAM_HASH_ENTRY *Entry = &Table->Buckets[Bucket];
+
+        if (Entry->Hash == Hash &&
+            XdpProgramRuleKeyEqual(&Rules[Entry->RuleIndex], &Rules[RuleIndex])) {
+            //
+            // Rules are inserted in ascending order, so the existing rule with
+            // the same key always matches first.
+            //
+            ASSERT(Entry->RuleIndex < RuleIndex);
+            return;
+        }
+
+        Bucket = (Bucket + 1) & Table->BucketMask;
+    }
+
+    Table->Buckets[Bucket].Hash = Hash;
+    Table->Buckets[Bucket].RuleIndex = RuleIndex;
+    Table->EntryCount++;
+}
+
+static
+BOOLEAN
+XdpProgramGetPrefixLength(
+    _In_ CONST UINT8 *Mask,
+    _In_ UINT32 AddressLength,
+    _Out_ UINT32 *PrefixLength
+    )
+{
+    UINT32 Length = 0;
+    UINT32 i = 0;
+
+    //
+    // Determine whether the mask is a contiguous prefix mask, and if so, its
+    // length in bits.
+    //
+
+    while (i < AddressLength && Mask[i] == 0xFF) {
+        Length += 8;
+        i++;
+    }
+
+    if (i < AddressLength) {
+        UINT8 Partial = Mask[i++];
+
+        while (Partial & 0x80) {
+            Partial <<= 1;
+            Length++;
+        }
+
+        if (Partial != 0) {
+            return FALSE;
+        }
+    }
+
+    while (i < AddressLength) {
+        if (Mask[i++] != 0) {
+            return FALSE;
+        }
+    }
+
+    *PrefixLength = Length;
+    return TRUE;
+}
+
+static
+BOOLEAN
+XdpProgramIsLpmRule(
+    _In_ CONST XDP_RULE *Rule,
+    _In_ XDP_MATCH_TYPE Match,
+    _Out_ UINT32 *PrefixLength
+    )
+{
+    CONST UINT8 *Address = (CONST UINT8 *)&Rule->Pattern.IpMask.Address;
+    CONST UINT8 *Mask = (CONST UINT8 *)&Rule->Pattern.IpMask.Mask;
+    UINT32 AddressLength =
+        (Match == XDP_MATCH_IPV4_DST_MASK || Match == XDP_MATCH_IPV4_SRC_MASK) ?
+            sizeof(IN_ADDR) : sizeof(IN6_ADDR);
+
+    if (Rule->Match != Match ||
+        !XdpProgramGetPrefixLength(Mask, AddressLength, PrefixLength)) {
+        return FALSE;
+    }
+
+    //
+    // A rule whose address has bits outside its mask never matches, but the
+    // trie only inserts the prefix, so leave such rules to the rule walk.
+    //
+    for (UINT32 i = 0; i < AddressLength; i++) {
+        if ((Address[i] & ~Mask[i]) != 0) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static
+NTSTATUS
+XdpProgramLpmAllocateNode(
+    _Inout_ XDP_PROGRAM_LPM *Lpm,
+    _Out_ UINT32 *NodeIndex
+    )
+{
+    if (Lpm->NodeCount == Lpm->NodeCapacity) {
+        XDP_PROGRAM_LPM_ENTRY *Nodes;
+        UINT32 NodeCapacity;
+        SIZE_T AllocationSize;
+        NTSTATUS Status;
+
+        //
+        // Grow the node array geometrically; this only occurs on the control
+        // path, before the trie is visible to the data path.
+        //
+        Status = RtlUInt32Mult(max(Lpm->NodeCapacity, 32), 2, &NodeCapacity);
+        if (!NT_SUCCESS(Status)) {
+            return Status;
+        }
+
+        Status =
+            RtlSizeTMult(
+                sizeof(*Nodes) * XDP_PROGRAM_LPM_NODE_SIZE, NodeCapacity, &AllocationSize);
+        if (!NT_SUCCESS(Status)) {
+            return Status;
+        }
+
+        Nodes = ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, XDP_POOLTAG_PROGRAM);
+        if (Nodes == NULL) {
+            return STATUS_NO_MEMORY;
+        }
+
+        if (Lpm->Nodes != NULL) {
+            RtlCopyMemory(
+                Nodes, Lpm->Nodes,
+                sizeof(*Nodes) * XDP_PROGRAM_LPM_NODE_SIZE * Lpm->NodeCount);
+            ExFreePoolWithTag(Lpm->Nodes, XDP_POOLTAG_PROGRAM);
+        } else {
+            //
+            // Reserve node 0 as the null child.
+            //
+            Lpm->NodeCount = 1;
+        }
+
+        Lpm->Nodes = Nodes;
+        Lpm->NodeCapacity = NodeCapacity;
+    }
+
+    for (UINT32 i = 0; i < XDP_PROGRAM_LPM_NODE_SIZE; i++) {
+        Lpm->Nodes[Lpm->NodeCount * XDP_PROGRAM_LPM_NODE_SIZE + i].RuleIndex =
+            XDP_PROGRAM_RULE_INDEX_NONE;
+    }
+
+    *NodeIndex = Lpm->NodeCount++;
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XdpProgramLpmInsert(
+    _Inout_ XDP_PROGRAM_LPM *Lpm,
+    _In_ CONST UINT8 *Prefix,
+    _In_ UINT32 PrefixLength,
+    _In_ UINT32 RuleIndex
+    )
+{
+    XDP_PROGRAM_LPM_ENTRY *Entries = Lpm->Root;
+    UINT32 EntryIndex = ((UINT32)Prefix[0] << 8) | Prefix[1];
+    UINT32 NodeIndex = 0;
+    UINT32 Stride = XDP_PROGRAM_LPM_ROOT_STRIDE;
+    UINT32 BitOffset = 0;
+    UINT32 Depth = 1;
+    NTSTATUS Status;
+
+    //
+    // Walk down the trie until reaching the stride containing the end of the
+    // prefix, creating nodes along the way.
+    //
+    while (PrefixLength > BitOffset + Stride) {
+        UINT32 Child = Entries[EntryIndex].Child;
+
+        if (Child == 0) {
+            Status = XdpProgramLpmAllocateNode(Lpm, &Child);
+            if (!NT_SUCCESS(Status)) {
+                return Status;
+            }
+
+            //
+            // The root table never moves, but the node array may have been
+            // reallocated.
+            //
+            if (NodeIndex != 0) {
+                Entries = &Lpm->Nodes[NodeIndex * XDP_PROGRAM_LPM_NODE_SIZE];
+            }
+            Entries[EntryIndex].Child = Child;
+        }
+
+        NodeIndex = Child;
+        BitOffset += Stride;
+        Stride = XDP_PROGRAM_LPM_NODE_STRIDE;
+        Entries = &Lpm->Nodes[NodeIndex * XDP_PROGRAM_LPM_NODE_SIZE];
+        EntryIndex = XdpProgramLpmGetBits(Prefix, BitOffset);
+        Depth++;
+    }
+
+    //
+    // Expand the prefix to every entry it covers within the final stride.
+    //
+    EntryIndex &= ~((1ui32 << (BitOffset + Stride - PrefixLength)) - 1);
+
+    for (UINT32 i = 0; i < (1ui32 << (BitOffset + Stride - PrefixLength)); i++) {
+        XDP_PROGRAM_LPM_ENTRY *Entry = &Entries[EntryIndex + i];
+        Entry->RuleIndex = min(Entry->RuleIndex, RuleIndex);
+    }
+
+    Lpm->RuleCount++;
+    Lpm->MaxDepth = max(Lpm->MaxDepth, Depth);
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XdpProgramCompileLpm(
+    _In_reads_(RuleCount) CONST XDP_RULE *Rules,
+    _In_ UINT32 RuleCount,
+    _In_ XDP_MATCH_TYPE Match,
+    _Inout_ XDP_PROGRAM_LPM *Lpm
+    )
+{
+    UINT32 RootSize = 1ui32 << XDP_PROGRAM_LPM_ROOT_STRIDE;
+    UINT32 LpmRuleCount = 0;
+    UINT32 PrefixLength;
+    NTSTATUS Status;
+
+    for (UINT32 Index = 0; Index < RuleCount; Index++) {
+        if (XdpProgramIsLpmRule(&Rules[Index], Match, &PrefixLength)) {
+            LpmRuleCount++;
+        }
+    }
+
+    if (LpmRuleCount < XDP_PROGRAM_LPM_MIN_RULES) {
+        return STATUS_SUCCESS;
+    }
+
+    Lpm->Root =
+        ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Lpm->Root) * RootSize, XDP_POOLTAG_PROGRAM);
+    if (Lpm->Root == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    for (UINT32 i = 0; i < RootSize; i++) {
+        Lpm->Root[i].RuleIndex = XDP_PROGRAM_RULE_INDEX_NONE;
+    }
+
+    for (UINT32 Index = 0; Index < RuleCount; Index++) {
+        CONST XDP_RULE *Rule = &Rules[Index];
+
+        if (XdpProgramIsLpmRule(Rule, Match, &PrefixLength)) {
+            Status =
+                XdpProgramLpmInsert(
+                    Lpm, (CONST UINT8 *)&Rule->Pattern.IpMask.Address, PrefixLength, Index);
+            if (!NT_SUCCESS(Status)) {
+                return Status;
+            }
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+XdpProgramFreeLpm(
+    _Inout_ XDP_PROGRAM_LPM *Lpm
+    )
+{
+    if (Lpm->Nodes != NULL) {
+        ExFreePoolWithTag(Lpm->Nodes, XDP_POOLTAG_PROGRAM);
+        Lpm->Nodes = NULL;
+    }
+
+    if (Lpm->Root != NULL) {
+        ExFreePoolWithTag(Lpm->Root, XDP_POOLTAG_PROGRAM);
+        Lpm->Root = NULL;
+    }
+}
+
+static
+UINT32
+XdpProgramGetMapKeyFieldFrameClasses(
+    _In_ XDP_MAP_KEY_FIELD KeyField
+    )
+{
+    switch (KeyField) {
+    case XDP_MAP_KEY_FIELD_IPV4_SOURCE:
+    case XDP_MAP_KEY_FIELD_IPV4_DESTINATION:
+        return XDP_PROGRAM_FRAME_CLASS_IPV4_ALL;
+
+    case XDP_MAP_KEY_FIELD_IPV6_SOURCE:
+    case XDP_MAP_KEY_FIELD_IPV6_DESTINATION:
+        return XDP_PROGRAM_FRAME_CLASS_IPV6_ALL;
+
+    case XDP_MAP_KEY_FIELD_UDP_SOURCE:
+    case XDP_MAP_KEY_FIELD_UDP_DESTINATION:
+        return XDP_PROGRAM_FRAME_CLASS_UDP_ALL;
+
+    case XDP_MAP_KEY_FIELD_TCP_SOURCE:
+    case XDP_MAP_KEY_FIELD_TCP_DESTINATION:
+        return XDP_PROGRAM_FRAME_CLASS_TCP_ALL;
+
+    default:
+        ASSERT(FALSE);
+        return XDP_PROGRAM_FRAME_CLASS_ALL;
+    }
+}
+
+static
+UINT32
+XdpProgramGetPayloadLayerFrameClasses(
+    _In_ XDP_PAYLOAD_LAYER Layer
+    )
+{
+    switch (Layer) {
+    case XDP_PAYLOAD_LAYER_L2:
+        return XDP_PROGRAM_FRAME_CLASS_ALL;
+
+    case XDP_PAYLOAD_LAYER_L3:
+        return XDP_PROGRAM_FRAME_CLASS_IPV4_ALL | XDP_PROGRAM_FRAME_CLASS_IPV6_ALL;
+
+    case XDP_PAYLOAD_LAYER_L4:
+    case XDP_PAYLOAD_LAYER_L4_PAYLOAD:
+        return XDP_PROGRAM_FRAME_CLASS_UDP_ALL | XDP_PROGRAM_FRAME_CLASS_TCP_ALL;
+
+    default:
+        ASSERT(FALSE);
+        return XDP_PROGRAM_FRAME_CLASS_ALL;
+    }
+}
+
+static
+UINT32
+XdpProgramGetRuleFrameClasses(
+    _In_ CONST XDP_RULE *Rule
+    )
+{
+    //
+    // Returns the set of frame classes the rule can match.
+    //
+    switch (Rule->Match) {
+    case XDP_MATCH_ALL:
+        return XDP_PROGRAM_FRAME_CLASS_ALL;
+
+    case XDP_MATCH_IPV4_DST_MASK:
+    case XDP_MATCH_IPV4_SRC_MASK:
+    case XDP_MATCH_IPV4_ADDRESS_SET:
+        return XDP_PROGRAM_FRAME_CLASS_IPV4_ALL;
+
+    case XDP_MATCH_IPV6_DST_MASK:
+    case XDP_MATCH_IPV6_SRC_MASK:
+    case XDP_MATCH_IPV6_ADDRESS_SET:
+        return XDP_PROGRAM_FRAME_CLASS_IPV6_ALL;
+
+    case XDP_MATCH_IPV4_UDP_TUPLE:
+    case XDP_MATCH_IPV4_UDP_PORT_SET:
+        return XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_IPV4_UDP);
+
+    case XDP_MATCH_IPV6_UDP_TUPLE:
+    case XDP_MATCH_IPV6_UDP_PORT_SET:
+        return XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_IPV6_UDP);
+
+    case XDP_MATCH_UDP:
+    case XDP_MATCH_UDP_DST:
+    case XDP_MATCH_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_QUIC_FLOW_DST_CID:
+    case XDP_MATCH_QUIC_FLOW_DST_CID_TABLE:
+    case XDP_MATCH_UDP_PORT_SET:
+    case XDP_MATCH_UDP_SRC:
+    case XDP_MATCH_UDP_SRC_PORT_SET:
+        return XDP_PROGRAM_FRAME_CLASS_UDP_ALL;
+
+    case XDP_MATCH_IPV4_TCP_TUPLE:
+    case XDP_MATCH_IPV4_TCP_PORT_SET:
+        return XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_IPV4_TCP);
+
+    case XDP_MATCH_IPV6_TCP_TUPLE:
+    case XDP_MATCH_IPV6_TCP_PORT_SET:
+        return XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_IPV6_TCP);
+
+    case XDP_MATCH_TCP:
+    case XDP_MATCH_TCP_DST:
+    case XDP_MATCH_TCP_PORT_SET:
+    case XDP_MATCH_TCP_FLAGS:
+    case XDP_MATCH_TCP_SRC:
+    case XDP_MATCH_TCP_SRC_PORT_SET:
+        return XDP_PROGRAM_FRAME_CLASS_TCP_ALL;
+
+    case XDP_MATCH_MAP:
+        return XdpProgramGetMapKeyFieldFrameClasses(Rule->Pattern.Map.KeyField);
+
+    case XDP_MATCH_PAYLOAD:
+        return XdpProgramGetPayloadLayerFrameClasses(Rule->Pattern.Payload.Layer);
+
+    case XDP_MATCH_BYTECODE:
+    case XDP_MATCH_VLAN_ID:
+    case XDP_MATCH_ETH_DST:
+    case XDP_MATCH_ETH_DST_SET:
+        return XDP_PROGRAM_FRAME_CLASS_ALL;
+
+    case XDP_MATCH_ETHERTYPE:
+        //
+        // Frames whose IP header is truncated are classified as other frames.
+        //
+        if (Rule->Pattern.EtherType == RtlUshortByteSwap(ETHERNET_TYPE_IPV4)) {
+            return
+                XDP_PROGRAM_FRAME_CLASS_IPV4_ALL |
+                XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_OTHER);
+        } else if (Rule->Pattern.EtherType == RtlUshortByteSwap(ETHERNET_TYPE_IPV6)) {
+            return
+                XDP_PROGRAM_FRAME_CLASS_IPV6_ALL |
+                XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_OTHER);
+        } else {
+            return XDP_PROGRAM_FRAME_CLASS_BIT(XDP_PROGRAM_FRAME_CLASS_OTHER);
+        }
+
+    case XDP_MATCH_TUNNEL_VNI:
+    case XDP_MATCH_TUNNEL_IPV4_TUPLE:
+    case XDP_MATCH_TUNNEL_IPV6_TUPLE:
+        return XDP_PROGRAM_FRAME_CLASS_UDP_ALL;
+
+    default:
+        ASSERT(FALSE);
+        return XDP_PROGRAM_FRAME_CLASS_ALL;
+    }
+}
+
+static
+BOOLEAN
+XdpProgramIsFlowMatch(
+    _In_ XDP_MATCH_TYPE Match
+    )
+{
+    //
+    // Returns whether a rule of the given type is matched by the frame class,
+    // IP addresses and transport ports of a frame alone. Map rules are not,
+    // since map updates do not invalidate the flow cache.
+    //
+    switch (Match) {
+    case XDP_MATCH_ALL:
+    case XDP_MATCH_UDP:
+    case XDP_MATCH_UDP_DST:
+    case XDP_MATCH_UDP_SRC:
+    case XDP_MATCH_IPV4_DST_MASK:
+    case XDP_MATCH_IPV6_DST_MASK:
+    case XDP_MATCH_IPV4_SRC_MASK:
+    case XDP_MATCH_IPV6_SRC_MASK:
+    case XDP_MATCH_IPV4_UDP_TUPLE:
+    case XDP_MATCH_IPV6_UDP_TUPLE:
+    case XDP_MATCH_UDP_PORT_SET:
+    case XDP_MATCH_IPV4_UDP_PORT_SET:
+    case XDP_MATCH_IPV6_UDP_PORT_SET:
+    case XDP_MATCH_UDP_SRC_PORT_SET:
+    case XDP_MATCH_TCP:
+    case XDP_MATCH_TCP_DST:
+    case XDP_MATCH_TCP_SRC:
+    case XDP_MATCH_IPV4_TCP_TUPLE:
+    case XDP_MATCH_IPV6_TCP_TUPLE:
+    case XDP_MATCH_TCP_PORT_SET:
+    case XDP_MATCH_IPV4_TCP_PORT_SET:
+    case XDP_MATCH_IPV6_TCP_PORT_SET:
+    case XDP_MATCH_TCP_SRC_PORT_SET:
+    case XDP_MATCH_IPV4_ADDRESS_SET:
+    case XDP_MATCH_IPV6_ADDRESS_SET:
+        return TRUE;
+
+    default:
+        return FALSE;
+    }
+}
+
+static
+VOID
+XdpProgramTraceCompiled(
+    _In_ CONST XDP_PROGRAM_COMPILED *Compiled,
+    _In_ UINT32 RuleCount
+    )
+{
+    static CONST CHAR *FrameClassNames[] = {
+        "OTHER",
+        "IPV4",
+        "IPV4_UDP",
+        "IPV4_TCP",
+        "IPV6",
+        "IPV6_UDP",
+        "IPV6_TCP",
+    };
+    C_ASSERT(RTL_NUMBER_OF(FrameClassNames) == XDP_PROGRAM_FRAME_CLASS_COUNT);
+
+    TraceInfo(
+        TRACE_CORE,
+        "Compiled=%p RuleCount=%u IndexedRuleCount=%u ParseRequired=%!BOOLEAN! "
+        "FlowCacheEnabled=%!BOOLEAN! UdpDst=%u Ipv4UdpTuple=%u Ipv6UdpTuple=%u "
+        "TcpDst=%u Ipv4TcpTuple=%u Ipv6TcpTuple=%u UdpSrc=%u TcpSrc=%u "
+        "Ipv4DstLpm={Rules=%u Nodes=%u Depth=%u} Ipv6DstLpm={Rules=%u Nodes=%u Depth=%u} "
+        "Ipv4SrcLpm={Rules=%u Nodes=%u Depth=%u} Ipv6SrcLpm={Rules=%u Nodes=%u Depth=%u}",
+        Compiled, RuleCount, Compiled->IndexedRuleCount,
+        Compiled->ParseRequired, Compiled->FlowCacheEnabled, Compiled->UdpDst.EntryCount,
+        Compiled->Ipv4UdpTuple.EntryCount, Compiled->Ipv6UdpTuple.EntryCount,
+        Compiled->TcpDst.EntryCount, Compiled->Ipv4TcpTuple.EntryCount,
+        Compiled->Ipv6TcpTuple.EntryCount, Compiled->UdpSrc.EntryCount,
+        Compiled->TcpSrc.EntryCount,
+        Compiled->Ipv4DstLpm.RuleCount, Compiled->Ipv4DstLpm.NodeCount,
+        Compiled->Ipv4DstLpm.MaxDepth, Compiled->Ipv6DstLpm.RuleCount,
+        Compiled->Ipv6DstLpm.NodeCount, Compiled->Ipv6DstLpm.MaxDepth,
+        Compiled->Ipv4SrcLpm.RuleCount, Compiled->Ipv4SrcLpm.NodeCount,
+        Compiled->Ipv4SrcLpm.MaxDepth, Compiled->Ipv6SrcLpm.RuleCount,
+        Compiled->Ipv6SrcLpm.NodeCount, Compiled->Ipv6SrcLpm.MaxDepth);
+
+    for (UINT32 Class = 0; Class < XDP_PROGRAM_FRAME_CLASS_COUNT; Class++) {
+        CONST XDP_PROGRAM_LPM *DstLpm = NULL;
+        CONST XDP_PROGRAM_LPM *SrcLpm = NULL;
+        UINT32 IndexDepth = 0;
+
+        //
+        // The depth is the worst-case number of decisions for a frame of the
+        // class: the header classification, one probe per applicable hash
+        // table, one per trie level, and one per rule in the sequence.
+        //
+        if (XDP_PROGRAM_FRAME_CLASS_BIT(Class) & XDP_PROGRAM_FRAME_CLASS_IPV4_ALL) {
+            DstLpm = &Compiled->Ipv4DstLpm;
+            SrcLpm = &Compiled->Ipv4SrcLpm;
+        } else if (XDP_PROGRAM_FRAME_CLASS_BIT(Class) & XDP_PROGRAM_FRAME_CLASS_IPV6_ALL) {
+            DstLpm = &Compiled->Ipv6DstLpm;
+            SrcLpm = &Compiled->Ipv6SrcLpm;
+        }
+
+        if (DstLpm != NULL) {
+            IndexDepth += DstLpm->MaxDepth + SrcLpm->MaxDepth;
+        }
+
+        if (XDP_PROGRAM_FRAME_CLASS_BIT(Class) & XDP_PROGRAM_FRAME_CLASS_UDP_ALL) {
+            IndexDepth += (Compiled->UdpSrc.EntryCount > 0);
+        } else if (XDP_PROGRAM_FRAME_CLASS_BIT(Class) & XDP_PROGRAM_FRAME_CLASS_TCP_ALL) {
+            IndexDepth += (Compiled->TcpSrc.EntryCount > 0);
+        }
+
+        if (Class == XDP_PROGRAM_FRAME_CLASS_IPV4_UDP) {
+            IndexDepth += (Compiled->UdpDst.EntryCount > 0);
+            IndexDepth += (Compiled->Ipv4UdpTuple.EntryCount > 0);
+        } else if (Class == XDP_PROGRAM_FRAME_CLASS_IPV6_UDP) {
+            IndexDepth += (Compiled->UdpDst.EntryCount > 0);
+            IndexDepth += (Compiled->Ipv6UdpTuple.EntryCount > 0);
+        } else if (Class == XDP_PROGRAM_FRAME_CLASS_IPV4_TCP) {
+            IndexDepth += (Compiled->TcpDst.EntryCount > 0);
+            IndexDepth += (Compiled->Ipv4TcpTuple.EntryCount > 0);
+        } else if (Class == XDP_PROGRAM_FRAME_CLASS_IPV6_TCP) {
+            IndexDepth += (Compiled->TcpDst.EntryCount > 0);
+            IndexDepth += (Compiled->Ipv6TcpTuple.EntryCount > 0);
+        }
+
+        TraceInfo(
+            TRACE_CORE, "Compiled=%p Class=%s SequenceRules=%u Depth=%u",
+            Compiled, FrameClassNames[Class], Compiled->Sequences[Class].RuleCount,
+            Compiled->ParseRequired + IndexDepth + Compiled->Sequences[Class].RuleCount);
+    }
+}
+
+static
+XDP_PROGRAM_HASH_TABLE *
+XdpProgramGetRuleHashTable(
+    _In_ XDP_PROGRAM_COMPILED *Compiled,
+    _In_ XDP_MATCH_TYPE Match
+    )
+{
+    switch (Match) {
+    case XDP_MATCH_UDP_DST:
+        return &Compiled->UdpDst;
+    case XDP_MATCH_IPV4_UDP_TUPLE:
+        return &Compiled->Ipv4UdpTuple;
+    case XDP_MATCH_IPV6_UDP_TUPLE:
+        return &Compiled->Ipv6UdpTuple;
+    case XDP_MATCH_TCP_DST:
+        return &Compiled->TcpDst;
+    case XDP_MATCH_IPV4_TCP_TUPLE:
+        return &Compiled->Ipv4TcpTuple;
+    case XDP_MATCH_IPV6_TCP_TUPLE:
+        return &Compiled->Ipv6TcpTuple;
+    case XDP_MATCH_UDP_SRC:
+        return &Compiled->UdpSrc;
+    case XDP_MATCH_TCP_SRC:
+        return &Compiled->TcpSrc;
+    default:
+        return NULL;
+    }
+}
+
+static
+VOID
+XdpProgramFreeCompiled(
+    _In_opt_ XDP_PROGRAM_COMPILED *Compiled
+    )
+{
+    if (Compiled == NULL) {
+        return;
+    }
+
+    XdpProgramFreeHashTable(&Compiled->UdpDst);
+    XdpProgramFreeHashTable(&Compiled->Ipv4UdpTuple);
+    XdpProgramFreeHashTable(&Compiled->Ipv6UdpTuple);
+    XdpProgramFreeHashTable(&Compiled->TcpDst);
+    XdpProgramFreeHashTable(&Compiled->Ipv4TcpTuple);
+    XdpProgramFreeHashTable(&Compiled->Ipv6TcpTuple);
+    XdpProgramFreeHashTable(&Compiled->UdpSrc);
+    XdpProgramFreeHashTable(&Compiled->TcpSrc);
+    XdpProgramFreeLpm(&Compiled->Ipv4DstLpm);
+    XdpProgramFreeLpm(&Compiled->Ipv6DstLpm);
+    XdpProgramFreeLpm(&Compiled->Ipv4SrcLpm);
+    XdpProgramFreeLpm(&Compiled->Ipv6SrcLpm);
+
+    if (Compiled->RuleIndexStorage != NULL) {
+        ExFreePoolWithTag(Compiled->RuleIndexStorage, XDP_POOLTAG_PROGRAM);
+    }
+
+    if (Compiled->RuleHits != NULL) {
+        ExFreePoolWithTag(Compiled->RuleHits, XDP_POOLTAG_PROGRAM);
+    }
+
+    if (Compiled->MinRuleIndexStorage != NULL) {
+        ExFreePoolWithTag(Compiled->MinRuleIndexStorage, XDP_POOLTAG_PROGRAM);
+    }
+
+    ExFreePoolWithTag(Compiled, XDP_POOLTAG_PROGRAM);
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+XdpProgramCompile(
+    _In_reads_(RuleCount) CONST XDP_RULE *Rules,
+    _In_ UINT32 RuleCount,
+    _In_ BOOLEAN TrackRuleHits,
+    _Out_ XDP_PROGRAM_COMPILED **NewCompiled
+    )
+{
+    XDP_PROGRAM_COMPILED *Compiled = NULL;
+    UINT32 HashEntryCounts[XDP_PROGRAM_MATCH_TYPE_COUNT] = {0};
+    BOOLEAN FlowMatchesOnly = TRUE;
+    NTSTATUS Status;
+
+    TraceEnter(
+        TRACE_CORE, "Rules=%p RuleCount=%u TrackRuleHits=%!BOOLEAN!",
+        Rules, RuleCount, TrackRuleHits);
+
+    Compiled = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Compiled), XDP_POOLTAG_PROGRAM);
+    if (Compiled == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    //
+    // Size each exact-match table by the number of rules of its match type.
+    //
+    for (UINT32 Index = 0; Index < RuleCount; Index++) {
+        HashEntryCounts[Rules[Index].Match]++;
+    }
+
+    for (UINT32 Match = 0; Match < RTL_NUMBER_OF(HashEntryCounts); Match++) {
+        XDP_PROGRAM_HASH_TABLE *Table =
+            XdpProgramGetRuleHashTable(Compiled, (XDP_MATCH_TYPE)Match);
+
+        if (Table != NULL) {
+            Status = XdpProgramAllocateHashTable(Table, HashEntryCounts[Match]);
+            if (!NT_SUCCESS(Status)) {
+                goto Exit;
+            }
+        }
+    }
+
+    Status =
+        XdpProgramCompileLpm(Rules, RuleCount, XDP_MATCH_IPV4_DST_MASK, &Compiled->Ipv4DstLpm);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status =
+        XdpProgramCompileLpm(Rules, RuleCount, XDP_MATCH_IPV6_DST_MASK, &Compiled->Ipv6DstLpm);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status =
+        XdpProgramCompileLpm(Rules, RuleCount, XDP_MATCH_IPV4_SRC_MASK, &Compiled->Ipv4SrcLpm);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status =
+        XdpProgramCompileLpm(Rules, RuleCount, XDP_MATCH_IPV6_SRC_MASK, &Compiled->Ipv6SrcLpm);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    if (RuleCount > 0) {
+        SIZE_T AllocationSize;
+
+        Status =
+            RtlSizeTMult(
+                sizeof(*Compiled->RuleIndexStorage) * XDP_PROGRAM_FRAME_CLASS_COUNT,
+                RuleCount, &AllocationSize);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        Compiled->RuleIndexStorage =
+            ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, XDP_POOLTAG_PROGRAM);
+        if (Compiled->RuleIndexStorage == NULL) {
+            Status = STATUS_NO_MEMORY;
+            goto Exit;
+        }
+
+        for (UINT32 Class = 0; Class < XDP_PROGRAM_FRAME_CLASS_COUNT; Class++) {
+            Compiled->Sequences[Class].RuleIndexes =
+                &Compiled->RuleIndexStorage[Class * RuleCount];
+        }
+
+        if (TrackRuleHits) {
+            Compiled->MinRuleIndexStorage =
+                ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, XDP_POOLTAG_PROGRAM);
+            if (Compiled->MinRuleIndexStorage == NULL) {
+                Status = STATUS_NO_MEMORY;
+                goto Exit;
+            }
+
+            Status = RtlSizeTMult(sizeof(*Compiled->RuleHits), RuleCount, &AllocationSize);
+            if (!NT_SUCCESS(Status)) {
+                goto Exit;
+            }
+
+            Compiled->RuleHits =
+                ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, XDP_POOLTAG_PROGRAM);
+            if (Compiled->RuleHits == NULL) {
+                Status = STATUS_NO_MEMORY;
+                goto Exit;
+            }
+        }
+    }
+
+    for (UINT32 Index = 0; Index < RuleCount; Index++) {
+        CONST XDP_RULE *Rule = &Rules[Index];
+        CONST XDP_TUPLE *Tuple = &Rule->Pattern.Tuple;
+        UINT32 PrefixLength;
+        UINT32 Classes;
+        BOOLEAN Indexed = FALSE;
+
+        switch (Rule->Match) {
+        case XDP_MATCH_UDP_DST:
+        case XDP_MATCH_TCP_DST:
+        case XDP_MATCH_UDP_SRC:
+        case XDP_MATCH_TCP_SRC:
+            XdpProgramHashInsert(
+                XdpProgramGetRuleHashTable(Compiled, Rule->Match), Rules, Index,
+                XdpProgramHashPort(Rule->Pattern.Port));
+            Indexed = TRUE;
+            break;
+
+        case XDP_MATCH_IPV4_UDP_TUPLE:
+        case XDP_MATCH_IPV4_TCP_TUPLE:
+            XdpProgramHashInsert(
+                XdpProgramGetRuleHashTable(Compiled, Rule->Match), Rules, Index,
+                XdpProgramHashIpv4Tuple(
+                    &Tuple->SourceAddress.Ipv4, &Tuple->DestinationAddress.Ipv4,
+                    Tuple->SourcePort, Tuple->DestinationPort));
+            Indexed = TRUE;
+            break;
+
+        case XDP_MATCH_IPV6_UDP_TUPLE:
+        case XDP_MATCH_IPV6_TCP_TUPLE:
+            XdpProgramHashInsert(
+                XdpProgramGetRuleHashTable(Compiled, Rule->Match), Rules, Index,
+                XdpProgramHashIpv6Tuple(
+                    &Tuple->SourceAddress.Ipv6, &Tuple->DestinationAddress.Ipv6,
+                    Tuple->SourcePort, Tuple->DestinationPort));
+            Indexed = TRUE;
+            break;
+
+        case XDP_MATCH_IPV4_DST_MASK:
+            Indexed =
+                Compiled->Ipv4DstLpm.Root != NULL &&
+                XdpProgramIsLpmRule(Rule, XDP_MATCH_IPV4_DST_MASK, &PrefixLength);
+            break;
+
+        case XDP_MATCH_IPV6_DST_MASK:
+            Indexed =
+                Compiled->Ipv6DstLpm.Root != NULL &&
+                XdpProgramIsLpmRule(Rule, XDP_MATCH_IPV6_DST_MASK, &PrefixLength);
+            break;
+
+        case XDP_MATCH_IPV4_SRC_MASK:
+            Indexed =
+                Compiled->Ipv4SrcLpm.Root != NULL &&
+                XdpProgramIsLpmRule(Rule, XDP_MATCH_IPV4_SRC_MASK, &PrefixLength);
+            break;
+
+        case XDP_MATCH_IPV6_SRC_MASK:
+            Indexed =
+                Compiled->Ipv6SrcLpm.Root != NULL &&
+                XdpProgramIsLpmRule(Rule, XDP_MATCH_IPV6_SRC_MASK, &PrefixLength);
+            break;
+        }
+
+        if (Rule->Match != XDP_MATCH_ALL) {
+            Compiled->ParseRequired = TRUE;
+        }
+
+        if (!XdpProgramIsFlowMatch(Rule->Match)) {
+            FlowMatchesOnly = FALSE;
+        }
+
+        if (Indexed) {
+            Compiled->IndexedRuleCount++;
+            continue;
+        }
+
+        //
+        // Append the rule to the sequence of each frame class it can match.
+        //
+        Classes = XdpProgramGetRuleFrameClasses(Rule);
+
+        for (UINT32 Class = 0; Class < XDP_PROGRAM_FRAME_CLASS_COUNT; Class++) {
+            if (Classes & XDP_PROGRAM_FRAME_CLASS_BIT(Class)) {
+                XDP_PROGRAM_RULE_SEQUENCE *Sequence = &Compiled->Sequences[Class];
+                Sequence->RuleIndexes[Sequence->RuleCount++] = Index;
+            }
+        }
+    }
+
+    Compiled->FlowCacheEnabled = Compiled->ParseRequired && FlowMatchesOnly;
+
+    XdpProgramTraceCompiled(Compiled, RuleCount);
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (NT_SUCCESS(Status)) {
+        *NewCompiled = Compiled;
+    } else {
+        XdpProgramFreeCompiled(Compiled);
+        *NewCompiled = NULL;
+    }
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+//
+// Returns whether no frame can match both rules. The check is conservative:
+// rules are only known to be disjoint if they have the same match type and
+// their patterns differ in a field the match compares exactly.
+//
+static
+BOOLEAN
+XdpProgramAreRulesDisjoint(
+    _In_ CONST XDP_RULE *Rule,
+    _In_ CONST XDP_RULE *OtherRule
+    )
+{
+    CONST XDP_MATCH_PATTERN *Pattern = &Rule->Pattern;
+    CONST XDP_MATCH_PATTERN *OtherPattern = &OtherRule->Pattern;
+
+    if (Rule->Match != OtherRule->Match) {
+        return FALSE;
+    }
+
+    switch (Rule->Match) {
+    case XDP_MATCH_IPV4_DST_MASK:
+    case XDP_MATCH_IPV4_SRC_MASK:
+        //
+        // A frame matching both rules has the same value in the bits covered by
+        // both masks.
+        //
+        return
+            ((Pattern->IpMask.Address.Ipv4.s_addr ^ OtherPattern->IpMask.Address.Ipv4.s_addr) &
+                Pattern->IpMask.Mask.Ipv4.s_addr & OtherPattern->IpMask.Mask.Ipv4.s_addr) != 0;
+
+    case XDP_MATCH_IPV6_DST_MASK:
+    case XDP_MATCH_IPV6_SRC_MASK:
+        for (UINT32 i = 0; i < sizeof(IN6_ADDR); i++) {
+            if ((Pattern->IpMask.Address.Ipv6.u.Byte[i] ^
+                    OtherPattern->IpMask.Address.Ipv6.u.Byte[i]) &
+                Pattern->IpMask.Mask.Ipv6.u.Byte[i] & OtherPattern->IpMask.Mask.Ipv6.u.Byte[i]) {
+                return TRUE;
+            }
+        }
+        return FALSE;
+
+    case XDP_MATCH_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_QUIC_FLOW_DST_CID:
+        return Pattern->QuicFlow.UdpPort != OtherPattern->QuicFlow.UdpPort;
+
+    case XDP_MATCH_QUIC_FLOW_DST_CID_TABLE:
+        return Pattern->QuicCidTable.UdpPort != OtherPattern->QuicCidTable.UdpPort;
+
+    case XDP_MATCH_IPV4_UDP_PORT_SET:
+    case XDP_MATCH_IPV4_TCP_PORT_SET:
+        return
+            !IN4_ADDR_EQUAL(
+                &Pattern->IpPortSet.Address.Ipv4, &OtherPattern->IpPortSet.Address.Ipv4);
+
+    case XDP_MATCH_IPV6_UDP_PORT_SET:
+    case XDP_MATCH_IPV6_TCP_PORT_SET:
+        return
+            !IN6_ADDR_EQUAL(
+                &Pattern->IpPortSet.Address.Ipv6, &OtherPattern->IpPortSet.Address.Ipv6);
+
+    case XDP_MATCH_PAYLOAD:
+    {
+        CONST XDP_PAYLOAD_MATCH *Payload = &Pattern->Payload;
+        CONST XDP_PAYLOAD_MATCH *OtherPayload = &OtherPattern->Payload;
+        UINT32 Start;
+        UINT32 End;
+
+        if (Payload->Layer != OtherPayload->Layer) {
+            return FALSE;
+        }
+
+        //
+        // Compare the bytes both rules match at the same offset, within both
+        // masks. The captured values are already masked.
+        //
+        Start = max(Payload->Offset, OtherPayload->Offset);
+        End =
+            min((UINT32)Payload->Offset + Payload->Length,
+                (UINT32)OtherPayload->Offset + OtherPayload->Length);
+
+        for (UINT32 Offset = Start; Offset < End; Offset++) {
+            UINT32 i = Offset - Payload->Offset;
+            UINT32 j = Offset - OtherPayload->Offset;
+
+            if ((Payload->Value[i] ^ OtherPayload->Value[j]) &
+                Payload->Mask[i] & OtherPayload->Mask[j]) {
+                return TRUE;
+            }
+        }
+
+        return FALSE;
+    }
+
+    case XDP_MATCH_TUNNEL_VNI:
+        return
+            Pattern->Tunnel.UdpPort != OtherPattern->Tunnel.UdpPort ||
+            Pattern->Tunnel.Vni != OtherPattern->Tunnel.Vni;
+
+    case XDP_MATCH_TUNNEL_IPV4_TUPLE:
+    case XDP_MATCH_TUNNEL_IPV6_TUPLE:
+    {
+        CONST XDP_TUNNEL_TUPLE *TunnelTuple = &Pattern->TunnelTuple;
+        CONST XDP_TUNNEL_TUPLE *OtherTunnelTuple = &OtherPattern->TunnelTuple;
+
+        if (TunnelTuple->Tunnel.UdpPort != OtherTunnelTuple->Tunnel.UdpPort ||
+            TunnelTuple->Tunnel.Vni != OtherTunnelTuple->Tunnel.Vni ||
+            TunnelTuple->Protocol != OtherTunnelTuple->Protocol ||
+            TunnelTuple->Tuple.SourcePort != OtherTunnelTuple->Tuple.SourcePort ||
+            TunnelTuple->Tuple.DestinationPort != OtherTunnelTuple->Tuple.DestinationPort) {
+            return TRUE;
+        }
+
+        if (Rule->Match == XDP_MATCH_TUNNEL_IPV4_TUPLE) {
+            return
+                !IN4_ADDR_EQUAL(
+                    &TunnelTuple->Tuple.SourceAddress.Ipv4,
+                    &OtherTunnelTuple->Tuple.SourceAddress.Ipv4) ||
+                !IN4_ADDR_EQUAL(
+                    &TunnelTuple->Tuple.DestinationAddress.Ipv4,
+                    &OtherTunnelTuple->Tuple.DestinationAddress.Ipv4);
+        } else {
+            return
+                !IN6_ADDR_EQUAL(
+                    &TunnelTuple->Tuple.SourceAddress.Ipv6,
+                    &OtherTunnelTuple->Tuple.SourceAddress.Ipv6) ||
+                !IN6_ADDR_EQUAL(
+                    &TunnelTuple->Tuple.DestinationAddress.Ipv6,
+                    &OtherTunnelTuple->Tuple.DestinationAddress.Ipv6);
+        }
+    }
+
+    case XDP_MATCH_VLAN_ID:
+        //
+        // The outer VLAN identifier is always compared; the inner identifier
+        // only if both rules compare it.
+        //
+        return
+            Pattern->Vlan.VlanId != OtherPattern->Vlan.VlanId ||
+            ((Pattern->Vlan.Flags & OtherPattern->Vlan.Flags & XDP_VLAN_MATCH_FLAG_INNER) &&
+                Pattern->Vlan.InnerVlanId != OtherPattern->Vlan.InnerVlanId);
+
+    case XDP_MATCH_ETH_DST:
+        return
+            !XdpProgramIsAddressEqual(
+                Pattern->MacAddress.Address, OtherPattern->MacAddress.Address,
+                sizeof(Pattern->MacAddress));
+
+    case XDP_MATCH_ETHERTYPE:
+        return Pattern->EtherType != OtherPattern->EtherType;
+
+    default:
+        return FALSE;
+    }
+}
+
+//
+// Reorders the rules of a sequence in ascending rule index order so the rules
+// with the most hits are evaluated first, without changing the lowest-indexed
+// rule matching any frame. The sequence is split into consecutive groups of
+// pairwise disjoint rules; a frame matches at most one rule of a group, so the
+// rules within a group can be evaluated in any order. Returns whether any rule
+// was moved.
+//
+static
+BOOLEAN
+XdpProgramOrderSequence(
+    _Inout_ XDP_PROGRAM_RULE_SEQUENCE *Sequence,
+    _In_ CONST XDP_RULE *Rules,
+    _In_ CONST UINT64 *RuleHits
+    )
+{
+    UINT32 *RuleIndexes = Sequence->RuleIndexes;
+    UINT32 GroupStart = 0;
+    BOOLEAN Reordered = FALSE;
+
+    while (GroupStart < Sequence->RuleCount) {
+        UINT32 GroupEnd = GroupStart + 1;
+
+        while (GroupEnd < Sequence->RuleCount &&
+            GroupEnd - GroupStart < XDP_PROGRAM_REORDER_MAX_GROUP_SIZE) {
+            CONST XDP_RULE *Rule = &Rules[RuleIndexes[GroupEnd]];
+            UINT32 i;
+
+            for (i = GroupStart; i < GroupEnd; i++) {
+                if (!XdpProgramAreRulesDisjoint(Rule, &Rules[RuleIndexes[i]])) {
+                    break;
+                }
+            }
+
+            if (i < GroupEnd) {
+                break;
+            }
+
+            GroupEnd++;
+        }
+
+        //
+        // Sort the group by descending hits. The insertion sort is stable, so
+        // rules with equal hits remain in rule index order.
+        //
+        for (UINT32 i = GroupStart + 1; i < GroupEnd; i++) {
+            UINT32 RuleIndex = RuleIndexes[i];
+            UINT32 j = i;
+
+            while (j > GroupStart && RuleHits[RuleIndexes[j - 1]] < RuleHits[RuleIndex]) {
+                RuleIndexes[j] = RuleIndexes[j - 1];
+                j--;
+            }
+
+            if (j != i) {
+                RuleIndexes[j] = RuleIndex;
+                Reordered = TRUE;
+            }
+        }
+
+        GroupStart = GroupEnd;
+    }
+
+    return Reordered;
+}
+
+//
+// Reorders each sequence of a newly compiled ruleset by the hits recorded in
+// its counters.
+//
+static
+VOID
+XdpProgramOrderCompiled(
+    _Inout_ XDP_PROGRAM_COMPILED *Compiled,
+    _In_reads_(RuleCount) CONST XDP_RULE *Rules,
+    _In_ UINT32 RuleCount
+    )
+{
+    ASSERT(Compiled->RuleHits != NULL);
+
+    for (UINT32 Class = 0; Class < XDP_PROGRAM_FRAME_CLASS_COUNT; Class++) {
+        XDP_PROGRAM_RULE_SEQUENCE *Sequence = &Compiled->Sequences[Class];
+        UINT32 MinRuleIndex = XDP_PROGRAM_RULE_INDEX_NONE;
+
+        ASSERT(Sequence->MinRuleIndexes == NULL);
+
+        if (!XdpProgramOrderSequence(Sequence, Rules, Compiled->RuleHits)) {
+            continue;
+        }
+
+        Sequence->MinRuleIndexes = &Compiled->MinRuleIndexStorage[Class * RuleCount];
+
+        for (UINT32 i = Sequence->RuleCount; i > 0; i--) {
+            MinRuleIndex = min(MinRuleIndex, Sequence->RuleIndexes[i - 1]);
+            Sequence->MinRuleIndexes[i - 1] = MinRuleIndex;
+        }
+    }
+}
+
+//
+// Returns whether two compilations of the same ruleset evaluate their sequences
+// in the same order.
+//
+static
+BOOLEAN
+XdpProgramIsCompiledOrderEqual(
+    _In_ CONST XDP_PROGRAM_COMPILED *Compiled,
+    _In_ CONST XDP_PROGRAM_COMPILED *OtherCompiled
+    )
+{
+    for (UINT32 Class = 0; Class < XDP_PROGRAM_FRAME_CLASS_COUNT; Class++) {
+        CONST XDP_PROGRAM_RULE_SEQUENCE *Sequence = &Compiled->Sequences[Class];
+        CONST XDP_PROGRAM_RULE_SEQUENCE *OtherSequence = &OtherCompiled->Sequences[Class];
+
+        ASSERT(Sequence->RuleCount == OtherSequence->RuleCount);
+
+        if (!RtlEqualMemory(
+                Sequence->RuleIndexes, OtherSequence->RuleIndexes,
+                Sequence->RuleCount * sizeof(*Sequence->RuleIndexes))) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+typedef struct _XDP_PROGRAM_SET_COMPILED_PARAMS {
+    XDP_PROGRAM *Program;
+    XDP_PROGRAM_COMPILED *Compiled;
+} XDP_PROGRAM_SET_COMPILED_PARAMS;
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramSetCompiled(
+    _In_opt_ VOID *CallbackContext
+    )
+{
+    XDP_PROGRAM_SET_COMPILED_PARAMS *Params = CallbackContext;
+
+    ASSERT(CallbackContext != NULL);
+
+    Params->Program->Compiled = Params->Compiled;
+    Params->Program->Generation++;
+}
+
+static
+NTSTATUS
+XdpProgramGetRuleBufferSize(
+    _In_ UINT32 RuleCapacity,
+    _Out_ SIZE_T *BufferSize
+    )
+{
+    //
+    // A rule buffer holds the rules followed by the per-rule statistics map.
+    //
+    C_ASSERT(sizeof(XDP_RULE) % sizeof(XDP_RULE_STATISTICS *) == 0);
+    return
+        RtlSizeTMult(
+            sizeof(XDP_RULE) + sizeof(XDP_RULE_STATISTICS *), RuleCapacity, BufferSize);
+}
+
+static
+XDP_RULE *
+XdpProgramGetInlineRules(
+    _In_ XDP_PROGRAM_OBJECT *ProgramObject
+    )
+{
+    return (XDP_RULE *)(ProgramObject + 1);
+}
+
+static
+VOID
+XdpProgramFreeRuleBuffer(
+    _In_ XDP_PROGRAM_OBJECT *ProgramObject,
+    _In_opt_ XDP_RULE *Rules
+    )
+{
+    if (Rules != NULL && Rules != XdpProgramGetInlineRules(ProgramObject)) {
+        ExFreePoolWithTag(Rules, XDP_POOLTAG_PROGRAM);
+    }
+}
+
+static
+VOID
+XdpProgramFreeMetaProgram(
+    _In_ XDP_PROGRAM_OBJECT *MetaProgramObject
+    )
+{
+    ASSERT(MetaProgramObject->Flags.IsMetaProgram);
+
+    XdpProgramFreeCompiled(MetaProgramObject->Program.Compiled);
+    XdpProgramFreeRuleBuffer(MetaProgramObject, MetaProgramObject->Program.Rules);
+    XdpProgramFreeRuleBuffer(MetaProgramObject, MetaProgramObject->StagedRules);
+    ExFreePoolWithTag(MetaProgramObject, XDP_POOLTAG_PROGRAM);
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramPopulateMetaProgram(
+    _Inout_ XDP_PROGRAM_OBJECT *MetaProgramObject
+    )
+{
+    XDP_PROGRAM *MetaProgram = &MetaProgramObject->Program;
+    LIST_ENTRY *Entry = &MetaProgramObject->SharingLink;
+
+    TraceEnter(TRACE_CORE, "MetaProgram=%p", MetaProgramObject);
+
+    //
+    // Traverse the shared programs and concatenate their rulesets into the
+    // shared metaprogram. Note that we may be reusing a previously-populated
+    // metaprogram if a shared program is being detached.
+    //
+    MetaProgram->RuleCount = 0;
+    MetaProgram->RuleStatistics = NULL;
+    MetaProgramObject->Flags.StatisticsEnabled = FALSE;
+
+    while ((Entry = Entry->Flink) != &MetaProgramObject->SharingLink) {
+        CONST XDP_PROGRAM_OBJECT *SharedProgramObject =
+            CONTAINING_RECORD(Entry, XDP_PROGRAM_OBJECT, SharingLink);
+        CONST XDP_PROGRAM *SharedProgram = &SharedProgramObject->Program;
+
+        //
+        // Each shared program retains its own statistics, which persist
+        // across metaprogram replacements. Rule updates of the metaprogram
+        // publish its statistics map along with the rules, even if the shared
+        // program has no rules yet.
+        //
+        if (SharedProgramObject->Flags.StatisticsEnabled) {
+            MetaProgram->RuleStatistics = MetaProgramObject->RuleStatisticsStorage;
+            MetaProgramObject->Flags.StatisticsEnabled = TRUE;
+        }
+
+        for (UINT32 i = 0; i < SharedProgram->RuleCount; i++) {
+            MetaProgramObject->RuleStatisticsStorage[MetaProgram->RuleCount] =
+                (SharedProgram->RuleStatistics != NULL) ?
+                    SharedProgram->RuleStatistics[i] : NULL;
+            MetaProgram->Rules[MetaProgram->RuleCount++] = SharedProgram->Rules[i];
+        }
+
+        ASSERT(SharedProgramObject->Flags.SharingEnabled);
+
+        TraceInfo(
+            TRACE_CORE, "Merged SharedProgram=%p into MetaProgram=%p",
+            SharedProgramObject, MetaProgramObject);
+        XdpProgramTraceObject(SharedProgramObject);
+    }
+
+    TraceExitSuccess(TRACE_CORE);
+}
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramRepopulateMetaProgram(
+    _In_opt_ VOID *CallbackContext
+    )
+{
+    XDP_PROGRAM_OBJECT *MetaProgramObject = CallbackContext;
+
+    ASSERT(CallbackContext != NULL);
+
+    //
+    // The lookup structures no longer describe the ruleset, so revert to
+    // evaluating the rules linearly. The caller frees the stale structures.
+    //
+    MetaProgramObject->Program.Compiled = NULL;
+    MetaProgramObject->Program.Generation++;
+    XdpProgramPopulateMetaProgram(MetaProgramObject);
+}
+
+static
+VOID
+XdpProgramDetachRxQueue(
+    _In_ XDP_PROGRAM_OBJECT *ProgramObject
+    )
+{
+    XDP_RX_QUEUE *RxQueue = ProgramObject->RxQueue;
+
+    TraceEnter(TRACE_CORE, "Program=%p", ProgramObject);
+
+    ASSERT(RxQueue != NULL);
+    ASSERT(!ProgramObject->Flags.IsMetaProgram);
+
+    if (XdpRxQueueGetProgram(RxQueue) == &ProgramObject->Program) {
+        ASSERT(!ProgramObject->Flags.SharingEnabled);
+        XdpRxQueueDeregisterNotifications(RxQueue, &ProgramObject->RxQueueNotificationEntry);
+        XdpRxQueueSetProgram(RxQueue, NULL);
+    } else if (ProgramObject->Flags.SharingEnabled && !IsListEmpty(&ProgramObject->SharingLink)) {
+        XDP_PROGRAM *MetaProgram = XdpRxQueueGetProgram(RxQueue);
+        XDP_PROGRAM_OBJECT *MetaProgramObject =
+            CONTAINING_RECORD(MetaProgram, XDP_PROGRAM_OBJECT, Program);
+
+        //
+        // This program isn't directly attached to the RX queue, but a meta
+        // program is. Remove this program from the metaprogram, and either
+        // update the program ruleset (in-place) or remove the meta-program if
+        // this was the final shared program.
+        //
+        ASSERT(MetaProgram != NULL);
+        ASSERT(MetaProgramObject->Flags.IsMetaProgram);
+
+        XdpRxQueueDeregisterNotifications(RxQueue, &ProgramObject->RxQueueNotificationEntry);
+        RemoveEntryList(&ProgramObject->SharingLink);
+        InitializeListHead(&ProgramObject->SharingLink);
+
+        if (IsListEmpty(&MetaProgramObject->SharingLink)) {
+            XdpRxQueueSetProgram(RxQueue, NULL);
+            XdpProgramFreeMetaProgram(MetaProgramObject);
+            TraceInfo(
+                TRACE_CORE, "Detached metaprogram RxQueue=%p Program=%p",
+                RxQueue, MetaProgramObject);
+        } else {
+            XDP_PROGRAM_COMPILED *OldCompiled = MetaProgram->Compiled;
+            XDP_PROGRAM_SET_COMPILED_PARAMS SetParams = {0};
+            NTSTATUS Status;
+
+            XdpRxQueueSync(RxQueue, XdpProgramRepopulateMetaProgram, MetaProgramObject);
+            XdpProgramFreeCompiled(OldCompiled);
+
+            //
+            // Detach cannot fail, so if the updated ruleset cannot be compiled,
+            // the metaprogram continues to evaluate its rules linearly.
+            //
+            SetParams.Program = MetaProgram;
+            Status =
+                XdpProgramCompile(
+                    MetaProgram->Rules, MetaProgram->RuleCount, FALSE, &SetParams.Compiled);
+            if (NT_SUCCESS(Status)) {
+                XdpRxQueueSync(RxQueue, XdpProgramSetCompiled, &SetParams);
+            }
+
+            TraceInfo(
+                TRACE_CORE, "Updated metaprogram RxQueue=%p Program=%p",
+                RxQueue, MetaProgramObject);
+        }
+    }
+
+    TraceExitSuccess(TRACE_CORE);
+}
+static
+VOID
+XdpProgramReleasePortSet(
+    _Inout_ XDP_PORT_SET *PortSet
+    )
+{
+    PortSet->PortSet = NULL;
+
+    if (PortSet->Reserved != NULL) {
+        MDL *Mdl = PortSet->Reserved;
+        if (Mdl->MdlFlags & MDL_PAGES_LOCKED) {
+            MmUnlockPages(Mdl);
+        }
+        IoFreeMdl(Mdl);
+        PortSet->Reserved = NULL;
+    }
+}
+
+static
+NTSTATUS
+XdpProgramCapturePortSet(
+    _In_ CONST XDP_PORT_SET *UserPortSet,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_PORT_SET *KernelPortSet
+    )
+{
+    NTSTATUS Status;
+
+    __try {
+        if (UserPortSet->Reserved != NULL) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+
+        KernelPortSet->Reserved =
+            IoAllocateMdl(UserPortSet->PortSet, XDP_PORT_SET_BUFFER_SIZE, FALSE, FALSE, NULL);
+        if (KernelPortSet->Reserved == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
+
+        MmProbeAndLockPages(KernelPortSet->Reserved, RequestorMode, IoReadAccess);
+
+        KernelPortSet->PortSet =
+            MmGetSystemAddressForMdlSafe(KernelPortSet->Reserved, LowPagePriority);
+        if (KernelPortSet->PortSet == NULL) {
+            Status = STATUS_INSUFFICIENT_RESOURCES;
+            goto Exit;
+        }
+
+        Status = STATUS_SUCCESS;
+    } __except(EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        XdpProgramReleasePortSet(KernelPortSet);
+    }
+
+    return Status;
+}
+
+static
+XDP_REDIRECT_PARAMS *
+XdpProgramGetRuleRedirect(
+    _In_ XDP_RULE *Rule
+    )
+{
+    switch (Rule->Action) {
+    case XDP_PROGRAM_ACTION_REDIRECT:
+        return &Rule->Redirect;
+    case XDP_PROGRAM_ACTION_SAMPLE:
+        return &Rule->Sample.Redirect;
+    default:
+        return NULL;
+    }
+}
+
+static
+NTSTATUS
+XdpProgramValidateRedirect(
+    _In_ CONST XDP_REDIRECT_PARAMS *Redirect,
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    CONST XDP_PROGRAM_XSK_GROUP *Group;
+    NTSTATUS Status = STATUS_SUCCESS;
+
+    switch (Redirect->TargetType) {
+
+    case XDP_REDIRECT_TARGET_TYPE_XSK:
+        Status = XskValidateDatapathHandle(Redirect->Target, RxQueue);
+        break;
+
+    case XDP_REDIRECT_TARGET_TYPE_XSK_GROUP:
+        Group = Redirect->Target;
+
+        for (UINT32 Index = 0; Index < Group->SocketCount; Index++) {
+            Status = XskValidateDatapathHandle(Group->Sockets[Index], RxQueue);
+            if (!NT_SUCCESS(Status)) {
+                break;
+            }
+        }
+
+        break;
+
+    default:
+        break;
+    }
+
+    return Status;
+}
+
+static
+NTSTATUS
+XdpProgramValidateRule(
+    _In_ XDP_RULE *Rule,
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    XDP_REDIRECT_PARAMS *Redirect = XdpProgramGetRuleRedirect(Rule);
+
+    if (Redirect != NULL) {
+        return XdpProgramValidateRedirect(Redirect, RxQueue);
+    }
+
+    if (Rule->Action == XDP_PROGRAM_ACTION_L2FWD && !XdpRxQueueIsTxActionSupported(RxQueue)) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+XdpProgramReleaseXskGroup(
+    _In_ XDP_PROGRAM_XSK_GROUP *Group
+    )
+{
+    for (UINT32 Index = 0; Index < Group->SocketCount; Index++) {
+        XskDereferenceDatapathHandle(Group->Sockets[Index]);
+    }
+
+    ExFreePoolWithTag(Group, XDP_POOLTAG_PROGRAM);
+}
+
+static
+VOID
+XdpProgramPopulateXskGroup(
+    _Inout_ XDP_PROGRAM_XSK_GROUP *Group
+    )
+{
+    UINT32 Offsets[XDP_XSK_GROUP_MAX_SOCKETS];
+    UINT32 Skips[XDP_XSK_GROUP_MAX_SOCKETS];
+    UINT32 Next[XDP_XSK_GROUP_MAX_SOCKETS] = {0};
+    UINT32 FilledCount = 0;
+
+    ASSERT(Group->SocketCount > 0);
+
+    //
+    // Derive each socket's permutation of the lookup table from the identity
+    // of the socket rather than its position in the group, so a socket claims
+    // the same entries regardless of the other members. The table size is
+    // prime, so every non-zero skip visits every entry.
+    //
+    for (UINT32 Index = 0; Index < Group->SocketCount; Index++) {
+        UINT64 Key = (UINT64)(ULONG_PTR)Group->Sockets[Index];
+        UINT32 Hash;
+
+        Hash = XdpProgramHashMix(0, (UINT32)Key);
+        Hash = XdpProgramHashMix(Hash, (UINT32)(Key >> 32));
+        Offsets[Index] = XdpProgramHashFinalize(Hash) % XDP_PROGRAM_XSK_GROUP_LOOKUP_SIZE;
+        Hash = XdpProgramHashMix(Hash, Offsets[Index]);
+        Skips[Index] =
+            XdpProgramHashFinalize(Hash) % (XDP_PROGRAM_XSK_GROUP_LOOKUP_SIZE - 1) + 1;
+    }
+
+    RtlFillMemory(Group->Lookup, sizeof(Group->Lookup), XDP_PROGRAM_XSK_GROUP_ENTRY_NONE);
+
+    //
+    // Let the sockets take turns claiming their next preferred entry that is
+    // still free, until the table is full.
+    //
+    for (;;) {
+        for (UINT32 Index = 0; Index < Group->SocketCount; Index++) {
+            UINT32 Entry;
+
+            do {
+                Entry =
+                    (Offsets[Index] + Next[Index] * Skips[Index]) %
+                        XDP_PROGRAM_XSK_GROUP_LOOKUP_SIZE;
+                Next[Index]++;
+            } while (Group->Lookup[Entry] != XDP_PROGRAM_XSK_GROUP_ENTRY_NONE);
+
+            Group->Lookup[Entry] = (UINT8)Index;
+
+            if (++FilledCount == XDP_PROGRAM_XSK_GROUP_LOOKUP_SIZE) {
+                return;
+            }
+        }
+    }
+}
+
+static
+NTSTATUS
+XdpProgramCaptureXskGroup(
+    _In_ CONST XDP_XSK_GROUP *UserGroup,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Out_ XDP_PROGRAM_XSK_GROUP **KernelGroup
+    )
+{
+    XDP_PROGRAM_XSK_GROUP *Group = NULL;
+    NTSTATUS Status;
+
+    if (UserGroup->SocketCount == 0 || UserGroup->SocketCount > XDP_XSK_GROUP_MAX_SOCKETS) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Group = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Group), XDP_POOLTAG_PROGRAM);
+    if (Group == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    //
+    // The handle array itself has not been bounced, so the handles are probed
+    // and read individually.
+    //
+    for (UINT32 Index = 0; Index < UserGroup->SocketCount; Index++) {
+        Status =
+            XskReferenceDatapathHandle(
+                RequestorMode, &UserGroup->Sockets[Index], FALSE, &Group->Sockets[Index]);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        Group->SocketCount++;
+
+        for (UINT32 PreviousIndex = 0; PreviousIndex < Index; PreviousIndex++) {
+            if (Group->Sockets[PreviousIndex] == Group->Sockets[Index]) {
+                Status = STATUS_INVALID_PARAMETER;
+                goto Exit;
+            }
+        }
+    }
+
+    XdpProgramPopulateXskGroup(Group);
+
+    *KernelGroup = Group;
+    Group = NULL;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (Group != NULL) {
+        XdpProgramReleaseXskGroup(Group);
+    }
+
+    return Status;
+}
+
+static
+VOID
+XdpProgramFreeQuicCidEntry(
+    _In_ XDP_PROGRAM_QUIC_CID_ENTRY *Entry
+    )
+{
+    if (Entry->Target != NULL) {
+        XskDereferenceDatapathHandle(Entry->Target);
+    }
+
+    ExFreePoolWithTag(Entry, XDP_POOLTAG_PROGRAM);
+}
+
+static
+NTSTATUS
+XdpProgramAllocateQuicCidBuckets(
+    _In_ UINT32 BucketCount,
+    _In_ UINT32 LinkIndex,
+    _Out_ XDP_PROGRAM_QUIC_CID_BUCKETS **NewBuckets
+    )
+{
+    XDP_PROGRAM_QUIC_CID_BUCKETS *Buckets;
+
+    ASSERT(BucketCount <= XDP_PROGRAM_QUIC_CID_TABLE_MAX_BUCKETS);
+    ASSERT(LinkIndex < XDP_PROGRAM_QUIC_CID_LINK_COUNT);
+
+    Buckets =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, FIELD_OFFSET(XDP_PROGRAM_QUIC_CID_BUCKETS, Heads[BucketCount]),
+            XDP_POOLTAG_PROGRAM);
+    if (Buckets == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    Buckets->BucketMask = BucketCount - 1;
+    Buckets->LinkIndex = LinkIndex;
+    *NewBuckets = Buckets;
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+XdpProgramReleaseQuicCidTable(
+    _Inout_ XDP_QUIC_CID_TABLE *TablePattern
+    )
+{
+    XDP_PROGRAM_QUIC_CID_TABLE *Table = TablePattern->Reserved;
+
+    if (Table == NULL) {
+        return;
+    }
+
+    if (Table->Buckets != NULL) {
+        XDP_PROGRAM_QUIC_CID_BUCKETS *Buckets = Table->Buckets;
+
+        for (UINT32 Index = 0; Index <= Buckets->BucketMask; Index++) {
+            while (Buckets->Heads[Index] != NULL) {
+                XDP_PROGRAM_QUIC_CID_ENTRY *Entry = Buckets->Heads[Index];
+
+                Buckets->Heads[Index] = Entry->Next[Buckets->LinkIndex];
+                XdpProgramFreeQuicCidEntry(Entry);
+            }
+        }
+
+        ExFreePoolWithTag(Buckets, XDP_POOLTAG_PROGRAM);
+    }
+
+    ExFreePoolWithTag(Table, XDP_POOLTAG_PROGRAM);
+    TablePattern->Reserved = NULL;
+}
+
+static
+NTSTATUS
+XdpProgramCaptureQuicCidTable(
+    _In_ CONST XDP_QUIC_CID_TABLE *UserPattern,
+    _Inout_ XDP_QUIC_CID_TABLE *KernelPattern
+    )
+{
+    XDP_PROGRAM_QUIC_CID_TABLE *Table;
+
+    if (UserPattern->Reserved != NULL || UserPattern->CidLength == 0 ||
+        UserPattern->CidOffset + UserPattern->CidLength > QUIC_MAX_CID_LENGTH) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    *KernelPattern = *UserPattern;
+
+    Table = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Table), XDP_POOLTAG_PROGRAM);
+    if (Table == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    KernelPattern->Reserved = Table;
+
+    return
+        XdpProgramAllocateQuicCidBuckets(
+            XDP_PROGRAM_QUIC_CID_TABLE_MIN_BUCKETS, 0, &Table->Buckets);
+}
+
+static
+NTSTATUS
+XdpProgramCaptureMap(
+    _In_ CONST XDP_MAP_MATCH *UserPattern,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_MAP_MATCH *KernelPattern
+    )
+{
+    NTSTATUS Status;
+    XDP_MAP *Map;
+    UINT32 FieldSize;
+
+    switch (UserPattern->KeyField) {
+    case XDP_MAP_KEY_FIELD_IPV4_SOURCE:
+    case XDP_MAP_KEY_FIELD_IPV4_DESTINATION:
+        FieldSize = sizeof(IN_ADDR);
+        break;
+    case XDP_MAP_KEY_FIELD_IPV6_SOURCE:
+    case XDP_MAP_KEY_FIELD_IPV6_DESTINATION:
+        FieldSize = sizeof(IN6_ADDR);
+        break;
+    case XDP_MAP_KEY_FIELD_UDP_SOURCE:
+    case XDP_MAP_KEY_FIELD_UDP_DESTINATION:
+    case XDP_MAP_KEY_FIELD_TCP_SOURCE:
+    case XDP_MAP_KEY_FIELD_TCP_DESTINATION:
+        FieldSize = sizeof(UINT16);
+        break;
+    default:
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    //
+    // Capture the map reference in the context of the calling thread.
+    //
+    Status = XdpMapReferenceByHandle(UserPattern->Map, RequestorMode, &Map);
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    KernelPattern->Map = Map;
+    KernelPattern->KeyField = UserPattern->KeyField;
+
+    if (!XdpMapIsFieldSizeValid(Map, FieldSize)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+XdpProgramFreeAddressSet(
+    _In_opt_ XDP_PROGRAM_ADDRESS_SET *Set
+    )
+{
+    if (Set == NULL) {
+        return;
+    }
+
+    if (Set->Slots != NULL) {
+        ExFreePoolWithTag(Set->Slots, XDP_POOLTAG_PROGRAM);
+    }
+
+    if (Set->BloomAllocation != NULL) {
+        ExFreePoolWithTag(Set->BloomAllocation, XDP_POOLTAG_PROGRAM);
+    }
+
+    ExFreePoolWithTag(Set, XDP_POOLTAG_PROGRAM);
+}
+
+static
+VOID
+XdpProgramInsertAddressSet(
+    _Inout_ XDP_PROGRAM_ADDRESS_SET *Set,
+    _In_reads_bytes_(Set->AddressLength) CONST UCHAR *Address
+    )
+{
+    UCHAR *Slot;
+    UINT32 Hash;
+    UINT32 SlotIndex;
+
+    Hash = XdpProgramHashAddress(Address, Set->AddressLength);
+
+    if (Set->BloomBlocks != NULL) {
+        XDP_PROGRAM_BLOOM_BLOCK *Block;
+        UINT32 BitIndex;
+        UINT32 BitStep;
+
+        Block = XdpProgramGetBloomBlock(Set, Hash, &BitIndex, &BitStep);
+
+        for (UINT32 i = 0; i < XDP_PROGRAM_BLOOM_HASH_COUNT; i++) {
+            Block->Bits[BitIndex / 64] |= 1ui64 << (BitIndex % 64);
+            BitIndex = (BitIndex + BitStep) & (XDP_PROGRAM_BLOOM_BLOCK_BITS - 1);
+        }
+    }
+
+    if (XdpProgramIsAddressZero(Address, Set->AddressLength)) {
+        Set->ContainsZero = TRUE;
+        return;
+    }
+
+    for (SlotIndex = Hash & Set->SlotMask;; SlotIndex = (SlotIndex + 1) & Set->SlotMask) {
+        Slot = &Set->Slots[(SIZE_T)SlotIndex * Set->AddressLength];
+
+        if (XdpProgramIsAddressZero(Slot, Set->AddressLength)) {
+            RtlCopyMemory(Slot, Address, Set->AddressLength);
+            return;
+        }
+
+        if (XdpProgramIsAddressEqual(Slot, Address, Set->AddressLength)) {
+            return;
+        }
+    }
+}
+
+//
+// Allocates an empty address set sized for the given number of addresses. The
+// caller frees the set even on failure.
+//
+static
+NTSTATUS
+XdpProgramAllocateAddressSet(
+    _In_ UINT32 AddressCount,
+    _In_ UINT32 AddressLength,
+    _In_ BOOLEAN BloomFilter,
+    _Out_ XDP_PROGRAM_ADDRESS_SET **NewSet
+    )
+{
+    XDP_PROGRAM_ADDRESS_SET *Set;
+    UINT32 SlotCount;
+    NTSTATUS Status;
+
+    Set = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Set), XDP_POOLTAG_PROGRAM);
+    *NewSet = Set;
+    if (Set == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    Set->AddressLength = AddressLength;
+
+    //
+    // Keep the slot array at most three quarters full, which bounds the length
+    // of probe sequences.
+    //
+    Status = RtlUInt32RoundUpToPowerOfTwo(AddressCount + AddressCount / 3 + 1, &SlotCount);
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    Set->Slots =
+        ExAllocatePoolZero(
+            NonPagedPoolNx, (SIZE_T)SlotCount * AddressLength, XDP_POOLTAG_PROGRAM);
+    if (Set->Slots == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    Set->SlotMask = SlotCount - 1;
+
+    if (BloomFilter) {
+        UINT32 BlockCount =
+            (AddressCount * XDP_PROGRAM_BLOOM_BITS_PER_ADDRESS +
+                XDP_PROGRAM_BLOOM_BLOCK_BITS - 1) / XDP_PROGRAM_BLOOM_BLOCK_BITS;
+
+        Status = RtlUInt32RoundUpToPowerOfTwo(BlockCount, &BlockCount);
+        if (!NT_SUCCESS(Status)) {
+            return Status;
+        }
+
+        //
+        // Pool allocations are not necessarily cache line aligned, so the
+        // blocks are aligned within a padded allocation.
+        //
+        Set->BloomAllocation =
+            ExAllocatePoolZero(
+                NonPagedPoolNx,
+                (SIZE_T)BlockCount * sizeof(*Set->BloomBlocks) + XDP_PROGRAM_BLOOM_BLOCK_SIZE - 1,
+                XDP_POOLTAG_PROGRAM);
+        if (Set->BloomAllocation == NULL) {
+            return STATUS_NO_MEMORY;
+        }
+
+        Set->BloomBlocks =
+            ALIGN_UP_POINTER_BY(Set->BloomAllocation, XDP_PROGRAM_BLOOM_BLOCK_SIZE);
+        Set->BloomBlockMask = BlockCount - 1;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XdpProgramCaptureIpAddressSet(
+    _In_ CONST XDP_IP_ADDRESS_SET *UserPattern,
+    _In_ UINT32 AddressLength,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_IP_ADDRESS_SET *KernelPattern
+    )
+{
+    XDP_PROGRAM_ADDRESS_SET *Set;
+    CONST XDP_INET_ADDR *Addresses = UserPattern->Addresses;
+    UINT32 AddressCount = UserPattern->AddressCount;
+    NTSTATUS Status;
+
+    if (UserPattern->Reserved != NULL || AddressCount == 0 ||
+        AddressCount > XDP_IP_ADDRESS_SET_MAX_ADDRESSES ||
+        (UserPattern->Flags &
+            ~(XDP_IP_ADDRESS_SET_FLAG_SOURCE | XDP_IP_ADDRESS_SET_FLAG_BLOOM_FILTER)) != 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    KernelPattern->Addresses = NULL;
+    KernelPattern->AddressCount = AddressCount;
+    KernelPattern->Flags = UserPattern->Flags;
+
+    Status =
+        XdpProgramAllocateAddressSet(
+            AddressCount, AddressLength,
+            !!(UserPattern->Flags & XDP_IP_ADDRESS_SET_FLAG_BLOOM_FILTER), &Set);
+    KernelPattern->Reserved = Set;
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    //
+    // The address array has not been bounced, so it is probed and read here.
+    //
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID *)Addresses, sizeof(*Addresses) * AddressCount,
+                PROBE_ALIGNMENT(XDP_INET_ADDR));
+        }
+
+        for (UINT32 Index = 0; Index < AddressCount; Index++) {
+            XDP_INET_ADDR Address;
+
+            RtlCopyMemory(&Address, &Addresses[Index], AddressLength);
+            XdpProgramInsertAddressSet(Set, (CONST UCHAR *)&Address);
+        }
+
+        Status = STATUS_SUCCESS;
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+    }
+
+    return Status;
+}
+
+static
+NTSTATUS
+XdpProgramCaptureMacAddressSet(
+    _In_ CONST XDP_MAC_ADDRESS_SET *UserPattern,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_MAC_ADDRESS_SET *KernelPattern
+    )
+{
+    XDP_PROGRAM_ADDRESS_SET *Set;
+    CONST XDP_MAC_ADDRESS *Addresses = UserPattern->Addresses;
+    UINT32 AddressCount = UserPattern->AddressCount;
+    NTSTATUS Status;
+
+    if (UserPattern->Reserved != NULL || AddressCount == 0 ||
+        AddressCount > XDP_MAC_ADDRESS_SET_MAX_ADDRESSES ||
+        (UserPattern->Flags & ~XDP_MAC_ADDRESS_SET_FLAG_BLOOM_FILTER) != 0) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    KernelPattern->Addresses = NULL;
+    KernelPattern->AddressCount = AddressCount;
+    KernelPattern->Flags = UserPattern->Flags;
+
+    Status =
+        XdpProgramAllocateAddressSet(
+            AddressCount, sizeof(XDP_MAC_ADDRESS),
+            !!(UserPattern->Flags & XDP_MAC_ADDRESS_SET_FLAG_BLOOM_FILTER), &Set);
+    KernelPattern->Reserved = Set;
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    //
+    // The address array has not been bounced, so it is probed and read here.
+    //
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID *)Addresses, sizeof(*Addresses) * AddressCount,
+                PROBE_ALIGNMENT(XDP_MAC_ADDRESS));
+        }
+
+        for (UINT32 Index = 0; Index < AddressCount; Index++) {
+            XDP_MAC_ADDRESS Address = Addresses[Index];
+
+            XdpProgramInsertAddressSet(Set, Address.Address);
+        }
+
+        Status = STATUS_SUCCESS;
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+    }
+
+    return Status;
+}
+
+static
+NTSTATUS
+XdpProgramCapturePayload(
+    _In_ CONST XDP_PAYLOAD_MATCH *UserPattern,
+    _Out_ XDP_PAYLOAD_MATCH *KernelPattern
+    )
+{
+    if (UserPattern->Layer < XDP_PAYLOAD_LAYER_L2 ||
+        UserPattern->Layer > XDP_PAYLOAD_LAYER_L4_PAYLOAD ||
+        UserPattern->Length == 0 || UserPattern->Length > XDP_PAYLOAD_MATCH_MAX_LENGTH) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    //
+    // Zero the mask and value beyond the match length, and the value outside
+    // the mask, so the data path compares whole words.
+    //
+    RtlZeroMemory(KernelPattern, sizeof(*KernelPattern));
+    KernelPattern->Layer = UserPattern->Layer;
+    KernelPattern->Offset = UserPattern->Offset;
+    KernelPattern->Length = UserPattern->Length;
+
+    for (UINT32 Index = 0; Index < UserPattern->Length; Index++) {
+        KernelPattern->Mask[Index] = UserPattern->Mask[Index];
+        KernelPattern->Value[Index] = UserPattern->Value[Index] & UserPattern->Mask[Index];
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+BOOLEAN
+XdpProgramIsTunnelValid(
+    _In_ CONST XDP_TUNNEL *Tunnel
+    )
+{
+    return
+        (Tunnel->Type == XDP_TUNNEL_TYPE_VXLAN || Tunnel->Type == XDP_TUNNEL_TYPE_GENEVE) &&
+        Tunnel->Vni <= XDP_TUNNEL_VNI_MAX;
+}
+
+static
+NTSTATUS
+XdpProgramVerifyBytecode(
+    _In_ CONST XDP_PROGRAM_BYTECODE *Bytecode
+    )
+{
+    UINT32 Count = Bytecode->InstructionCount;
+
+    //
+    // Jumps are forward only and land within the program, and the last
+    // instruction returns, so every path ends with a return after at most
+    // InstructionCount steps.
+    //
+    if (Bytecode->Instructions[Count - 1].Opcode != XDP_BYTECODE_OP_RETURN) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    for (UINT32 Pc = 0; Pc < Count; Pc++) {
+        CONST XDP_BYTECODE_INSTRUCTION *Instruction = &Bytecode->Instructions[Pc];
+        UINT32 Size;
+        BOOLEAN Indexed;
+        BOOLEAN IsLoad = XdpBytecodeIsLoad(Instruction->Opcode, &Size, &Indexed);
+        BOOLEAN IsJump = FALSE;
+        BOOLEAN IsConditional = FALSE;
+
+        switch (Instruction->Opcode) {
+        case XDP_BYTECODE_OP_RETURN:
+        case XDP_BYTECODE_OP_LOAD_IMMEDIATE:
+        case XDP_BYTECODE_OP_AND:
+        case XDP_BYTECODE_OP_OR:
+        case XDP_BYTECODE_OP_ADD:
+            break;
+
+        case XDP_BYTECODE_OP_LOAD_8:
+        case XDP_BYTECODE_OP_LOAD_16:
+        case XDP_BYTECODE_OP_LOAD_32:
+        case XDP_BYTECODE_OP_LOAD_INDEXED_8:
+        case XDP_BYTECODE_OP_LOAD_INDEXED_16:
+        case XDP_BYTECODE_OP_LOAD_INDEXED_32:
+            if (Instruction->Layer > XDP_PAYLOAD_LAYER_L4_PAYLOAD ||
+                Instruction->Immediate > MAXUINT16) {
+                return STATUS_INVALID_PARAMETER;
+            }
+            break;
+
+        case XDP_BYTECODE_OP_LEFT_SHIFT:
+        case XDP_BYTECODE_OP_RIGHT_SHIFT:
+            if (Instruction->Immediate >= 32) {
+                return STATUS_INVALID_PARAMETER;
+            }
+            break;
+
+        case XDP_BYTECODE_OP_MOVE_TO_INDEX:
+            if (Instruction->Immediate != 0) {
+                return STATUS_INVALID_PARAMETER;
+            }
+            break;
+
+        case XDP_BYTECODE_OP_JUMP:
+            if (Instruction->Immediate != 0) {
+                return STATUS_INVALID_PARAMETER;
+            }
+            IsJump = TRUE;
+            break;
+
+        case XDP_BYTECODE_OP_JUMP_EQUAL:
+        case XDP_BYTECODE_OP_JUMP_GREATER:
+        case XDP_BYTECODE_OP_JUMP_GREATER_EQUAL:
+        case XDP_BYTECODE_OP_JUMP_SET:
+            IsJump = TRUE;
+            IsConditional = TRUE;
+            break;
+
+        default:
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        //
+        // Fields unused by the opcode must be zero.
+        //
+        if ((!IsLoad && Instruction->Layer != 0) ||
+            (!IsJump && Instruction->JumpTrue != 0) ||
+            (!IsConditional && Instruction->JumpFalse != 0)) {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        if (IsJump &&
+            (Pc + 1 + Instruction->JumpTrue >= Count ||
+                Pc + 1 + Instruction->JumpFalse >= Count)) {
+            return STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+VOID
+XdpProgramReleaseBytecode(
+    _Inout_ XDP_BYTECODE *BytecodePattern
+    )
+{
+    if (BytecodePattern->Reserved != NULL) {
+        ExFreePoolWithTag(BytecodePattern->Reserved, XDP_POOLTAG_PROGRAM);
+        BytecodePattern->Reserved = NULL;
+    }
+}
+
+static
+NTSTATUS
+XdpProgramCaptureBytecode(
+    _In_ CONST XDP_BYTECODE *UserPattern,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_BYTECODE *KernelPattern
+    )
+{
+    XDP_PROGRAM_BYTECODE *Bytecode;
+    CONST XDP_BYTECODE_INSTRUCTION *Instructions = UserPattern->Instructions;
+    UINT32 InstructionCount = UserPattern->InstructionCount;
+
+    if (UserPattern->Reserved != NULL || InstructionCount == 0 ||
+        InstructionCount > XDP_BYTECODE_MAX_INSTRUCTIONS) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    KernelPattern->Instructions = NULL;
+    KernelPattern->InstructionCount = InstructionCount;
+
+    Bytecode =
+        ExAllocatePoolZero(
+            NonPagedPoolNx,
+            FIELD_OFFSET(XDP_PROGRAM_BYTECODE, Instructions[InstructionCount]),
+            XDP_POOLTAG_PROGRAM);
+    if (Bytecode == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    KernelPattern->Reserved = Bytecode;
+    Bytecode->InstructionCount = InstructionCount;
+
+    //
+    // The instruction array has not been bounced, so it is probed and copied
+    // here, and then verified from the copy.
+    //
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead(
+                (VOID *)Instructions, sizeof(*Instructions) * InstructionCount,
+                PROBE_ALIGNMENT(XDP_BYTECODE_INSTRUCTION));
+        }
+        RtlCopyMemory(
+            Bytecode->Instructions, Instructions, sizeof(*Instructions) * InstructionCount);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        return GetExceptionCode();
+    }
+
+    return XdpProgramVerifyBytecode(Bytecode);
+}
+
+static
+VOID
+XdpProgramReleaseRule(
+    _Inout_ XDP_RULE *Rule
+    )
+{
+    XDP_REDIRECT_PARAMS *Redirect = XdpProgramGetRuleRedirect(Rule);
+
+    if (Rule->Match == XDP_MATCH_IPV4_UDP_PORT_SET ||
+        Rule->Match == XDP_MATCH_IPV6_UDP_PORT_SET ||
+        Rule->Match == XDP_MATCH_IPV4_TCP_PORT_SET ||
+        Rule->Match == XDP_MATCH_IPV6_TCP_PORT_SET) {
+        XdpProgramReleasePortSet(&Rule->Pattern.IpPortSet.PortSet);
+    }
+
+    if (Rule->Match == XDP_MATCH_UDP_PORT_SET ||
+        Rule->Match == XDP_MATCH_TCP_PORT_SET ||
+        Rule->Match == XDP_MATCH_UDP_SRC_PORT_SET ||
+        Rule->Match == XDP_MATCH_TCP_SRC_PORT_SET) {
+        XdpProgramReleasePortSet(&Rule->Pattern.PortSet);
+    }
+
+    if (Rule->Match == XDP_MATCH_QUIC_FLOW_DST_CID_TABLE) {
+        XdpProgramReleaseQuicCidTable(&Rule->Pattern.QuicCidTable);
+    }
+
+    if (Rule->Match == XDP_MATCH_MAP && Rule->Pattern.Map.Map != NULL) {
+        XdpMapDereference(Rule->Pattern.Map.Map);
+        Rule->Pattern.Map.Map = NULL;
+    }
+
+    if (Rule->Match == XDP_MATCH_IPV4_ADDRESS_SET ||
+        Rule->Match == XDP_MATCH_IPV6_ADDRESS_SET) {
+        XdpProgramFreeAddressSet(Rule->Pattern.IpAddressSet.Reserved);
+        Rule->Pattern.IpAddressSet.Reserved = NULL;
+    }
+
+    if (Rule->Match == XDP_MATCH_ETH_DST_SET) {
+        XdpProgramFreeAddressSet(Rule->Pattern.MacAddressSet.Reserved);
+        Rule->Pattern.MacAddressSet.Reserved = NULL;
+    }
+
+    if (Rule->Match == XDP_MATCH_BYTECODE) {
+        XdpProgramReleaseBytecode(&Rule->Pattern.Bytecode);
+    }
+
+    if (Redirect != NULL) {
+
+        switch (Redirect->TargetType) {
+
+        case XDP_REDIRECT_TARGET_TYPE_XSK:
+            if (Redirect->Target != NULL) {
+                XskDereferenceDatapathHandle(Redirect->Target);
+                Redirect->Target = NULL;
+            }
+            break;
+
+        case XDP_REDIRECT_TARGET_TYPE_XSK_GROUP:
+            if (Redirect->Target != NULL) {
+                XdpProgramReleaseXskGroup(Redirect->Target);
+                Redirect->Target = NULL;
+            }
+            break;
+
+        case XDP_REDIRECT_TARGET_TYPE_QUIC_CID_TABLE:
+            //
+            // The targets are referenced by the connection ID table entries.
+            //
+            break;
+
+        default:
+            ASSERT(FALSE);
+        }
+    }
+
+    if (Rule->Action == XDP_PROGRAM_ACTION_RATE_LIMIT && Rule->RateLimit.Reserved != NULL) {
+        ExFreePoolWithTag(Rule->RateLimit.Reserved, XDP_POOLTAG_PROGRAM);
+        Rule->RateLimit.Reserved = NULL;
+    }
+
+    if (Rule->Action == XDP_PROGRAM_ACTION_SAMPLE && Rule->Sample.Reserved != NULL) {
+        ExFreePoolWithTag(Rule->Sample.Reserved, XDP_POOLTAG_PROGRAM);
+        Rule->Sample.Reserved = NULL;
+    }
+}
+
+static
+NTSTATUS
+XdpProgramCaptureRedirect(
+    _In_ CONST XDP_REDIRECT_PARAMS *UserParams,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_REDIRECT_PARAMS *KernelParams
+    )
+{
+    XDP_PROGRAM_XSK_GROUP *Group;
+    NTSTATUS Status;
+
+    //
+    // Capture object handle references in the context of the calling thread.
+    // The handle will be validated further on the control path.
+    //
+    switch (UserParams->TargetType) {
+
+    case XDP_REDIRECT_TARGET_TYPE_XSK:
+        KernelParams->TargetType = UserParams->TargetType;
+        Status =
+            XskReferenceDatapathHandle(
+                RequestorMode, &UserParams->Target, TRUE, &KernelParams->Target);
+        break;
+
+    case XDP_REDIRECT_TARGET_TYPE_XSK_GROUP:
+        KernelParams->TargetType = UserParams->TargetType;
+        Status = XdpProgramCaptureXskGroup(&UserParams->XskGroup, RequestorMode, &Group);
+        if (NT_SUCCESS(Status)) {
+            KernelParams->Target = Group;
+        }
+        break;
+
+    case XDP_REDIRECT_TARGET_TYPE_QUIC_CID_TABLE:
+        if (UserParams->Target != NULL) {
+            Status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+        KernelParams->TargetType = UserParams->TargetType;
+        Status = STATUS_SUCCESS;
+        break;
+
+    default:
+        Status = STATUS_INVALID_PARAMETER;
+        break;
+    }
+
+    return Status;
+}
+
+static
+NTSTATUS
+XdpProgramCaptureSample(
+    _In_ CONST XDP_SAMPLE_PARAMS *UserParams,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Inout_ XDP_SAMPLE_PARAMS *KernelParams
+    )
+{
+    XDP_PROGRAM_SAMPLER *Sampler;
+    NTSTATUS Status;
+
+    if (UserParams->Reserved != NULL || UserParams->Interval == 0 ||
+        UserParams->Redirect.TargetType == XDP_REDIRECT_TARGET_TYPE_QUIC_CID_TABLE) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    KernelParams->Interval = UserParams->Interval;
+
+    Status =
+        XdpProgramCaptureRedirect(&UserParams->Redirect, RequestorMode, &KernelParams->Redirect);
+    if (!NT_SUCCESS(Status)) {
+        return Status;
+    }
+
+    Sampler = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Sampler), XDP_POOLTAG_PROGRAM);
+    if (Sampler == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    //
+    // Sample the first matching frame.
+    //
+    Sampler->Countdown = 1;
+    KernelParams->Reserved = Sampler;
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XdpProgramCaptureRateLimit(
+    _In_ CONST XDP_RATE_LIMIT_PARAMS *UserParams,
+    _Inout_ XDP_RATE_LIMIT_PARAMS *KernelParams
+    )
+{
+    XDP_PROGRAM_RATE_LIMITER *Limiter;
+    UINT64 FrameBurst;
+    UINT64 ByteBurst;
+
+    if (UserParams->Reserved != NULL ||
+        (UserParams->FramesPerSecond == 0 && UserParams->BytesPerSecond == 0) ||
+        UserParams->BytesPerSecond > XDP_RATE_LIMIT_MAX_BYTES ||
+        UserParams->ByteBurst > XDP_RATE_LIMIT_MAX_BYTES ||
+        (UserParams->ConformAction != XDP_PROGRAM_ACTION_DROP &&
+            UserParams->ConformAction != XDP_PROGRAM_ACTION_PASS) ||
+        (UserParams->ExceedAction != XDP_PROGRAM_ACTION_DROP &&
+            UserParams->ExceedAction != XDP_PROGRAM_ACTION_PASS)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    Limiter = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Limiter), XDP_POOLTAG_PROGRAM);
+    if (Limiter == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    FrameBurst =
+        (UserParams->FrameBurst != 0) ? UserParams->FrameBurst : UserParams->FramesPerSecond;
+    ByteBurst =
+        (UserParams->ByteBurst != 0) ? UserParams->ByteBurst : UserParams->BytesPerSecond;
+
+    Limiter->FrameCapacity = FrameBurst * XDP_PROGRAM_RATE_LIMIT_SCALE;
+    Limiter->ByteCapacity = ByteBurst * XDP_PROGRAM_RATE_LIMIT_SCALE;
+
+    if (UserParams->FramesPerSecond > 0) {
+        Limiter->FrameFillTime =
+            (Limiter->FrameCapacity + UserParams->FramesPerSecond - 1) /
+                UserParams->FramesPerSecond;
+    }
+
+    if (UserParams->BytesPerSecond > 0) {
+        Limiter->ByteFillTime =
+            (Limiter->ByteCapacity + UserParams->BytesPerSecond - 1) /
+                UserParams->BytesPerSecond;
+    }
+    Limiter->FrameTokens = Limiter->FrameCapacity;
+    Limiter->ByteTokens = Limiter->ByteCapacity;
+    Limiter->UpdateTime = KeQueryInterruptTime();
+
+    *KernelParams = *UserParams;
+    KernelParams->Reserved = Limiter;
+
+    return STATUS_SUCCESS;
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+XdpProgramCaptureRule(
+    _In_ CONST XDP_RULE *UserRule,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Out_ XDP_RULE *ValidatedRule
+    )
+{
+    NTSTATUS Status;
+
+    //
+    // Initialize the trusted kernel rule buffer. On failure, the caller must
+    // release the partially validated rule.
+    //
+    RtlZeroMemory(ValidatedRule, sizeof(*ValidatedRule));
+
+    if (UserRule->Match < XDP_MATCH_ALL || UserRule->Match >= XDP_PROGRAM_MATCH_TYPE_COUNT) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    ValidatedRule->Match = UserRule->Match;
+
+    //
+    // Validate each match condition. Many match conditions support all
+    // possible input pattern values.
+    //
+    switch (ValidatedRule->Match) {
+    case XDP_MATCH_QUIC_FLOW_SRC_CID:
+    case XDP_MATCH_QUIC_FLOW_DST_CID:
+        if (UserRule->Pattern.QuicFlow.CidLength > RTL_FIELD_SIZE(XDP_QUIC_FLOW, CidData)) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+        ValidatedRule->Pattern.QuicFlow = UserRule->Pattern.QuicFlow;
+        break;
+    case XDP_MATCH_QUIC_FLOW_DST_CID_TABLE:
+        Status =
+            XdpProgramCaptureQuicCidTable(
+                &UserRule->Pattern.QuicCidTable, &ValidatedRule->Pattern.QuicCidTable);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    case XDP_MATCH_MAP:
+        Status =
+            XdpProgramCaptureMap(
+                &UserRule->Pattern.Map, RequestorMode, &ValidatedRule->Pattern.Map);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    case XDP_MATCH_BYTECODE:
+        Status =
+            XdpProgramCaptureBytecode(
+                &UserRule->Pattern.Bytecode, RequestorMode, &ValidatedRule->Pattern.Bytecode);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    case XDP_MATCH_VLAN_ID:
+        if (UserRule->Pattern.Vlan.VlanId > XDP_VLAN_ID_MAX ||
+            UserRule->Pattern.Vlan.InnerVlanId > XDP_VLAN_ID_MAX ||
+            (UserRule->Pattern.Vlan.Flags & ~XDP_VLAN_MATCH_FLAG_INNER) != 0 ||
+            (!(UserRule->Pattern.Vlan.Flags & XDP_VLAN_MATCH_FLAG_INNER) &&
+                UserRule->Pattern.Vlan.InnerVlanId != 0)) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+        ValidatedRule->Pattern.Vlan = UserRule->Pattern.Vlan;
+        break;
+    case XDP_MATCH_TUNNEL_VNI:
+        if (!XdpProgramIsTunnelValid(&UserRule->Pattern.Tunnel)) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+        ValidatedRule->Pattern.Tunnel = UserRule->Pattern.Tunnel;
+        break;
+    case XDP_MATCH_TUNNEL_IPV4_TUPLE:
+    case XDP_MATCH_TUNNEL_IPV6_TUPLE:
+        if (!XdpProgramIsTunnelValid(&UserRule->Pattern.TunnelTuple.Tunnel) ||
+            (UserRule->Pattern.TunnelTuple.Protocol != IPPROTO_UDP &&
+                UserRule->Pattern.TunnelTuple.Protocol != IPPROTO_TCP)) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+        ValidatedRule->Pattern.TunnelTuple = UserRule->Pattern.TunnelTuple;
+        break;
+    case XDP_MATCH_PAYLOAD:
+        Status =
+            XdpProgramCapturePayload(
+                &UserRule->Pattern.Payload, &ValidatedRule->Pattern.Payload);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    case XDP_MATCH_IPV4_ADDRESS_SET:
+    case XDP_MATCH_IPV6_ADDRESS_SET:
+        Status =
+            XdpProgramCaptureIpAddressSet(
+                &UserRule->Pattern.IpAddressSet,
+                ValidatedRule->Match == XDP_MATCH_IPV4_ADDRESS_SET ?
+                    sizeof(IN_ADDR) : sizeof(IN6_ADDR),
+                RequestorMode, &ValidatedRule->Pattern.IpAddressSet);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    case XDP_MATCH_ETH_DST_SET:
+        Status =
+            XdpProgramCaptureMacAddressSet(
+                &UserRule->Pattern.MacAddressSet, RequestorMode,
+                &ValidatedRule->Pattern.MacAddressSet);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    case XDP_MATCH_UDP_PORT_SET:
+    case XDP_MATCH_TCP_PORT_SET:
+    case XDP_MATCH_UDP_SRC_PORT_SET:
+    case XDP_MATCH_TCP_SRC_PORT_SET:
+        Status =
+            XdpProgramCapturePortSet(
+                &UserRule->Pattern.PortSet, RequestorMode, &ValidatedRule->Pattern.PortSet);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        break;
+    case XDP_MATCH_IPV4_UDP_PORT_SET:
+    case XDP_MATCH_IPV6_UDP_PORT_SET:
+    case XDP_MATCH_IPV4_TCP_PORT_SET:
+    case XDP_MATCH_IPV6_TCP_PORT_SET:
+        Status =
+            XdpProgramCapturePortSet(
+                &UserRule->Pattern.IpPortSet.PortSet, RequestorMode,
+                &ValidatedRule->Pattern.IpPortSet.PortSet);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+        ValidatedRule->Pattern.IpPortSet.Address = UserRule->Pattern.IpPortSet.Address;
+        break;
+    default:
+        ValidatedRule->Pattern = UserRule->Pattern;
+        break;
+    }
+
+    if (UserRule->Action < XDP_PROGRAM_ACTION_DROP ||
+        UserRule->Action > XDP_PROGRAM_ACTION_L2FWD) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    ValidatedRule->Action = UserRule->Action;
+
+    if (UserRule->Action == XDP_PROGRAM_ACTION_REDIRECT) {
+        Status =
+            XdpProgramCaptureRedirect(
+                &UserRule->Redirect, RequestorMode, &ValidatedRule->Redirect);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    } else if (UserRule->Action == XDP_PROGRAM_ACTION_SAMPLE) {
+        Status = XdpProgramCaptureSample(&UserRule->Sample, RequestorMode, &ValidatedRule->Sample);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    } else if (UserRule->Action == XDP_PROGRAM_ACTION_RATE_LIMIT) {
+        Status = XdpProgramCaptureRateLimit(&UserRule->RateLimit, &ValidatedRule->RateLimit);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    } else if (UserRule->Action == XDP_PROGRAM_ACTION_L2FWD) {
+        if (UserRule->L2Fwd.Flags & ~XDP_L2FWD_FLAG_SWAP_MAC_ADDRESSES) {
+            Status = STATUS_INVALID_PARAMETER;
+            goto Exit;
+        }
+        ValidatedRule->L2Fwd = UserRule->L2Fwd;
+    }
+
+    //
+    // Connection ID table rules, and only those, redirect frames to the
+    // targets of their table entries.
+    //
+    if ((ValidatedRule->Match == XDP_MATCH_QUIC_FLOW_DST_CID_TABLE) !=
+            (ValidatedRule->Action == XDP_PROGRAM_ACTION_REDIRECT &&
+                ValidatedRule->Redirect.TargetType == XDP_REDIRECT_TARGET_TYPE_QUIC_CID_TABLE)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    return Status;
+}
+
+static
+VOID
+XdpProgramDelete(
+    _In_ XDP_PROGRAM_OBJECT *ProgramObject
+    )
+{
+    TraceEnter(TRACE_CORE, "Program=%p", ProgramObject);
+
+    ASSERT(!ProgramObject->Flags.IsMetaProgram);
+
+    //
+    // Detach the XDP program from the RX queue.
+    //
+    if (ProgramObject->RxQueue != NULL) {
+        XdpProgramDetachRxQueue(ProgramObject);
+        XdpRxQueueDereference(ProgramObject->RxQueue);
+        ProgramObject->RxQueue = NULL;
+    }
+
+    //
+    // Clean up the XDP program after data path references are dropped.
+    //
+
+    for (ULONG Index = 0; Index < ProgramObject->Program.RuleCount; Index++) {
+        XdpProgramReleaseRule(&ProgramObject->Program.Rules[Index]);
+
+        if (ProgramObject->Program.RuleStatistics != NULL &&
+            ProgramObject->Program.RuleStatistics[Index] != NULL) {
+            ExFreePoolWithTag(ProgramObject->Program.RuleStatistics[Index], XDP_POOLTAG_PROGRAM);
+        }
+    }
+
+    XdpProgramFreeCompiled(ProgramObject->Program.Compiled);
+    XdpProgramFreeRuleBuffer(ProgramObject, ProgramObject->Program.Rules);
+    XdpProgramFreeRuleBuffer(ProgramObject, ProgramObject->StagedRules);
+
+    //
+    // Timers of programs that failed to attach were never started.
+    //
+    if (ProgramObject->ReorderTimer != NULL) {
+        XdpTimerShutdown(ProgramObject->ReorderTimer, TRUE, TRUE);
+    }
+
+    if (ProgramObject->Program.FragmentTable != NULL) {
+        ExFreePoolWithTag(ProgramObject->Program.FragmentTable, XDP_POOLTAG_PROGRAM);
+    }
+
+    TraceVerbose(TRACE_CORE, "Deleted Program=%p", ProgramObject);
+    ExFreePoolWithTag(ProgramObject, XDP_POOLTAG_PROGRAM);
+    TraceExitSuccess(TRACE_CORE);
+}
+
+static
+VOID
+XdpProgramRxQueueNotify(
+    XDP_RX_QUEUE_NOTIFICATION_ENTRY *NotificationEntry,
+    XDP_RX_QUEUE_NOTIFICATION_TYPE NotificationType
+    )
+{
+    XDP_PROGRAM_OBJECT *ProgramObject =
+        CONTAINING_RECORD(NotificationEntry, XDP_PROGRAM_OBJECT, RxQueueNotificationEntry);
+
+    switch (NotificationType) {
+
+    case XDP_RX_QUEUE_NOTIFICATION_DELETE:
+        XdpProgramDetachRxQueue(ProgramObject);
+        break;
+
+    }
+}
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+BOOLEAN
+XdpProgramCanXskBypass(
+    _In_ XDP_PROGRAM *Program
+    )
+{
+    XDP_PROGRAM_OBJECT *ProgramObject = CONTAINING_RECORD(Program, XDP_PROGRAM_OBJECT, Program);
+
+    return
+        ProgramObject->Flags.SharingEnabled == FALSE &&
+        Program->RuleStatistics == NULL &&
+        Program->RuleCount == 1 &&
+        Program->Rules[0].Match == XDP_MATCH_ALL &&
+        Program->Rules[0].Action == XDP_PROGRAM_ACTION_REDIRECT &&
+        Program->Rules[0].Redirect.TargetType == XDP_REDIRECT_TARGET_TYPE_XSK;
+}
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+XdpProgramCreateInspectBatch(
+    _Out_ XDP_INSPECT_BATCH **InspectBatch
+    )
+{
+    *InspectBatch =
+        ExAllocatePoolZero(NonPagedPoolNx, sizeof(**InspectBatch), XDP_POOLTAG_PROGRAM);
+    if (*InspectBatch == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramDeleteInspectBatch(
+    _In_ XDP_INSPECT_BATCH *InspectBatch
+    )
+{
+    ExFreePoolWithTag(InspectBatch, XDP_POOLTAG_PROGRAM);
+}
+
+static
+NTSTATUS
+XdpProgramAllocate(
+    _In_ UINT32 RuleCount,
+    _Out_ XDP_PROGRAM_OBJECT **NewProgramObject
+    )
+{
+    XDP_PROGRAM_OBJECT *ProgramObject = NULL;
+    SIZE_T AllocationSize;
+    NTSTATUS Status;
+
+    //
+    // Allocate the object followed by its initial rule buffer.
+    //
+    Status = XdpProgramGetRuleBufferSize(RuleCount, &AllocationSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    Status = RtlSizeTAdd(sizeof(*ProgramObject), AllocationSize, &AllocationSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    ProgramObject = ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, XDP_POOLTAG_PROGRAM);
+    if (ProgramObject == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
+
+    ProgramObject->CreatedByPid = (ULONG_PTR)PsGetCurrentProcessId();
+    ProgramObject->Program.Rules = XdpProgramGetInlineRules(ProgramObject);
+    ProgramObject->RuleStatisticsStorage =
+        (XDP_RULE_STATISTICS **)&ProgramObject->Program.Rules[RuleCount];
+    ProgramObject->RuleCapacity = RuleCount;
+    ExInitializePushLock(&ProgramObject->Lock);
+    InitializeListHead(&ProgramObject->SharingLink);
+
+Exit:
+
+    *NewProgramObject = ProgramObject;
+    return Status;
+}
+
+static
+NTSTATUS
+XdpProgramAllocateRuleStatistics(
+    _Out_ XDP_RULE_STATISTICS **RuleStatistics
+    )
+{
+    //
+    // The statistics are written by the data path on every match, so keep
+    // them on their own cache lines. Each rule's statistics are allocated
+    // separately so they can follow the rule across rule updates.
+    //
+    *RuleStatistics =
+        ExAllocatePoolZero(
+            NonPagedPoolNxCacheAligned, sizeof(**RuleStatistics), XDP_POOLTAG_PROGRAM);
+    if (*RuleStatistics == NULL) {
+        return STATUS_NO_MEMORY;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+XdpProgramAllocateStatistics(
+    _Inout_ XDP_PROGRAM_OBJECT *ProgramObject
+    )
+{
+    XDP_PROGRAM *Program = &ProgramObject->Program;
+    NTSTATUS Status;
+
+    ProgramObject->Flags.StatisticsEnabled = TRUE;
+    Program->RuleStatistics = ProgramObject->RuleStatisticsStorage;
+
+    for (UINT32 i = 0; i < Program->RuleCount; i++) {
+        Status = XdpProgramAllocateRuleStatistics(&Program->RuleStatistics[i]);
+        if (!NT_SUCCESS(Status)) {
+            return Status;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+XdpCaptureProgram(
+    _In_ CONST XDP_RULE *Rules,
+    _In_ ULONG RuleCount,
+    _In_ KPROCESSOR_MODE RequestorMode,
+    _Out_ XDP_PROGRAM_OBJECT **NewProgramObject
+    )
+{
+    NTSTATUS Status;
+    XDP_PROGRAM_OBJECT *ProgramObject = NULL;
+    XDP_PROGRAM *Program = NULL;
+
+    TraceEnter(TRACE_CORE, "-");
+
+    Status = XdpProgramAllocate(RuleCount, &ProgramObject);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    TraceVerbose(TRACE_CORE, "Allocated Program=%p", ProgramObject);
+
+    Program = &ProgramObject->Program;
+
+    __try {
+        if (RequestorMode != KernelMode) {
+            ProbeForRead((VOID*)Rules, sizeof(*Rules) * RuleCount, PROBE_ALIGNMENT(XDP_RULE));
+        }
+        RtlCopyMemory(ProgramObject->Program.Rules, Rules, sizeof(*Rules) * RuleCount);
+    } __except (EXCEPTION_EXECUTE_HANDLER) {
+        Status = GetExceptionCode();
+        goto Exit;
+    }
+
+    for (ULONG Index = 0; Index < RuleCount; Index++) {
+        XDP_RULE UserRule = Program->Rules[Index];
+
+        //
+        // Increment the count of validated rules before capturing each rule.
+        // The error path will not attempt to clean up unvalidated rules.
+        //
+        Program->RuleCount++;
+
+        Status = XdpProgramCaptureRule(&UserRule, RequestorMode, &Program->Rules[Index]);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (NT_SUCCESS(Status)) {
+        ASSERT(ProgramObject != NULL);
+        *NewProgramObject = ProgramObject;
+    } else {
+        if (ProgramObject != NULL) {
+            XdpProgramDelete(ProgramObject);
+        }
+    }
 
-        case XDP_PROGRAM_ACTION_PASS:
-            TraceInfo(
-                TRACE_CORE, "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_PASS",
-                ProgramObject, i);
-            break;
+    TraceExitStatus(TRACE_CORE);
 
-        case XDP_PROGRAM_ACTION_REDIRECT:
+    return Status;
+}
+
+static
+VOID
+XdpProgramAttach(
+    _In_ XDP_BINDING_WORKITEM *WorkItem
+    )
+{
+    XDP_PROGRAM_WORKITEM *Item = (XDP_PROGRAM_WORKITEM *)WorkItem;
+    XDP_PROGRAM_OBJECT *ProgramObject = Item->ProgramObject;
+    XDP_PROGRAM *Program = &ProgramObject->Program;
+    XDP_PROGRAM *ExistingProgram;
+    XDP_PROGRAM_OBJECT *ExistingProgramObject = NULL;
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_CORE, "Program=%p", ProgramObject);
+
+    if (Item->HookId.SubLayer != XDP_HOOK_INSPECT) {
+        //
+        // Only RX queue programs are currently supported.
+        //
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    Status =
+        XdpRxQueueFindOrCreate(
+            Item->Bind.BindingHandle, &Item->HookId, Item->QueueId, &ProgramObject->RxQueue);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    //
+    // Perform further rule validation that require the interface work queue.
+    //
+    for (ULONG Index = 0; Index < Program->RuleCount; Index++) {
+        Status = XdpProgramValidateRule(&Program->Rules[Index], ProgramObject->RxQueue);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    //
+    // Query the existing top-level program on the queue, if any.
+    //
+    ExistingProgram = XdpRxQueueGetProgram(ProgramObject->RxQueue);
+    if (ExistingProgram != NULL) {
+        ExistingProgramObject = CONTAINING_RECORD(ExistingProgram, XDP_PROGRAM_OBJECT, Program);
+    }
+
+    if (ProgramObject->Flags.SharingEnabled) {
+        UINT32 MetaRuleCount = Program->RuleCount;
+        XDP_PROGRAM_OBJECT *NewMetaProgramObject = NULL;
+
+        if (ExistingProgramObject != NULL && !ExistingProgramObject->Flags.SharingEnabled) {
+            Status = STATUS_SHARING_VIOLATION;
+            goto Exit;
+        }
+
+        //
+        // Calculate the new total rule count and allocate a new metaprogram.
+        //
+        if (ExistingProgram != NULL) {
+            Status = RtlUInt32Add(MetaRuleCount, ExistingProgram->RuleCount, &MetaRuleCount);
+            if (!NT_SUCCESS(Status)) {
+                goto Exit;
+            }
+        }
+
+        Status = XdpProgramAllocate(MetaRuleCount, &NewMetaProgramObject);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        NewMetaProgramObject->Flags.SharingEnabled = TRUE;
+        NewMetaProgramObject->Flags.IsMetaProgram = TRUE;
+
+        //
+        // Migrate the list of shared programs from the old metaprogram (if
+        // present) onto the new metaprogram and add our new program to the
+        // list.
+        //
+        if (ExistingProgramObject != NULL) {
+            ASSERT(ExistingProgramObject->Flags.IsMetaProgram);
+            ASSERT(IsListEmpty(&NewMetaProgramObject->SharingLink));
+            ASSERT(!IsListEmpty(&ExistingProgramObject->SharingLink));
+            AppendTailList(&NewMetaProgramObject->SharingLink, &ExistingProgramObject->SharingLink);
+            RemoveEntryList(&ExistingProgramObject->SharingLink);
+            InitializeListHead(&ExistingProgramObject->SharingLink);
+        }
+
+        ASSERT(IsListEmpty(&ProgramObject->SharingLink));
+        InsertTailList(&NewMetaProgramObject->SharingLink, &ProgramObject->SharingLink);
+
+        //
+        // Merge all shared programs into the shared metaprogram ruleset.
+        //
+        XdpProgramPopulateMetaProgram(NewMetaProgramObject);
+
+        //
+        // Build the lookup structures for the merged ruleset, then synchronize
+        // with data path and replace old metaprogram with new metaprogram. The
+        // replacement is guaranteed to succeed when a program is already
+        // attached.
+        //
+        Status =
+            XdpProgramCompile(
+                NewMetaProgramObject->Program.Rules, NewMetaProgramObject->Program.RuleCount,
+                FALSE, &NewMetaProgramObject->Program.Compiled);
+        if (NT_SUCCESS(Status)) {
+            Status = XdpRxQueueSetProgram(ProgramObject->RxQueue, &NewMetaProgramObject->Program);
+        }
+        if (NT_SUCCESS(Status)) {
             TraceInfo(
-                TRACE_CORE,
-                "Program=%p Rule[%u] Action=XDP_PROGRAM_ACTION_REDIRECT "
-                "TargetType=%!REDIRECT_TARGET_TYPE! Target=%p",
-                ProgramObject, i, Rule->Redirect.TargetType, Rule->Redirect.Target);
-            break;
+                TRACE_CORE, "Attached metaprogram RxQueue=%p Program=%p OldProgram=%p",
+                ProgramObject->RxQueue, ProgramObject, ExistingProgramObject);
+            XdpProgramTraceObject(ProgramObject);
 
-        default:
-            ASSERT(FALSE);
-            break;
+            if (ExistingProgramObject != NULL) {
+                XdpProgramFreeMetaProgram(ExistingProgramObject);
+                ExistingProgramObject = NULL;
+            }
+        } else {
+            //
+            // Revert changes to the program and the old metaprogram (if
+            // present), scrap the new metaprogram, and bail.
+            //
+            RemoveEntryList(&ProgramObject->SharingLink);
+            InitializeListHead(&ProgramObject->SharingLink);
+
+            if (ExistingProgramObject != NULL) {
+                AppendTailList(
+                    &ExistingProgramObject->SharingLink, &NewMetaProgramObject->SharingLink);
+                RemoveEntryList(&NewMetaProgramObject->SharingLink);
+                InitializeListHead(&NewMetaProgramObject->SharingLink);
+            }
+
+            ASSERT(IsListEmpty(&NewMetaProgramObject->SharingLink));
+            XdpProgramFreeMetaProgram(NewMetaProgramObject);
+            goto Exit;
+        }
+    } else {
+        //
+        // The new program has not enabled sharing; directly attach this program
+        // to the queue if it is empty.
+        //
+
+        if (ExistingProgramObject != NULL) {
+            Status = STATUS_DUPLICATE_OBJECTID;
+            goto Exit;
+        }
+
+        Status =
+            XdpProgramCompile(
+                Program->Rules, Program->RuleCount, ProgramObject->Flags.AdaptiveOrder,
+                &Program->Compiled);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        Status = XdpRxQueueSetProgram(ProgramObject->RxQueue, Program);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
         }
     }
+
+    TraceInfo(
+        TRACE_CORE, "Attached program RxQueue=%p Program=%p",
+        ProgramObject->RxQueue, ProgramObject);
+    XdpProgramTraceObject(ProgramObject);
+
+    //
+    // Register for interface/queue removal notifications.
+    //
+    XdpRxQueueRegisterNotifications(
+        ProgramObject->RxQueue, &ProgramObject->RxQueueNotificationEntry, XdpProgramRxQueueNotify);
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        XdpProgramDelete(ProgramObject);
+    }
+
+    Item->CompletionStatus = Status;
+    KeSetEvent(&Item->CompletionEvent, 0, FALSE);
+
+    TraceExitStatus(TRACE_CORE);
 }
 
 static
-_IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
-XdpProgramPopulateMetaProgram(
-    _Inout_ XDP_PROGRAM_OBJECT *MetaProgramObject
+XdpProgramDetach(
+    _In_ XDP_BINDING_WORKITEM *WorkItem
     )
 {
-    XDP_PROGRAM *MetaProgram = &MetaProgramObject->Program;
-    LIST_ENTRY *Entry = &MetaProgramObject->SharingLink;
+    XDP_PROGRAM_WORKITEM *Item = (XDP_PROGRAM_WORKITEM *)WorkItem;
 
-    TraceEnter(TRACE_CORE, "MetaProgram=%p", MetaProgramObject);
+    TraceEnter(TRACE_CORE, "Program=%p", Item->ProgramObject);
+
+    XdpIfDereferenceBinding(Item->ProgramObject->IfHandle);
+    XdpProgramDelete(Item->ProgramObject);
+    TraceInfo(TRACE_CORE, "Detached Program=%p", Item->ProgramObject);
+
+    Item->CompletionStatus = STATUS_SUCCESS;
+    KeSetEvent(&Item->CompletionEvent, 0, FALSE);
+
+    TraceExitSuccess(TRACE_CORE);
+}
+
+static
+NTSTATUS
+XdpProgramStageRuleUpdate(
+    _Inout_ XDP_PROGRAM_OBJECT *ProgramObject,
+    _In_ CONST XDP_PROGRAM_RULE_UPDATE *Update,
+    _In_ UINT32 RuleOffset,
+    _Out_ UINT32 *StagedRuleCount
+    )
+{
+    CONST XDP_PROGRAM *Program = &ProgramObject->Program;
+    UINT32 RuleIndex = RuleOffset + Update->RuleIndex;
+    UINT32 InsertCount = 1;
+    UINT32 RemoveCount = 1;
+    UINT32 RuleCount;
+    UINT32 TailCount;
+    NTSTATUS Status;
+
+    switch (Update->Operation) {
+    case XDP_PROGRAM_RULE_OPERATION_ADD:
+        RemoveCount = 0;
+        break;
+    case XDP_PROGRAM_RULE_OPERATION_REMOVE:
+        InsertCount = 0;
+        break;
+    default:
+        ASSERT(Update->Operation == XDP_PROGRAM_RULE_OPERATION_REPLACE);
+        break;
+    }
+
+    ASSERT(RuleIndex + RemoveCount <= Program->RuleCount);
+    TailCount = Program->RuleCount - RuleIndex - RemoveCount;
+
+    Status = RtlUInt32Add(Program->RuleCount - RemoveCount, InsertCount, &RuleCount);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    if (ProgramObject->StagedRuleCapacity < RuleCount) {
+        XDP_RULE *StagedRules;
+        UINT32 RuleCapacity;
+        SIZE_T BufferSize;
+
+        //
+        // Grow the staging buffer geometrically, so a series of additions
+        // reallocates the rule buffers a logarithmic number of times.
+        //
+        if (!NT_SUCCESS(RtlUInt32Mult(RuleCount, 2, &RuleCapacity))) {
+            RuleCapacity = RuleCount;
+        }
+
+        Status = XdpProgramGetRuleBufferSize(RuleCapacity, &BufferSize);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        StagedRules = ExAllocatePoolZero(NonPagedPoolNx, BufferSize, XDP_POOLTAG_PROGRAM);
+        if (StagedRules == NULL) {
+            Status = STATUS_NO_MEMORY;
+            goto Exit;
+        }
+
+        XdpProgramFreeRuleBuffer(ProgramObject, ProgramObject->StagedRules);
+        ProgramObject->StagedRules = StagedRules;
+        ProgramObject->StagedRuleStatistics = (XDP_RULE_STATISTICS **)&StagedRules[RuleCapacity];
+        ProgramObject->StagedRuleCapacity = RuleCapacity;
+    }
 
     //
-    // Traverse the shared programs and concatenate their rulesets into the
-    // shared metaprogram. Note that we may be reusing a previously-populated
-    // metaprogram if a shared program is being detached.
+    // Copy the active ruleset into the staging buffer with the update applied.
+    // Rules are copied shallowly; their captured resources remain owned by the
+    // program that created them.
     //
-    MetaProgram->RuleCount = 0;
+    RtlCopyMemory(ProgramObject->StagedRules, Program->Rules, sizeof(XDP_RULE) * RuleIndex);
+    RtlCopyMemory(
+        ProgramObject->StagedRuleStatistics, ProgramObject->RuleStatisticsStorage,
+        sizeof(XDP_RULE_STATISTICS *) * RuleIndex);
+
+    if (InsertCount > 0) {
+        ProgramObject->StagedRules[RuleIndex] = Update->Rule;
+        ProgramObject->StagedRuleStatistics[RuleIndex] = Update->Statistics;
+    }
 
-    while ((Entry = Entry->Flink) != &MetaProgramObject->SharingLink) {
-        CONST XDP_PROGRAM_OBJECT *SharedProgramObject =
-            CONTAINING_RECORD(Entry, XDP_PROGRAM_OBJECT, SharingLink);
-        CONST XDP_PROGRAM *SharedProgram = &SharedProgramObject->Program;
+    RtlCopyMemory(
+        &ProgramObject->StagedRules[RuleIndex + InsertCount],
+        &Program->Rules[RuleIndex + RemoveCount], sizeof(XDP_RULE) * TailCount);
+    RtlCopyMemory(
+        &ProgramObject->StagedRuleStatistics[RuleIndex + InsertCount],
+        &ProgramObject->RuleStatisticsStorage[RuleIndex + RemoveCount],
+        sizeof(XDP_RULE_STATISTICS *) * TailCount);
+
+    *StagedRuleCount = RuleCount;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    return Status;
+}
+
+typedef struct _XDP_PROGRAM_SWAP_RULES_PARAMS {
+    XDP_PROGRAM_OBJECT *ProgramObject;
+    UINT32 RuleCount;
+    XDP_PROGRAM_COMPILED *Compiled;
+} XDP_PROGRAM_SWAP_RULES_PARAMS;
+
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramSwapRules(
+    _In_opt_ VOID *CallbackContext
+    )
+{
+    XDP_PROGRAM_SWAP_RULES_PARAMS *Params = CallbackContext;
+    XDP_PROGRAM_OBJECT *ProgramObject;
+    XDP_PROGRAM *Program;
+    XDP_RULE *Rules;
+    XDP_RULE_STATISTICS **RuleStatistics;
+    XDP_PROGRAM_COMPILED *Compiled;
+    UINT32 RuleCapacity;
+
+    ASSERT(CallbackContext != NULL);
 
-        for (UINT32 i = 0; i < SharedProgram->RuleCount; i++) {
-            MetaProgram->Rules[MetaProgram->RuleCount++] = SharedProgram->Rules[i];
-        }
+    ProgramObject = Params->ProgramObject;
+    Program = &ProgramObject->Program;
+    Rules = Program->Rules;
+    RuleStatistics = ProgramObject->RuleStatisticsStorage;
+    Compiled = Program->Compiled;
+    RuleCapacity = ProgramObject->RuleCapacity;
 
-        ASSERT(MetaProgram->RuleCount != 0);
-        ASSERT(SharedProgramObject->Flags.SharingEnabled);
+    //
+    // Publish the staged ruleset, and keep the previous ruleset as the staging
+    // buffer for the next update. The previous compiled state is returned to
+    // the caller, which frees it once the data path can no longer use it.
+    //
+    Program->Rules = ProgramObject->StagedRules;
+    Program->RuleCount = Params->RuleCount;
+    Program->Compiled = Params->Compiled;
+    Program->Generation++;
+    ProgramObject->RuleStatisticsStorage = ProgramObject->StagedRuleStatistics;
+    ProgramObject->RuleCapacity = ProgramObject->StagedRuleCapacity;
 
-        TraceInfo(
-            TRACE_CORE, "Merged SharedProgram=%p into MetaProgram=%p",
-            SharedProgramObject, MetaProgramObject);
-        XdpProgramTraceObject(SharedProgramObject);
+    //
+    // The data path counts through the published statistics map, so it must
+    // follow the ruleset. A metaprogram keeps statistics if any of its shared
+    // programs does.
+    //
+    if (ProgramObject->Flags.StatisticsEnabled) {
+        Program->RuleStatistics = ProgramObject->RuleStatisticsStorage;
     }
 
-    TraceExitSuccess(TRACE_CORE);
+    ProgramObject->StagedRules = Rules;
+    ProgramObject->StagedRuleStatistics = RuleStatistics;
+    ProgramObject->StagedRuleCapacity = RuleCapacity;
+    Params->Compiled = Compiled;
 }
 
 static
 VOID
-XdpProgramDetachRxQueue(
-    _In_ XDP_PROGRAM_OBJECT *ProgramObject
+XdpProgramUpdate(
+    _In_ XDP_BINDING_WORKITEM *WorkItem
     )
 {
+    XDP_PROGRAM_WORKITEM *Item = (XDP_PROGRAM_WORKITEM *)WorkItem;
+    XDP_PROGRAM_OBJECT *ProgramObject = Item->ProgramObject;
+    XDP_PROGRAM_RULE_UPDATE *Update = Item->RuleUpdate;
+    XDP_PROGRAM *Program = &ProgramObject->Program;
     XDP_RX_QUEUE *RxQueue = ProgramObject->RxQueue;
+    XDP_PROGRAM_OBJECT *MetaProgramObject = NULL;
+    XDP_PROGRAM_SWAP_RULES_PARAMS SwapParams = {0};
+    XDP_PROGRAM_SWAP_RULES_PARAMS MetaSwapParams = {0};
+    XDP_RULE RemovedRule = {0};
+    XDP_RULE_STATISTICS *RemovedStatistics = NULL;
+    UINT32 RuleOffset = 0;
+    BOOLEAN Attached = FALSE;
+    NTSTATUS Status;
 
-    TraceEnter(TRACE_CORE, "Program=%p", ProgramObject);
+    TraceEnter(
+        TRACE_CORE, "Program=%p Operation=%u RuleIndex=%u",
+        ProgramObject, Update->Operation, Update->RuleIndex);
 
     ASSERT(RxQueue != NULL);
     ASSERT(!ProgramObject->Flags.IsMetaProgram);
 
-    if (XdpRxQueueGetProgram(RxQueue) == &ProgramObject->Program) {
-        ASSERT(!ProgramObject->Flags.SharingEnabled);
-        XdpRxQueueDeregisterNotifications(RxQueue, &ProgramObject->RxQueueNotificationEntry);
-        XdpRxQueueSetProgram(RxQueue, NULL);
-    } else if (ProgramObject->Flags.SharingEnabled && !IsListEmpty(&ProgramObject->SharingLink)) {
-        XDP_PROGRAM *MetaProgram = XdpRxQueueGetProgram(RxQueue);
-        XDP_PROGRAM_OBJECT *MetaProgramObject =
-            CONTAINING_RECORD(MetaProgram, XDP_PROGRAM_OBJECT, Program);
+    if (Update->Operation == XDP_PROGRAM_RULE_OPERATION_ADD ?
+            Update->RuleIndex > Program->RuleCount :
+            Update->RuleIndex >= Program->RuleCount) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (Update->Operation != XDP_PROGRAM_RULE_OPERATION_REMOVE) {
+        Status = XdpProgramValidateRule(&Update->Rule, RxQueue);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
 
+    if (XdpRxQueueGetProgram(RxQueue) == Program) {
         //
-        // This program isn't directly attached to the RX queue, but a meta
-        // program is. Remove this program from the metaprogram, and either
-        // update the program ruleset (in-place) or remove the meta-program if
-        // this was the final shared program.
+        // The RX queue selects its dispatch routines when the program is
+        // attached, and may deliver frames to an XSK without inspecting the
+        // rules at all.
         //
-        ASSERT(MetaProgram != NULL);
-        ASSERT(MetaProgramObject->Flags.IsMetaProgram);
+        if (XdpProgramCanXskBypass(Program)) {
+            Status = STATUS_NOT_SUPPORTED;
+            goto Exit;
+        }
 
-        XdpRxQueueDeregisterNotifications(RxQueue, &ProgramObject->RxQueueNotificationEntry);
-        RemoveEntryList(&ProgramObject->SharingLink);
-        InitializeListHead(&ProgramObject->SharingLink);
+        Attached = TRUE;
+    } else if (ProgramObject->Flags.SharingEnabled && !IsListEmpty(&ProgramObject->SharingLink)) {
+        LIST_ENTRY *Entry;
 
-        if (IsListEmpty(&MetaProgramObject->SharingLink)) {
-            XdpRxQueueSetProgram(RxQueue, NULL);
-            ExFreePoolWithTag(MetaProgramObject, XDP_POOLTAG_PROGRAM);
-            TraceInfo(
-                TRACE_CORE, "Detached metaprogram RxQueue=%p Program=%p",
-                RxQueue, MetaProgramObject);
-        } else {
-            XdpRxQueueSync(RxQueue, XdpProgramPopulateMetaProgram, MetaProgramObject);
-            TraceInfo(
-                TRACE_CORE, "Updated metaprogram RxQueue=%p Program=%p",
-                RxQueue, MetaProgramObject);
+        MetaProgramObject =
+            CONTAINING_RECORD(XdpRxQueueGetProgram(RxQueue), XDP_PROGRAM_OBJECT, Program);
+        ASSERT(MetaProgramObject->Flags.IsMetaProgram);
+
+        //
+        // Locate the rules of this program within the metaprogram ruleset.
+        //
+        for (Entry = MetaProgramObject->SharingLink.Flink;
+             Entry != &ProgramObject->SharingLink;
+             Entry = Entry->Flink) {
+            CONST XDP_PROGRAM_OBJECT *SharedProgramObject =
+                CONTAINING_RECORD(Entry, XDP_PROGRAM_OBJECT, SharingLink);
+            RuleOffset += SharedProgramObject->Program.RuleCount;
         }
     }
 
-    TraceExitSuccess(TRACE_CORE);
-}
-static
-VOID
-XdpProgramReleasePortSet(
-    _Inout_ XDP_PORT_SET *PortSet
-    )
-{
-    PortSet->PortSet = NULL;
-
-    if (PortSet->Reserved != NULL) {
-        MDL *Mdl = PortSet->Reserved;
-        if (Mdl->MdlFlags & MDL_PAGES_LOCKED) {
-            MmUnlockPages(Mdl);
-        }
-        IoFreeMdl(Mdl);
-        PortSet->Reserved = NULL;
+    //
+    // Stage every allocation of the update before publishing it, so a failed
+    // update leaves the active rulesets untouched.
+    //
+    Status = XdpProgramStageRuleUpdate(ProgramObject, Update, 0, &SwapParams.RuleCount);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
     }
-}
 
-static
-NTSTATUS
-XdpProgramCapturePortSet(
-    _In_ CONST XDP_PORT_SET *UserPortSet,
-    _In_ KPROCESSOR_MODE RequestorMode,
-    _Inout_ XDP_PORT_SET *KernelPortSet
-    )
-{
-    NTSTATUS Status;
+    SwapParams.ProgramObject = ProgramObject;
 
-    __try {
-        if (UserPortSet->Reserved != NULL) {
-            Status = STATUS_INVALID_PARAMETER;
+    if (Attached) {
+        Status =
+            XdpProgramCompile(
+                ProgramObject->StagedRules, SwapParams.RuleCount,
+                ProgramObject->Flags.AdaptiveOrder, &SwapParams.Compiled);
+        if (!NT_SUCCESS(Status)) {
             goto Exit;
         }
+    }
 
-        KernelPortSet->Reserved =
-            IoAllocateMdl(UserPortSet->PortSet, XDP_PORT_SET_BUFFER_SIZE, FALSE, FALSE, NULL);
-        if (KernelPortSet->Reserved == NULL) {
-            Status = STATUS_INSUFFICIENT_RESOURCES;
+    if (MetaProgramObject != NULL) {
+        Status =
+            XdpProgramStageRuleUpdate(
+                MetaProgramObject, Update, RuleOffset, &MetaSwapParams.RuleCount);
+        if (!NT_SUCCESS(Status)) {
             goto Exit;
         }
 
-        MmProbeAndLockPages(KernelPortSet->Reserved, RequestorMode, IoReadAccess);
+        MetaSwapParams.ProgramObject = MetaProgramObject;
 
-        KernelPortSet->PortSet =
-            MmGetSystemAddressForMdlSafe(KernelPortSet->Reserved, LowPagePriority);
-        if (KernelPortSet->PortSet == NULL) {
-            Status = STATUS_INSUFFICIENT_RESOURCES;
+        Status =
+            XdpProgramCompile(
+                MetaProgramObject->StagedRules, MetaSwapParams.RuleCount, FALSE,
+                &MetaSwapParams.Compiled);
+        if (!NT_SUCCESS(Status)) {
             goto Exit;
         }
+    }
 
-        Status = STATUS_SUCCESS;
-    } __except(EXCEPTION_EXECUTE_HANDLER) {
-        Status = GetExceptionCode();
-        goto Exit;
+    if (Update->Operation != XDP_PROGRAM_RULE_OPERATION_ADD) {
+        RemovedRule = Program->Rules[Update->RuleIndex];
+        RemovedStatistics = ProgramObject->RuleStatisticsStorage[Update->RuleIndex];
     }
 
-Exit:
+    //
+    // Publish the staged rulesets. Once the data path has synchronized with
+    // the swap, it no longer references the removed rule.
+    //
+    if (MetaProgramObject != NULL) {
+        XdpRxQueueSync(RxQueue, XdpProgramSwapRules, &MetaSwapParams);
+    }
 
-    if (!NT_SUCCESS(Status)) {
-        XdpProgramReleasePortSet(KernelPortSet);
+    RtlAcquirePushLockExclusive(&ProgramObject->Lock);
+    if (Attached) {
+        XdpRxQueueSync(RxQueue, XdpProgramSwapRules, &SwapParams);
+    } else {
+        XdpProgramSwapRules(&SwapParams);
     }
+    RtlReleasePushLockExclusive(&ProgramObject->Lock);
 
-    return Status;
-}
+    XdpProgramReleaseRule(&RemovedRule);
+    if (RemovedStatistics != NULL) {
+        ExFreePoolWithTag(RemovedStatistics, XDP_POOLTAG_PROGRAM);
+    }
 
-static
-VOID
-XdpProgramDelete(
-    _In_ XDP_PROGRAM_OBJECT *ProgramObject
-    )
-{
-    TraceEnter(TRACE_CORE, "Program=%p", ProgramObject);
+    TraceInfo(
+        TRACE_CORE, "Updated Program=%p MetaProgram=%p Operation=%u RuleIndex=%u RuleCount=%u",
+        ProgramObject, MetaProgramObject, Update->Operation, Update->RuleIndex,
+        Program->RuleCount);
 
-    ASSERT(!ProgramObject->Flags.IsMetaProgram);
+    Status = STATUS_SUCCESS;
 
-    //
-    // Detach the XDP program from the RX queue.
-    //
-    if (ProgramObject->RxQueue != NULL) {
-        XdpProgramDetachRxQueue(ProgramObject);
-        XdpRxQueueDereference(ProgramObject->RxQueue);
-        ProgramObject->RxQueue = NULL;
-    }
+Exit:
 
     //
-    // Clean up the XDP program after data path references are dropped.
+    // On success, the previous compiled state was returned by the swap.
     //
+    XdpProgramFreeCompiled(SwapParams.Compiled);
+    XdpProgramFreeCompiled(MetaSwapParams.Compiled);
 
-    for (ULONG Index = 0; Index < ProgramObject->Program.RuleCount; Index++) {
-        XDP_RULE *Rule = &ProgramObject->Program.Rules[Index];
-
-        if (Rule->Match == XDP_MATCH_IPV4_UDP_PORT_SET ||
-            Rule->Match == XDP_MATCH_IPV6_UDP_PORT_SET) {
-            XdpProgramReleasePortSet(&Rule->Pattern.IpPortSet.PortSet);
-        }
-
-        if (Rule->Match == XDP_MATCH_UDP_PORT_SET) {
-            XdpProgramReleasePortSet(&Rule->Pattern.PortSet);
-        }
-
-        if (Rule->Action == XDP_PROGRAM_ACTION_REDIRECT) {
+    Item->CompletionStatus = Status;
+    KeSetEvent(&Item->CompletionEvent, 0, FALSE);
 
-            switch (Rule->Redirect.TargetType) {
+    TraceExitStatus(TRACE_CORE);
+}
 
-            case XDP_REDIRECT_TARGET_TYPE_XSK:
-                if (Rule->Redirect.Target != NULL) {
-                    XskDereferenceDatapathHandle(Rule->Redirect.Target);
-                }
-                break;
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramSwapCompiled(
+    _In_opt_ VOID *CallbackContext
+    )
+{
+    XDP_PROGRAM_SET_COMPILED_PARAMS *Params = CallbackContext;
+    XDP_PROGRAM_COMPILED *Compiled;
 
-            default:
-                ASSERT(FALSE);
-            }
-        }
-    }
+    ASSERT(CallbackContext != NULL);
 
-    TraceVerbose(TRACE_CORE, "Deleted Program=%p", ProgramObject);
-    ExFreePoolWithTag(ProgramObject, XDP_POOLTAG_PROGRAM);
-    TraceExitSuccess(TRACE_CORE);
+    //
+    // Every frame matches the same rule after a reorder, so the flow cache of
+    // the RX queue remains valid. The previous compiled state is returned to
+    // the caller.
+    //
+    Compiled = Params->Program->Compiled;
+    Params->Program->Compiled = Params->Compiled;
+    Params->Compiled = Compiled;
 }
 
 static
 VOID
-XdpProgramRxQueueNotify(
-    XDP_RX_QUEUE_NOTIFICATION_ENTRY *NotificationEntry,
-    XDP_RX_QUEUE_NOTIFICATION_TYPE NotificationType
+XdpProgramReorder(
+    _In_ XDP_BINDING_WORKITEM *WorkItem
     )
 {
-    XDP_PROGRAM_OBJECT *ProgramObject =
-        CONTAINING_RECORD(NotificationEntry, XDP_PROGRAM_OBJECT, RxQueueNotificationEntry);
+    XDP_PROGRAM_WORKITEM *Item = (XDP_PROGRAM_WORKITEM *)WorkItem;
+    XDP_PROGRAM_OBJECT *ProgramObject = Item->ProgramObject;
+    XDP_PROGRAM *Program = &ProgramObject->Program;
+    XDP_RX_QUEUE *RxQueue = ProgramObject->RxQueue;
+    XDP_PROGRAM_SET_COMPILED_PARAMS SetParams = {0};
+    XDP_PROGRAM_COMPILED *Compiled;
+    UINT64 TotalHits = 0;
+    NTSTATUS Status = STATUS_SUCCESS;
 
-    switch (NotificationType) {
+    TraceEnter(TRACE_CORE, "Program=%p", ProgramObject);
 
-    case XDP_RX_QUEUE_NOTIFICATION_DELETE:
-        XdpProgramDetachRxQueue(ProgramObject);
-        break;
+    ASSERT(ProgramObject->Flags.AdaptiveOrder);
 
+    //
+    // The program may have been detached from the RX queue.
+    //
+    if (RxQueue == NULL || XdpRxQueueGetProgram(RxQueue) != Program) {
+        goto Exit;
     }
-}
 
-_IRQL_requires_max_(PASSIVE_LEVEL)
-BOOLEAN
-XdpProgramCanXskBypass(
-    _In_ XDP_PROGRAM *Program
-    )
-{
-    XDP_PROGRAM_OBJECT *ProgramObject = CONTAINING_RECORD(Program, XDP_PROGRAM_OBJECT, Program);
+    Compiled = Program->Compiled;
+    ASSERT(Compiled != NULL);
 
-    return
-        ProgramObject->Flags.SharingEnabled == FALSE &&
-        Program->RuleCount == 1 &&
-        Program->Rules[0].Match == XDP_MATCH_ALL &&
-        Program->Rules[0].Action == XDP_PROGRAM_ACTION_REDIRECT &&
-        Program->Rules[0].Redirect.TargetType == XDP_REDIRECT_TARGET_TYPE_XSK;
-}
+    //
+    // Rule updates replace the compiled ruleset and its counters.
+    //
+    if (ProgramObject->ReorderGeneration != Program->Generation) {
+        ProgramObject->ReorderGeneration = Program->Generation;
+        ProgramObject->ReorderBaseHits = 0;
+    }
 
-static
-NTSTATUS
-XdpProgramAllocate(
-    _In_ UINT32 RuleCount,
-    _Out_ XDP_PROGRAM_OBJECT **NewProgramObject
-    )
-{
-    XDP_PROGRAM_OBJECT *ProgramObject = NULL;
-    SIZE_T AllocationSize;
-    NTSTATUS Status;
+    for (UINT32 i = 0; i < Program->RuleCount; i++) {
+        TotalHits += ReadULong64NoFence(&Compiled->RuleHits[i]);
+    }
 
-    Status = RtlSizeTMult(sizeof(XDP_RULE), RuleCount, &AllocationSize);
-    if (!NT_SUCCESS(Status)) {
+    if (TotalHits - ProgramObject->ReorderBaseHits < XDP_PROGRAM_REORDER_MIN_HITS) {
         goto Exit;
     }
 
-    Status = RtlSizeTAdd(sizeof(*ProgramObject), AllocationSize, &AllocationSize);
+    ProgramObject->ReorderBaseHits = TotalHits;
+
+    Status = XdpProgramCompile(Program->Rules, Program->RuleCount, TRUE, &SetParams.Compiled);
     if (!NT_SUCCESS(Status)) {
         goto Exit;
     }
 
-    ProgramObject = ExAllocatePoolZero(NonPagedPoolNx, AllocationSize, XDP_POOLTAG_PROGRAM);
-    if (ProgramObject == NULL) {
-        Status = STATUS_NO_MEMORY;
+    for (UINT32 i = 0; i < Program->RuleCount; i++) {
+        SetParams.Compiled->RuleHits[i] = ReadULong64NoFence(&Compiled->RuleHits[i]);
+    }
+
+    XdpProgramOrderCompiled(SetParams.Compiled, Program->Rules, Program->RuleCount);
+
+    if (XdpProgramIsCompiledOrderEqual(SetParams.Compiled, Compiled)) {
         goto Exit;
     }
 
-    ProgramObject->CreatedByPid = (ULONG_PTR)PsGetCurrentProcessId();
-    InitializeListHead(&ProgramObject->SharingLink);
+    //
+    // Carry the hits over at half weight, so the order follows changes in the
+    // traffic mix.
+    //
+    ProgramObject->ReorderBaseHits = 0;
+    for (UINT32 i = 0; i < Program->RuleCount; i++) {
+        SetParams.Compiled->RuleHits[i] /= 2;
+        ProgramObject->ReorderBaseHits += SetParams.Compiled->RuleHits[i];
+    }
+
+    SetParams.Program = Program;
+    XdpRxQueueSync(RxQueue, XdpProgramSwapCompiled, &SetParams);
+
+    TraceInfo(
+        TRACE_CORE, "Reordered Program=%p RuleCount=%u TotalHits=%llu",
+        ProgramObject, Program->RuleCount, TotalHits);
 
 Exit:
 
-    *NewProgramObject = ProgramObject;
-    return Status;
+    //
+    // On success, the previous compiled state was returned by the swap.
+    //
+    XdpProgramFreeCompiled(SetParams.Compiled);
+
+    Item->CompletionStatus = Status;
+    KeSetEvent(&Item->CompletionEvent, 0, FALSE);
+
+    TraceExitStatus(TRACE_CORE);
 }
 
 static
 _IRQL_requires_max_(PASSIVE_LEVEL)
-NTSTATUS
-XdpCaptureProgram(
-    _In_ CONST XDP_RULE *Rules,
-    _In_ ULONG RuleCount,
-    _In_ KPROCESSOR_MODE RequestorMode,
-    _Out_ XDP_PROGRAM_OBJECT **NewProgramObject
+_IRQL_requires_same_
+_Function_class_(WORKER_THREAD_ROUTINE)
+VOID
+XdpProgramReorderTimeout(
+    _In_ VOID *Parameter
     )
-{
-    NTSTATUS Status;
-    XDP_PROGRAM_OBJECT *ProgramObject = NULL;
-    XDP_PROGRAM *Program = NULL;
+{
+    XDP_PROGRAM_OBJECT *ProgramObject = Parameter;
+    XDP_PROGRAM_WORKITEM WorkItem = {0};
 
-    TraceEnter(TRACE_CORE, "-");
+    //
+    // Reorder the rules on the interface's work queue, which serializes the
+    // reorder with rule updates, then schedule the next attempt. The timer is
+    // shut down before the program is detached.
+    //
+    KeInitializeEvent(&WorkItem.CompletionEvent, NotificationEvent, FALSE);
+    WorkItem.ProgramObject = ProgramObject;
+    WorkItem.Bind.BindingHandle = ProgramObject->IfHandle;
+    WorkItem.Bind.WorkRoutine = XdpProgramReorder;
 
-    Status = XdpProgramAllocate(RuleCount, &ProgramObject);
-    if (!NT_SUCCESS(Status)) {
-        goto Exit;
-    }
+    XdpIfQueueWorkItem(&WorkItem.Bind);
+    KeWaitForSingleObject(&WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
 
-    TraceVerbose(TRACE_CORE, "Allocated Program=%p", ProgramObject);
+    XdpTimerStart(ProgramObject->ReorderTimer, XDP_PROGRAM_REORDER_INTERVAL_MS, NULL);
+}
 
-    Program = &ProgramObject->Program;
+typedef struct _XDP_PROGRAM_UPDATE_QUIC_CID_PARAMS {
+    XDP_PROGRAM_QUIC_CID_TABLE *Table;
+    XDP_QUIC_CID_OPERATION Operation;
+    UINT32 CidLength;
 
-    __try {
-        if (RequestorMode != KernelMode) {
-            ProbeForRead((VOID*)Rules, sizeof(*Rules) * RuleCount, PROBE_ALIGNMENT(XDP_RULE));
-        }
-        RtlCopyMemory(ProgramObject->Program.Rules, Rules, sizeof(*Rules) * RuleCount);
-    } __except (EXCEPTION_EXECUTE_HANDLER) {
-        Status = GetExceptionCode();
-        goto Exit;
-    }
+    //
+    // The entry to insert, or the key of the entry to remove. Set to NULL if
+    // the entry is inserted into the table.
+    //
+    XDP_PROGRAM_QUIC_CID_ENTRY *Entry;
 
-    for (ULONG Index = 0; Index < RuleCount; Index++) {
-        XDP_RULE UserRule = Program->Rules[Index];
-        XDP_RULE *ValidatedRule = &Program->Rules[Index];
+    //
+    // A larger bucket array already holding every entry of the table, if any.
+    // Returns the previous bucket array, which the caller frees.
+    //
+    XDP_PROGRAM_QUIC_CID_BUCKETS *Buckets;
 
-        //
-        // Initialize the trusted kernel rule buffer and increment the count of
-        // validated rules. The error path will not attempt to clean up
-        // unvalidated rules.
-        //
-        RtlZeroMemory(ValidatedRule, sizeof(*ValidatedRule));
-        Program->RuleCount++;
+    //
+    // Returns the removed entry, which the caller frees.
+    //
+    XDP_PROGRAM_QUIC_CID_ENTRY *RemovedEntry;
+} XDP_PROGRAM_UPDATE_QUIC_CID_PARAMS;
 
-        if (UserRule.Match < XDP_MATCH_ALL || UserRule.Match > XDP_MATCH_IPV6_UDP_PORT_SET) {
-            Status = STATUS_INVALID_PARAMETER;
-            goto Exit;
-        }
+static
+VOID
+XdpProgramInsertQuicCidEntry(
+    _Inout_ XDP_PROGRAM_QUIC_CID_BUCKETS *Buckets,
+    _Inout_ XDP_PROGRAM_QUIC_CID_ENTRY *Entry
+    )
+{
+    XDP_PROGRAM_QUIC_CID_ENTRY **Head = &Buckets->Heads[Entry->Hash & Buckets->BucketMask];
 
-        ValidatedRule->Match = UserRule.Match;
+    Entry->Next[Buckets->LinkIndex] = *Head;
+    *Head = Entry;
+}
 
-        //
-        // Validate each match condition. Many match conditions support all
-        // possible input pattern values.
-        //
-        switch (ValidatedRule->Match) {
-        case XDP_MATCH_QUIC_FLOW_SRC_CID:
-        case XDP_MATCH_QUIC_FLOW_DST_CID:
-            if (UserRule.Pattern.QuicFlow.CidLength > RTL_FIELD_SIZE(XDP_QUIC_FLOW, CidData)) {
-                Status = STATUS_INVALID_PARAMETER;
-                goto Exit;
-            }
-            ValidatedRule->Pattern.QuicFlow = UserRule.Pattern.QuicFlow;
-            break;
-        case XDP_MATCH_UDP_PORT_SET:
-            Status =
-                XdpProgramCapturePortSet(
-                    &UserRule.Pattern.PortSet, RequestorMode, &ValidatedRule->Pattern.PortSet);
-            if (!NT_SUCCESS(Status)) {
-                goto Exit;
-            }
-            break;
-        case XDP_MATCH_IPV4_UDP_PORT_SET:
-        case XDP_MATCH_IPV6_UDP_PORT_SET:
-            Status =
-                XdpProgramCapturePortSet(
-                    &UserRule.Pattern.IpPortSet.PortSet, RequestorMode,
-                    &ValidatedRule->Pattern.IpPortSet.PortSet);
-            if (!NT_SUCCESS(Status)) {
-                goto Exit;
-            }
-            ValidatedRule->Pattern.IpPortSet.Address = UserRule.Pattern.IpPortSet.Address;
-            break;
-        default:
-            ValidatedRule->Pattern = UserRule.Pattern;
-            break;
-        }
+//
+// Chains every entry of the table into a larger bucket array through the link
+// the current bucket array does not use. The data path only follows the links
+// of the current bucket array, so this runs without synchronization; the
+// caller serializes table updates.
+//
+static
+VOID
+XdpProgramRehashQuicCidTable(
+    _In_ CONST XDP_PROGRAM_QUIC_CID_TABLE *Table,
+    _Inout_ XDP_PROGRAM_QUIC_CID_BUCKETS *NewBuckets
+    )
+{
+    CONST XDP_PROGRAM_QUIC_CID_BUCKETS *Buckets = Table->Buckets;
 
-        if (UserRule.Action < XDP_PROGRAM_ACTION_DROP ||
-            UserRule.Action > XDP_PROGRAM_ACTION_REDIRECT) {
-            Status = STATUS_INVALID_PARAMETER;
-            goto Exit;
-        }
+    ASSERT(NewBuckets->LinkIndex != Buckets->LinkIndex);
 
-        ValidatedRule->Action = UserRule.Action;
+    for (UINT32 Index = 0; Index <= Buckets->BucketMask; Index++) {
+        XDP_PROGRAM_QUIC_CID_ENTRY *Entry;
 
-        //
-        // Capture object handle references in the context of the calling thread.
-        // The handle will be validated further on the control path.
-        //
-        if (UserRule.Action == XDP_PROGRAM_ACTION_REDIRECT) {
+        for (Entry = Buckets->Heads[Index];
+             Entry != NULL;
+             Entry = Entry->Next[Buckets->LinkIndex]) {
+            XdpProgramInsertQuicCidEntry(NewBuckets, Entry);
+        }
+    }
+}
 
-            switch (UserRule.Redirect.TargetType) {
+static
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramUpdateQuicCidTable(
+    _In_opt_ VOID *CallbackContext
+    )
+{
+    XDP_PROGRAM_UPDATE_QUIC_CID_PARAMS *Params = CallbackContext;
+    XDP_PROGRAM_QUIC_CID_TABLE *Table;
+    XDP_PROGRAM_QUIC_CID_BUCKETS *Buckets;
+    XDP_PROGRAM_QUIC_CID_ENTRY *Entry;
+    XDP_PROGRAM_QUIC_CID_ENTRY **Link;
 
-            case XDP_REDIRECT_TARGET_TYPE_XSK:
-                Status =
-                    XskReferenceDatapathHandle(
-                        RequestorMode, &UserRule.Redirect.Target, TRUE,
-                        &ValidatedRule->Redirect.Target);
-                break;
+    ASSERT(CallbackContext != NULL);
 
-            default:
-                Status = STATUS_INVALID_PARAMETER;
-                break;
-            }
+    Table = Params->Table;
+    Entry = Params->Entry;
 
-            if (!NT_SUCCESS(Status)) {
-                goto Exit;
-            }
-        }
+    if (Params->Buckets != NULL) {
+        Buckets = Table->Buckets;
+        Table->Buckets = Params->Buckets;
+        Params->Buckets = Buckets;
     }
 
-    Status = STATUS_SUCCESS;
-
-Exit:
+    Buckets = Table->Buckets;
 
-    if (NT_SUCCESS(Status)) {
-        ASSERT(ProgramObject != NULL);
-        *NewProgramObject = ProgramObject;
-    } else {
-        if (ProgramObject != NULL) {
-            XdpProgramDelete(ProgramObject);
+    for (Link = &Buckets->Heads[Entry->Hash & Buckets->BucketMask];
+         *Link != NULL;
+         Link = &(*Link)->Next[Buckets->LinkIndex]) {
+        if ((*Link)->Hash == Entry->Hash &&
+            RtlEqualMemory((*Link)->CidData, Entry->CidData, Params->CidLength)) {
+            break;
         }
     }
 
-    TraceExitStatus(TRACE_CORE);
-
-    return Status;
+    if (Params->Operation == XDP_QUIC_CID_OPERATION_SET) {
+        if (*Link != NULL) {
+            //
+            // Retarget the existing entry, and return its previous target to
+            // the caller in the new entry.
+            //
+            HANDLE Target = (*Link)->Target;
+            (*Link)->Target = Entry->Target;
+            Entry->Target = Target;
+        } else {
+            XdpProgramInsertQuicCidEntry(Buckets, Entry);
+            Table->EntryCount++;
+            Params->Entry = NULL;
+        }
+    } else if (*Link != NULL) {
+        Params->RemovedEntry = *Link;
+        *Link = (*Link)->Next[Buckets->LinkIndex];
+        Table->EntryCount--;
+    }
 }
 
 static
 VOID
-XdpProgramAttach(
+XdpProgramUpdateQuicCidEntry(
     _In_ XDP_BINDING_WORKITEM *WorkItem
     )
 {
     XDP_PROGRAM_WORKITEM *Item = (XDP_PROGRAM_WORKITEM *)WorkItem;
     XDP_PROGRAM_OBJECT *ProgramObject = Item->ProgramObject;
+    XDP_PROGRAM_QUIC_CID_UPDATE *Update = Item->QuicCidUpdate;
     XDP_PROGRAM *Program = &ProgramObject->Program;
-    XDP_PROGRAM *ExistingProgram;
-    XDP_PROGRAM_OBJECT *ExistingProgramObject = NULL;
+    XDP_RX_QUEUE *RxQueue = ProgramObject->RxQueue;
+    XDP_PROGRAM_UPDATE_QUIC_CID_PARAMS Params = {0};
+    XDP_QUIC_CID_TABLE *TablePattern;
     NTSTATUS Status;
 
-    TraceEnter(TRACE_CORE, "Program=%p", ProgramObject);
-
-    if (Item->HookId.SubLayer != XDP_HOOK_INSPECT) {
-        //
-        // Only RX queue programs are currently supported.
-        //
-        Status = STATUS_NOT_SUPPORTED;
-        goto Exit;
-    }
+    TraceEnter(
+        TRACE_CORE, "Program=%p Operation=%u RuleIndex=%u",
+        ProgramObject, Update->Operation, Update->RuleIndex);
 
-    Status =
-        XdpRxQueueFindOrCreate(
-            Item->Bind.BindingHandle, &Item->HookId, Item->QueueId, &ProgramObject->RxQueue);
-    if (!NT_SUCCESS(Status)) {
-        goto Exit;
-    }
+    ASSERT(RxQueue != NULL);
+    ASSERT(!ProgramObject->Flags.IsMetaProgram);
 
     //
-    // Perform further rule validation that require the interface work queue.
+    // Rule updates are serialized on the same work queue, so the rule cannot
+    // be removed concurrently.
     //
-    for (ULONG Index = 0; Index < Program->RuleCount; Index++) {
-        XDP_RULE *Rule = &Program->Rules[Index];
-
-        if (Rule->Action == XDP_PROGRAM_ACTION_REDIRECT) {
-
-            switch (Rule->Redirect.TargetType) {
-
-            case XDP_REDIRECT_TARGET_TYPE_XSK:
-                Status = XskValidateDatapathHandle(Rule->Redirect.Target, ProgramObject->RxQueue);
-                if (!NT_SUCCESS(Status)) {
-                    goto Exit;
-                }
-
-                break;
-
-            default:
-                break;
-            }
-        }
+    if (Update->RuleIndex >= Program->RuleCount ||
+        Program->Rules[Update->RuleIndex].Match != XDP_MATCH_QUIC_FLOW_DST_CID_TABLE) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
     }
 
-    //
-    // Query the existing top-level program on the queue, if any.
-    //
-    ExistingProgram = XdpRxQueueGetProgram(ProgramObject->RxQueue);
-    if (ExistingProgram != NULL) {
-        ExistingProgramObject = CONTAINING_RECORD(ExistingProgram, XDP_PROGRAM_OBJECT, Program);
+    TablePattern = &Program->Rules[Update->RuleIndex].Pattern.QuicCidTable;
+
+    if (Update->CidLength != TablePattern->CidLength) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
     }
 
-    if (ProgramObject->Flags.SharingEnabled) {
-        UINT32 MetaRuleCount = Program->RuleCount;
-        XDP_PROGRAM_OBJECT *NewMetaProgramObject = NULL;
+    Params.Table = TablePattern->Reserved;
+    Params.Operation = Update->Operation;
+    Params.CidLength = Update->CidLength;
 
-        if (ExistingProgramObject != NULL && !ExistingProgramObject->Flags.SharingEnabled) {
-            Status = STATUS_SHARING_VIOLATION;
+    if (Update->Operation == XDP_QUIC_CID_OPERATION_SET) {
+        Status = XskValidateDatapathHandle(Update->Target, RxQueue);
+        if (!NT_SUCCESS(Status)) {
             goto Exit;
         }
 
         //
-        // Calculate the new total rule count and allocate a new metaprogram.
+        // Keep the load factor at most one by doubling the bucket array. The
+        // entries are rehashed into the new bucket array before the data path
+        // is synchronized, which only publishes it.
         //
-        if (ExistingProgram != NULL) {
-            Status = RtlUInt32Add(MetaRuleCount, ExistingProgram->RuleCount, &MetaRuleCount);
+        if (Params.Table->EntryCount > Params.Table->Buckets->BucketMask &&
+            Params.Table->Buckets->BucketMask < XDP_PROGRAM_QUIC_CID_TABLE_MAX_BUCKETS - 1) {
+            Status =
+                XdpProgramAllocateQuicCidBuckets(
+                    (Params.Table->Buckets->BucketMask + 1) * 2,
+                    !Params.Table->Buckets->LinkIndex, &Params.Buckets);
             if (!NT_SUCCESS(Status)) {
                 goto Exit;
             }
         }
+    }
 
-        Status = XdpProgramAllocate(MetaRuleCount, &NewMetaProgramObject);
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
-        }
-
-        NewMetaProgramObject->Flags.SharingEnabled = TRUE;
-        NewMetaProgramObject->Flags.IsMetaProgram = TRUE;
-
-        //
-        // Migrate the list of shared programs from the old metaprogram (if
-        // present) onto the new metaprogram and add our new program to the
-        // list.
-        //
-        if (ExistingProgramObject != NULL) {
-            ASSERT(ExistingProgramObject->Flags.IsMetaProgram);
-            ASSERT(IsListEmpty(&NewMetaProgramObject->SharingLink));
-            ASSERT(!IsListEmpty(&ExistingProgramObject->SharingLink));
-            AppendTailList(&NewMetaProgramObject->SharingLink, &ExistingProgramObject->SharingLink);
-            RemoveEntryList(&ExistingProgramObject->SharingLink);
-            InitializeListHead(&ExistingProgramObject->SharingLink);
-        }
-
-        ASSERT(IsListEmpty(&ProgramObject->SharingLink));
-        InsertTailList(&NewMetaProgramObject->SharingLink, &ProgramObject->SharingLink);
-
-        //
-        // Merge all shared programs into the shared metaprogram ruleset.
-        //
-        XdpProgramPopulateMetaProgram(NewMetaProgramObject);
-
-        //
-        // Synchronize with data path and replace old metaprogram with new
-        // metaprogram. This is guaranteed to succeed when a program is already
-        // attached.
-        //
-        Status = XdpRxQueueSetProgram(ProgramObject->RxQueue, &NewMetaProgramObject->Program);
-        if (NT_SUCCESS(Status)) {
-            TraceInfo(
-                TRACE_CORE, "Attached metaprogram RxQueue=%p Program=%p OldProgram=%p",
-                ProgramObject->RxQueue, ProgramObject, ExistingProgramObject);
-            XdpProgramTraceObject(ProgramObject);
-
-            if (ExistingProgramObject != NULL) {
-                ExFreePoolWithTag(ExistingProgramObject, XDP_POOLTAG_PROGRAM);
-                ExistingProgramObject = NULL;
-            }
-        } else {
-            //
-            // Revert changes to the program, scrap the metaprogram, and bail.
-            // This can happen only if no metaprogram was previously attached.
-            //
-            ASSERT(ExistingProgramObject == NULL);
+    Params.Entry = ExAllocatePoolZero(NonPagedPoolNx, sizeof(*Params.Entry), XDP_POOLTAG_PROGRAM);
+    if (Params.Entry == NULL) {
+        Status = STATUS_NO_MEMORY;
+        goto Exit;
+    }
 
-            RemoveEntryList(&ProgramObject->SharingLink);
-            InitializeListHead(&ProgramObject->SharingLink);
+    RtlCopyMemory(Params.Entry->CidData, Update->CidData, Update->CidLength);
+    Params.Entry->Hash = XdpProgramHashQuicCid(Update->CidData, Update->CidLength);
 
-            ASSERT(IsListEmpty(&NewMetaProgramObject->SharingLink));
-            ExFreePoolWithTag(NewMetaProgramObject, XDP_POOLTAG_PROGRAM);
-            goto Exit;
-        }
-    } else {
-        //
-        // The new program has not enabled sharing; directly attach this program
-        // to the queue if it is empty.
-        //
+    if (Update->Operation == XDP_QUIC_CID_OPERATION_SET) {
+        Params.Entry->Target = Update->Target;
+        Update->Target = NULL;
+    }
 
-        if (ExistingProgramObject != NULL) {
-            Status = STATUS_DUPLICATE_OBJECTID;
-            goto Exit;
-        }
+    if (Params.Buckets != NULL) {
+        XdpProgramRehashQuicCidTable(Params.Table, Params.Buckets);
+    }
 
+    XdpRxQueueSync(RxQueue, XdpProgramUpdateQuicCidTable, &Params);
 
-        Status = XdpRxQueueSetProgram(ProgramObject->RxQueue, Program);
-        if (!NT_SUCCESS(Status)) {
-            goto Exit;
-        }
+    if (Update->Operation == XDP_QUIC_CID_OPERATION_DELETE && Params.RemovedEntry == NULL) {
+        Status = STATUS_NOT_FOUND;
+        goto Exit;
     }
 
     TraceInfo(
-        TRACE_CORE, "Attached program RxQueue=%p Program=%p",
-        ProgramObject->RxQueue, ProgramObject);
-    XdpProgramTraceObject(ProgramObject);
-
-    //
-    // Register for interface/queue removal notifications.
-    //
-    XdpRxQueueRegisterNotifications(
-        ProgramObject->RxQueue, &ProgramObject->RxQueueNotificationEntry, XdpProgramRxQueueNotify);
+        TRACE_CORE, "Updated Program=%p Operation=%u RuleIndex=%u EntryCount=%u BucketCount=%u",
+        ProgramObject, Update->Operation, Update->RuleIndex, Params.Table->EntryCount,
+        Params.Table->Buckets->BucketMask + 1);
 
-Exit:
-
-    if (!NT_SUCCESS(Status)) {
-        XdpProgramDelete(ProgramObject);
-    }
-
-    Item->CompletionStatus = Status;
-    KeSetEvent(&Item->CompletionEvent, 0, FALSE);
+    Status = STATUS_SUCCESS;
 
-    TraceExitStatus(TRACE_CORE);
-}
+Exit:
 
-static
-VOID
-XdpProgramDetach(
-    _In_ XDP_BINDING_WORKITEM *WorkItem
-    )
-{
-    XDP_PROGRAM_WORKITEM *Item = (XDP_PROGRAM_WORKITEM *)WorkItem;
+    if (Params.Buckets != NULL) {
+        ExFreePoolWithTag(Params.Buckets, XDP_POOLTAG_PROGRAM);
+    }
 
-    TraceEnter(TRACE_CORE, "Program=%p", Item->ProgramObject);
+    if (Params.Entry != NULL) {
+        XdpProgramFreeQuicCidEntry(Params.Entry);
+    }
 
-    XdpIfDereferenceBinding(Item->ProgramObject->IfHandle);
-    XdpProgramDelete(Item->ProgramObject);
-    TraceInfo(TRACE_CORE, "Detached Program=%p", Item->ProgramObject);
+    if (Params.RemovedEntry != NULL) {
+        XdpProgramFreeQuicCidEntry(Params.RemovedEntry);
+    }
 
-    Item->CompletionStatus = STATUS_SUCCESS;
+    Item->CompletionStatus = Status;
     KeSetEvent(&Item->CompletionEvent, 0, FALSE);
 
-    TraceExitSuccess(TRACE_CORE);
+    TraceExitStatus(TRACE_CORE);
 }
 
 _IRQL_requires_max_(PASSIVE_LEVEL)
@@ -1704,7 +8307,8 @@ XdpIrpCreateProgram(
     NTSTATUS Status;
     CONST UINT32 ValidFlags =
         XDP_CREATE_PROGRAM_FLAG_GENERIC | XDP_CREATE_PROGRAM_FLAG_NATIVE |
-        XDP_CREATE_PROGRAM_FLAG_SHARE;
+        XDP_CREATE_PROGRAM_FLAG_SHARE | XDP_CREATE_PROGRAM_FLAG_STATISTICS |
+        XDP_CREATE_PROGRAM_FLAG_ADAPTIVE_ORDER | XDP_CREATE_PROGRAM_FLAG_TRACK_FRAGMENTS;
 
     if (Disposition != FILE_CREATE || InputBufferLength < sizeof(*Params)) {
         Status = STATUS_INVALID_PARAMETER;
@@ -1720,7 +8324,13 @@ XdpIrpCreateProgram(
 
     if ((Params->Flags & ~ValidFlags) ||
         !RTL_IS_CLEAR_OR_SINGLE_FLAG(
-            Params->Flags, XDP_CREATE_PROGRAM_FLAG_GENERIC | XDP_CREATE_PROGRAM_FLAG_NATIVE)) {
+            Params->Flags, XDP_CREATE_PROGRAM_FLAG_GENERIC | XDP_CREATE_PROGRAM_FLAG_NATIVE) ||
+        !RTL_IS_CLEAR_OR_SINGLE_FLAG(
+            Params->Flags,
+            XDP_CREATE_PROGRAM_FLAG_SHARE | XDP_CREATE_PROGRAM_FLAG_ADAPTIVE_ORDER) ||
+        !RTL_IS_CLEAR_OR_SINGLE_FLAG(
+            Params->Flags,
+            XDP_CREATE_PROGRAM_FLAG_SHARE | XDP_CREATE_PROGRAM_FLAG_TRACK_FRAGMENTS)) {
         Status = STATUS_INVALID_PARAMETER;
         goto Exit;
     }
@@ -1751,6 +8361,34 @@ XdpIrpCreateProgram(
         ProgramObject->Flags.SharingEnabled = TRUE;
     }
 
+    if (Params->Flags & XDP_CREATE_PROGRAM_FLAG_STATISTICS) {
+        Status = XdpProgramAllocateStatistics(ProgramObject);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    if (Params->Flags & XDP_CREATE_PROGRAM_FLAG_ADAPTIVE_ORDER) {
+        ProgramObject->Flags.AdaptiveOrder = TRUE;
+        ProgramObject->ReorderTimer =
+            XdpTimerCreate(XdpProgramReorderTimeout, ProgramObject, XdpDriverObject, NULL);
+        if (ProgramObject->ReorderTimer == NULL) {
+            Status = STATUS_NO_MEMORY;
+            goto Exit;
+        }
+    }
+
+    if (Params->Flags & XDP_CREATE_PROGRAM_FLAG_TRACK_FRAGMENTS) {
+        ProgramObject->Program.FragmentTable =
+            ExAllocatePoolZero(
+                NonPagedPoolNx, sizeof(*ProgramObject->Program.FragmentTable),
+                XDP_POOLTAG_PROGRAM);
+        if (ProgramObject->Program.FragmentTable == NULL) {
+            Status = STATUS_NO_MEMORY;
+            goto Exit;
+        }
+    }
+
     KeInitializeEvent(&WorkItem.CompletionEvent, NotificationEvent, FALSE);
     WorkItem.QueueId = Params->QueueId;
     WorkItem.HookId = Params->HookId;
@@ -1773,6 +8411,10 @@ Exit:
         ProgramObject->Header.Dispatch = &XdpProgramFileDispatch;
         ProgramObject->IfHandle = BindingHandle, BindingHandle = NULL;
         IrpSp->FileObject->FsContext = ProgramObject;
+
+        if (ProgramObject->ReorderTimer != NULL) {
+            XdpTimerStart(ProgramObject->ReorderTimer, XDP_PROGRAM_REORDER_INTERVAL_MS, NULL);
+        }
     }
 
     if (BindingHandle != NULL) {
@@ -1793,6 +8435,307 @@ Exit:
     return Status;
 }
 
+static
+NTSTATUS
+XdpIrpProgramGetStatistics(
+    _In_ XDP_PROGRAM_OBJECT *ProgramObject,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    XDP_RULE_STATISTICS *OutputBuffer = Irp->AssociatedIrp.SystemBuffer;
+    SIZE_T OutputBufferLength = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
+    SIZE_T *BytesReturned = &Irp->IoStatus.Information;
+    UINT32 RequiredSize;
+    BOOLEAN LockHeld = FALSE;
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_CORE, "Program=%p", ProgramObject);
+
+    *BytesReturned = 0;
+
+    if (!ProgramObject->Flags.StatisticsEnabled) {
+        TraceError(TRACE_CORE, "Program=%p Statistics not enabled", ProgramObject);
+        Status = STATUS_NOT_SUPPORTED;
+        goto Exit;
+    }
+
+    //
+    // Prevent rule updates from changing the ruleset while it is read.
+    //
+    RtlAcquirePushLockShared(&ProgramObject->Lock);
+    LockHeld = TRUE;
+
+    Status =
+        RtlUInt32Mult(sizeof(*OutputBuffer), ProgramObject->Program.RuleCount, &RequiredSize);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
+    if ((OutputBufferLength == 0) && (Irp->Flags & IRP_INPUT_OPERATION) == 0) {
+        *BytesReturned = RequiredSize;
+        Status = STATUS_BUFFER_OVERFLOW;
+        goto Exit;
+    }
+
+    if (OutputBufferLength < RequiredSize) {
+        TraceError(
+            TRACE_CORE,
+            "Program=%p Output buffer length too small OutputBufferLength=%llu RequiredSize=%u",
+            ProgramObject, (UINT64)OutputBufferLength, RequiredSize);
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    //
+    // The data path updates the statistics concurrently; each counter is read
+    // individually, so the result is not a consistent snapshot.
+    //
+    for (UINT32 i = 0; i < ProgramObject->Program.RuleCount; i++) {
+        CONST XDP_RULE_STATISTICS *Statistics = ProgramObject->Program.RuleStatistics[i];
+
+        OutputBuffer[i].FramesMatched = ReadULong64NoFence(&Statistics->FramesMatched);
+        OutputBuffer[i].BytesMatched = ReadULong64NoFence(&Statistics->BytesMatched);
+    }
+
+    *BytesReturned = RequiredSize;
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    if (LockHeld) {
+        RtlReleasePushLockShared(&ProgramObject->Lock);
+    }
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XdpIrpProgramGetFlowCacheStatistics(
+    _In_ XDP_PROGRAM_OBJECT *ProgramObject,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    XDP_FLOW_CACHE_STATISTICS *OutputBuffer = Irp->AssociatedIrp.SystemBuffer;
+    SIZE_T OutputBufferLength = IrpSp->Parameters.DeviceIoControl.OutputBufferLength;
+    CONST XDP_FLOW_CACHE *FlowCache;
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_CORE, "Program=%p", ProgramObject);
+
+    if (OutputBufferLength < sizeof(*OutputBuffer)) {
+        Status = STATUS_BUFFER_TOO_SMALL;
+        goto Exit;
+    }
+
+    //
+    // The data path updates the counters concurrently; each counter is read
+    // individually, so the result is not a consistent snapshot.
+    //
+    FlowCache = XdpRxQueueGetFlowCache(ProgramObject->RxQueue);
+    OutputBuffer->Hits = ReadULong64NoFence(&FlowCache->Hits);
+    OutputBuffer->Misses = ReadULong64NoFence(&FlowCache->Misses);
+
+    Irp->IoStatus.Information = sizeof(*OutputBuffer);
+    Status = STATUS_SUCCESS;
+
+Exit:
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XdpIrpProgramUpdateRule(
+    _In_ XDP_PROGRAM_OBJECT *ProgramObject,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    CONST XDP_PROGRAM_UPDATE_RULE_IN *Params = Irp->AssociatedIrp.SystemBuffer;
+    XDP_PROGRAM_RULE_UPDATE Update = {0};
+    XDP_PROGRAM_WORKITEM WorkItem = {0};
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_CORE, "Program=%p", ProgramObject);
+
+    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(*Params)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (Params->Operation < XDP_PROGRAM_RULE_OPERATION_ADD ||
+        Params->Operation > XDP_PROGRAM_RULE_OPERATION_REPLACE) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Update.Operation = Params->Operation;
+    Update.RuleIndex = Params->RuleIndex;
+
+    if (Update.Operation != XDP_PROGRAM_RULE_OPERATION_REMOVE) {
+        //
+        // Capture the rule in the context of the calling thread.
+        //
+        Status = XdpProgramCaptureRule(&Params->Rule, Irp->RequestorMode, &Update.Rule);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+
+        if (ProgramObject->Flags.StatisticsEnabled) {
+            Status = XdpProgramAllocateRuleStatistics(&Update.Statistics);
+            if (!NT_SUCCESS(Status)) {
+                goto Exit;
+            }
+        }
+    }
+
+    KeInitializeEvent(&WorkItem.CompletionEvent, NotificationEvent, FALSE);
+    WorkItem.ProgramObject = ProgramObject;
+    WorkItem.RuleUpdate = &Update;
+    WorkItem.Bind.BindingHandle = ProgramObject->IfHandle;
+    WorkItem.Bind.WorkRoutine = XdpProgramUpdate;
+
+    //
+    // Perform the update on the interface's work queue.
+    //
+    XdpIfQueueWorkItem(&WorkItem.Bind);
+    KeWaitForSingleObject(&WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+
+    Status = WorkItem.CompletionStatus;
+
+Exit:
+
+    if (!NT_SUCCESS(Status)) {
+        XdpProgramReleaseRule(&Update.Rule);
+
+        if (Update.Statistics != NULL) {
+            ExFreePoolWithTag(Update.Statistics, XDP_POOLTAG_PROGRAM);
+        }
+    }
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+static
+NTSTATUS
+XdpIrpProgramUpdateQuicCid(
+    _In_ XDP_PROGRAM_OBJECT *ProgramObject,
+    _In_ IRP *Irp,
+    _In_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    CONST XDP_PROGRAM_UPDATE_QUIC_CID_IN *Params = Irp->AssociatedIrp.SystemBuffer;
+    XDP_PROGRAM_QUIC_CID_UPDATE Update = {0};
+    XDP_PROGRAM_WORKITEM WorkItem = {0};
+    NTSTATUS Status;
+
+    TraceEnter(TRACE_CORE, "Program=%p", ProgramObject);
+
+    if (IrpSp->Parameters.DeviceIoControl.InputBufferLength < sizeof(*Params)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    if (Params->Operation < XDP_QUIC_CID_OPERATION_SET ||
+        Params->Operation > XDP_QUIC_CID_OPERATION_DELETE ||
+        Params->CidLength > sizeof(Update.CidData)) {
+        Status = STATUS_INVALID_PARAMETER;
+        goto Exit;
+    }
+
+    Update.Operation = Params->Operation;
+    Update.RuleIndex = Params->RuleIndex;
+    Update.CidLength = Params->CidLength;
+    RtlCopyMemory(Update.CidData, Params->CidData, Params->CidLength);
+
+    if (Update.Operation == XDP_QUIC_CID_OPERATION_SET) {
+        //
+        // Capture the target in the context of the calling thread.
+        //
+        Status =
+            XskReferenceDatapathHandle(
+                Irp->RequestorMode, &Params->Target, TRUE, &Update.Target);
+        if (!NT_SUCCESS(Status)) {
+            goto Exit;
+        }
+    }
+
+    KeInitializeEvent(&WorkItem.CompletionEvent, NotificationEvent, FALSE);
+    WorkItem.ProgramObject = ProgramObject;
+    WorkItem.QuicCidUpdate = &Update;
+    WorkItem.Bind.BindingHandle = ProgramObject->IfHandle;
+    WorkItem.Bind.WorkRoutine = XdpProgramUpdateQuicCidEntry;
+
+    //
+    // Perform the update on the interface's work queue.
+    //
+    XdpIfQueueWorkItem(&WorkItem.Bind);
+    KeWaitForSingleObject(&WorkItem.CompletionEvent, Executive, KernelMode, FALSE, NULL);
+
+    Status = WorkItem.CompletionStatus;
+
+Exit:
+
+    if (Update.Target != NULL) {
+        XskDereferenceDatapathHandle(Update.Target);
+    }
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+_IRQL_requires_same_
+NTSTATUS
+XdpIrpProgramDeviceIoControl(
+    _Inout_ IRP *Irp,
+    _Inout_ IO_STACK_LOCATION *IrpSp
+    )
+{
+    NTSTATUS Status;
+    ULONG IoControlCode = IrpSp->Parameters.DeviceIoControl.IoControlCode;
+    XDP_PROGRAM_OBJECT *ProgramObject = IrpSp->FileObject->FsContext;
+
+    TraceEnter(TRACE_CORE, "Program=%p", ProgramObject);
+
+    Irp->IoStatus.Information = 0;
+
+    switch (IoControlCode) {
+    case IOCTL_PROGRAM_GET_STATISTICS:
+        Status = XdpIrpProgramGetStatistics(ProgramObject, Irp, IrpSp);
+        break;
+    case IOCTL_PROGRAM_UPDATE_RULE:
+        Status = XdpIrpProgramUpdateRule(ProgramObject, Irp, IrpSp);
+        break;
+    case IOCTL_PROGRAM_GET_FLOW_CACHE_STATISTICS:
+        Status = XdpIrpProgramGetFlowCacheStatistics(ProgramObject, Irp, IrpSp);
+        break;
+    case IOCTL_PROGRAM_UPDATE_QUIC_CID:
+        Status = XdpIrpProgramUpdateQuicCid(ProgramObject, Irp, IrpSp);
+        break;
+    default:
+        Status = STATUS_NOT_SUPPORTED;
+        break;
+    }
+
+    TraceInfo(
+        TRACE_CORE, "Program=%p Ioctl=%u Status=%!STATUS!", ProgramObject, IoControlCode, Status);
+
+    TraceExitStatus(TRACE_CORE);
+
+    return Status;
+}
+
 _IRQL_requires_max_(PASSIVE_LEVEL)
 _IRQL_requires_same_
 NTSTATUS
@@ -1809,6 +8752,16 @@ XdpIrpProgramClose(
     TraceEnter(TRACE_CORE, "Program=%p", Program);
     TraceInfo(TRACE_CORE, "Closing Program=%p", Program);
 
+    //
+    // Stop reordering rules before the detach is queued: the timer routine
+    // waits on the interface's work queue, so the timer cannot be shut down
+    // from the work queue once started.
+    //
+    if (Program->ReorderTimer != NULL) {
+        XdpTimerShutdown(Program->ReorderTimer, TRUE, TRUE);
+        Program->ReorderTimer = NULL;
+    }
+
     KeInitializeEvent(&WorkItem.CompletionEvent, NotificationEvent, FALSE);
     WorkItem.ProgramObject = Program;
     WorkItem.Bind.BindingHandle = Program->IfHandle;
@@ -1825,3 +8778,40 @@ XdpIrpProgramClose(
 
     return STATUS_SUCCESS;
 }
+
+static
+_IRQL_requires_(PASSIVE_LEVEL)
+VOID
+XdpProgramRegistryUpdate(
+    VOID
+    )
+{
+    NTSTATUS Status;
+    DWORD Value;
+
+    Status =
+        XdpRegQueryDwordValue(XDP_PARAMETERS_KEY, L"XdpIpv6ExtensionHeaderLimit", &Value);
+    if (NT_SUCCESS(Status) && Value <= XDP_PROGRAM_MAX_IPV6_EXTENSION_HEADER_LIMIT) {
+        XdpProgramIpv6ExtensionHeaderLimit = Value;
+    } else {
+        XdpProgramIpv6ExtensionHeaderLimit = XDP_PROGRAM_DEFAULT_IPV6_EXTENSION_HEADER_LIMIT;
+    }
+}
+
+NTSTATUS
+XdpProgramStart(
+    VOID
+    )
+{
+    XdpRegWatcherAddClient(
+        XdpRegWatcher, XdpProgramRegistryUpdate, &XdpProgramRegWatcherEntry);
+    return STATUS_SUCCESS;
+}
+
+VOID
+XdpProgramStop(
+    VOID
+    )
+{
+    XdpRegWatcherRemoveClient(XdpRegWatcher, &XdpProgramRegWatcherEntry);
+}
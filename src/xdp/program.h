@@ -8,6 +8,41 @@
 #include "redirect.h"
 
 typedef struct _XDP_PROGRAM XDP_PROGRAM;
+typedef struct _XDP_INSPECT_BATCH XDP_INSPECT_BATCH;
+
+//
+// The number of entries of an RX queue's flow cache. Must be a power of two.
+//
+#define XDP_FLOW_CACHE_SIZE 256
+
+typedef struct _XDP_FLOW_CACHE_KEY {
+    UINT8 SourceAddress[16];
+    UINT8 DestinationAddress[16];
+    UINT16 SourcePort;
+    UINT16 DestinationPort;
+    UINT32 FrameClass;
+} XDP_FLOW_CACHE_KEY;
+
+typedef struct _XDP_FLOW_CACHE_ENTRY {
+    XDP_FLOW_CACHE_KEY Key;
+    UINT32 Generation;
+    UINT32 RuleIndex;
+} XDP_FLOW_CACHE_ENTRY;
+
+//
+// A direct-mapped cache of the rule matched by recent UDP and TCP flows, owned
+// by an RX queue. The RX queue data path is serialized, so the cache is updated
+// without interlocked operations. Entries are valid only if they carry the
+// current generation of the cache, and the cache only describes the program
+// generation it was populated with.
+//
+typedef struct _XDP_FLOW_CACHE {
+    UINT32 Generation;
+    UINT32 ProgramGeneration;
+    UINT64 Hits;
+    UINT64 Misses;
+    XDP_FLOW_CACHE_ENTRY Entries[XDP_FLOW_CACHE_SIZE];
+} XDP_FLOW_CACHE;
 
 //
 // Data path routines.
@@ -17,6 +52,7 @@ _IRQL_requires_max_(DISPATCH_LEVEL)
 XDP_RX_ACTION
 XdpInspect(
     _In_ XDP_PROGRAM *Program,
+    _Inout_ XDP_FLOW_CACHE *FlowCache,
     _In_ XDP_REDIRECT_CONTEXT *RedirectContext,
     _In_ XDP_RING *FrameRing,
     _In_ UINT32 FrameIndex,
@@ -26,6 +62,39 @@ XdpInspect(
     _In_ XDP_EXTENSION *VirtualAddressExtension
     );
 
+//
+// The maximum number of frames inspected by a single XdpInspectBatch call.
+//
+#define XDP_INSPECT_BATCH_SIZE 32
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpInspectBatch(
+    _In_ XDP_PROGRAM *Program,
+    _Inout_ XDP_FLOW_CACHE *FlowCache,
+    _Inout_ XDP_INSPECT_BATCH *InspectBatch,
+    _In_ XDP_REDIRECT_CONTEXT *RedirectContext,
+    _In_ XDP_RING *FrameRing,
+    _In_reads_(FrameCount) CONST UINT32 *FrameIndexes,
+    _In_opt_ XDP_RING *FragmentRing,
+    _In_opt_ XDP_EXTENSION *FragmentExtension,
+    _In_reads_(FrameCount) CONST UINT32 *FragmentIndexes,
+    _In_ XDP_EXTENSION *VirtualAddressExtension,
+    _In_range_(1, XDP_INSPECT_BATCH_SIZE) UINT32 FrameCount,
+    _Out_writes_(FrameCount) XDP_RX_ACTION *Actions
+    );
+
+//
+// Invalidates every entry of the flow cache, which then describes the given
+// program. The caller must serialize with the RX queue data path.
+//
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramResetFlowCache(
+    _In_ XDP_PROGRAM *Program,
+    _Inout_ XDP_FLOW_CACHE *FlowCache
+    );
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 VOID *
 XdpProgramGetXskBypassTarget(
@@ -42,4 +111,30 @@ XdpProgramCanXskBypass(
     _In_ XDP_PROGRAM *Program
     );
 
+//
+// Allocates the per-frame parse state used by XdpInspectBatch, which is owned
+// by an RX queue.
+//
+_IRQL_requires_max_(PASSIVE_LEVEL)
+NTSTATUS
+XdpProgramCreateInspectBatch(
+    _Out_ XDP_INSPECT_BATCH **InspectBatch
+    );
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+XdpProgramDeleteInspectBatch(
+    _In_ XDP_INSPECT_BATCH *InspectBatch
+    );
+
 XDP_FILE_CREATE_ROUTINE XdpIrpCreateProgram;
+
+NTSTATUS
+XdpProgramStart(
+    VOID
+    );
+
+VOID
+XdpProgramStop(
+    VOID
+    );
@@ -53,6 +53,16 @@ typedef struct _XDP_RX_QUEUE {
     //
     XDP_REDIRECT_CONTEXT RedirectContext;
 
+    //
+    // The rules matched by recent flows of the attached program.
+    //
+    XDP_FLOW_CACHE FlowCache;
+
+    //
+    // The parsed headers of the frames of an inspection batch.
+    //
+    XDP_INSPECT_BATCH *InspectBatch;
+
     //
     // The pending data path / control path serialization callback.
     //
@@ -146,41 +156,60 @@ XdppReceiveBatch(
     )
 {
     XDP_RING *FrameRing = RxQueue->FrameRing;
+    XDP_RING *FragmentRing = RxQueue->FragmentRing;
+    UINT32 FrameIndexes[XDP_INSPECT_BATCH_SIZE];
+    UINT32 FragmentIndexes[XDP_INSPECT_BATCH_SIZE];
+    XDP_RX_ACTION Actions[XDP_INSPECT_BATCH_SIZE];
+    UINT32 Count;
 
     //
     // XdpReceive makes no assumptions on the number of elements queued at
     // a time. Look at all elements in the ring and always flush on behalf of
-    // the caller.
+    // the caller. Frames are inspected in batches so the program can overlap
+    // header cache misses across frames.
     //
 
-    while (XdpRingCount(FrameRing) > 0) {
-        UINT32 FrameIndex = FrameRing->ConsumerIndex & FrameRing->Mask;
-        UINT32 FragmentIndex = 0;
-        XDP_FRAME *Frame;
-        XDP_RX_ACTION Action;
-        XDP_FRAME_FRAGMENT *Fragment = NULL;
-        XDP_FRAME_RX_ACTION *ActionExtension;
+    while ((Count = XdpRingCount(FrameRing)) > 0) {
+        UINT32 FragmentConsumerIndex = 0;
+
+        Count = min(Count, RTL_NUMBER_OF(FrameIndexes));
 
-        Frame = XdpRingGetElement(FrameRing, FrameIndex);
+        if (FragmentRing != NULL) {
+            FragmentConsumerIndex = FragmentRing->ConsumerIndex;
+        }
+
+        for (UINT32 i = 0; i < Count; i++) {
+            FrameIndexes[i] = (FrameRing->ConsumerIndex + i) & FrameRing->Mask;
+            FragmentIndexes[i] = 0;
 
-        if (RxQueue->FragmentRing != NULL) {
-            FragmentIndex = RxQueue->FragmentRing->ConsumerIndex & RxQueue->FragmentRing->Mask;
-            Fragment = XdpGetFragmentExtension(Frame, &RxQueue->FragmentExtension);
+            if (FragmentRing != NULL) {
+                XDP_FRAME *Frame = XdpRingGetElement(FrameRing, FrameIndexes[i]);
+                XDP_FRAME_FRAGMENT *Fragment =
+                    XdpGetFragmentExtension(Frame, &RxQueue->FragmentExtension);
+
+                FragmentIndexes[i] = FragmentConsumerIndex & FragmentRing->Mask;
+                FragmentConsumerIndex += Fragment->FragmentBufferCount;
+            }
         }
 
-        Action =
-            XdpInspect(
-                RxQueue->Program, &RxQueue->RedirectContext, RxQueue->FrameRing, FrameIndex,
-                RxQueue->FragmentRing, &RxQueue->FragmentExtension, FragmentIndex,
-                &RxQueue->VirtualAddressExtension);
+        XdpInspectBatch(
+            RxQueue->Program, &RxQueue->FlowCache, RxQueue->InspectBatch,
+            &RxQueue->RedirectContext, FrameRing, FrameIndexes, FragmentRing,
+            &RxQueue->FragmentExtension, FragmentIndexes, &RxQueue->VirtualAddressExtension,
+            Count, Actions);
 
-        ActionExtension = XdpGetRxActionExtension(Frame, &RxQueue->RxActionExtension);
-        ActionExtension->RxAction = Action;
+        for (UINT32 i = 0; i < Count; i++) {
+            XDP_FRAME *Frame = XdpRingGetElement(FrameRing, FrameIndexes[i]);
+            XDP_FRAME_RX_ACTION *ActionExtension =
+                XdpGetRxActionExtension(Frame, &RxQueue->RxActionExtension);
 
-        FrameRing->ConsumerIndex++;
+            ActionExtension->RxAction = Actions[i];
+        }
 
-        if (RxQueue->FragmentRing != NULL) {
-            RxQueue->FragmentRing->ConsumerIndex += Fragment->FragmentBufferCount;
+        FrameRing->ConsumerIndex += Count;
+
+        if (FragmentRing != NULL) {
+            FragmentRing->ConsumerIndex = FragmentConsumerIndex;
         }
 
 #if DBG
@@ -532,6 +561,22 @@ XdpRxQueueGetMaximumFragments(
     return RxQueue->InterfaceRxCapabilities.MaximumFragments;
 }
 
+CONST XDP_FLOW_CACHE *
+XdpRxQueueGetFlowCache(
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    return &RxQueue->FlowCache;
+}
+
+BOOLEAN
+XdpRxQueueIsTxActionSupported(
+    _In_ XDP_RX_QUEUE *RxQueue
+    )
+{
+    return RxQueue->InterfaceRxCapabilities.TxActionSupported;
+}
+
 static
 CONST XDP_HOOK_ID *
 XdppRxQueueGetHookId(
@@ -895,6 +940,11 @@ XdpRxQueueCreate(
     XdpInitializeQueueInfo(&RxQueue->QueueInfo, XDP_QUEUE_TYPE_DEFAULT_RSS, QueueId);
     XdbgInitializeQueueEc(RxQueue);
 
+    Status = XdpProgramCreateInspectBatch(&RxQueue->InspectBatch);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
     Status =
         XdpIfRegisterClient(
             Binding, &RxQueueBindingClient, &RxQueue->Key, &RxQueue->BindingClientEntry);
@@ -1030,6 +1080,7 @@ XdpRxQueueSwapProgram(
     ASSERT(CallbackContext != NULL);
 
     SwapParams->RxQueue->Program = SwapParams->NewProgram;
+    XdpProgramResetFlowCache(SwapParams->NewProgram, &SwapParams->RxQueue->FlowCache);
 }
 
 NTSTATUS
@@ -1060,6 +1111,7 @@ XdpRxQueueSetProgram(
         // queue on the interface.
         //
         RxQueue->Program = Program;
+        XdpProgramResetFlowCache(Program, &RxQueue->FlowCache);
         Status = XdpRxQueueAttachInterface(RxQueue);
         if (!NT_SUCCESS(Status)) {
             RxQueue->Program = NULL;
@@ -1109,6 +1161,9 @@ XdpRxQueueDereference(
     if (XdpDecrementReferenceCount(&RxQueue->ReferenceCount)) {
         TraceInfo(TRACE_CORE, "Deleting RxQueue=%p", RxQueue);
         XdpIfDeregisterClient(RxQueue->Binding, &RxQueue->BindingClientEntry);
+        if (RxQueue->InspectBatch != NULL) {
+            XdpProgramDeleteInspectBatch(RxQueue->InspectBatch);
+        }
         ExFreePoolWithTag(RxQueue, XDP_POOLTAG_RXQUEUE);
     }
 }
@@ -94,6 +94,16 @@ XdpRxQueueGetMaximumFragments(
     _In_ XDP_RX_QUEUE_CONFIG_ACTIVATE RxQueueConfig
     );
 
+CONST XDP_FLOW_CACHE *
+XdpRxQueueGetFlowCache(
+    _In_ XDP_RX_QUEUE *RxQueue
+    );
+
+BOOLEAN
+XdpRxQueueIsTxActionSupported(
+    _In_ XDP_RX_QUEUE *RxQueue
+    );
+
 NTSTATUS
 XdpRxStart(
     VOID
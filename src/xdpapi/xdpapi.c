@@ -36,6 +36,211 @@ XdpCreateProgram(
     return S_OK;
 }
 
+HRESULT
+XDPAPI
+XdpProgramGetStatistics(
+    _In_ HANDLE Program,
+    _Out_opt_ XDP_RULE_STATISTICS *RuleStatistics,
+    _Inout_ UINT32 *RuleStatisticsSize
+    )
+{
+    BOOL Success =
+        XdpIoctl(
+            Program, IOCTL_PROGRAM_GET_STATISTICS, NULL, 0, RuleStatistics,
+            *RuleStatisticsSize, (ULONG *)RuleStatisticsSize, NULL, TRUE);
+    if (!Success) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+HRESULT
+XDPAPI
+XdpProgramUpdateRule(
+    _In_ HANDLE Program,
+    _In_ XDP_PROGRAM_RULE_OPERATION Operation,
+    _In_ UINT32 RuleIndex,
+    _In_opt_ CONST XDP_RULE *Rule
+    )
+{
+    XDP_PROGRAM_UPDATE_RULE_IN UpdateIn = {0};
+
+    UpdateIn.Operation = Operation;
+    UpdateIn.RuleIndex = RuleIndex;
+    if (Rule != NULL) {
+        UpdateIn.Rule = *Rule;
+    }
+
+    BOOL Success =
+        XdpIoctl(
+            Program, IOCTL_PROGRAM_UPDATE_RULE, &UpdateIn, sizeof(UpdateIn), NULL, 0, NULL,
+            NULL, TRUE);
+    if (!Success) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+HRESULT
+XDPAPI
+XdpProgramGetFlowCacheStatistics(
+    _In_ HANDLE Program,
+    _Out_ XDP_FLOW_CACHE_STATISTICS *Statistics
+    )
+{
+    BOOL Success =
+        XdpIoctl(
+            Program, IOCTL_PROGRAM_GET_FLOW_CACHE_STATISTICS, NULL, 0, Statistics,
+            sizeof(*Statistics), NULL, NULL, TRUE);
+    if (!Success) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+HRESULT
+XDPAPI
+XdpProgramUpdateQuicCid(
+    _In_ HANDLE Program,
+    _In_ XDP_QUIC_CID_OPERATION Operation,
+    _In_ UINT32 RuleIndex,
+    _In_reads_bytes_(CidLength) CONST UCHAR *Cid,
+    _In_ UINT32 CidLength,
+    _In_opt_ HANDLE Target
+    )
+{
+    XDP_PROGRAM_UPDATE_QUIC_CID_IN UpdateIn = {0};
+
+    if (CidLength > sizeof(UpdateIn.CidData)) {
+        return E_INVALIDARG;
+    }
+
+    UpdateIn.Operation = Operation;
+    UpdateIn.RuleIndex = RuleIndex;
+    UpdateIn.CidLength = CidLength;
+    RtlCopyMemory(UpdateIn.CidData, Cid, CidLength);
+    UpdateIn.Target = Target;
+
+    BOOL Success =
+        XdpIoctl(
+            Program, IOCTL_PROGRAM_UPDATE_QUIC_CID, &UpdateIn, sizeof(UpdateIn), NULL, 0, NULL,
+            NULL, TRUE);
+    if (!Success) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+HRESULT
+XDPAPI
+XdpMapCreate(
+    _In_ XDP_MAP_TYPE Type,
+    _In_ UINT32 KeySize,
+    _In_ UINT32 ValueSize,
+    _In_ UINT32 MaxEntries,
+    _Out_ HANDLE *Map
+    )
+{
+    XDP_MAP_OPEN *MapOpen;
+    CHAR EaBuffer[XDP_OPEN_EA_LENGTH + sizeof(*MapOpen)];
+
+    MapOpen = XdpInitializeEa(XDP_OBJECT_TYPE_MAP, EaBuffer, sizeof(EaBuffer));
+    MapOpen->Type = Type;
+    MapOpen->KeySize = KeySize;
+    MapOpen->ValueSize = ValueSize;
+    MapOpen->MaxEntries = MaxEntries;
+
+    *Map = XdpOpen(FILE_CREATE, EaBuffer, sizeof(EaBuffer));
+    if (*Map == NULL) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+static
+HRESULT
+XdpMapElementIoctl(
+    _In_ HANDLE Map,
+    _In_ ULONG Operation,
+    _In_reads_bytes_(KeySize) CONST VOID *Key,
+    _In_ UINT32 KeySize,
+    _In_reads_bytes_opt_(InValueSize) CONST VOID *InValue,
+    _In_ UINT32 InValueSize,
+    _Out_writes_bytes_opt_(OutValueSize) VOID *OutValue,
+    _In_ UINT32 OutValueSize
+    )
+{
+    XDP_MAP_ELEMENT_IN ElementIn = {0};
+
+    if (KeySize > sizeof(ElementIn.Key) || InValueSize > sizeof(ElementIn.Value) ||
+        (InValue == NULL && InValueSize > 0)) {
+        return E_INVALIDARG;
+    }
+
+    ElementIn.KeySize = KeySize;
+    ElementIn.ValueSize = InValueSize;
+    RtlCopyMemory(ElementIn.Key, Key, KeySize);
+    if (InValue != NULL) {
+        RtlCopyMemory(ElementIn.Value, InValue, InValueSize);
+    }
+
+    BOOL Success =
+        XdpIoctl(
+            Map, Operation, &ElementIn, sizeof(ElementIn), OutValue, OutValueSize, NULL, NULL,
+            TRUE);
+    if (!Success) {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    return S_OK;
+}
+
+HRESULT
+XDPAPI
+XdpMapUpdateElement(
+    _In_ HANDLE Map,
+    _In_reads_bytes_(KeySize) CONST VOID *Key,
+    _In_ UINT32 KeySize,
+    _In_reads_bytes_opt_(ValueSize) CONST VOID *Value,
+    _In_ UINT32 ValueSize
+    )
+{
+    return
+        XdpMapElementIoctl(
+            Map, IOCTL_MAP_UPDATE_ELEMENT, Key, KeySize, Value, ValueSize, NULL, 0);
+}
+
+HRESULT
+XDPAPI
+XdpMapDeleteElement(
+    _In_ HANDLE Map,
+    _In_reads_bytes_(KeySize) CONST VOID *Key,
+    _In_ UINT32 KeySize
+    )
+{
+    return XdpMapElementIoctl(Map, IOCTL_MAP_DELETE_ELEMENT, Key, KeySize, NULL, 0, NULL, 0);
+}
+
+HRESULT
+XDPAPI
+XdpMapLookupElement(
+    _In_ HANDLE Map,
+    _In_reads_bytes_(KeySize) CONST VOID *Key,
+    _In_ UINT32 KeySize,
+    _Out_writes_bytes_opt_(ValueSize) VOID *Value,
+    _In_ UINT32 ValueSize
+    )
+{
+    return
+        XdpMapElementIoctl(
+            Map, IOCTL_MAP_LOOKUP_ELEMENT, Key, KeySize, NULL, 0, Value, ValueSize);
+}
+
 HRESULT
 XDPAPI
 XdpInterfaceOpen(
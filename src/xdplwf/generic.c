@@ -447,6 +447,7 @@ XdpGenericCleanupInterface(
 {
     XdpGenericCleanupDatapath(Generic, &Generic->Tx.Datapath);
     XdpGenericCleanupDatapath(Generic, &Generic->Rx.Datapath);
+    XdpGenericHairpinCleanup(Generic);
 
     if (Generic->Registration != NULL) {
         XdpDeregisterInterface(Generic->Registration);
@@ -520,6 +521,11 @@ XdpGenericAttachInterface(
         goto Exit;
     }
 
+    Status = XdpGenericHairpinInitialize(Generic);
+    if (!NT_SUCCESS(Status)) {
+        goto Exit;
+    }
+
     Status =
         XdpInitializeCapabilities(
             &Generic->Capabilities, &DriverApiVersion);
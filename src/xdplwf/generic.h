@@ -49,6 +49,10 @@ typedef struct _XDP_LWF_GENERIC {
         XDP_LWF_DATAPATH_BYPASS Datapath;
         LIST_ENTRY Queues;
         UINT32 Mtu;
+        NDIS_HANDLE HairpinNblPool;
+        UINT32 HairpinBufferLength;
+        EX_RUNDOWN_REF HairpinRundown;
+        XDP_LWF_GENERIC_HAIRPIN_STATS HairpinStats;
     } Tx;
 } XDP_LWF_GENERIC;
 
@@ -551,6 +551,7 @@ XdpGenericReceivePostInspectNbs(
     _In_opt_ NET_BUFFER *NbTail,
     _Inout_ NBL_COUNTED_QUEUE *PassList,
     _Inout_ NBL_QUEUE *DropList,
+    _Inout_ XDP_LWF_GENERIC_HAIRPIN_QUEUE *HairpinQueue,
     _Inout_ NBL_QUEUE *LowResourcesList
     )
 {
@@ -635,6 +636,19 @@ XdpGenericReceivePostInspectNbs(
                 NdisAppendSingleNblToNblQueue(DropList, ActionNbl);
                 break;
 
+            case XDP_RX_ACTION_TX:
+            {
+                //
+                // Transmit a copy of the frame, and return the original to
+                // the miniport. If the copy fails, the frame is dropped.
+                //
+                XdpGenericHairpinEnqueue(
+                    RxQueue->Generic, HairpinQueue, NET_BUFFER_LIST_FIRST_NB(ActionNbl));
+
+                NdisAppendSingleNblToNblQueue(DropList, ActionNbl);
+                break;
+            }
+
             default:
                 ASSERT(FALSE);
             }
@@ -665,7 +679,8 @@ XdpGenericReceiveInspect(
     _In_ NDIS_PORT_NUMBER PortNumber,
     _In_ BOOLEAN CanPend,
     _Inout_ NBL_COUNTED_QUEUE *PassList,
-    _Inout_ NBL_QUEUE *DropList
+    _Inout_ NBL_QUEUE *DropList,
+    _Inout_ XDP_LWF_GENERIC_HAIRPIN_QUEUE *HairpinQueue
     )
 {
     NBL_QUEUE LowResourcesList;
@@ -699,7 +714,7 @@ XdpGenericReceiveInspect(
         //
         XdpGenericReceivePostInspectNbs(
             RxQueue, PortNumber, CanPend, NblHead, NbHead, NextNb, PassList, DropList,
-            &LowResourcesList);
+            HairpinQueue, &LowResourcesList);
     } while (NextNb != NULL);
 }
 
@@ -721,11 +736,13 @@ XdpGenericReceive(
     XDP_LWF_GENERIC_RSS_QUEUE *RssQueue = NULL;
     XDP_LWF_GENERIC_RX_QUEUE *RxQueue = NULL;
     XDP_RX_QUEUE_HANDLE XdpRxQueue = NULL;
+    XDP_LWF_GENERIC_HAIRPIN_QUEUE HairpinQueue;
 
     EventWriteGenericRxInspectStart(&MICROSOFT_XDP_PROVIDER, Generic);
 
     NdisInitializeNblCountedQueue(PassList);
     NdisInitializeNblQueue(DropList);
+    XdpGenericHairpinInitializeQueue(&HairpinQueue);
 
     if (!(XdpInspectFlags & XDP_LWF_GENERIC_INSPECT_FLAG_DISPATCH)) {
         OldIrql = KeRaiseIrqlToDpcLevel();
@@ -749,13 +766,16 @@ XdpGenericReceive(
         // Perform XDP inspection on each frame within the NBL chain.
         //
         XdpGenericReceiveInspect(
-            RxQueue, XdpRxQueue, NetBufferLists, PortNumber, CanPend, PassList, DropList);
+            RxQueue, XdpRxQueue, NetBufferLists, PortNumber, CanPend, PassList, DropList,
+            &HairpinQueue);
     }
 
     if (XdpRxQueue != NULL) {
         XdpGenericReceiveExitEc(RxQueue, TxWorker, PassList);
     }
 
+    XdpGenericHairpinSend(Generic, &HairpinQueue);
+
     if (RssQueue != NULL && !TxInspect) {
         //
         // Attempt to steal time from the RX path to ensure TX gets a chance to
@@ -1049,6 +1069,10 @@ XdpGenericRxCreateQueue(
 
     XdpInitializeRxCapabilitiesDriverVa(&RxCapabilities);
     RxCapabilities.MaximumFragments = RxQueue->FragmentLimit;
+    //
+    // Frames inspected on the TX path cannot be transmitted again.
+    //
+    RxCapabilities.TxActionSupported = !RxQueue->Flags.TxInspect;
     XdpRxQueueSetCapabilities(Config, &RxCapabilities);
 
     XdpInitializeRxDescriptorContexts(&DescriptorContexts);
@@ -48,6 +48,280 @@ NblTxContext(
     return (NBL_TX_CONTEXT *)NET_BUFFER_LIST_CONTEXT_DATA_START(NetBufferList);
 }
 
+//
+// Frames transmitted by the XDP_RX_ACTION_TX action are copies owned by this
+// filter, identified by a NULL TX queue in their NBL context.
+//
+#define SEND_HAIRPIN_CLASSIFICATION ((ULONG_PTR)1)
+
+//
+// Each hairpin NBL carries its copy of the frame in its context, after the
+// NBL_TX_CONTEXT and an MDL describing the copy, so copying a frame needs no
+// allocation beyond the NBL pool's own cache. The copies are sized for the MTU
+// plus two 802.1Q or 802.1ad tags, since TX actions apply to tagged frames, up
+// to a limit that keeps the context size within 16 bits.
+//
+#define XDP_GENERIC_HAIRPIN_VLAN_LENGTH (2 * 4)
+#define XDP_GENERIC_HAIRPIN_MAX_BUFFER_LENGTH (60 * 1024)
+
+static
+SIZE_T
+XdpGenericHairpinMdlSize(
+    _In_ UINT32 BufferLength
+    )
+{
+    return MmSizeOfMdl((VOID *)(PAGE_SIZE - 1), BufferLength);
+}
+
+static
+SIZE_T
+XdpGenericHairpinContextSize(
+    _In_ UINT32 BufferLength
+    )
+{
+    return
+        ALIGN_UP_BY(
+            sizeof(NBL_TX_CONTEXT) + XdpGenericHairpinMdlSize(BufferLength) + BufferLength,
+            MEMORY_ALLOCATION_ALIGNMENT);
+}
+
+static
+VOID
+XdpGenericHairpinFreeNbls(
+    _In_ NET_BUFFER_LIST *NetBufferLists
+    )
+{
+    while (NetBufferLists != NULL) {
+        NET_BUFFER_LIST *Nbl = NetBufferLists;
+
+        NetBufferLists = NET_BUFFER_LIST_NEXT_NBL(Nbl);
+
+        NdisFreeNetBufferList(Nbl);
+    }
+}
+
+VOID
+XdpGenericHairpinInitializeQueue(
+    _Out_ XDP_LWF_GENERIC_HAIRPIN_QUEUE *Queue
+    )
+{
+    RtlZeroMemory(Queue, sizeof(*Queue));
+    NdisInitializeNblCountedQueue(&Queue->Nbls);
+}
+
+_IRQL_requires_(DISPATCH_LEVEL)
+VOID
+XdpGenericHairpinEnqueue(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _Inout_ XDP_LWF_GENERIC_HAIRPIN_QUEUE *Queue,
+    _In_ NET_BUFFER *Nb
+    )
+{
+    ULONG Length = NET_BUFFER_DATA_LENGTH(Nb);
+    UINT32 BufferLength;
+    NET_BUFFER_LIST *Nbl;
+    NET_BUFFER *CopyNb;
+    MDL *Mdl;
+    UCHAR *Buffer;
+    UCHAR *Data;
+
+    //
+    // The filter must not send while paused. The NBL pool is replaced only
+    // while paused, so the queue's rundown reference also keeps the pool valid.
+    //
+    if (!Queue->Active) {
+        if (!ExAcquireRundownProtection(&Generic->Tx.HairpinRundown)) {
+            return;
+        }
+
+        Queue->Active = TRUE;
+    }
+
+    if (Generic->Tx.HairpinNblPool == NULL) {
+        Queue->Stats.AllocationFailures++;
+        return;
+    }
+
+    //
+    // The RX NBL is owned by the miniport and must be returned to it, so the
+    // frame is copied into a filter-owned NBL before being sent.
+    //
+    BufferLength = Generic->Tx.HairpinBufferLength;
+    if (Length == 0 || Length > BufferLength) {
+        Queue->Stats.CopyFailures++;
+        return;
+    }
+
+    Nbl =
+        NdisAllocateNetBufferList(
+            Generic->Tx.HairpinNblPool, (USHORT)XdpGenericHairpinContextSize(BufferLength), 0);
+    if (Nbl == NULL) {
+        Queue->Stats.AllocationFailures++;
+        return;
+    }
+
+    Mdl = (MDL *)(NET_BUFFER_LIST_CONTEXT_DATA_START(Nbl) + sizeof(NBL_TX_CONTEXT));
+    Buffer = (UCHAR *)Mdl + XdpGenericHairpinMdlSize(BufferLength);
+
+    Data = NdisGetDataBuffer(Nb, Length, Buffer, 1, 0);
+    if (Data == NULL) {
+        NdisFreeNetBufferList(Nbl);
+        Queue->Stats.CopyFailures++;
+        return;
+    }
+
+    if (Data != Buffer) {
+        RtlCopyMemory(Buffer, Data, Length);
+    }
+
+    MmInitializeMdl(Mdl, Buffer, Length);
+    MmBuildMdlForNonPagedPool(Mdl);
+
+    CopyNb = NET_BUFFER_LIST_FIRST_NB(Nbl);
+    NET_BUFFER_FIRST_MDL(CopyNb) = Mdl;
+    NET_BUFFER_CURRENT_MDL(CopyNb) = Mdl;
+    NET_BUFFER_DATA_LENGTH(CopyNb) = Length;
+    NET_BUFFER_DATA_OFFSET(CopyNb) = 0;
+    NET_BUFFER_CURRENT_MDL_OFFSET(CopyNb) = 0;
+
+    Nbl->SourceHandle = Generic->NdisFilterHandle;
+    RtlZeroMemory(NblTxContext(Nbl), sizeof(NBL_TX_CONTEXT));
+
+    NdisAppendSingleNblToNblCountedQueue(&Queue->Nbls, Nbl);
+}
+
+_IRQL_requires_(DISPATCH_LEVEL)
+VOID
+XdpGenericHairpinSend(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _Inout_ XDP_LWF_GENERIC_HAIRPIN_QUEUE *Queue
+    )
+{
+    if (!Queue->Active) {
+        return;
+    }
+
+    if (Queue->Stats.CopyFailures > 0 || Queue->Stats.AllocationFailures > 0) {
+        LONG64 CopyFailures =
+            InterlockedAdd64(
+                (LONG64 *)&Generic->Tx.HairpinStats.CopyFailures,
+                (LONG64)Queue->Stats.CopyFailures);
+        LONG64 AllocationFailures =
+            InterlockedAdd64(
+                (LONG64 *)&Generic->Tx.HairpinStats.AllocationFailures,
+                (LONG64)Queue->Stats.AllocationFailures);
+
+        EventWriteGenericRxHairpinDrop(
+            &MICROSOFT_XDP_PROVIDER, Generic, CopyFailures, AllocationFailures);
+    }
+
+    if (!NdisIsNblCountedQueueEmpty(&Queue->Nbls)) {
+        NET_BUFFER_LIST *NetBufferLists = NdisGetNblChainFromNblCountedQueue(&Queue->Nbls);
+
+        //
+        // Each copy holds a reference until its send completes, which makes
+        // pausing wait for the filter's own sends. If a pause has begun, the
+        // copies are dropped.
+        //
+        if (ExAcquireRundownProtectionEx(
+                &Generic->Tx.HairpinRundown, (ULONG)Queue->Nbls.NblCount)) {
+            NdisFSendNetBufferLists(
+                Generic->NdisFilterHandle, NetBufferLists, NDIS_DEFAULT_PORT_NUMBER,
+                NDIS_SEND_FLAGS_DISPATCH_LEVEL);
+        } else {
+            XdpGenericHairpinFreeNbls(NetBufferLists);
+        }
+    }
+
+    ExReleaseRundownProtection(&Generic->Tx.HairpinRundown);
+}
+
+NTSTATUS
+XdpGenericHairpinInitialize(
+    _Inout_ XDP_LWF_GENERIC *Generic
+    )
+{
+    //
+    // The filter attaches in the paused state. The NBL pool is allocated once
+    // the MTU is known, when the filter restarts.
+    //
+    ExInitializeRundownProtection(&Generic->Tx.HairpinRundown);
+    ExWaitForRundownProtectionRelease(&Generic->Tx.HairpinRundown);
+
+    return STATUS_SUCCESS;
+}
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+XdpGenericHairpinRestart(
+    _Inout_ XDP_LWF_GENERIC *Generic,
+    _In_ UINT32 NewMtu
+    )
+{
+    NET_BUFFER_LIST_POOL_PARAMETERS PoolParams = {0};
+    UINT32 BufferLength;
+    SIZE_T ContextSize;
+
+    //
+    // The filter is paused and has waited for its hairpin sends to complete, so
+    // the NBL pool can be replaced to size the copies for a new MTU.
+    //
+    if (NewMtu == 0) {
+        return;
+    }
+
+    BufferLength =
+        min(NewMtu, XDP_GENERIC_HAIRPIN_MAX_BUFFER_LENGTH - XDP_GENERIC_HAIRPIN_VLAN_LENGTH) +
+            XDP_GENERIC_HAIRPIN_VLAN_LENGTH;
+    if (BufferLength == Generic->Tx.HairpinBufferLength) {
+        return;
+    }
+
+    XdpGenericHairpinCleanup(Generic);
+
+    if (NewMtu > XDP_GENERIC_HAIRPIN_MAX_BUFFER_LENGTH - XDP_GENERIC_HAIRPIN_VLAN_LENGTH) {
+        TraceWarn(
+            TRACE_GENERIC,
+            "IfIndex=%u TX action copies limited below MTU NewMtu=%u BufferLength=%u",
+            Generic->IfIndex, NewMtu, BufferLength);
+    }
+
+    ContextSize = XdpGenericHairpinContextSize(BufferLength);
+    ASSERT(ContextSize <= MAXUSHORT);
+
+    PoolParams.Header.Type = NDIS_OBJECT_TYPE_DEFAULT;
+    PoolParams.Header.Revision = NET_BUFFER_LIST_POOL_PARAMETERS_REVISION_1;
+    PoolParams.Header.Size = sizeof(PoolParams);
+    PoolParams.ProtocolId = NDIS_PROTOCOL_ID_TCP_IP;
+    PoolParams.PoolTag = POOLTAG_BUFFER;
+    PoolParams.fAllocateNetBuffer = TRUE;
+    PoolParams.ContextSize = (USHORT)ContextSize;
+
+    Generic->Tx.HairpinNblPool =
+        NdisAllocateNetBufferListPool(Generic->NdisFilterHandle, &PoolParams);
+    if (Generic->Tx.HairpinNblPool == NULL) {
+        TraceWarn(
+            TRACE_GENERIC, "IfIndex=%u Failed to allocate TX action NBL pool NewMtu=%u",
+            Generic->IfIndex, NewMtu);
+        return;
+    }
+
+    Generic->Tx.HairpinBufferLength = BufferLength;
+}
+
+VOID
+XdpGenericHairpinCleanup(
+    _Inout_ XDP_LWF_GENERIC *Generic
+    )
+{
+    if (Generic->Tx.HairpinNblPool != NULL) {
+        NdisFreeNetBufferListPool(Generic->Tx.HairpinNblPool);
+        Generic->Tx.HairpinNblPool = NULL;
+    }
+
+    Generic->Tx.HairpinBufferLength = 0;
+}
+
 static
 ULONG_PTR
 XdpGenericInjectCompleteClassify(
@@ -55,12 +329,19 @@ XdpGenericInjectCompleteClassify(
     _In_ NET_BUFFER_LIST *Nbl)
 {
     if (Nbl->SourceHandle == ClassificationContext) {
-        return (ULONG_PTR)NblTxContext(Nbl)->TxQueue;
+        XDP_LWF_GENERIC_TX_QUEUE *TxQueue = NblTxContext(Nbl)->TxQueue;
+
+        return TxQueue != NULL ? (ULONG_PTR)TxQueue : SEND_HAIRPIN_CLASSIFICATION;
     }
 
     return (ULONG_PTR)NULL;
 }
 
+typedef struct _SEND_INJECT_COMPLETE_CONTEXT {
+    XDP_LWF_GENERIC *Generic;
+    NBL_QUEUE PassList;
+} SEND_INJECT_COMPLETE_CONTEXT;
+
 static
 VOID
 XdpGenericInjectCompleteFlush(
@@ -68,12 +349,16 @@ XdpGenericInjectCompleteFlush(
     _In_ ULONG_PTR ClassificationResult,
     _In_ NBL_COUNTED_QUEUE *Queue)
 {
-    if (ClassificationResult == (ULONG_PTR)NULL) {
-        NBL_QUEUE *PassList = (NBL_QUEUE *)FlushContext;
+    SEND_INJECT_COMPLETE_CONTEXT *Context = (SEND_INJECT_COMPLETE_CONTEXT *)FlushContext;
 
+    if (ClassificationResult == (ULONG_PTR)NULL) {
         NdisAppendNblChainToNblQueueFast(
-            PassList, Queue->Queue.First,
+            &Context->PassList, Queue->Queue.First,
             CONTAINING_RECORD(Queue->Queue.Last, NET_BUFFER_LIST, Next));
+    } else if (ClassificationResult == SEND_HAIRPIN_CLASSIFICATION) {
+        XdpGenericHairpinFreeNbls(Queue->Queue.First);
+        ExReleaseRundownProtectionEx(
+            &Context->Generic->Tx.HairpinRundown, (ULONG)Queue->NblCount);
     } else {
         XDP_LWF_GENERIC_TX_QUEUE *TxQueue = (XDP_LWF_GENERIC_TX_QUEUE *)ClassificationResult;
 
@@ -96,15 +381,16 @@ XdpGenericInjectNetBufferListsComplete(
     _In_ NET_BUFFER_LIST *NetBufferLists
     )
 {
-    NBL_QUEUE PassList;
+    SEND_INJECT_COMPLETE_CONTEXT Context;
 
-    NdisInitializeNblQueue(&PassList);
+    Context.Generic = Generic;
+    NdisInitializeNblQueue(&Context.PassList);
 
     NdisClassifyNblChainByValueLookaheadWithCount(
         NetBufferLists, XdpGenericInjectCompleteClassify, Generic->NdisFilterHandle,
-        XdpGenericInjectCompleteFlush, &PassList);
+        XdpGenericInjectCompleteFlush, &Context);
 
-    return NdisGetNblChainFromNblQueue(&PassList);
+    return NdisGetNblChainFromNblQueue(&Context.PassList);
 }
 
 _Use_decl_annotations_
@@ -526,6 +812,8 @@ XdpGenericTxPause(
         XdpGenericTxPauseQueue(Generic, TxQueue);
     }
 
+    ExWaitForRundownProtectionRelease(&Generic->Tx.HairpinRundown);
+
     TraceExitSuccess(TRACE_GENERIC);
 }
 
@@ -565,6 +853,8 @@ XdpGenericTxRestart(
     }
 
     Generic->Tx.Mtu = NewMtu;
+    XdpGenericHairpinRestart(Generic, NewMtu);
+    ExReInitializeRundownProtection(&Generic->Tx.HairpinRundown);
 
     TraceExitSuccess(TRACE_GENERIC);
 }
@@ -13,6 +13,22 @@ typedef struct _XDP_LWF_GENERIC_TX_STATS {
     UINT64 BatchesPosted;
 } XDP_LWF_GENERIC_TX_STATS;
 
+typedef struct _XDP_LWF_GENERIC_HAIRPIN_STATS {
+    UINT64 CopyFailures;
+    UINT64 AllocationFailures;
+} XDP_LWF_GENERIC_HAIRPIN_STATS;
+
+//
+// The copies of frames transmitted by the XDP_RX_ACTION_TX action during one
+// receive indication. While any copy is queued, the queue holds a reference
+// on the hairpin rundown.
+//
+typedef struct _XDP_LWF_GENERIC_HAIRPIN_QUEUE {
+    NBL_COUNTED_QUEUE Nbls;
+    BOOLEAN Active;
+    XDP_LWF_GENERIC_HAIRPIN_STATS Stats;
+} XDP_LWF_GENERIC_HAIRPIN_QUEUE;
+
 typedef struct _XDP_LWF_GENERIC_TX_QUEUE {
     ULONG QueueId;
     LIST_ENTRY Link;
@@ -59,6 +75,43 @@ XdpGenericInjectNetBufferListsComplete(
     _In_ NET_BUFFER_LIST *NetBufferLists
     );
 
+VOID
+XdpGenericHairpinInitializeQueue(
+    _Out_ XDP_LWF_GENERIC_HAIRPIN_QUEUE *Queue
+    );
+
+_IRQL_requires_(DISPATCH_LEVEL)
+VOID
+XdpGenericHairpinEnqueue(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _Inout_ XDP_LWF_GENERIC_HAIRPIN_QUEUE *Queue,
+    _In_ NET_BUFFER *Nb
+    );
+
+_IRQL_requires_(DISPATCH_LEVEL)
+VOID
+XdpGenericHairpinSend(
+    _In_ XDP_LWF_GENERIC *Generic,
+    _Inout_ XDP_LWF_GENERIC_HAIRPIN_QUEUE *Queue
+    );
+
+NTSTATUS
+XdpGenericHairpinInitialize(
+    _Inout_ XDP_LWF_GENERIC *Generic
+    );
+
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+XdpGenericHairpinRestart(
+    _Inout_ XDP_LWF_GENERIC *Generic,
+    _In_ UINT32 NewMtu
+    );
+
+VOID
+XdpGenericHairpinCleanup(
+    _Inout_ XDP_LWF_GENERIC *Generic
+    );
+
 _IRQL_requires_(DISPATCH_LEVEL)
 VOID
 XdpGenericTxFlushRss(
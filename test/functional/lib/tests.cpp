@@ -1850,6 +1850,8 @@ GenericRxMatchUdp(
     Rule.Match = MatchType;
     if (MatchType == XDP_MATCH_UDP_DST) {
         Rule.Pattern.Port = LocalPort;
+    } else if (MatchType == XDP_MATCH_UDP_SRC) {
+        Rule.Pattern.Port = RemotePort;
     } else if (MatchType == XDP_MATCH_IPV4_UDP_TUPLE || MatchType == XDP_MATCH_IPV6_UDP_TUPLE) {
         Rule.Pattern.Tuple.SourcePort = RemotePort;
         Rule.Pattern.Tuple.DestinationPort = LocalPort;
@@ -1878,6 +1880,12 @@ GenericRxMatchUdp(
             Rule.Pattern.IpPortSet.Address = *(XDP_INET_ADDR *)&LocalIp;
             Rule.Pattern.IpPortSet.PortSet.PortSet = PortSet.get();
         }
+    } else if (MatchType == XDP_MATCH_UDP_SRC_PORT_SET) {
+        PortSet.reset((UINT8 *)calloc(XDP_PORT_SET_BUFFER_SIZE, 1));
+        TEST_NOT_NULL(PortSet.get());
+
+        SetBit(PortSet.get(), RemotePort);
+        Rule.Pattern.PortSet.PortSet = PortSet.get();
     }
 
     //
@@ -1929,6 +1937,21 @@ GenericRxMatchUdp(
         TEST_EQUAL(UdpPayloadLength, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
         TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, UdpPayloadLength));
 
+    } else if (Rule.Match == XDP_MATCH_UDP_SRC) {
+        //
+        // Verify default action (when no rules match) is pass.
+        //
+        ProgramHandle.reset();
+        Rule.Pattern.Port = htons(ntohs(RemotePort) - 1);
+
+        ProgramHandle =
+            CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        TEST_EQUAL(UdpPayloadLength, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+        TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, UdpPayloadLength));
+
     } else if (Rule.Match == XDP_MATCH_IPV4_UDP_TUPLE || Rule.Match == XDP_MATCH_IPV6_UDP_TUPLE) {
         //
         // Verify source port matching.
@@ -2108,6 +2131,124 @@ GenericRxMatchUdp(
     }
 }
 
+VOID
+GenericRxMatchUdpRuleOrder(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    CONST UINT32 FillerRuleCount = 1000;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    wil::unique_handle ProgramHandle;
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    UCHAR UdpPayload[] = "GenericRxMatchUdpRuleOrder";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    XDP_RULE TupleRule = {};
+    TupleRule.Match = (Af == AF_INET) ? XDP_MATCH_IPV4_UDP_TUPLE : XDP_MATCH_IPV6_UDP_TUPLE;
+    TupleRule.Pattern.Tuple.SourcePort = RemotePort;
+    TupleRule.Pattern.Tuple.DestinationPort = LocalPort;
+    memcpy(&TupleRule.Pattern.Tuple.SourceAddress, &RemoteIp, sizeof(INET_ADDR));
+    memcpy(&TupleRule.Pattern.Tuple.DestinationAddress, &LocalIp, sizeof(INET_ADDR));
+
+    XDP_RULE PortRule = {};
+    PortRule.Match = XDP_MATCH_UDP_DST;
+    PortRule.Pattern.Port = LocalPort;
+
+    //
+    // Build a large program of non-matching exact-match rules, followed by two
+    // matching rules with conflicting actions.
+    //
+    std::vector<XDP_RULE> Rules;
+    for (UINT32 i = 0; i < FillerRuleCount; i++) {
+        XDP_RULE Rule;
+
+        if (i % 2 == 0) {
+            Rule = PortRule;
+            Rule.Pattern.Port = htons((UINT16)(ntohs(LocalPort) + 1 + i));
+        } else {
+            Rule = TupleRule;
+            Rule.Pattern.Tuple.SourcePort = htons((UINT16)(ntohs(RemotePort) + 1 + i));
+        }
+
+        Rule.Action = XDP_PROGRAM_ACTION_DROP;
+        Rules.push_back(Rule);
+    }
+
+    //
+    // Verify the lowest-indexed matching rule wins.
+    //
+    TupleRule.Action = XDP_PROGRAM_ACTION_PASS;
+    PortRule.Action = XDP_PROGRAM_ACTION_DROP;
+    Rules.push_back(TupleRule);
+    Rules.push_back(PortRule);
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rules[0],
+            (UINT32)Rules.size());
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+
+    ProgramHandle.reset();
+    std::swap(Rules[FillerRuleCount], Rules[FillerRuleCount + 1]);
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rules[0],
+            (UINT32)Rules.size());
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+
+    //
+    // Verify a non-indexed rule preceding the indexed rules still wins.
+    //
+    ProgramHandle.reset();
+    XDP_RULE UdpRule = {};
+    UdpRule.Match = XDP_MATCH_UDP;
+    UdpRule.Action = XDP_PROGRAM_ACTION_PASS;
+    Rules.insert(Rules.begin() + FillerRuleCount / 2, UdpRule);
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rules[0],
+            (UINT32)Rules.size());
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+}
+
 VOID
 GenericRxMatchIpPrefix(
     _In_ ADDRESS_FAMILY Af
@@ -2181,116 +2322,551 @@ GenericRxMatchIpPrefix(
     TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
     TEST_EQUAL(sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
     TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+
+    //
+    // Verify source IP prefix match.
+    //
+    ProgramHandle.reset();
+    Rule.Match = (Af == AF_INET) ? XDP_MATCH_IPV4_SRC_MASK : XDP_MATCH_IPV6_SRC_MASK;
+    Rule.Pattern.IpMask.Address = RemoteIp;
+    ClearMaskedBits(&Rule.Pattern.IpMask.Address, &Rule.Pattern.IpMask.Mask, Af);
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+
+    //
+    // Verify source IP prefix mismatch.
+    //
+    ProgramHandle.reset();
+    *(UCHAR *)&Rule.Pattern.IpMask.Address ^= 0xFFu;
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
 }
 
 VOID
-GenericRxLowResources()
+GenericRxMatchIpPrefixRuleOrder(
+    _In_ ADDRESS_FAMILY Af
+    )
 {
     auto If = FnMpIf;
-    ADDRESS_FAMILY Af = AF_INET6;
-    UINT16 LocalPort, LocalXskPort, RemotePort;
+    UINT16 LocalPort, RemotePort;
     ETHERNET_ADDRESS LocalHw, RemoteHw;
-    INET_ADDR LocalIp, RemoteIp;
+    XDP_INET_ADDR LocalIp, RemoteIp;
+    CONST UINT32 FillerRuleCount = 1000;
 
     auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
     auto GenericMp = MpOpenGeneric(If.GetIfIndex());
-    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    wil::unique_handle ProgramHandle;
 
-    LocalXskPort = htons(ntohs(LocalPort) + 1);
     RemotePort = htons(1234);
     If.GetHwAddress(&LocalHw);
     If.GetRemoteHwAddress(&RemoteHw);
-    If.GetIpv6Address(&LocalIp.Ipv6);
-    If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
 
-    UCHAR UdpMatchPayload[] = "GenericRxLowResourcesMatch";
-    UCHAR UdpMatchFrame[UDP_HEADER_STORAGE + sizeof(UdpMatchPayload)];
-    UINT32 UdpMatchFrameLength = sizeof(UdpMatchFrame);
+    UCHAR UdpPayload[] = "GenericRxMatchIpPrefixRuleOrder";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
     TEST_TRUE(
         PktBuildUdpFrame(
-            UdpMatchFrame, &UdpMatchFrameLength, UdpMatchPayload, sizeof(UdpMatchPayload), &LocalHw,
-            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalXskPort, RemotePort));
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
 
-    UCHAR UdpNoMatchPayload[] = "GenericRxLowResourcesNoMatch";
-    UCHAR UdpNoMatchFrame[UDP_HEADER_STORAGE + sizeof(UdpNoMatchPayload)];
-    UINT32 UdpNoMatchFrameLength = sizeof(UdpNoMatchFrame);
-    TEST_TRUE(
-        PktBuildUdpFrame(
-            UdpNoMatchFrame, &UdpNoMatchFrameLength, UdpNoMatchPayload, sizeof(UdpNoMatchPayload),
-            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    XDP_RULE ShortPrefixRule = {};
+    XDP_RULE LongPrefixRule = {};
 
-    XDP_RULE Rule;
-    Rule.Match = XDP_MATCH_UDP_DST;
-    Rule.Pattern.Port = LocalXskPort;
-    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
-    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
-    Rule.Redirect.Target = Xsk.Handle.get();
+    if (Af == AF_INET) {
+        ShortPrefixRule.Match = XDP_MATCH_IPV4_DST_MASK;
+        TEST_EQUAL(1, inet_pton(Af, "255.0.0.0", &ShortPrefixRule.Pattern.IpMask.Mask));
+        LongPrefixRule.Match = XDP_MATCH_IPV4_DST_MASK;
+        TEST_EQUAL(1, inet_pton(Af, "255.255.255.255", &LongPrefixRule.Pattern.IpMask.Mask));
+    } else {
+        ShortPrefixRule.Match = XDP_MATCH_IPV6_DST_MASK;
+        TEST_EQUAL(1, inet_pton(Af, "FFFF::0", &ShortPrefixRule.Pattern.IpMask.Mask));
+        LongPrefixRule.Match = XDP_MATCH_IPV6_DST_MASK;
+        TEST_EQUAL(
+            1,
+            inet_pton(
+                Af, "FFFF:FFFF:FFFF:FFFF:FFFF:FFFF:FFFF:FFFF",
+                &LongPrefixRule.Pattern.IpMask.Mask));
+    }
 
-    wil::unique_handle ProgramHandle =
-        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+    ShortPrefixRule.Pattern.IpMask.Address = LocalIp;
+    ClearMaskedBits(
+        &ShortPrefixRule.Pattern.IpMask.Address, &ShortPrefixRule.Pattern.IpMask.Mask, Af);
+    LongPrefixRule.Pattern.IpMask.Address = LocalIp;
 
     //
-    // Low resource handling requires logically splitting a chain of NBLs and
-    // returning the original chain to the caller. The FNMP driver verifies the
-    // NDIS contract, and this test verifies observable behavior.
+    // Build a large program of non-matching prefix rules, followed by a short
+    // and a long matching prefix with conflicting actions.
     //
-    CONST UINT32 NumMatchFrames = 4;
-    CONST UINT32 NumNoMatchFrames = 4;
+    std::vector<XDP_RULE> Rules;
+    for (UINT32 i = 0; i < FillerRuleCount; i++) {
+        XDP_RULE Rule = LongPrefixRule;
+
+        //
+        // Vary the prefix length and flip a bit within the prefix.
+        //
+        UINT32 AddressBytes = (Af == AF_INET) ? sizeof(IN_ADDR) : sizeof(IN6_ADDR);
+        UINT32 PrefixLength = 1 + (i % (AddressBytes * 8));
+        UINT8 *Mask = (UINT8 *)&Rule.Pattern.IpMask.Mask;
+        UINT8 *Address = (UINT8 *)&Rule.Pattern.IpMask.Address;
+
+        RtlZeroMemory(Mask, AddressBytes);
+        for (UINT32 Bit = 0; Bit < PrefixLength; Bit++) {
+            Mask[Bit / 8] |= (UINT8)(0x80 >> (Bit % 8));
+        }
+        Address[(PrefixLength - 1) / 8] ^= (UINT8)(0x80 >> ((PrefixLength - 1) % 8));
+        ClearMaskedBits(&Rule.Pattern.IpMask.Address, &Rule.Pattern.IpMask.Mask, Af);
+
+        Rule.Action = XDP_PROGRAM_ACTION_DROP;
+        Rules.push_back(Rule);
+    }
+
+    //
+    // Verify the lowest-indexed matching rule wins, rather than the longest
+    // matching prefix.
+    //
+    ShortPrefixRule.Action = XDP_PROGRAM_ACTION_PASS;
+    LongPrefixRule.Action = XDP_PROGRAM_ACTION_DROP;
+    Rules.push_back(ShortPrefixRule);
+    Rules.push_back(LongPrefixRule);
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rules[0],
+            (UINT32)Rules.size());
 
     RX_FRAME Frame;
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
-    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
-    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
 
-    SocketProduceRxFill(&Xsk, NumMatchFrames);
+    ProgramHandle.reset();
+    std::swap(Rules[FillerRuleCount], Rules[FillerRuleCount + 1]);
 
-    DATA_FLUSH_OPTIONS FlushOptions = {0};
-    FlushOptions.Flags.LowResources = TRUE;
-    TEST_HRESULT(MpRxFlush(GenericMp, &FlushOptions));
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rules[0],
+            (UINT32)Rules.size());
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
 
     //
-    // Verify the match NBLs propagated correctly to XSK.
+    // Verify a prefix rule whose address has bits set outside its mask never
+    // matches, even when the program has enough prefix rules to build a trie.
     //
-    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, NumMatchFrames);
-    TEST_EQUAL(NumMatchFrames, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+    ProgramHandle.reset();
+    Rules.resize(FillerRuleCount);
 
-    for (UINT32 Index = 0; Index < NumMatchFrames; Index++) {
-        auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex++);
-        TEST_EQUAL(UdpMatchFrameLength, RxDesc->length);
-        TEST_TRUE(
-            RtlEqualMemory(
-                Xsk.Umem.Buffer.get() + XskDescriptorGetAddress(RxDesc->address) +
-                    XskDescriptorGetOffset(RxDesc->address),
-                UdpMatchFrame,
-                UdpMatchFrameLength));
-    }
+    XDP_RULE HostBitsRule = ShortPrefixRule;
+    HostBitsRule.Pattern.IpMask.Address = LocalIp;
+    ((UINT8 *)&HostBitsRule.Pattern.IpMask.Address)[
+        ((Af == AF_INET) ? sizeof(IN_ADDR) : sizeof(IN6_ADDR)) - 1] |= 1;
+    HostBitsRule.Action = XDP_PROGRAM_ACTION_DROP;
+    Rules.push_back(HostBitsRule);
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rules[0],
+            (UINT32)Rules.size());
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
 
     //
-    // Verify the no-match NBLs propagated past XDP to the local stack.
+    // Verify the same for source prefix rules, using full-length prefixes of
+    // other remote addresses to build the trie.
     //
-    CHAR RecvPayload[sizeof(UdpNoMatchPayload)];
-    for (UINT32 Index = 0; Index < NumNoMatchFrames; Index++) {
-        TEST_EQUAL(
-            sizeof(UdpNoMatchPayload),
-            recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
-        TEST_TRUE(RtlEqualMemory(UdpNoMatchPayload, RecvPayload, sizeof(UdpNoMatchPayload)));
+    ProgramHandle.reset();
+    Rules.clear();
+
+    XDP_MATCH_TYPE SrcMatch =
+        (Af == AF_INET) ? XDP_MATCH_IPV4_SRC_MASK : XDP_MATCH_IPV6_SRC_MASK;
+    UINT32 AddressBytes = (Af == AF_INET) ? sizeof(IN_ADDR) : sizeof(IN6_ADDR);
+
+    for (UINT32 i = 0; i < FillerRuleCount; i++) {
+        XDP_RULE Rule = LongPrefixRule;
+        UINT8 *Address = (UINT8 *)&Rule.Pattern.IpMask.Address;
+
+        Rule.Match = SrcMatch;
+        Rule.Pattern.IpMask.Address = RemoteIp;
+        Address[AddressBytes - 1] ^= (UINT8)(i + 1);
+        Address[AddressBytes - 2] ^= (UINT8)((i + 1) >> 8);
+        Rule.Action = XDP_PROGRAM_ACTION_DROP;
+        Rules.push_back(Rule);
     }
 
-    TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
-    TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+    HostBitsRule.Match = SrcMatch;
+    HostBitsRule.Pattern.IpMask.Address = RemoteIp;
+    ((UINT8 *)&HostBitsRule.Pattern.IpMask.Address)[AddressBytes - 1] |= 1;
+    Rules.push_back(HostBitsRule);
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rules[0],
+            (UINT32)Rules.size());
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+}
+
+VOID
+GenericRxMatchFrameClassRuleOrder(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    XDP_INET_ADDR LocalIp, RemoteIp;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    wil::unique_handle ProgramHandle;
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    UCHAR UdpPayload[] = "GenericRxMatchFrameClassRuleOrder";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    //
+    // Build a program mixing rules for both address families: the rules for
+    // the other family would drop every frame of that family, but must never
+    // be evaluated against this frame.
+    //
+    XDP_RULE OtherFamilyRule = {};
+    OtherFamilyRule.Match = (Af == AF_INET) ? XDP_MATCH_IPV6_DST_MASK : XDP_MATCH_IPV4_DST_MASK;
+    OtherFamilyRule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    XDP_RULE OtherPortRule = {};
+    OtherPortRule.Match = XDP_MATCH_UDP_DST;
+    OtherPortRule.Pattern.Port = htons(ntohs(LocalPort) + 1);
+    OtherPortRule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    XDP_RULE SameFamilyRule = {};
+    SameFamilyRule.Match = (Af == AF_INET) ? XDP_MATCH_IPV4_DST_MASK : XDP_MATCH_IPV6_DST_MASK;
+    SameFamilyRule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    XDP_RULE PassRule = {};
+    PassRule.Match = XDP_MATCH_ALL;
+    PassRule.Action = XDP_PROGRAM_ACTION_PASS;
+
+    std::vector<XDP_RULE> Rules;
+    Rules.push_back(OtherFamilyRule);
+    Rules.push_back(OtherPortRule);
+    Rules.push_back(PassRule);
+    Rules.push_back(SameFamilyRule);
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rules[0],
+            (UINT32)Rules.size());
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+
+    //
+    // Move the same-family rule ahead of the catch-all rule and verify it
+    // takes precedence.
+    //
+    ProgramHandle.reset();
+    std::swap(Rules[2], Rules[3]);
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rules[0],
+            (UINT32)Rules.size());
+
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+}
+
+VOID
+GenericRxMatchTcp(
+    _In_ ADDRESS_FAMILY Af,
+    _In_ XDP_MATCH_TYPE MatchType
+    )
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    unique_malloc_ptr<UINT8> PortSet;
+
+    auto Socket = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    LocalPort = htons(1234);
+    RemotePort = htons(4321);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    //
+    // Build a bare SYN between the local and remote ports, which every rule
+    // below matches, and a SYN+ACK between different ports, which none of them
+    // match.
+    //
+    UCHAR TcpPayload[] = "GenericRxMatchTcp";
+    UCHAR MatchFrame[TCP_HEADER_STORAGE + sizeof(TcpPayload)];
+    UINT32 MatchFrameLength = sizeof(MatchFrame);
+    TEST_TRUE(
+        PktBuildTcpFrame(
+            MatchFrame, &MatchFrameLength, TcpPayload, sizeof(TcpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort,
+            XDP_TCP_FLAG_SYN));
+
+    UCHAR MismatchFrame[TCP_HEADER_STORAGE + sizeof(TcpPayload)];
+    UINT32 MismatchFrameLength = sizeof(MismatchFrame);
+    TEST_TRUE(
+        PktBuildTcpFrame(
+            MismatchFrame, &MismatchFrameLength, TcpPayload, sizeof(TcpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, htons(ntohs(LocalPort) + 1),
+            htons(ntohs(RemotePort) + 1), XDP_TCP_FLAG_SYN | XDP_TCP_FLAG_ACK));
+
+    XDP_RULE Rule = {};
+    Rule.Match = MatchType;
+    if (MatchType == XDP_MATCH_TCP_DST) {
+        Rule.Pattern.Port = LocalPort;
+    } else if (MatchType == XDP_MATCH_TCP_SRC) {
+        Rule.Pattern.Port = RemotePort;
+    } else if (MatchType == XDP_MATCH_IPV4_TCP_TUPLE || MatchType == XDP_MATCH_IPV6_TCP_TUPLE) {
+        Rule.Pattern.Tuple.SourcePort = RemotePort;
+        Rule.Pattern.Tuple.DestinationPort = LocalPort;
+        memcpy(&Rule.Pattern.Tuple.SourceAddress, &RemoteIp, sizeof(INET_ADDR));
+        memcpy(&Rule.Pattern.Tuple.DestinationAddress, &LocalIp, sizeof(INET_ADDR));
+    } else if (MatchType == XDP_MATCH_TCP_PORT_SET ||
+               MatchType == XDP_MATCH_IPV4_TCP_PORT_SET ||
+               MatchType == XDP_MATCH_IPV6_TCP_PORT_SET) {
+        PortSet.reset((UINT8 *)calloc(XDP_PORT_SET_BUFFER_SIZE, 1));
+        TEST_NOT_NULL(PortSet.get());
+
+        SetBit(PortSet.get(), LocalPort);
+
+        if (MatchType == XDP_MATCH_TCP_PORT_SET) {
+            Rule.Pattern.PortSet.PortSet = PortSet.get();
+        } else {
+            Rule.Pattern.IpPortSet.Address = *(XDP_INET_ADDR *)&LocalIp;
+            Rule.Pattern.IpPortSet.PortSet.PortSet = PortSet.get();
+        }
+    } else if (MatchType == XDP_MATCH_TCP_SRC_PORT_SET) {
+        PortSet.reset((UINT8 *)calloc(XDP_PORT_SET_BUFFER_SIZE, 1));
+        TEST_NOT_NULL(PortSet.get());
+
+        SetBit(PortSet.get(), RemotePort);
+        Rule.Pattern.PortSet.PortSet = PortSet.get();
+    } else if (MatchType == XDP_MATCH_TCP_FLAGS) {
+        Rule.Pattern.TcpFlags.Mask =
+            XDP_TCP_FLAG_SYN | XDP_TCP_FLAG_ACK | XDP_TCP_FLAG_RST | XDP_TCP_FLAG_FIN;
+        Rule.Pattern.TcpFlags.Flags = XDP_TCP_FLAG_SYN;
+    }
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Redirect.Target = Socket.Handle.get();
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    SocketProduceRxFill(&Socket, 1);
+
+    //
+    // Verify the mismatched frame is not redirected, except by the rule
+    // matching every TCP frame.
+    //
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), MismatchFrame, MismatchFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    UINT32 ConsumerIndex;
+    if (MatchType == XDP_MATCH_TCP) {
+        ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+        TEST_EQUAL(1, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+        auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+        TEST_EQUAL(MismatchFrameLength, RxDesc->length);
+        SocketProduceRxFill(&Socket, 1);
+    } else {
+        Sleep(TEST_TIMEOUT_ASYNC_MS);
+        TEST_EQUAL(0, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+    }
+
+    //
+    // Verify the matching frame is redirected.
+    //
+    RxInitializeFrame(&Frame, If.GetQueueId(), MatchFrame, MatchFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    TEST_EQUAL(1, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+    auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+    TEST_EQUAL(MatchFrameLength, RxDesc->length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Socket.Umem.Buffer.get() +
+                XskDescriptorGetAddress(RxDesc->address) + XskDescriptorGetOffset(RxDesc->address),
+            MatchFrame,
+            MatchFrameLength));
+}
+
+VOID
+GenericRxLowResources()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET6;
+    UINT16 LocalPort, LocalXskPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+
+    LocalXskPort = htons(ntohs(LocalPort) + 1);
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv6Address(&LocalIp.Ipv6);
+    If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+
+    UCHAR UdpMatchPayload[] = "GenericRxLowResourcesMatch";
+    UCHAR UdpMatchFrame[UDP_HEADER_STORAGE + sizeof(UdpMatchPayload)];
+    UINT32 UdpMatchFrameLength = sizeof(UdpMatchFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpMatchFrame, &UdpMatchFrameLength, UdpMatchPayload, sizeof(UdpMatchPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalXskPort, RemotePort));
+
+    UCHAR UdpNoMatchPayload[] = "GenericRxLowResourcesNoMatch";
+    UCHAR UdpNoMatchFrame[UDP_HEADER_STORAGE + sizeof(UdpNoMatchPayload)];
+    UINT32 UdpNoMatchFrameLength = sizeof(UdpNoMatchFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpNoMatchFrame, &UdpNoMatchFrameLength, UdpNoMatchPayload, sizeof(UdpNoMatchPayload),
+            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    XDP_RULE Rule;
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalXskPort;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Redirect.Target = Xsk.Handle.get();
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    //
+    // Low resource handling requires logically splitting a chain of NBLs and
+    // returning the original chain to the caller. The FNMP driver verifies the
+    // NDIS contract, and this test verifies observable behavior.
+    //
+    CONST UINT32 NumMatchFrames = 4;
+    CONST UINT32 NumNoMatchFrames = 4;
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpMatchFrame, UdpMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpNoMatchFrame, UdpNoMatchFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+
+    SocketProduceRxFill(&Xsk, NumMatchFrames);
+
+    DATA_FLUSH_OPTIONS FlushOptions = {0};
+    FlushOptions.Flags.LowResources = TRUE;
+    TEST_HRESULT(MpRxFlush(GenericMp, &FlushOptions));
+
+    //
+    // Verify the match NBLs propagated correctly to XSK.
+    //
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, NumMatchFrames);
+    TEST_EQUAL(NumMatchFrames, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+
+    for (UINT32 Index = 0; Index < NumMatchFrames; Index++) {
+        auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex++);
+        TEST_EQUAL(UdpMatchFrameLength, RxDesc->length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Xsk.Umem.Buffer.get() + XskDescriptorGetAddress(RxDesc->address) +
+                    XskDescriptorGetOffset(RxDesc->address),
+                UdpMatchFrame,
+                UdpMatchFrameLength));
+    }
+
+    //
+    // Verify the no-match NBLs propagated past XDP to the local stack.
+    //
+    CHAR RecvPayload[sizeof(UdpNoMatchPayload)];
+    for (UINT32 Index = 0; Index < NumNoMatchFrames; Index++) {
+        TEST_EQUAL(
+            sizeof(UdpNoMatchPayload),
+            recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+        TEST_TRUE(RtlEqualMemory(UdpNoMatchPayload, RecvPayload, sizeof(UdpNoMatchPayload)));
+    }
+
+    TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
 }
 
 VOID
@@ -2300,218 +2876,2695 @@ GenericRxMultiSocket()
     ADDRESS_FAMILY Af = AF_INET;
     ETHERNET_ADDRESS LocalHw, RemoteHw;
     INET_ADDR LocalIp, RemoteIp;
-    UCHAR UdpMatchPayload[] = "GenericRxMultiSocket";
-    struct {
-        MY_SOCKET Xsk;
-        UINT16 LocalPort;
-        UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpMatchPayload)];
-        UINT32 UdpFrameLength;
-    } Sockets[2];
-    XDP_RULE Rules[RTL_NUMBER_OF(Sockets)] = {};
+    UCHAR UdpMatchPayload[] = "GenericRxMultiSocket";
+    struct {
+        MY_SOCKET Xsk;
+        UINT16 LocalPort;
+        UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpMatchPayload)];
+        UINT32 UdpFrameLength;
+    } Sockets[2];
+    XDP_RULE Rules[RTL_NUMBER_OF(Sockets)] = {};
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        Sockets[Index].Xsk =
+            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+        Sockets[Index].LocalPort = htons(1000 + Index);
+        Sockets[Index].UdpFrameLength = sizeof(Sockets[Index].UdpFrame);
+        TEST_TRUE(
+            PktBuildUdpFrame(
+                Sockets[Index].UdpFrame, &Sockets[Index].UdpFrameLength, UdpMatchPayload,
+                sizeof(UdpMatchPayload), &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp,
+                Sockets[Index].LocalPort, htons(2000)));
+
+        Rules[Index].Match = XDP_MATCH_UDP_DST;
+        Rules[Index].Pattern.Port = Sockets[Index].LocalPort;
+        Rules[Index].Action = XDP_PROGRAM_ACTION_REDIRECT;
+        Rules[Index].Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+        Rules[Index].Redirect.Target = Sockets[Index].Xsk.Handle.get();
+    }
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            Rules, RTL_NUMBER_OF(Rules));
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        auto &Socket = Sockets[Index].Xsk;
+        DATA_BUFFER Buffer = {0};
+
+        SocketProduceRxFill(&Socket, 1);
+
+        Buffer.DataOffset = 0;
+        Buffer.DataLength = Sockets[Index].UdpFrameLength;
+        Buffer.BufferLength = Buffer.DataLength;
+        Buffer.VirtualAddress = Sockets[Index].UdpFrame;
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), &Buffer);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+
+        //
+        // Verify the NBL propagated correctly to XSK.
+        //
+        TEST_EQUAL(1, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+        auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+        TEST_EQUAL(Buffer.DataLength, RxDesc->length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Socket.Umem.Buffer.get() +
+                    XskDescriptorGetAddress(RxDesc->address) + XskDescriptorGetOffset(RxDesc->address),
+                Buffer.VirtualAddress + Buffer.DataOffset,
+                Buffer.DataLength));
+    }
+}
+
+VOID
+GenericRxXskGroup()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UCHAR UdpPayload[] = "GenericRxXskGroup";
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT16 LocalPort = htons(1000);
+    CONST UINT16 FlowCount = 16;
+    CONST UINT32 FramesPerFlow = 2;
+    MY_SOCKET Sockets[2];
+    HANDLE SocketHandles[RTL_NUMBER_OF(Sockets)];
+    UINT32 SocketFlowCounts[RTL_NUMBER_OF(Sockets)] = {0};
+    wil::unique_handle ProgramHandle;
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        Sockets[Index] =
+            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+        SocketHandles[Index] = Sockets[Index].Handle.get();
+        SocketProduceRxFill(&Sockets[Index], FramesPerFlow);
+    }
+
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK_GROUP;
+    Rule.Redirect.XskGroup.Sockets = SocketHandles;
+
+    //
+    // Verify empty groups and duplicate sockets are rejected.
+    //
+    Rule.Redirect.XskGroup.SocketCount = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1));
+
+    HANDLE DuplicateHandles[] = { SocketHandles[0], SocketHandles[0] };
+    Rule.Redirect.XskGroup.Sockets = DuplicateHandles;
+    Rule.Redirect.XskGroup.SocketCount = RTL_NUMBER_OF(DuplicateHandles);
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1));
+
+    Rule.Redirect.XskGroup.Sockets = SocketHandles;
+    Rule.Redirect.XskGroup.SocketCount = RTL_NUMBER_OF(SocketHandles);
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    for (UINT16 Flow = 0; Flow < FlowCount; Flow++) {
+        UINT32 UdpFrameLength = sizeof(UdpFrame);
+        UINT32 RxCounts[RTL_NUMBER_OF(Sockets)] = {0};
+        UINT32 ConsumerIndexes[RTL_NUMBER_OF(Sockets)];
+
+        TEST_TRUE(
+            PktBuildUdpFrame(
+                UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+                &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, htons(2000 + Flow)));
+
+        for (UINT32 Index = 0; Index < FramesPerFlow; Index++) {
+            RX_FRAME Frame;
+            RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+            TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+        }
+
+        TEST_HRESULT(MpRxFlush(GenericMp));
+
+        Stopwatch<std::chrono::milliseconds> Watchdog(TEST_TIMEOUT_ASYNC);
+        do {
+            UINT32 RxCount = 0;
+
+            for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+                RxCounts[Index] =
+                    XskRingConsumerReserve(
+                        &Sockets[Index].Rings.Rx, MAXUINT32, &ConsumerIndexes[Index]);
+                RxCount += RxCounts[Index];
+            }
+
+            if (RxCount >= FramesPerFlow) {
+                break;
+            }
+        } while (!Watchdog.IsExpired());
+
+        //
+        // Verify all frames of the flow were redirected to the same socket.
+        //
+        TEST_EQUAL(FramesPerFlow, RxCounts[0] + RxCounts[1]);
+        TEST_TRUE(RxCounts[0] == 0 || RxCounts[1] == 0);
+
+        for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+            auto &Socket = Sockets[Index];
+
+            if (RxCounts[Index] == 0) {
+                continue;
+            }
+
+            for (UINT32 i = 0; i < RxCounts[Index]; i++) {
+                auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndexes[Index]++);
+                TEST_EQUAL(UdpFrameLength, RxDesc->length);
+                TEST_TRUE(
+                    RtlEqualMemory(
+                        Socket.Umem.Buffer.get() + XskDescriptorGetAddress(RxDesc->address) +
+                            XskDescriptorGetOffset(RxDesc->address),
+                        UdpFrame, UdpFrameLength));
+            }
+
+            XskRingConsumerRelease(&Socket.Rings.Rx, RxCounts[Index]);
+            SocketProduceRxFill(&Socket, RxCounts[Index]);
+            SocketFlowCounts[Index]++;
+        }
+    }
+
+    //
+    // Verify the flows were spread across the group.
+    //
+    for (UINT32 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        TEST_NOT_EQUAL(0, SocketFlowCounts[Index]);
+    }
+}
+
+VOID
+GenericRxMultiProgram()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UCHAR UdpMatchPayload[] = "GenericRxMultiProgram";
+    struct {
+        MY_SOCKET Xsk;
+        wil::unique_handle ProgramHandle;
+        UINT16 LocalPort;
+        UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpMatchPayload)];
+        UINT32 UdpFrameLength;
+    } Sockets[4];
+
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        XDP_RULE Rule = {};
+
+        Sockets[Index].Xsk =
+            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+        Sockets[Index].LocalPort = htons(1000 + Index);
+        Sockets[Index].UdpFrameLength = sizeof(Sockets[Index].UdpFrame);
+        TEST_TRUE(
+            PktBuildUdpFrame(
+                Sockets[Index].UdpFrame, &Sockets[Index].UdpFrameLength, UdpMatchPayload,
+                sizeof(UdpMatchPayload), &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp,
+                Sockets[Index].LocalPort, htons(2000)));
+
+        Rule.Match = XDP_MATCH_UDP_DST;
+        Rule.Pattern.Port = Sockets[Index].LocalPort;
+        Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+        Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+        Rule.Redirect.Target = Sockets[Index].Xsk.Handle.get();
+
+        Sockets[Index].ProgramHandle =
+            CreateXdpProg(
+                If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+                &Rule, 1, XDP_CREATE_PROGRAM_FLAG_SHARE);
+    }
+
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
+        auto &Socket = Sockets[Index].Xsk;
+        DATA_BUFFER Buffer = {0};
+        BOOLEAN Detach = Index & 1;
+
+        if (Detach) {
+            //
+            // Ensure shared programs are properly detached.
+            //
+            Sockets[Index].ProgramHandle.reset();
+        }
+
+        SocketProduceRxFill(&Socket, 1);
+
+        Buffer.DataOffset = 0;
+        Buffer.DataLength = Sockets[Index].UdpFrameLength;
+        Buffer.BufferLength = Buffer.DataLength;
+        Buffer.VirtualAddress = Sockets[Index].UdpFrame;
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), &Buffer);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        //
+        // Verify the NBL propagated correctly to XSK.
+        //
+        if (Detach) {
+            UINT32 ConsumerIndex;
+            Sleep(TEST_TIMEOUT_ASYNC_MS);
+            TEST_EQUAL(0, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+        } else {
+            UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+
+            TEST_EQUAL(1, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
+            auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
+            TEST_EQUAL(Buffer.DataLength, RxDesc->length);
+            TEST_TRUE(
+                RtlEqualMemory(
+                    Socket.Umem.Buffer.get() +
+                        XskDescriptorGetAddress(RxDesc->address) + XskDescriptorGetOffset(RxDesc->address),
+                    Buffer.VirtualAddress + Buffer.DataOffset,
+                    Buffer.DataLength));
+        }
+    }
+}
+
+VOID
+GenericRxMultiProgramConflicts()
+{
+    auto If = FnMpIf;
+    XDP_RULE Rule = {};
+
+    Rule.Match = XDP_MATCH_ALL;
+    Rule.Action = XDP_PROGRAM_ACTION_PASS;
+
+    //
+    // Verify a non-sharing program prevents sharing.
+    //
+    wil::unique_handle failProgram;
+    wil::unique_handle validProgram =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    //
+    // A non-sharing program should fail with ERROR_OBJECT_ALREADY_EXISTS.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_OBJECT_ALREADY_EXISTS),
+        TryCreateXdpProg(
+            failProgram, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1));
+
+    //
+    // A sharing program should fail with ERROR_SHARING_VIOLATION.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_SHARING_VIOLATION),
+        TryCreateXdpProg(
+            failProgram, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1,
+            XDP_CREATE_PROGRAM_FLAG_SHARE));
+
+    //
+    // Verify a sharing program prevents sharing with non-sharing programs.
+    //
+    validProgram.reset();
+    validProgram =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1,
+            XDP_CREATE_PROGRAM_FLAG_SHARE);
+
+    //
+    // A non-sharing program should fail with ERROR_OBJECT_ALREADY_EXISTS.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_OBJECT_ALREADY_EXISTS),
+        TryCreateXdpProg(
+            failProgram, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1));
+}
+
+VOID
+GenericRxProgramStatistics()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    XDP_RULE_STATISTICS Statistics[2];
+    UINT32 StatisticsSize;
+    CONST UINT32 FrameCount = 2;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    UCHAR UdpPayload[] = "GenericRxProgramStatistics";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    //
+    // Attach a shared program without statistics ahead of a shared program
+    // with statistics, so the counted rules are not at the start of the
+    // merged ruleset.
+    //
+    XDP_RULE OtherRule = {};
+    OtherRule.Match = XDP_MATCH_UDP_DST;
+    OtherRule.Pattern.Port = htons(ntohs(LocalPort) + 1);
+    OtherRule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    XDP_RULE Rules[2] = {};
+    Rules[0].Match = XDP_MATCH_UDP_DST;
+    Rules[0].Pattern.Port = htons(ntohs(LocalPort) + 2);
+    Rules[0].Action = XDP_PROGRAM_ACTION_DROP;
+    Rules[1].Match = XDP_MATCH_UDP_DST;
+    Rules[1].Pattern.Port = LocalPort;
+    Rules[1].Action = XDP_PROGRAM_ACTION_PASS;
+
+    wil::unique_handle OtherProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &OtherRule, 1,
+            XDP_CREATE_PROGRAM_FLAG_SHARE);
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+            RTL_NUMBER_OF(Rules),
+            XDP_CREATE_PROGRAM_FLAG_SHARE | XDP_CREATE_PROGRAM_FLAG_STATISTICS);
+
+    StatisticsSize = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED),
+        XdpProgramGetStatistics(OtherProgramHandle.get(), NULL, &StatisticsSize));
+
+    StatisticsSize = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_MORE_DATA),
+        XdpProgramGetStatistics(ProgramHandle.get(), NULL, &StatisticsSize));
+    TEST_EQUAL(sizeof(Statistics), StatisticsSize);
+
+    for (UINT32 i = 0; i < FrameCount; i++) {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        TEST_EQUAL(sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    }
+
+    TEST_HRESULT(XdpProgramGetStatistics(ProgramHandle.get(), Statistics, &StatisticsSize));
+    TEST_EQUAL(sizeof(Statistics), StatisticsSize);
+    TEST_EQUAL(0, Statistics[0].FramesMatched);
+    TEST_EQUAL(0, Statistics[0].BytesMatched);
+    TEST_EQUAL(FrameCount, Statistics[1].FramesMatched);
+    TEST_EQUAL((UINT64)FrameCount * UdpFrameLength, Statistics[1].BytesMatched);
+
+    //
+    // Verify the statistics persist when the other shared program detaches.
+    //
+    OtherProgramHandle.reset();
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    TEST_EQUAL(sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+
+    TEST_HRESULT(XdpProgramGetStatistics(ProgramHandle.get(), Statistics, &StatisticsSize));
+    TEST_EQUAL(FrameCount + 1, Statistics[1].FramesMatched);
+    TEST_EQUAL((UINT64)(FrameCount + 1) * UdpFrameLength, Statistics[1].BytesMatched);
+}
+
+VOID
+GenericRxUpdateRule(
+    _In_ BOOLEAN Shared
+    )
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    wil::unique_handle OtherProgramHandle;
+    UINT32 Flags = 0;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    UCHAR UdpPayload[] = "GenericRxUpdateRule";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    auto RxIndicate = [&] (BOOLEAN ExpectDrop) {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        if (ExpectDrop) {
+            TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+            TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+        } else {
+            TEST_EQUAL(
+                sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+        }
+    };
+
+    XDP_RULE OtherPortRule = {};
+    OtherPortRule.Match = XDP_MATCH_UDP_DST;
+    OtherPortRule.Pattern.Port = htons(ntohs(LocalPort) + 1);
+    OtherPortRule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    XDP_RULE DropRule = {};
+    DropRule.Match = XDP_MATCH_UDP_DST;
+    DropRule.Pattern.Port = LocalPort;
+    DropRule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    XDP_RULE PassRule = DropRule;
+    PassRule.Action = XDP_PROGRAM_ACTION_PASS;
+
+    if (Shared) {
+        //
+        // Attach another shared program first, so the updated rules are not at
+        // the start of the merged ruleset.
+        //
+        Flags = XDP_CREATE_PROGRAM_FLAG_SHARE;
+        OtherProgramHandle =
+            CreateXdpProg(
+                If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &OtherPortRule,
+                1, Flags);
+    }
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &OtherPortRule, 1,
+            Flags);
+    RxIndicate(FALSE);
+
+    //
+    // Append a rule dropping the frame.
+    //
+    TEST_HRESULT(
+        XdpProgramUpdateRule(ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_ADD, 1, &DropRule));
+    RxIndicate(TRUE);
+
+    //
+    // Insert a rule passing the frame ahead of the dropping rule.
+    //
+    TEST_HRESULT(
+        XdpProgramUpdateRule(ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_ADD, 0, &PassRule));
+    RxIndicate(FALSE);
+
+    //
+    // Remove the passing rule.
+    //
+    TEST_HRESULT(
+        XdpProgramUpdateRule(ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REMOVE, 0, NULL));
+    RxIndicate(TRUE);
+
+    //
+    // Replace the dropping rule with a rule matching another port.
+    //
+    TEST_HRESULT(
+        XdpProgramUpdateRule(
+            ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REPLACE, 1, &OtherPortRule));
+    RxIndicate(FALSE);
+
+    //
+    // Verify out-of-range rule indexes are rejected.
+    //
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        XdpProgramUpdateRule(ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REMOVE, 2, NULL));
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        XdpProgramUpdateRule(
+            ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_ADD, 3, &DropRule));
+
+    if (Shared) {
+        //
+        // Verify the updated ruleset is retained when the other shared program
+        // detaches.
+        //
+        TEST_HRESULT(
+            XdpProgramUpdateRule(
+                ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_ADD, 2, &DropRule));
+        OtherProgramHandle.reset();
+        RxIndicate(TRUE);
+    }
+}
+
+VOID
+GenericRxUpdateRuleSharedStatistics()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    XDP_RULE_STATISTICS Statistics[3];
+    UINT32 StatisticsSize;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    UCHAR UdpPayload[] = "GenericRxUpdateRuleSharedStatistics";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    auto RxIndicate = [&] (BOOLEAN ExpectDrop) {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        if (ExpectDrop) {
+            TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+            TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+        } else {
+            TEST_EQUAL(
+                sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+        }
+    };
+
+    XDP_RULE OtherPortRule = {};
+    OtherPortRule.Match = XDP_MATCH_UDP_DST;
+    OtherPortRule.Pattern.Port = htons(ntohs(LocalPort) + 1);
+    OtherPortRule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    XDP_RULE DropRule = {};
+    DropRule.Match = XDP_MATCH_UDP_DST;
+    DropRule.Pattern.Port = LocalPort;
+    DropRule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    XDP_RULE PassRule = DropRule;
+    PassRule.Action = XDP_PROGRAM_ACTION_PASS;
+
+    //
+    // Attach a shared program without statistics ahead of the updated shared
+    // program with statistics, so the data path counts through the statistics
+    // map of the metaprogram.
+    //
+    wil::unique_handle OtherProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &OtherPortRule, 1,
+            XDP_CREATE_PROGRAM_FLAG_SHARE);
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &OtherPortRule, 1,
+            XDP_CREATE_PROGRAM_FLAG_SHARE | XDP_CREATE_PROGRAM_FLAG_STATISTICS);
+
+    //
+    // Append a rule passing the frame, which grows the statistics map.
+    //
+    TEST_HRESULT(
+        XdpProgramUpdateRule(ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_ADD, 1, &PassRule));
+    RxIndicate(FALSE);
+
+    StatisticsSize = sizeof(Statistics);
+    TEST_HRESULT(XdpProgramGetStatistics(ProgramHandle.get(), Statistics, &StatisticsSize));
+    TEST_EQUAL(2 * sizeof(Statistics[0]), StatisticsSize);
+    TEST_EQUAL(0, Statistics[0].FramesMatched);
+    TEST_EQUAL(1, Statistics[1].FramesMatched);
+
+    //
+    // Insert another passing rule ahead of it. The statistics of the existing
+    // rule follow it to its new index.
+    //
+    TEST_HRESULT(
+        XdpProgramUpdateRule(ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_ADD, 0, &PassRule));
+    RxIndicate(FALSE);
+
+    StatisticsSize = sizeof(Statistics);
+    TEST_HRESULT(XdpProgramGetStatistics(ProgramHandle.get(), Statistics, &StatisticsSize));
+    TEST_EQUAL(3 * sizeof(Statistics[0]), StatisticsSize);
+    TEST_EQUAL(1, Statistics[0].FramesMatched);
+    TEST_EQUAL(0, Statistics[1].FramesMatched);
+    TEST_EQUAL(1, Statistics[2].FramesMatched);
+
+    //
+    // Remove the inserted rule; its statistics are freed and the data path
+    // counts the remaining passing rule again.
+    //
+    TEST_HRESULT(
+        XdpProgramUpdateRule(ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REMOVE, 0, NULL));
+    RxIndicate(FALSE);
+
+    StatisticsSize = sizeof(Statistics);
+    TEST_HRESULT(XdpProgramGetStatistics(ProgramHandle.get(), Statistics, &StatisticsSize));
+    TEST_EQUAL(2 * sizeof(Statistics[0]), StatisticsSize);
+    TEST_EQUAL(2, Statistics[1].FramesMatched);
+    TEST_EQUAL((UINT64)2 * UdpFrameLength, Statistics[1].BytesMatched);
+
+    //
+    // Replace the passing rule with a dropping rule, which starts with fresh
+    // statistics.
+    //
+    TEST_HRESULT(
+        XdpProgramUpdateRule(
+            ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REPLACE, 1, &DropRule));
+    RxIndicate(TRUE);
+
+    StatisticsSize = sizeof(Statistics);
+    TEST_HRESULT(XdpProgramGetStatistics(ProgramHandle.get(), Statistics, &StatisticsSize));
+    TEST_EQUAL(2 * sizeof(Statistics[0]), StatisticsSize);
+    TEST_EQUAL(1, Statistics[1].FramesMatched);
+    TEST_EQUAL((UINT64)UdpFrameLength, Statistics[1].BytesMatched);
+}
+
+VOID
+GenericRxRateLimit()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    wil::unique_handle ProgramHandle;
+    CONST UINT32 FrameBurst = 2;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    UCHAR UdpPayload[] = "GenericRxRateLimit";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_RATE_LIMIT;
+    Rule.RateLimit.FramesPerSecond = 1;
+    Rule.RateLimit.FrameBurst = FrameBurst;
+    Rule.RateLimit.ConformAction = XDP_PROGRAM_ACTION_PASS;
+    Rule.RateLimit.ExceedAction = XDP_PROGRAM_ACTION_DROP;
+
+    //
+    // Verify invalid rate limits are rejected.
+    //
+    XDP_RULE InvalidRule = Rule;
+    InvalidRule.RateLimit.FramesPerSecond = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+
+    InvalidRule = Rule;
+    InvalidRule.RateLimit.BytesPerSecond = XDP_RATE_LIMIT_MAX_BYTES + 1;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+
+    InvalidRule = Rule;
+    InvalidRule.RateLimit.ExceedAction = XDP_PROGRAM_ACTION_REDIRECT;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    //
+    // The bucket starts full, so a burst of frames conforms. The bucket refills
+    // at one frame per second, so the next frame indicated immediately exceeds
+    // the rate limit.
+    //
+    for (UINT32 i = 0; i < FrameBurst + 1; i++) {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        if (i < FrameBurst) {
+            TEST_EQUAL(
+                sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+        } else {
+            TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+            TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+        }
+    }
+}
+
+VOID
+GenericRxSample()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    CONST UINT32 NumFrames = 5;
+    CONST UINT32 Interval = 2;
+    CONST UINT32 NumSampledFrames = (NumFrames + Interval - 1) / Interval;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    UCHAR UdpPayload[] = "GenericRxSample";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_SAMPLE;
+    Rule.Sample.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
+    Rule.Sample.Redirect.Target = Xsk.Handle.get();
+    Rule.Sample.Interval = Interval;
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    for (UINT32 Index = 0; Index < NumFrames; Index++) {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    }
+
+    SocketProduceRxFill(&Xsk, NumFrames);
+    TEST_HRESULT(MpRxFlush(GenericMp));
+
+    //
+    // Verify copies of the first frame and every Interval-th frame thereafter
+    // propagated to XSK.
+    //
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, NumSampledFrames);
+    TEST_EQUAL(NumSampledFrames, XskRingConsumerReserve(&Xsk.Rings.Rx, MAXUINT32, &ConsumerIndex));
+
+    for (UINT32 Index = 0; Index < NumSampledFrames; Index++) {
+        auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex++);
+        TEST_EQUAL(UdpFrameLength, RxDesc->length);
+        TEST_TRUE(
+            RtlEqualMemory(
+                Xsk.Umem.Buffer.get() + XskDescriptorGetAddress(RxDesc->address) +
+                    XskDescriptorGetOffset(RxDesc->address),
+                UdpFrame,
+                UdpFrameLength));
+    }
+
+    //
+    // Verify all frames, sampled or not, propagated past XDP to the local stack.
+    //
+    for (UINT32 Index = 0; Index < NumFrames; Index++) {
+        TEST_EQUAL(
+            sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+        TEST_TRUE(RtlEqualMemory(UdpPayload, RecvPayload, sizeof(UdpPayload)));
+    }
+
+    TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+}
+
+VOID
+GenericRxL2Fwd()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    wil::unique_handle ProgramHandle;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    UCHAR UdpPayload[] = "GenericRxL2Fwd";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_L2FWD;
+
+    //
+    // Verify invalid flags are rejected.
+    //
+    Rule.L2Fwd.Flags = ~XDP_L2FWD_FLAG_SWAP_MAC_ADDRESSES;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1));
+
+    //
+    // Verify frames inspected on the TX path cannot be transmitted again.
+    //
+    XDP_HOOK_ID TxHook = XdpInspectRxL2;
+    TxHook.Direction = XDP_HOOK_TX;
+    Rule.L2Fwd.Flags = XDP_L2FWD_FLAG_SWAP_MAC_ADDRESSES;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &TxHook, If.GetQueueId(), XDP_GENERIC, &Rule, 1));
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    //
+    // The frame is expected on the TX path with its MAC addresses swapped.
+    //
+    UCHAR ExpectedFrame[sizeof(UdpFrame)];
+    ETHERNET_HEADER *ExpectedEthHdr = (ETHERNET_HEADER *)ExpectedFrame;
+    RtlCopyMemory(ExpectedFrame, UdpFrame, UdpFrameLength);
+    ExpectedEthHdr->Destination = RemoteHw;
+    ExpectedEthHdr->Source = LocalHw;
+
+    ETHERNET_HEADER Mask;
+    RtlFillMemory(&Mask, sizeof(Mask), 0xFF);
+    MpTxFilter(GenericMp, ExpectedEthHdr, &Mask, sizeof(Mask));
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+    TEST_EQUAL(1, MpTxFrame->BufferCount);
+
+    CONST DATA_BUFFER *MpTxBuffer = &MpTxFrame->Buffers[0];
+    TEST_EQUAL(UdpFrameLength, MpTxBuffer->BufferLength);
+    TEST_TRUE(
+        RtlEqualMemory(
+            ExpectedFrame, MpTxBuffer->VirtualAddress + MpTxBuffer->DataOffset,
+            UdpFrameLength));
+
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
+
+    //
+    // Verify the frame did not propagate to the local stack.
+    //
+    TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+}
+
+VOID
+GenericRxL2FwdVlanMtu()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    wil::unique_handle ProgramHandle;
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto MtuScopeGuard = wil::scope_exit([&]
+    {
+        MpSetMtu(GenericMp, FNMP_DEFAULT_MTU);
+        //
+        // Wait for the MTU changes to quiesce, which may involve a complete NDIS
+        // rebind for filters and protocols.
+        //
+        Sleep(TEST_TIMEOUT_ASYNC_MS);
+        WaitForWfpQuarantine(If);
+    });
+
+    //
+    // The TX action copies frames into buffers sized when the filter restarts,
+    // so use an MTU smaller than the largest copy.
+    //
+    const UINT32 TestMtu = FNMP_MIN_MTU;
+    MpSetMtu(GenericMp, TestMtu);
+    Sleep(TEST_TIMEOUT_ASYNC_MS);
+
+    LocalPort = htons(1234);
+    RemotePort = htons(4321);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    //
+    // Build an untagged frame of the full MTU, then insert an 802.1ad tag
+    // followed by an 802.1Q tag between the Ethernet header and its payload.
+    //
+    std::vector<UCHAR> UdpPayload(TestMtu - UDP_HEADER_BACKFILL(Af), 0x5A);
+    std::vector<UCHAR> UdpFrame(UDP_HEADER_STORAGE + UdpPayload.size());
+    UINT32 UdpFrameLength = (UINT32)UdpFrame.size();
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            &UdpFrame[0], &UdpFrameLength, &UdpPayload[0], (UINT16)UdpPayload.size(),
+            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    TEST_EQUAL(TestMtu, UdpFrameLength);
+
+    UINT32 TaggedFrameLength = UdpFrameLength + 2 * sizeof(VLAN_TAG);
+    std::vector<UCHAR> TaggedFrame(TaggedFrameLength);
+    CONST ETHERNET_HEADER *EthHdr = (CONST ETHERNET_HEADER *)&UdpFrame[0];
+    ETHERNET_HEADER *TaggedEthHdr = (ETHERNET_HEADER *)&TaggedFrame[0];
+    VLAN_TAG *Tags = (VLAN_TAG *)(TaggedEthHdr + 1);
+
+    RtlCopyMemory(TaggedEthHdr, EthHdr, sizeof(*EthHdr));
+    TaggedEthHdr->Type = htons(ETHERNET_TYPE_802_1AD);
+    Tags[0].Tag = htons(200);
+    Tags[0].Type = htons(ETHERNET_TYPE_802_1Q);
+    Tags[1].Tag = htons(300);
+    Tags[1].Type = EthHdr->Type;
+    RtlCopyMemory(&Tags[2], EthHdr + 1, UdpFrameLength - sizeof(*EthHdr));
+
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_L2FWD;
+    Rule.L2Fwd.Flags = XDP_L2FWD_FLAG_SWAP_MAC_ADDRESSES;
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    //
+    // The whole tagged frame is expected on the TX path with its MAC addresses
+    // swapped.
+    //
+    std::vector<UCHAR> ExpectedFrame = TaggedFrame;
+    ETHERNET_HEADER *ExpectedEthHdr = (ETHERNET_HEADER *)&ExpectedFrame[0];
+    ExpectedEthHdr->Destination = RemoteHw;
+    ExpectedEthHdr->Source = LocalHw;
+
+    ETHERNET_HEADER Mask;
+    RtlFillMemory(&Mask, sizeof(Mask), 0xFF);
+    MpTxFilter(GenericMp, ExpectedEthHdr, &Mask, sizeof(Mask));
+
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), &TaggedFrame[0], TaggedFrameLength);
+    TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+    auto MpTxFrame = MpTxAllocateAndGetFrame(GenericMp, 0);
+    TEST_EQUAL(1, MpTxFrame->BufferCount);
+
+    CONST DATA_BUFFER *MpTxBuffer = &MpTxFrame->Buffers[0];
+    TEST_EQUAL(TaggedFrameLength, MpTxBuffer->BufferLength);
+    TEST_TRUE(
+        RtlEqualMemory(
+            &ExpectedFrame[0], MpTxBuffer->VirtualAddress + MpTxBuffer->DataOffset,
+            TaggedFrameLength));
+
+    MpTxDequeueFrame(GenericMp, 0);
+    MpTxFlush(GenericMp);
+}
+
+VOID
+GenericRxFlowCache()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    XDP_FLOW_CACHE_STATISTICS Before;
+    XDP_FLOW_CACHE_STATISTICS After;
+    CONST UINT32 FrameCount = 8;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    UCHAR UdpPayload[] = "GenericRxFlowCache";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    XDP_RULE Rules[2] = {};
+    Rules[0].Match = XDP_MATCH_UDP_DST;
+    Rules[0].Pattern.Port = htons(ntohs(LocalPort) + 1);
+    Rules[0].Action = XDP_PROGRAM_ACTION_DROP;
+    Rules[1].Match = XDP_MATCH_UDP_DST;
+    Rules[1].Pattern.Port = LocalPort;
+    Rules[1].Action = XDP_PROGRAM_ACTION_PASS;
+
+    wil::unique_handle ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+            RTL_NUMBER_OF(Rules));
+
+    auto IndicateFrames = [&](BOOLEAN Pass) {
+        for (UINT32 i = 0; i < FrameCount; i++) {
+            RX_FRAME Frame;
+            RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+            if (Pass) {
+                TEST_EQUAL(
+                    sizeof(UdpPayload),
+                    recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+            } else {
+                TEST_EQUAL(
+                    SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+                TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+            }
+        }
+    };
+
+    //
+    // Every frame belongs to the same flow, so only the first frame walks the
+    // ruleset and the remaining frames reuse the cached rule.
+    //
+    TEST_HRESULT(XdpProgramGetFlowCacheStatistics(ProgramHandle.get(), &Before));
+    IndicateFrames(TRUE);
+    TEST_HRESULT(XdpProgramGetFlowCacheStatistics(ProgramHandle.get(), &After));
+    TEST_TRUE(After.Misses - Before.Misses >= 1);
+    TEST_TRUE(After.Hits - Before.Hits >= FrameCount - 1);
+
+    //
+    // Updating the ruleset invalidates the cached rule.
+    //
+    XDP_RULE DropRule = Rules[1];
+    DropRule.Action = XDP_PROGRAM_ACTION_DROP;
+    TEST_HRESULT(
+        XdpProgramUpdateRule(
+            ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REPLACE, 1, &DropRule));
+    IndicateFrames(FALSE);
+}
+
+VOID
+GenericRxQuicCidTable()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    wil::unique_handle ProgramHandle;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    auto Xsk = CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    const UCHAR QuicShortHdrUdpPayload[20] = {
+        0x00, // IsLongHeader
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, // DestCid
+        0x00 // The rest
+    };
+    const UCHAR QuicCid[] = {
+        0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
+    };
+    CHAR RecvPayload[sizeof(QuicShortHdrUdpPayload)];
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(QuicShortHdrUdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, QuicShortHdrUdpPayload, sizeof(QuicShortHdrUdpPayload),
+            &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_QUIC_FLOW_DST_CID_TABLE;
+    Rule.Pattern.QuicCidTable.UdpPort = LocalPort;
+    Rule.Pattern.QuicCidTable.CidOffset = 2; // Some arbitrary offset.
+    Rule.Pattern.QuicCidTable.CidLength = 4; // Some arbitrary length.
+    Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
+    Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_QUIC_CID_TABLE;
+
+    //
+    // Verify connection ID tables are only paired with their redirect target.
+    //
+    XDP_RULE InvalidRule = Rule;
+    InvalidRule.Action = XDP_PROGRAM_ACTION_DROP;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+
+    InvalidRule = Rule;
+    InvalidRule.Match = XDP_MATCH_UDP_DST;
+    InvalidRule.Pattern.Port = LocalPort;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+
+    ProgramHandle =
+        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    auto VerifyPass = [&]() {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        TEST_EQUAL(
+            sizeof(QuicShortHdrUdpPayload),
+            recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    };
+
+    //
+    // The table is initially empty, so the frame does not match.
+    //
+    VerifyPass();
+
+    CONST UCHAR *Cid = QuicCid + Rule.Pattern.QuicCidTable.CidOffset;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        XdpProgramUpdateQuicCid(
+            ProgramHandle.get(), XDP_QUIC_CID_OPERATION_SET, 0, Cid,
+            Rule.Pattern.QuicCidTable.CidLength - 1, Xsk.Handle.get()));
+    TEST_HRESULT(
+        XdpProgramUpdateQuicCid(
+            ProgramHandle.get(), XDP_QUIC_CID_OPERATION_SET, 0, Cid,
+            Rule.Pattern.QuicCidTable.CidLength, Xsk.Handle.get()));
+
+    //
+    // Verify the frame is redirected to the XSK of its table entry.
+    //
+    RX_FRAME Frame;
+    RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+    TEST_HRESULT(MpRxEnqueueFrame(GenericMp, &Frame));
+    SocketProduceRxFill(&Xsk, 1);
+    TEST_HRESULT(MpRxFlush(GenericMp));
+
+    UINT32 ConsumerIndex = SocketConsumerReserve(&Xsk.Rings.Rx, 1);
+    auto RxDesc = SocketGetAndFreeRxDesc(&Xsk, ConsumerIndex);
+    TEST_EQUAL(UdpFrameLength, RxDesc->length);
+    TEST_TRUE(
+        RtlEqualMemory(
+            Xsk.Umem.Buffer.get() + XskDescriptorGetAddress(RxDesc->address) +
+                XskDescriptorGetOffset(RxDesc->address),
+            UdpFrame,
+            UdpFrameLength));
+    TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+    TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+
+    //
+    // Verify removed entries no longer match.
+    //
+    TEST_HRESULT(
+        XdpProgramUpdateQuicCid(
+            ProgramHandle.get(), XDP_QUIC_CID_OPERATION_DELETE, 0, Cid,
+            Rule.Pattern.QuicCidTable.CidLength, NULL));
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+        XdpProgramUpdateQuicCid(
+            ProgramHandle.get(), XDP_QUIC_CID_OPERATION_DELETE, 0, Cid,
+            Rule.Pattern.QuicCidTable.CidLength, NULL));
+    VerifyPass();
+}
+
+VOID
+GenericRxMap()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    wil::unique_handle AddressMap;
+    wil::unique_handle PortMap;
+    wil::unique_handle InvalidMap;
+    wil::unique_handle ProgramHandle;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    UCHAR UdpPayload[] = "GenericRxMap";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        XdpMapCreate(XDP_MAP_TYPE_BITMAP, sizeof(UINT32), 1, MAXUINT16 + 1, &InvalidMap));
+    TEST_HRESULT(XdpMapCreate(XDP_MAP_TYPE_HASH, sizeof(IN_ADDR), 0, 16, &AddressMap));
+    TEST_HRESULT(XdpMapCreate(XDP_MAP_TYPE_BITMAP, sizeof(UINT32), 0, MAXUINT16 + 1, &PortMap));
+
+    XDP_RULE Rules[2] = {};
+    Rules[0].Match = XDP_MATCH_MAP;
+    Rules[0].Pattern.Map.Map = AddressMap.get();
+    Rules[0].Pattern.Map.KeyField = XDP_MAP_KEY_FIELD_IPV4_SOURCE;
+    Rules[0].Action = XDP_PROGRAM_ACTION_DROP;
+    Rules[1].Match = XDP_MATCH_MAP;
+    Rules[1].Pattern.Map.Map = PortMap.get();
+    Rules[1].Pattern.Map.KeyField = XDP_MAP_KEY_FIELD_UDP_DESTINATION;
+    Rules[1].Action = XDP_PROGRAM_ACTION_DROP;
+
+    //
+    // The key size of the map must match the key field.
+    //
+    XDP_RULE InvalidRule = Rules[0];
+    InvalidRule.Pattern.Map.KeyField = XDP_MAP_KEY_FIELD_IPV6_SOURCE;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+            RTL_NUMBER_OF(Rules));
+
+    auto VerifyFrame = [&](BOOLEAN Pass) {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        if (Pass) {
+            TEST_EQUAL(
+                sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+        } else {
+            TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+            TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+        }
+    };
+
+    //
+    // The maps are initially empty, so the frame does not match.
+    //
+    VerifyFrame(TRUE);
+
+    //
+    // Verify map updates take effect without updating the program.
+    //
+    TEST_HRESULT(
+        XdpMapUpdateElement(AddressMap.get(), &RemoteIp.Ipv4, sizeof(IN_ADDR), NULL, 0));
+    TEST_HRESULT(
+        XdpMapLookupElement(AddressMap.get(), &RemoteIp.Ipv4, sizeof(IN_ADDR), NULL, 0));
+    VerifyFrame(FALSE);
+
+    TEST_HRESULT(XdpMapDeleteElement(AddressMap.get(), &RemoteIp.Ipv4, sizeof(IN_ADDR)));
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_NOT_FOUND),
+        XdpMapDeleteElement(AddressMap.get(), &RemoteIp.Ipv4, sizeof(IN_ADDR)));
+    VerifyFrame(TRUE);
+
+    //
+    // Bitmap maps are indexed by the port represented in network order.
+    //
+    UINT32 PortIndex = LocalPort;
+    TEST_HRESULT(XdpMapUpdateElement(PortMap.get(), &PortIndex, sizeof(PortIndex), NULL, 0));
+    VerifyFrame(FALSE);
+
+    //
+    // The rules keep referencing the maps after their handles are closed.
+    //
+    AddressMap.reset();
+    PortMap.reset();
+    VerifyFrame(FALSE);
+}
+
+VOID
+GenericRxIpAddressSet(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    XDP_MATCH_TYPE Match;
+    wil::unique_handle ProgramHandle;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+        Match = XDP_MATCH_IPV4_ADDRESS_SET;
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+        Match = XDP_MATCH_IPV6_ADDRESS_SET;
+    }
+
+    UCHAR UdpPayload[] = "GenericRxIpAddressSet";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    //
+    // Build a set of addresses derived from the remote address, none of which
+    // is the local or the remote address.
+    //
+    UINT32 AddressLength = (Af == AF_INET) ? sizeof(IN_ADDR) : sizeof(IN6_ADDR);
+    std::vector<XDP_INET_ADDR> Addresses;
+    for (UINT32 Index = 1; Addresses.size() < 4096; Index++) {
+        XDP_INET_ADDR Address = {0};
+        RtlCopyMemory(&Address, &RemoteIp, AddressLength);
+        ((UCHAR *)&Address)[AddressLength - 2] ^= (UCHAR)(Index >> 8);
+        ((UCHAR *)&Address)[AddressLength - 1] ^= (UCHAR)Index;
+        if (!RtlEqualMemory(&Address, &LocalIp, AddressLength)) {
+            Addresses.push_back(Address);
+        }
+    }
+
+    XDP_RULE Rule = {};
+    Rule.Match = Match;
+    Rule.Pattern.IpAddressSet.Addresses = Addresses.data();
+    Rule.Pattern.IpAddressSet.AddressCount = (UINT32)Addresses.size();
+    Rule.Pattern.IpAddressSet.Flags =
+        XDP_IP_ADDRESS_SET_FLAG_SOURCE | XDP_IP_ADDRESS_SET_FLAG_BLOOM_FILTER;
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    XDP_RULE InvalidRule = Rule;
+    InvalidRule.Pattern.IpAddressSet.AddressCount = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    auto VerifyFrame = [&](BOOLEAN Pass) {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        if (Pass) {
+            TEST_EQUAL(
+                sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+        } else {
+            TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+            TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+        }
+    };
+
+    //
+    // The set does not contain the source address.
+    //
+    VerifyFrame(TRUE);
+
+    //
+    // The set is captured when the rule is created, so updating the array
+    // requires replacing the rule.
+    //
+    RtlCopyMemory(&Addresses[Addresses.size() / 2], &RemoteIp, AddressLength);
+    VerifyFrame(TRUE);
+    TEST_HRESULT(
+        XdpProgramUpdateRule(
+            ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REPLACE, 0, &Rule));
+    VerifyFrame(FALSE);
+
+    //
+    // Sets without a Bloom filter match the same addresses.
+    //
+    Rule.Pattern.IpAddressSet.Flags = XDP_IP_ADDRESS_SET_FLAG_SOURCE;
+    TEST_HRESULT(
+        XdpProgramUpdateRule(
+            ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REPLACE, 0, &Rule));
+    VerifyFrame(FALSE);
+
+    //
+    // Match the destination address instead.
+    //
+    Rule.Pattern.IpAddressSet.Flags = XDP_IP_ADDRESS_SET_FLAG_BLOOM_FILTER;
+    TEST_HRESULT(
+        XdpProgramUpdateRule(
+            ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REPLACE, 0, &Rule));
+    VerifyFrame(TRUE);
+
+    RtlCopyMemory(&Addresses[0], &LocalIp, AddressLength);
+    TEST_HRESULT(
+        XdpProgramUpdateRule(
+            ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REPLACE, 0, &Rule));
+    VerifyFrame(FALSE);
+}
+
+VOID
+GenericRxPayload()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    wil::unique_handle ProgramHandle;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    UCHAR UdpPayload[] = "GenericRxPayload";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    //
+    // Match "Payload" within the UDP payload.
+    //
+    CONST UINT16 MatchOffset = sizeof("GenericRx") - 1;
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_PAYLOAD;
+    Rule.Pattern.Payload.Layer = XDP_PAYLOAD_LAYER_L4_PAYLOAD;
+    Rule.Pattern.Payload.Offset = MatchOffset;
+    Rule.Pattern.Payload.Length = sizeof("Payload") - 1;
+    RtlCopyMemory(
+        Rule.Pattern.Payload.Value, &UdpPayload[MatchOffset], Rule.Pattern.Payload.Length);
+    RtlFillMemory(Rule.Pattern.Payload.Mask, Rule.Pattern.Payload.Length, 0xFF);
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    XDP_RULE InvalidRule = Rule;
+    InvalidRule.Pattern.Payload.Length = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+    InvalidRule.Pattern.Payload.Length = XDP_PAYLOAD_MATCH_MAX_LENGTH + 1;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    //
+    // Indicate the frame contiguously and split into two buffers at every
+    // offset.
+    //
+    auto VerifyFrame = [&](BOOLEAN Pass) {
+        for (UINT32 SplitOffset = 0; SplitOffset < UdpFrameLength; SplitOffset++) {
+            RX_FRAME Frame;
+            DATA_BUFFER Buffers[2] = {};
+
+            if (SplitOffset == 0) {
+                RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+            } else {
+                Buffers[0].DataLength = SplitOffset;
+                Buffers[0].BufferLength = Buffers[0].DataLength;
+                Buffers[0].VirtualAddress = &UdpFrame[0];
+                Buffers[1].DataLength = UdpFrameLength - SplitOffset;
+                Buffers[1].BufferLength = Buffers[1].DataLength;
+                Buffers[1].VirtualAddress = &UdpFrame[SplitOffset];
+                RxInitializeFrame(&Frame, If.GetQueueId(), Buffers, RTL_NUMBER_OF(Buffers));
+            }
+            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+            if (Pass) {
+                TEST_EQUAL(
+                    sizeof(UdpPayload),
+                    recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+            } else {
+                TEST_EQUAL(
+                    SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+                TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+            }
+        }
+    };
+
+    VerifyFrame(FALSE);
+
+    //
+    // Bits outside the mask are ignored.
+    //
+    Rule.Pattern.Payload.Value[0] ^= 0x20;
+    TEST_HRESULT(
+        XdpProgramUpdateRule(
+            ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REPLACE, 0, &Rule));
+    VerifyFrame(TRUE);
+
+    Rule.Pattern.Payload.Mask[0] = (UCHAR)~0x20;
+    TEST_HRESULT(
+        XdpProgramUpdateRule(
+            ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REPLACE, 0, &Rule));
+    VerifyFrame(FALSE);
+
+    //
+    // Frames ending before the matched bytes do not match.
+    //
+    Rule.Pattern.Payload.Offset = sizeof(UdpPayload);
+    TEST_HRESULT(
+        XdpProgramUpdateRule(
+            ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REPLACE, 0, &Rule));
+    VerifyFrame(TRUE);
+
+    //
+    // Match the IPv4 protocol at an offset from the network layer.
+    //
+    Rule.Pattern.Payload.Layer = XDP_PAYLOAD_LAYER_L3;
+    Rule.Pattern.Payload.Offset = FIELD_OFFSET(IPV4_HEADER, Protocol);
+    Rule.Pattern.Payload.Length = 1;
+    Rule.Pattern.Payload.Value[0] = IPPROTO_UDP;
+    Rule.Pattern.Payload.Mask[0] = 0xFF;
+    TEST_HRESULT(
+        XdpProgramUpdateRule(
+            ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REPLACE, 0, &Rule));
+    VerifyFrame(FALSE);
+}
+
+VOID
+GenericRxBytecode()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    wil::unique_handle ProgramHandle;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    UCHAR UdpPayload[] = "GenericRxBytecode";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    //
+    // Match UDP frames destined to the local port. Loaded values are in host
+    // byte order.
+    //
+    XDP_BYTECODE_INSTRUCTION Instructions[] = {
+        { XDP_BYTECODE_OP_LOAD_8, XDP_PAYLOAD_LAYER_L3, 0, 0,
+            FIELD_OFFSET(IPV4_HEADER, Protocol) },
+        { XDP_BYTECODE_OP_JUMP_EQUAL, 0, 0, 3, IPPROTO_UDP },
+        { XDP_BYTECODE_OP_LOAD_16, XDP_PAYLOAD_LAYER_L4, 0, 0,
+            FIELD_OFFSET(UDP_HDR, uh_dport) },
+        { XDP_BYTECODE_OP_JUMP_EQUAL, 0, 0, 1, ntohs(LocalPort) },
+        { XDP_BYTECODE_OP_RETURN, 0, 0, 0, TRUE },
+        { XDP_BYTECODE_OP_RETURN, 0, 0, 0, FALSE },
+    };
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_BYTECODE;
+    Rule.Pattern.Bytecode.Instructions = Instructions;
+    Rule.Pattern.Bytecode.InstructionCount = RTL_NUMBER_OF(Instructions);
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    //
+    // Programs must end with a return and jump only within the program.
+    //
+    XDP_RULE InvalidRule = Rule;
+    InvalidRule.Pattern.Bytecode.InstructionCount = RTL_NUMBER_OF(Instructions) - 2;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+    InvalidRule.Pattern.Bytecode.InstructionCount = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+    Instructions[1].JumpFalse = 4;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1));
+    Instructions[1].JumpFalse = 3;
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    auto VerifyFrame = [&](BOOLEAN Pass) {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        if (Pass) {
+            TEST_EQUAL(
+                sizeof(UdpPayload),
+                recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+        } else {
+            TEST_EQUAL(
+                SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+            TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+        }
+    };
+
+    VerifyFrame(FALSE);
+
+    //
+    // The program is captured when the rule is created or updated.
+    //
+    Instructions[3].Immediate = ntohs(LocalPort) + 1;
+    VerifyFrame(FALSE);
+    TEST_HRESULT(
+        XdpProgramUpdateRule(
+            ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REPLACE, 0, &Rule));
+    VerifyFrame(TRUE);
+}
+
+VOID
+GenericRxAdaptiveOrder()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    wil::unique_handle ProgramHandle;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
 
+    RemotePort = htons(1234);
     If.GetHwAddress(&LocalHw);
     If.GetRemoteHwAddress(&RemoteHw);
     If.GetIpv4Address(&LocalIp.Ipv4);
     If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
 
-    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
-        Sockets[Index].Xsk =
-            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
-        Sockets[Index].LocalPort = htons(1000 + Index);
-        Sockets[Index].UdpFrameLength = sizeof(Sockets[Index].UdpFrame);
+    UCHAR PassPayload[] = "GenericRxAdaptiveOrder";
+    UCHAR DropPayload[sizeof(PassPayload)];
+    CHAR RecvPayload[sizeof(PassPayload)] = {0};
+    UCHAR PassFrame[UDP_HEADER_STORAGE + sizeof(PassPayload)];
+    UINT32 PassFrameLength = sizeof(PassFrame);
+    UCHAR DropFrame[UDP_HEADER_STORAGE + sizeof(DropPayload)];
+    UINT32 DropFrameLength = sizeof(DropFrame);
+
+    RtlCopyMemory(DropPayload, PassPayload, sizeof(DropPayload));
+    DropPayload[1] = 'x';
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            PassFrame, &PassFrameLength, PassPayload, sizeof(PassPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            DropFrame, &DropFrameLength, DropPayload, sizeof(DropPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    //
+    // Match the first payload byte against disjoint values; only the last rule
+    // matches the frames. An earlier rule matching the second byte overlaps
+    // the last rule, and must still take precedence after the rules are
+    // reordered.
+    //
+    XDP_RULE Rules[32] = {};
+    CONST UINT32 OverlapIndex = 10;
+    for (UINT32 i = 0; i < RTL_NUMBER_OF(Rules); i++) {
+        Rules[i].Match = XDP_MATCH_PAYLOAD;
+        Rules[i].Pattern.Payload.Layer = XDP_PAYLOAD_LAYER_L4_PAYLOAD;
+        Rules[i].Pattern.Payload.Length = 1;
+        Rules[i].Pattern.Payload.Value[0] = (UCHAR)(PassPayload[0] + 1 + i);
+        Rules[i].Pattern.Payload.Mask[0] = 0xFF;
+        Rules[i].Action = XDP_PROGRAM_ACTION_PASS;
+    }
+    Rules[OverlapIndex].Pattern.Payload.Offset = 1;
+    Rules[OverlapIndex].Pattern.Payload.Value[0] = PassPayload[1];
+    Rules[RTL_NUMBER_OF(Rules) - 1].Pattern.Payload.Value[0] = PassPayload[0];
+    Rules[RTL_NUMBER_OF(Rules) - 1].Action = XDP_PROGRAM_ACTION_DROP;
+
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            Rules, RTL_NUMBER_OF(Rules),
+            XDP_CREATE_PROGRAM_FLAG_SHARE | XDP_CREATE_PROGRAM_FLAG_ADAPTIVE_ORDER));
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+            RTL_NUMBER_OF(Rules), XDP_CREATE_PROGRAM_FLAG_ADAPTIVE_ORDER);
+
+    auto VerifyFrames = [&]() {
+        RX_FRAME Frame;
+
+        RxInitializeFrame(&Frame, If.GetQueueId(), PassFrame, PassFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        TEST_EQUAL(
+            sizeof(PassPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+
+        RxInitializeFrame(&Frame, If.GetQueueId(), DropFrame, DropFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+        TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+    };
+
+    VerifyFrames();
+
+    //
+    // Make the last rule the most frequently matched, and give the program time
+    // to reorder its rules, which it attempts once per second.
+    //
+    for (UINT32 i = 0; i < 4096; i++) {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), DropFrame, DropFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    }
+
+    Sleep(3000);
+
+    VerifyFrames();
+
+    //
+    // Reordered programs can still be updated.
+    //
+    Rules[0].Action = XDP_PROGRAM_ACTION_DROP;
+    TEST_HRESULT(
+        XdpProgramUpdateRule(
+            ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REPLACE, 0, &Rules[0]));
+    VerifyFrames();
+}
+
+VOID
+GenericRxAdaptiveOrderFlowCache()
+{
+    auto If = FnMpIf;
+    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    unique_malloc_ptr<UINT8> PortSet;
+    unique_malloc_ptr<UINT8> OtherPortSet;
+    wil::unique_handle ProgramHandle;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv4Address(&LocalIp.Ipv4);
+    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+
+    UCHAR UdpPayload[] = "GenericRxAdaptiveOrderFlowCache";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    PortSet.reset((UINT8 *)calloc(XDP_PORT_SET_BUFFER_SIZE, 1));
+    TEST_NOT_NULL(PortSet.get());
+    SetBit(PortSet.get(), LocalPort);
+    OtherPortSet.reset((UINT8 *)calloc(XDP_PORT_SET_BUFFER_SIZE, 1));
+    TEST_NOT_NULL(OtherPortSet.get());
+    SetBit(OtherPortSet.get(), RemotePort);
+
+    //
+    // Match the destination address against disjoint values with rules the
+    // flow cache can answer; only the last rule matches the frames. An earlier
+    // rule with the same address overlaps the last rule, and must still take
+    // precedence after the rules are reordered.
+    //
+    XDP_RULE Rules[32] = {};
+    CONST UINT32 OverlapIndex = 10;
+    for (UINT32 i = 0; i < RTL_NUMBER_OF(Rules); i++) {
+        Rules[i].Match = XDP_MATCH_IPV4_UDP_PORT_SET;
+        Rules[i].Pattern.IpPortSet.Address.Ipv4 = LocalIp.Ipv4;
+        ((UCHAR *)&Rules[i].Pattern.IpPortSet.Address.Ipv4)[3] ^= (UCHAR)(1 + i);
+        Rules[i].Pattern.IpPortSet.PortSet.PortSet = PortSet.get();
+        Rules[i].Action = XDP_PROGRAM_ACTION_PASS;
+    }
+    Rules[OverlapIndex].Pattern.IpPortSet.Address.Ipv4 = LocalIp.Ipv4;
+    Rules[OverlapIndex].Pattern.IpPortSet.PortSet.PortSet = OtherPortSet.get();
+    Rules[RTL_NUMBER_OF(Rules) - 1].Pattern.IpPortSet.Address.Ipv4 = LocalIp.Ipv4;
+    Rules[RTL_NUMBER_OF(Rules) - 1].Action = XDP_PROGRAM_ACTION_DROP;
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+            RTL_NUMBER_OF(Rules), XDP_CREATE_PROGRAM_FLAG_ADAPTIVE_ORDER);
+
+    auto VerifyFrame = [&](BOOLEAN Pass) {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        if (Pass) {
+            TEST_EQUAL(
+                sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+        } else {
+            TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+            TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+        }
+    };
+
+    VerifyFrame(FALSE);
+
+    //
+    // Every frame of the flow after the first is answered by the flow cache,
+    // and must still count towards the hits of the last rule so the program
+    // moves it forward.
+    //
+    for (UINT32 i = 0; i < 4096; i++) {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    }
+
+    Sleep(3000);
+
+    VerifyFrame(FALSE);
+
+    //
+    // Reordered programs can still be updated, which invalidates the flow
+    // cache.
+    //
+    Rules[RTL_NUMBER_OF(Rules) - 1].Action = XDP_PROGRAM_ACTION_PASS;
+    TEST_HRESULT(
+        XdpProgramUpdateRule(
+            ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REPLACE, RTL_NUMBER_OF(Rules) - 1,
+            &Rules[RTL_NUMBER_OF(Rules) - 1]));
+    VerifyFrame(TRUE);
+}
+
+VOID
+GenericRxVlan(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    XDP_RULE_STATISTICS Statistics[3];
+    UINT32 StatisticsSize = sizeof(Statistics);
+    UINT64 SingleTagCount;
+    UINT64 DoubleTagCount;
+    wil::unique_handle ProgramHandle;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    UCHAR UdpPayload[] = "GenericRxVlan";
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
+
+    //
+    // Insert a single 802.1Q tag, or an 802.1ad tag followed by an 802.1Q tag,
+    // between the Ethernet header and its payload. The EtherType of each header
+    // is moved to the tag that follows it.
+    //
+    UCHAR SingleTagFrame[sizeof(UdpFrame) + sizeof(VLAN_TAG)];
+    UCHAR DoubleTagFrame[sizeof(UdpFrame) + 2 * sizeof(VLAN_TAG)];
+    CONST ETHERNET_HEADER *EthHdr = (CONST ETHERNET_HEADER *)UdpFrame;
+    ETHERNET_HEADER *TaggedEthHdr;
+    VLAN_TAG *Tags;
+
+    TaggedEthHdr = (ETHERNET_HEADER *)SingleTagFrame;
+    Tags = (VLAN_TAG *)(TaggedEthHdr + 1);
+    RtlCopyMemory(TaggedEthHdr, EthHdr, sizeof(*EthHdr));
+    TaggedEthHdr->Type = htons(ETHERNET_TYPE_802_1Q);
+    Tags[0].Tag = htons(100);
+    Tags[0].Type = EthHdr->Type;
+    RtlCopyMemory(&Tags[1], EthHdr + 1, UdpFrameLength - sizeof(*EthHdr));
+
+    TaggedEthHdr = (ETHERNET_HEADER *)DoubleTagFrame;
+    Tags = (VLAN_TAG *)(TaggedEthHdr + 1);
+    RtlCopyMemory(TaggedEthHdr, EthHdr, sizeof(*EthHdr));
+    TaggedEthHdr->Type = htons(ETHERNET_TYPE_802_1AD);
+    Tags[0].Tag = htons(200);
+    Tags[0].Type = htons(ETHERNET_TYPE_802_1Q);
+    Tags[1].Tag = htons(300);
+    Tags[1].Type = EthHdr->Type;
+    RtlCopyMemory(&Tags[2], EthHdr + 1, UdpFrameLength - sizeof(*EthHdr));
+
+    XDP_RULE Rules[3] = {};
+    Rules[0].Match = XDP_MATCH_VLAN_ID;
+    Rules[0].Pattern.Vlan.VlanId = 200;
+    Rules[0].Pattern.Vlan.InnerVlanId = 301;
+    Rules[0].Pattern.Vlan.Flags = XDP_VLAN_MATCH_FLAG_INNER;
+    Rules[0].Action = XDP_PROGRAM_ACTION_DROP;
+    Rules[1] = Rules[0];
+    Rules[1].Pattern.Vlan.InnerVlanId = 300;
+    Rules[2].Match = XDP_MATCH_UDP_DST;
+    Rules[2].Pattern.Port = LocalPort;
+    Rules[2].Action = XDP_PROGRAM_ACTION_DROP;
+
+    XDP_RULE InvalidRule = Rules[0];
+    InvalidRule.Pattern.Vlan.VlanId = XDP_VLAN_ID_MAX + 1;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+    InvalidRule = Rules[0];
+    InvalidRule.Pattern.Vlan.Flags = 0;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+    InvalidRule = Rules[0];
+    InvalidRule.Pattern.Vlan.Flags = ~0u;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+            RTL_NUMBER_OF(Rules), XDP_CREATE_PROGRAM_FLAG_STATISTICS);
+
+    //
+    // Indicate each tagged frame contiguously and split into two buffers at
+    // every offset, so the tags are also parsed across buffers.
+    //
+    auto IndicateFrame = [&](UCHAR *FrameData, UINT32 FrameLength) {
+        UINT64 FrameCount = 0;
+
+        for (UINT32 SplitOffset = 0; SplitOffset < FrameLength; SplitOffset++) {
+            RX_FRAME Frame;
+            DATA_BUFFER Buffers[2] = {};
+
+            if (SplitOffset == 0) {
+                RxInitializeFrame(&Frame, If.GetQueueId(), FrameData, FrameLength);
+            } else {
+                Buffers[0].DataLength = SplitOffset;
+                Buffers[0].BufferLength = Buffers[0].DataLength;
+                Buffers[0].VirtualAddress = &FrameData[0];
+                Buffers[1].DataLength = FrameLength - SplitOffset;
+                Buffers[1].BufferLength = Buffers[1].DataLength;
+                Buffers[1].VirtualAddress = &FrameData[SplitOffset];
+                RxInitializeFrame(&Frame, If.GetQueueId(), Buffers, RTL_NUMBER_OF(Buffers));
+            }
+            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+            FrameCount++;
+        }
+
+        return FrameCount;
+    };
+
+    //
+    // The single-tagged frame is parsed through its tag to the UDP header, and
+    // the double-tagged frame matches the rule with both of its VLAN IDs.
+    //
+    SingleTagCount = IndicateFrame(SingleTagFrame, UdpFrameLength + sizeof(VLAN_TAG));
+    DoubleTagCount = IndicateFrame(DoubleTagFrame, UdpFrameLength + 2 * sizeof(VLAN_TAG));
+
+    TEST_HRESULT(XdpProgramGetStatistics(ProgramHandle.get(), Statistics, &StatisticsSize));
+    TEST_EQUAL(sizeof(Statistics), StatisticsSize);
+    TEST_EQUAL(0, Statistics[0].FramesMatched);
+    TEST_EQUAL(DoubleTagCount, Statistics[1].FramesMatched);
+    TEST_EQUAL(SingleTagCount, Statistics[2].FramesMatched);
+}
+
+VOID
+GenericRxTunnel(
+    _In_ ADDRESS_FAMILY Af
+    )
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    XDP_RULE_STATISTICS Statistics[3];
+    UINT32 StatisticsSize = sizeof(Statistics);
+    CONST UINT16 VxlanPort = htons(4789);
+    CONST UINT16 GenevePort = htons(6081);
+    wil::unique_handle ProgramHandle;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
+
+    //
+    // Encapsulate an inner UDP frame between the same hosts in a VXLAN header,
+    // or in a GENEVE header with one empty option.
+    //
+    CONST UCHAR VxlanHdr[] = {
+        0x08, 0x00, 0x00, 0x00, // Flags: VNI present
+        0x00, 0x00, 200, 0x00,  // VNI 200
+    };
+    CONST UCHAR GeneveHdr[] = {
+        0x01, 0x00, 0x65, 0x58, // Option length 1, protocol type Ethernet
+        0x00, 0x01, 0x2C, 0x00, // VNI 300
+        0x00, 0x00, 0x00, 0x00, // Empty option
+    };
+    UCHAR InnerPayload[] = "GenericRxTunnel";
+    UCHAR EncapPayload[sizeof(GeneveHdr) + UDP_HEADER_STORAGE + sizeof(InnerPayload)];
+    UCHAR VxlanFrame[UDP_HEADER_STORAGE + sizeof(EncapPayload)];
+    UCHAR OtherVxlanFrame[UDP_HEADER_STORAGE + sizeof(EncapPayload)];
+    UCHAR GeneveFrame[UDP_HEADER_STORAGE + sizeof(EncapPayload)];
+    UINT32 VxlanFrameLength = sizeof(VxlanFrame);
+    UINT32 OtherVxlanFrameLength = sizeof(OtherVxlanFrame);
+    UINT32 GeneveFrameLength = sizeof(GeneveFrame);
+
+    auto BuildTunnelFrame = [&](
+            UCHAR *Frame, UINT32 *FrameLength, UINT16 TunnelPort, CONST UCHAR *TunnelHdr,
+            UINT32 TunnelHdrLength, UINT16 InnerRemotePort) {
+        UINT32 InnerFrameLength = sizeof(EncapPayload) - TunnelHdrLength;
+
+        RtlCopyMemory(EncapPayload, TunnelHdr, TunnelHdrLength);
         TEST_TRUE(
             PktBuildUdpFrame(
-                Sockets[Index].UdpFrame, &Sockets[Index].UdpFrameLength, UdpMatchPayload,
-                sizeof(UdpMatchPayload), &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp,
-                Sockets[Index].LocalPort, htons(2000)));
+                &EncapPayload[TunnelHdrLength], &InnerFrameLength, InnerPayload,
+                sizeof(InnerPayload), &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp,
+                LocalPort, InnerRemotePort));
+        TEST_TRUE(
+            PktBuildUdpFrame(
+                Frame, FrameLength, EncapPayload, (UINT16)(TunnelHdrLength + InnerFrameLength),
+                &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp, TunnelPort, RemotePort));
+    };
+
+    BuildTunnelFrame(
+        VxlanFrame, &VxlanFrameLength, VxlanPort, VxlanHdr, sizeof(VxlanHdr), RemotePort);
+    BuildTunnelFrame(
+        OtherVxlanFrame, &OtherVxlanFrameLength, VxlanPort, VxlanHdr, sizeof(VxlanHdr),
+        htons(ntohs(RemotePort) + 1));
+    BuildTunnelFrame(
+        GeneveFrame, &GeneveFrameLength, GenevePort, GeneveHdr, sizeof(GeneveHdr), RemotePort);
+
+    XDP_RULE Rules[3] = {};
+    Rules[0].Match = (Af == AF_INET) ? XDP_MATCH_TUNNEL_IPV4_TUPLE : XDP_MATCH_TUNNEL_IPV6_TUPLE;
+    Rules[0].Pattern.TunnelTuple.Tunnel.UdpPort = VxlanPort;
+    Rules[0].Pattern.TunnelTuple.Tunnel.Type = XDP_TUNNEL_TYPE_VXLAN;
+    Rules[0].Pattern.TunnelTuple.Tunnel.Vni = 200;
+    memcpy(&Rules[0].Pattern.TunnelTuple.Tuple.SourceAddress, &RemoteIp, sizeof(INET_ADDR));
+    memcpy(&Rules[0].Pattern.TunnelTuple.Tuple.DestinationAddress, &LocalIp, sizeof(INET_ADDR));
+    Rules[0].Pattern.TunnelTuple.Tuple.SourcePort = RemotePort;
+    Rules[0].Pattern.TunnelTuple.Tuple.DestinationPort = LocalPort;
+    Rules[0].Pattern.TunnelTuple.Protocol = IPPROTO_UDP;
+    Rules[0].Action = XDP_PROGRAM_ACTION_DROP;
+    Rules[1].Match = XDP_MATCH_TUNNEL_VNI;
+    Rules[1].Pattern.Tunnel = Rules[0].Pattern.TunnelTuple.Tunnel;
+    Rules[1].Action = XDP_PROGRAM_ACTION_DROP;
+    Rules[2].Match = XDP_MATCH_TUNNEL_VNI;
+    Rules[2].Pattern.Tunnel.UdpPort = GenevePort;
+    Rules[2].Pattern.Tunnel.Type = XDP_TUNNEL_TYPE_GENEVE;
+    Rules[2].Pattern.Tunnel.Vni = 300;
+    Rules[2].Action = XDP_PROGRAM_ACTION_DROP;
+
+    XDP_RULE InvalidRule = Rules[1];
+    InvalidRule.Pattern.Tunnel.Vni = XDP_TUNNEL_VNI_MAX + 1;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+    InvalidRule = Rules[1];
+    InvalidRule.Pattern.Tunnel.Type = XDP_TUNNEL_TYPE_GENEVE + 1;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+    InvalidRule = Rules[0];
+    InvalidRule.Pattern.TunnelTuple.Protocol = IPPROTO_ICMP;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, Rules,
+            RTL_NUMBER_OF(Rules), XDP_CREATE_PROGRAM_FLAG_STATISTICS);
+
+    //
+    // Indicate each frame contiguously and split into two buffers at every
+    // offset, so the inner headers are also read across buffers.
+    //
+    auto IndicateFrame = [&](UCHAR *FrameData, UINT32 FrameLength) {
+        UINT64 FrameCount = 0;
+
+        for (UINT32 SplitOffset = 0; SplitOffset < FrameLength; SplitOffset++) {
+            RX_FRAME Frame;
+            DATA_BUFFER Buffers[2] = {};
+
+            if (SplitOffset == 0) {
+                RxInitializeFrame(&Frame, If.GetQueueId(), FrameData, FrameLength);
+            } else {
+                Buffers[0].DataLength = SplitOffset;
+                Buffers[0].BufferLength = Buffers[0].DataLength;
+                Buffers[0].VirtualAddress = &FrameData[0];
+                Buffers[1].DataLength = FrameLength - SplitOffset;
+                Buffers[1].BufferLength = Buffers[1].DataLength;
+                Buffers[1].VirtualAddress = &FrameData[SplitOffset];
+                RxInitializeFrame(&Frame, If.GetQueueId(), Buffers, RTL_NUMBER_OF(Buffers));
+            }
+            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+            FrameCount++;
+        }
+
+        return FrameCount;
+    };
+
+    //
+    // The VXLAN frame matches the inner 5-tuple, the VXLAN frame from another
+    // inner port matches only the VNI, and the GENEVE frame matches its VNI
+    // after the option.
+    //
+    UINT64 TupleCount = IndicateFrame(VxlanFrame, VxlanFrameLength);
+    UINT64 VxlanCount = IndicateFrame(OtherVxlanFrame, OtherVxlanFrameLength);
+    UINT64 GeneveCount = IndicateFrame(GeneveFrame, GeneveFrameLength);
+
+    TEST_HRESULT(XdpProgramGetStatistics(ProgramHandle.get(), Statistics, &StatisticsSize));
+    TEST_EQUAL(sizeof(Statistics), StatisticsSize);
+    TEST_EQUAL(TupleCount, Statistics[0].FramesMatched);
+    TEST_EQUAL(VxlanCount, Statistics[1].FramesMatched);
+    TEST_EQUAL(GeneveCount, Statistics[2].FramesMatched);
+}
+
+VOID
+GenericRxIpv6ExtensionHeaders()
+{
+    auto If = FnMpIf;
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    XDP_RULE_STATISTICS Statistics[1];
+    UINT32 StatisticsSize = sizeof(Statistics);
+    UINT64 FirstFragmentCount;
+    wil::unique_handle ProgramHandle;
+
+    auto UdpSocket = CreateUdpSocket(AF_INET6, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    If.GetIpv6Address(&LocalIp.Ipv6);
+    If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+
+    UCHAR UdpPayload[] = "GenericRxIpv6ExtensionHeaders";
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, AF_INET6, &LocalIp, &RemoteIp, LocalPort, RemotePort));
 
-        Rules[Index].Match = XDP_MATCH_UDP_DST;
-        Rules[Index].Pattern.Port = Sockets[Index].LocalPort;
-        Rules[Index].Action = XDP_PROGRAM_ACTION_REDIRECT;
-        Rules[Index].Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
-        Rules[Index].Redirect.Target = Sockets[Index].Xsk.Handle.get();
-    }
+    //
+    // Insert a hop-by-hop options header, an SRv6 routing header with a single
+    // segment, a fragment header and a destination options header between the
+    // IPv6 header and the UDP header.
+    //
+    UCHAR ExtHdrs[] = {
+        IPPROTO_ROUTING, 0, 1, 4, 0, 0, 0, 0,
+        IPPROTO_FRAGMENT, 2, 4, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,
+        IPPROTO_DSTOPTS, 0, 0, 1, 0, 0, 0, 1,
+        IPPROTO_UDP, 0, 1, 4, 0, 0, 0, 0,
+    };
+    CONST UINT32 FragmentHeaderOffset = 32;
+    CONST UINT32 L3Offset = sizeof(ETHERNET_HEADER);
+    CONST UINT32 L4Offset = L3Offset + sizeof(IPV6_HEADER);
+    UCHAR ExtFrame[sizeof(UdpFrame) + sizeof(ExtHdrs)];
+    UINT32 ExtFrameLength = UdpFrameLength + sizeof(ExtHdrs);
+    IPV6_HEADER *Ip6Hdr;
 
-    wil::unique_handle ProgramHandle =
+    RtlCopyMemory(ExtFrame, UdpFrame, L4Offset);
+    RtlCopyMemory(&ExtFrame[L4Offset], ExtHdrs, sizeof(ExtHdrs));
+    RtlCopyMemory(
+        &ExtFrame[L4Offset + sizeof(ExtHdrs)], &UdpFrame[L4Offset], UdpFrameLength - L4Offset);
+    Ip6Hdr = (IPV6_HEADER *)&ExtFrame[L3Offset];
+    Ip6Hdr->NextHeader = IPPROTO_HOPOPTS;
+    Ip6Hdr->PayloadLength = htons(ntohs(Ip6Hdr->PayloadLength) + sizeof(ExtHdrs));
+
+    //
+    // Fragments other than the first do not carry the UDP header.
+    //
+    UCHAR LaterFragmentFrame[sizeof(ExtFrame)];
+    RtlCopyMemory(LaterFragmentFrame, ExtFrame, ExtFrameLength);
+    LaterFragmentFrame[L4Offset + FragmentHeaderOffset + 2] = 0x01;
+
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    ProgramHandle =
         CreateXdpProg(
-            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
-            Rules, RTL_NUMBER_OF(Rules));
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1,
+            XDP_CREATE_PROGRAM_FLAG_STATISTICS);
 
-    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+    //
+    // Indicate each frame contiguously and split into two buffers at every
+    // offset, so the extension headers are also walked across buffers.
+    //
+    auto IndicateFrame = [&](UCHAR *FrameData, UINT32 FrameLength) {
+        UINT64 FrameCount = 0;
 
-    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
-        auto &Socket = Sockets[Index].Xsk;
-        DATA_BUFFER Buffer = {0};
+        for (UINT32 SplitOffset = 0; SplitOffset < FrameLength; SplitOffset++) {
+            RX_FRAME Frame;
+            DATA_BUFFER Buffers[2] = {};
 
-        SocketProduceRxFill(&Socket, 1);
+            if (SplitOffset == 0) {
+                RxInitializeFrame(&Frame, If.GetQueueId(), FrameData, FrameLength);
+            } else {
+                Buffers[0].DataLength = SplitOffset;
+                Buffers[0].BufferLength = Buffers[0].DataLength;
+                Buffers[0].VirtualAddress = &FrameData[0];
+                Buffers[1].DataLength = FrameLength - SplitOffset;
+                Buffers[1].BufferLength = Buffers[1].DataLength;
+                Buffers[1].VirtualAddress = &FrameData[SplitOffset];
+                RxInitializeFrame(&Frame, If.GetQueueId(), Buffers, RTL_NUMBER_OF(Buffers));
+            }
+            TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+            FrameCount++;
+        }
 
-        Buffer.DataOffset = 0;
-        Buffer.DataLength = Sockets[Index].UdpFrameLength;
-        Buffer.BufferLength = Buffer.DataLength;
-        Buffer.VirtualAddress = Sockets[Index].UdpFrame;
-        RX_FRAME Frame;
-        RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), &Buffer);
-        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+        return FrameCount;
+    };
 
-        UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    FirstFragmentCount = IndicateFrame(ExtFrame, ExtFrameLength);
+    IndicateFrame(LaterFragmentFrame, ExtFrameLength);
 
-        //
-        // Verify the NBL propagated correctly to XSK.
-        //
-        TEST_EQUAL(1, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
-        auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
-        TEST_EQUAL(Buffer.DataLength, RxDesc->length);
-        TEST_TRUE(
-            RtlEqualMemory(
-                Socket.Umem.Buffer.get() +
-                    XskDescriptorGetAddress(RxDesc->address) + XskDescriptorGetOffset(RxDesc->address),
-                Buffer.VirtualAddress + Buffer.DataOffset,
-                Buffer.DataLength));
-    }
+    TEST_HRESULT(XdpProgramGetStatistics(ProgramHandle.get(), Statistics, &StatisticsSize));
+    TEST_EQUAL(sizeof(Statistics), StatisticsSize);
+    TEST_EQUAL(FirstFragmentCount, Statistics[0].FramesMatched);
 }
 
 VOID
-GenericRxMultiProgram()
+GenericRxFragmentTracking(
+    _In_ ADDRESS_FAMILY Af
+    )
 {
     auto If = FnMpIf;
-    ADDRESS_FAMILY Af = AF_INET;
+    UINT16 LocalPort, RemotePort;
     ETHERNET_ADDRESS LocalHw, RemoteHw;
     INET_ADDR LocalIp, RemoteIp;
-    UCHAR UdpMatchPayload[] = "GenericRxMultiProgram";
-    struct {
-        MY_SOCKET Xsk;
-        wil::unique_handle ProgramHandle;
-        UINT16 LocalPort;
-        UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpMatchPayload)];
-        UINT32 UdpFrameLength;
-    } Sockets[4];
+    XDP_RULE_STATISTICS Statistics[1];
+    UINT32 StatisticsSize = sizeof(Statistics);
+    wil::unique_handle ProgramHandle;
+
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
 
+    RemotePort = htons(1234);
     If.GetHwAddress(&LocalHw);
     If.GetRemoteHwAddress(&RemoteHw);
-    If.GetIpv4Address(&LocalIp.Ipv4);
-    If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+    }
 
-    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
-        XDP_RULE Rule = {};
+    UCHAR UdpPayload[32] = "GenericRxFragmentTracking";
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
 
-        Sockets[Index].Xsk =
-            CreateAndBindSocket(If.GetIfIndex(), If.GetQueueId(), TRUE, FALSE, XDP_GENERIC);
-        Sockets[Index].LocalPort = htons(1000 + Index);
-        Sockets[Index].UdpFrameLength = sizeof(Sockets[Index].UdpFrame);
-        TEST_TRUE(
-            PktBuildUdpFrame(
-                Sockets[Index].UdpFrame, &Sockets[Index].UdpFrameLength, UdpMatchPayload,
-                sizeof(UdpMatchPayload), &LocalHw, &RemoteHw, Af, &LocalIp, &RemoteIp,
-                Sockets[Index].LocalPort, htons(2000)));
+    //
+    // Split the IP payload of the datagram into two fragments. The first
+    // fragment carries the UDP header, and IPv6 fragments carry a fragment
+    // header between the IPv6 header and the fragment data.
+    //
+    CONST UINT32 FragmentHeaderLength = 8;
+    CONST UINT32 L3Offset = sizeof(ETHERNET_HEADER);
+    CONST UINT32 L4Offset =
+        L3Offset + ((Af == AF_INET) ? sizeof(IPV4_HEADER) : sizeof(IPV6_HEADER));
+    CONST UINT32 IpPayloadLength = UdpFrameLength - L4Offset;
+    CONST UINT32 FirstFragmentDataLength = 16;
+    UCHAR FirstFragment[sizeof(UdpFrame) + FragmentHeaderLength];
+    UCHAR LaterFragment[sizeof(UdpFrame) + FragmentHeaderLength];
+    UCHAR UnknownFragment[sizeof(UdpFrame) + FragmentHeaderLength];
+    UINT32 FirstFragmentLength;
+    UINT32 LaterFragmentLength;
+    UINT32 UnknownFragmentLength;
+
+    auto BuildFragment = [&](
+        UCHAR *Fragment, UINT32 DataOffset, UINT32 DataLength, BOOLEAN MoreFragments,
+        UINT16 Id) -> UINT32
+    {
+        UINT32 HeaderLength = L4Offset;
 
-        Rule.Match = XDP_MATCH_UDP_DST;
-        Rule.Pattern.Port = Sockets[Index].LocalPort;
-        Rule.Action = XDP_PROGRAM_ACTION_REDIRECT;
-        Rule.Redirect.TargetType = XDP_REDIRECT_TARGET_TYPE_XSK;
-        Rule.Redirect.Target = Sockets[Index].Xsk.Handle.get();
+        RtlCopyMemory(Fragment, UdpFrame, L4Offset);
 
-        Sockets[Index].ProgramHandle =
-            CreateXdpProg(
-                If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
-                &Rule, 1, XDP_CREATE_PROGRAM_FLAG_SHARE);
-    }
+        if (Af == AF_INET) {
+            IPV4_HEADER *Ip4Hdr = (IPV4_HEADER *)&Fragment[L3Offset];
 
-    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
+            Ip4Hdr->TotalLength = htons((UINT16)(sizeof(*Ip4Hdr) + DataLength));
+            Ip4Hdr->Identification = htons(Id);
+            Ip4Hdr->FlagsAndOffset =
+                htons((UINT16)((MoreFragments ? 0x2000 : 0) | (DataOffset / 8)));
+        } else {
+            IPV6_HEADER *Ip6Hdr = (IPV6_HEADER *)&Fragment[L3Offset];
+            UINT16 OffsetAndFlags = htons((UINT16)(DataOffset | (MoreFragments ? 1 : 0)));
+            UINT32 FragmentId = htonl(Id);
+            UCHAR *FragmentHeader = &Fragment[L4Offset];
+
+            Ip6Hdr->NextHeader = IPPROTO_FRAGMENT;
+            Ip6Hdr->PayloadLength = htons((UINT16)(FragmentHeaderLength + DataLength));
+            FragmentHeader[0] = IPPROTO_UDP;
+            FragmentHeader[1] = 0;
+            RtlCopyMemory(&FragmentHeader[2], &OffsetAndFlags, sizeof(OffsetAndFlags));
+            RtlCopyMemory(&FragmentHeader[4], &FragmentId, sizeof(FragmentId));
+            HeaderLength += FragmentHeaderLength;
+        }
 
-    for (UINT16 Index = 0; Index < RTL_NUMBER_OF(Sockets); Index++) {
-        auto &Socket = Sockets[Index].Xsk;
-        DATA_BUFFER Buffer = {0};
-        BOOLEAN Detach = Index & 1;
+        RtlCopyMemory(&Fragment[HeaderLength], &UdpFrame[L4Offset + DataOffset], DataLength);
+        return HeaderLength + DataLength;
+    };
 
-        if (Detach) {
-            //
-            // Ensure shared programs are properly detached.
-            //
-            Sockets[Index].ProgramHandle.reset();
-        }
+    FirstFragmentLength =
+        BuildFragment(FirstFragment, 0, FirstFragmentDataLength, TRUE, 1);
+    LaterFragmentLength =
+        BuildFragment(
+            LaterFragment, FirstFragmentDataLength,
+            IpPayloadLength - FirstFragmentDataLength, FALSE, 1);
+    UnknownFragmentLength =
+        BuildFragment(
+            UnknownFragment, FirstFragmentDataLength,
+            IpPayloadLength - FirstFragmentDataLength, FALSE, 2);
 
-        SocketProduceRxFill(&Socket, 1);
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_UDP_DST;
+    Rule.Pattern.Port = LocalPort;
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
 
-        Buffer.DataOffset = 0;
-        Buffer.DataLength = Sockets[Index].UdpFrameLength;
-        Buffer.BufferLength = Buffer.DataLength;
-        Buffer.VirtualAddress = Sockets[Index].UdpFrame;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &Rule, 1, XDP_CREATE_PROGRAM_FLAG_SHARE | XDP_CREATE_PROGRAM_FLAG_TRACK_FRAGMENTS));
+
+    auto IndicateFrame = [&](UCHAR *FrameData, UINT32 FrameLength) {
         RX_FRAME Frame;
-        RxInitializeFrame(&Frame, FnMpIf.GetQueueId(), &Buffer);
+        RxInitializeFrame(&Frame, If.GetQueueId(), FrameData, FrameLength);
         TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+    };
 
-        //
-        // Verify the NBL propagated correctly to XSK.
-        //
-        if (Detach) {
-            UINT32 ConsumerIndex;
-            Sleep(TEST_TIMEOUT_ASYNC_MS);
-            TEST_EQUAL(0, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
-        } else {
-            UINT32 ConsumerIndex = SocketConsumerReserve(&Socket.Rings.Rx, 1);
+    //
+    // Without fragment tracking, only the first fragment matches the UDP rule.
+    //
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1,
+            XDP_CREATE_PROGRAM_FLAG_STATISTICS);
 
-            TEST_EQUAL(1, XskRingConsumerReserve(&Socket.Rings.Rx, MAXUINT32, &ConsumerIndex));
-            auto RxDesc = SocketGetAndFreeRxDesc(&Socket, ConsumerIndex);
-            TEST_EQUAL(Buffer.DataLength, RxDesc->length);
-            TEST_TRUE(
-                RtlEqualMemory(
-                    Socket.Umem.Buffer.get() +
-                        XskDescriptorGetAddress(RxDesc->address) + XskDescriptorGetOffset(RxDesc->address),
-                    Buffer.VirtualAddress + Buffer.DataOffset,
-                    Buffer.DataLength));
-        }
-    }
+    IndicateFrame(FirstFragment, FirstFragmentLength);
+    IndicateFrame(LaterFragment, LaterFragmentLength);
+
+    TEST_HRESULT(XdpProgramGetStatistics(ProgramHandle.get(), Statistics, &StatisticsSize));
+    TEST_EQUAL(1, Statistics[0].FramesMatched);
+    ProgramHandle.reset();
+
+    //
+    // With fragment tracking, the later fragment follows the first fragment of
+    // its datagram. A later fragment of a datagram whose first fragment was not
+    // seen is inspected on its own.
+    //
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1,
+            XDP_CREATE_PROGRAM_FLAG_STATISTICS | XDP_CREATE_PROGRAM_FLAG_TRACK_FRAGMENTS);
+
+    IndicateFrame(UnknownFragment, UnknownFragmentLength);
+    IndicateFrame(FirstFragment, FirstFragmentLength);
+    IndicateFrame(LaterFragment, LaterFragmentLength);
+
+    TEST_HRESULT(XdpProgramGetStatistics(ProgramHandle.get(), Statistics, &StatisticsSize));
+    TEST_EQUAL(sizeof(Statistics), StatisticsSize);
+    TEST_EQUAL(2, Statistics[0].FramesMatched);
 }
 
 VOID
-GenericRxMultiProgramConflicts()
+GenericRxEthernetMatch(
+    _In_ ADDRESS_FAMILY Af
+    )
 {
     auto If = FnMpIf;
-    XDP_RULE Rule = {};
+    UINT16 LocalPort, RemotePort;
+    ETHERNET_ADDRESS LocalHw, RemoteHw;
+    INET_ADDR LocalIp, RemoteIp;
+    UINT16 EtherType, OtherEtherType;
+    wil::unique_handle ProgramHandle;
 
-    Rule.Match = XDP_MATCH_ALL;
-    Rule.Action = XDP_PROGRAM_ACTION_PASS;
+    auto UdpSocket = CreateUdpSocket(Af, &If, &LocalPort);
+    auto GenericMp = MpOpenGeneric(If.GetIfIndex());
 
-    //
-    // Verify a non-sharing program prevents sharing.
-    //
-    wil::unique_handle failProgram;
-    wil::unique_handle validProgram =
-        CreateXdpProg(If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+    RemotePort = htons(1234);
+    If.GetHwAddress(&LocalHw);
+    If.GetRemoteHwAddress(&RemoteHw);
+    if (Af == AF_INET) {
+        If.GetIpv4Address(&LocalIp.Ipv4);
+        If.GetRemoteIpv4Address(&RemoteIp.Ipv4);
+        EtherType = htons(ETHERNET_TYPE_IPV4);
+        OtherEtherType = htons(ETHERNET_TYPE_IPV6);
+    } else {
+        If.GetIpv6Address(&LocalIp.Ipv6);
+        If.GetRemoteIpv6Address(&RemoteIp.Ipv6);
+        EtherType = htons(ETHERNET_TYPE_IPV6);
+        OtherEtherType = htons(ETHERNET_TYPE_IPV4);
+    }
+
+    UCHAR UdpPayload[] = "GenericRxEthernetMatch";
+    CHAR RecvPayload[sizeof(UdpPayload)] = {0};
+    UCHAR UdpFrame[UDP_HEADER_STORAGE + sizeof(UdpPayload)];
+    UINT32 UdpFrameLength = sizeof(UdpFrame);
+    TEST_TRUE(
+        PktBuildUdpFrame(
+            UdpFrame, &UdpFrameLength, UdpPayload, sizeof(UdpPayload), &LocalHw,
+            &RemoteHw, Af, &LocalIp, &RemoteIp, LocalPort, RemotePort));
 
     //
-    // A non-sharing program should fail with ERROR_OBJECT_ALREADY_EXISTS.
+    // Build a set of addresses derived from the local address, none of which
+    // is the local address.
     //
+    std::vector<XDP_MAC_ADDRESS> Addresses;
+    for (UINT32 Index = 1; Addresses.size() < 4096; Index++) {
+        XDP_MAC_ADDRESS Address;
+        C_ASSERT(sizeof(Address.Address) == sizeof(LocalHw.Bytes));
+        RtlCopyMemory(Address.Address, LocalHw.Bytes, sizeof(Address.Address));
+        Address.Address[4] ^= (UCHAR)(Index >> 8);
+        Address.Address[5] ^= (UCHAR)Index;
+        Addresses.push_back(Address);
+    }
+
+    XDP_RULE Rule = {};
+    Rule.Match = XDP_MATCH_ETH_DST;
+    RtlCopyMemory(Rule.Pattern.MacAddress.Address, RemoteHw.Bytes, sizeof(RemoteHw.Bytes));
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+
+    XDP_RULE InvalidRule = {};
+    InvalidRule.Match = XDP_MATCH_ETH_DST_SET;
+    InvalidRule.Pattern.MacAddressSet.Addresses = Addresses.data();
+    InvalidRule.Pattern.MacAddressSet.AddressCount = 0;
+    InvalidRule.Action = XDP_PROGRAM_ACTION_DROP;
     TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_OBJECT_ALREADY_EXISTS),
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
         TryCreateXdpProg(
-            failProgram, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1));
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+    InvalidRule.Pattern.MacAddressSet.AddressCount = (UINT32)Addresses.size();
+    InvalidRule.Pattern.MacAddressSet.Flags = ~0u;
+    TEST_EQUAL(
+        HRESULT_FROM_WIN32(ERROR_INVALID_PARAMETER),
+        TryCreateXdpProg(
+            ProgramHandle, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC,
+            &InvalidRule, 1));
+
+    ProgramHandle =
+        CreateXdpProg(
+            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1);
+
+    auto VerifyFrame = [&](BOOLEAN Pass) {
+        RX_FRAME Frame;
+        RxInitializeFrame(&Frame, If.GetQueueId(), UdpFrame, UdpFrameLength);
+        TEST_HRESULT(MpRxIndicateFrame(GenericMp, &Frame));
+
+        if (Pass) {
+            TEST_EQUAL(
+                sizeof(UdpPayload), recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+        } else {
+            TEST_EQUAL(SOCKET_ERROR, recv(UdpSocket.get(), RecvPayload, sizeof(RecvPayload), 0));
+            TEST_EQUAL(WSAETIMEDOUT, WSAGetLastError());
+        }
+    };
+
+    auto ReplaceRule = [&]() {
+        TEST_HRESULT(
+            XdpProgramUpdateRule(
+                ProgramHandle.get(), XDP_PROGRAM_RULE_OPERATION_REPLACE, 0, &Rule));
+    };
 
     //
-    // A sharing program should fail with ERROR_SHARING_VIOLATION.
+    // The frame is addressed to the local address, not the remote address.
     //
-    TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_SHARING_VIOLATION),
-        TryCreateXdpProg(
-            failProgram, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1,
-            XDP_CREATE_PROGRAM_FLAG_SHARE));
+    VerifyFrame(TRUE);
+    RtlCopyMemory(Rule.Pattern.MacAddress.Address, LocalHw.Bytes, sizeof(LocalHw.Bytes));
+    ReplaceRule();
+    VerifyFrame(FALSE);
 
     //
-    // Verify a sharing program prevents sharing with non-sharing programs.
+    // The set does not contain the local address until the rule is replaced
+    // with an updated array, with or without a Bloom filter.
     //
-    validProgram.reset();
-    validProgram =
-        CreateXdpProg(
-            If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1,
-            XDP_CREATE_PROGRAM_FLAG_SHARE);
+    Rule.Match = XDP_MATCH_ETH_DST_SET;
+    Rule.Pattern.MacAddressSet.Addresses = Addresses.data();
+    Rule.Pattern.MacAddressSet.AddressCount = (UINT32)Addresses.size();
+    Rule.Pattern.MacAddressSet.Flags = XDP_MAC_ADDRESS_SET_FLAG_BLOOM_FILTER;
+    ReplaceRule();
+    VerifyFrame(TRUE);
+    RtlCopyMemory(
+        Addresses[Addresses.size() / 2].Address, LocalHw.Bytes, sizeof(LocalHw.Bytes));
+    ReplaceRule();
+    VerifyFrame(FALSE);
+    Rule.Pattern.MacAddressSet.Flags = 0;
+    ReplaceRule();
+    VerifyFrame(FALSE);
 
     //
-    // A non-sharing program should fail with ERROR_OBJECT_ALREADY_EXISTS.
+    // Match the EtherType of the other address family, then of this one.
     //
-    TEST_EQUAL(
-        HRESULT_FROM_WIN32(ERROR_OBJECT_ALREADY_EXISTS),
-        TryCreateXdpProg(
-            failProgram, If.GetIfIndex(), &XdpInspectRxL2, If.GetQueueId(), XDP_GENERIC, &Rule, 1));
+    Rule = {};
+    Rule.Match = XDP_MATCH_ETHERTYPE;
+    Rule.Pattern.EtherType = OtherEtherType;
+    Rule.Action = XDP_PROGRAM_ACTION_DROP;
+    ReplaceRule();
+    VerifyFrame(TRUE);
+    Rule.Pattern.EtherType = EtherType;
+    ReplaceRule();
+    VerifyFrame(FALSE);
 }
 
 VOID
@@ -32,23 +32,119 @@ GenericRxMatchUdp(
     _In_ XDP_MATCH_TYPE MatchType
     );
 
+VOID
+GenericRxMatchUdpRuleOrder(
+    _In_ ADDRESS_FAMILY Af
+    );
+
 VOID
 GenericRxMatchIpPrefix(
     _In_ UINT16 AddressFamily
     );
 
+VOID
+GenericRxMatchIpPrefixRuleOrder(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxMatchFrameClassRuleOrder(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxMatchTcp(
+    _In_ ADDRESS_FAMILY Af,
+    _In_ XDP_MATCH_TYPE MatchType
+    );
+
 VOID
 GenericRxLowResources();
 
 VOID
 GenericRxMultiSocket();
 
+VOID
+GenericRxXskGroup();
+
 VOID
 GenericRxMultiProgram();
 
 VOID
 GenericRxMultiProgramConflicts();
 
+VOID
+GenericRxProgramStatistics();
+
+VOID
+GenericRxUpdateRule(
+    _In_ BOOLEAN Shared
+    );
+
+VOID
+GenericRxUpdateRuleSharedStatistics();
+
+VOID
+GenericRxRateLimit();
+
+VOID
+GenericRxSample();
+
+VOID
+GenericRxL2Fwd();
+
+VOID
+GenericRxL2FwdVlanMtu();
+
+VOID
+GenericRxFlowCache();
+
+VOID
+GenericRxQuicCidTable();
+
+VOID
+GenericRxMap();
+
+VOID
+GenericRxIpAddressSet(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxPayload();
+
+VOID
+GenericRxBytecode();
+
+VOID
+GenericRxAdaptiveOrder();
+
+VOID
+GenericRxAdaptiveOrderFlowCache();
+
+VOID
+GenericRxVlan(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxTunnel(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxIpv6ExtensionHeaders();
+
+VOID
+GenericRxFragmentTracking(
+    _In_ ADDRESS_FAMILY Af
+    );
+
+VOID
+GenericRxEthernetMatch(
+    _In_ ADDRESS_FAMILY Af
+    );
+
 VOID
 GenericRxUdpFragmentQuicShortHeader(
     _In_ ADDRESS_FAMILY Af
@@ -112,6 +112,10 @@ public:
         ::GenericRxMultiSocket();
     }
 
+    TEST_METHOD(GenericRxXskGroup) {
+        ::GenericRxXskGroup();
+    }
+
     TEST_METHOD(GenericRxMultiProgram) {
         ::GenericRxMultiProgram();
     }
@@ -120,6 +124,110 @@ public:
         ::GenericRxMultiProgramConflicts();
     }
 
+    TEST_METHOD(GenericRxProgramStatistics) {
+        ::GenericRxProgramStatistics();
+    }
+
+    TEST_METHOD(GenericRxUpdateRule) {
+        ::GenericRxUpdateRule(FALSE);
+    }
+
+    TEST_METHOD(GenericRxUpdateRuleShared) {
+        ::GenericRxUpdateRule(TRUE);
+    }
+
+    TEST_METHOD(GenericRxUpdateRuleSharedStatistics) {
+        ::GenericRxUpdateRuleSharedStatistics();
+    }
+
+    TEST_METHOD(GenericRxRateLimit) {
+        ::GenericRxRateLimit();
+    }
+
+    TEST_METHOD(GenericRxSample) {
+        ::GenericRxSample();
+    }
+
+    TEST_METHOD(GenericRxL2Fwd) {
+        ::GenericRxL2Fwd();
+    }
+
+    TEST_METHOD(GenericRxL2FwdVlanMtu) {
+        ::GenericRxL2FwdVlanMtu();
+    }
+
+    TEST_METHOD(GenericRxFlowCache) {
+        ::GenericRxFlowCache();
+    }
+
+    TEST_METHOD(GenericRxQuicCidTable) {
+        ::GenericRxQuicCidTable();
+    }
+
+    TEST_METHOD(GenericRxMap) {
+        ::GenericRxMap();
+    }
+
+    TEST_METHOD(GenericRxIpAddressSetV4) {
+        ::GenericRxIpAddressSet(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxIpAddressSetV6) {
+        ::GenericRxIpAddressSet(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxPayload) {
+        ::GenericRxPayload();
+    }
+
+    TEST_METHOD(GenericRxBytecode) {
+        ::GenericRxBytecode();
+    }
+
+    TEST_METHOD(GenericRxAdaptiveOrder) {
+        ::GenericRxAdaptiveOrder();
+    }
+
+    TEST_METHOD(GenericRxAdaptiveOrderFlowCache) {
+        ::GenericRxAdaptiveOrderFlowCache();
+    }
+
+    TEST_METHOD(GenericRxVlanV4) {
+        ::GenericRxVlan(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxVlanV6) {
+        ::GenericRxVlan(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxTunnelV4) {
+        ::GenericRxTunnel(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxTunnelV6) {
+        ::GenericRxTunnel(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxIpv6ExtensionHeaders) {
+        ::GenericRxIpv6ExtensionHeaders();
+    }
+
+    TEST_METHOD(GenericRxFragmentTrackingV4) {
+        ::GenericRxFragmentTracking(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxFragmentTrackingV6) {
+        ::GenericRxFragmentTracking(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxEthernetMatchV4) {
+        ::GenericRxEthernetMatch(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxEthernetMatchV6) {
+        ::GenericRxEthernetMatch(AF_INET6);
+    }
+
     TEST_METHOD(GenericTxToRxInject) {
         ::GenericTxToRxInject();
     }
@@ -188,6 +296,14 @@ public:
         GenericRxMatchUdp(AF_INET6, XDP_MATCH_QUIC_FLOW_DST_CID);
     }
 
+    TEST_METHOD(GenericRxMatchUdpRuleOrderV4) {
+        GenericRxMatchUdpRuleOrder(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxMatchUdpRuleOrderV6) {
+        GenericRxMatchUdpRuleOrder(AF_INET6);
+    }
+
     TEST_METHOD(GenericRxMatchIpPrefixV4) {
         GenericRxMatchIpPrefix(AF_INET);
     }
@@ -196,6 +312,22 @@ public:
         GenericRxMatchIpPrefix(AF_INET6);
     }
 
+    TEST_METHOD(GenericRxMatchIpPrefixRuleOrderV4) {
+        GenericRxMatchIpPrefixRuleOrder(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxMatchIpPrefixRuleOrderV6) {
+        GenericRxMatchIpPrefixRuleOrder(AF_INET6);
+    }
+
+    TEST_METHOD(GenericRxMatchFrameClassRuleOrderV4) {
+        GenericRxMatchFrameClassRuleOrder(AF_INET);
+    }
+
+    TEST_METHOD(GenericRxMatchFrameClassRuleOrderV6) {
+        GenericRxMatchFrameClassRuleOrder(AF_INET6);
+    }
+
     TEST_METHOD(GenericRxMatchUdpPortSetV4) {
         GenericRxMatchUdp(AF_INET, XDP_MATCH_UDP_PORT_SET);
     }
@@ -212,6 +344,86 @@ public:
         GenericRxMatchUdp(AF_INET6, XDP_MATCH_IPV6_UDP_PORT_SET);
     }
 
+    TEST_METHOD(GenericRxMatchTcpV4) {
+        GenericRxMatchTcp(AF_INET, XDP_MATCH_TCP);
+    }
+
+    TEST_METHOD(GenericRxMatchTcpV6) {
+        GenericRxMatchTcp(AF_INET6, XDP_MATCH_TCP);
+    }
+
+    TEST_METHOD(GenericRxMatchTcpDstV4) {
+        GenericRxMatchTcp(AF_INET, XDP_MATCH_TCP_DST);
+    }
+
+    TEST_METHOD(GenericRxMatchTcpDstV6) {
+        GenericRxMatchTcp(AF_INET6, XDP_MATCH_TCP_DST);
+    }
+
+    TEST_METHOD(GenericRxMatchIpv4TcpTuple) {
+        GenericRxMatchTcp(AF_INET, XDP_MATCH_IPV4_TCP_TUPLE);
+    }
+
+    TEST_METHOD(GenericRxMatchIpv6TcpTuple) {
+        GenericRxMatchTcp(AF_INET6, XDP_MATCH_IPV6_TCP_TUPLE);
+    }
+
+    TEST_METHOD(GenericRxMatchTcpPortSetV4) {
+        GenericRxMatchTcp(AF_INET, XDP_MATCH_TCP_PORT_SET);
+    }
+
+    TEST_METHOD(GenericRxMatchTcpPortSetV6) {
+        GenericRxMatchTcp(AF_INET6, XDP_MATCH_TCP_PORT_SET);
+    }
+
+    TEST_METHOD(GenericRxMatchIpv4TcpPortSet) {
+        GenericRxMatchTcp(AF_INET, XDP_MATCH_IPV4_TCP_PORT_SET);
+    }
+
+    TEST_METHOD(GenericRxMatchIpv6TcpPortSet) {
+        GenericRxMatchTcp(AF_INET6, XDP_MATCH_IPV6_TCP_PORT_SET);
+    }
+
+    TEST_METHOD(GenericRxMatchTcpFlagsV4) {
+        GenericRxMatchTcp(AF_INET, XDP_MATCH_TCP_FLAGS);
+    }
+
+    TEST_METHOD(GenericRxMatchTcpFlagsV6) {
+        GenericRxMatchTcp(AF_INET6, XDP_MATCH_TCP_FLAGS);
+    }
+
+    TEST_METHOD(GenericRxMatchUdpSrcV4) {
+        GenericRxMatchUdp(AF_INET, XDP_MATCH_UDP_SRC);
+    }
+
+    TEST_METHOD(GenericRxMatchUdpSrcV6) {
+        GenericRxMatchUdp(AF_INET6, XDP_MATCH_UDP_SRC);
+    }
+
+    TEST_METHOD(GenericRxMatchUdpSrcPortSetV4) {
+        GenericRxMatchUdp(AF_INET, XDP_MATCH_UDP_SRC_PORT_SET);
+    }
+
+    TEST_METHOD(GenericRxMatchUdpSrcPortSetV6) {
+        GenericRxMatchUdp(AF_INET6, XDP_MATCH_UDP_SRC_PORT_SET);
+    }
+
+    TEST_METHOD(GenericRxMatchTcpSrcV4) {
+        GenericRxMatchTcp(AF_INET, XDP_MATCH_TCP_SRC);
+    }
+
+    TEST_METHOD(GenericRxMatchTcpSrcV6) {
+        GenericRxMatchTcp(AF_INET6, XDP_MATCH_TCP_SRC);
+    }
+
+    TEST_METHOD(GenericRxMatchTcpSrcPortSetV4) {
+        GenericRxMatchTcp(AF_INET, XDP_MATCH_TCP_SRC_PORT_SET);
+    }
+
+    TEST_METHOD(GenericRxMatchTcpSrcPortSetV6) {
+        GenericRxMatchTcp(AF_INET6, XDP_MATCH_TCP_SRC_PORT_SET);
+    }
+
     TEST_METHOD(GenericXskWaitRx) {
         GenericXskWait(TRUE, FALSE);
     }
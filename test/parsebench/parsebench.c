@@ -0,0 +1,709 @@
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+//
+
+//
+// This application benchmarks the header classification performed by the
+// contiguous path of XdpParseFrame against two alternatives for its common
+// case: an SSE2 classifier and a wide scalar load classifier. Kernel code can
+// use SSE2 without saving extended processor state, so wider instruction sets
+// are not considered.
+//
+// The scalar parser below mirrors XdpParseFrame for frames whose headers are
+// contiguous, and is checked against a table of frames whose results were
+// taken from the driver; any change to the contiguous path of XdpParseFrame
+// must be reflected in both. The alternatives only accept unfragmented,
+// untagged IPv4 and IPv6 frames without options or extension headers, and fall
+// back to the scalar parser for any other frame. Every variant is first checked
+// against the table and to produce identical results over the frame mix.
+//
+
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_M_AMD64)
+#include <emmintrin.h>
+#endif
+
+#define ETH_HEADER_LENGTH 14
+#define VLAN_TAG_LENGTH 4
+#define IP4_HEADER_LENGTH 20
+#define IP6_HEADER_LENGTH 40
+#define IP6_EXTENSION_HEADER_MIN_LENGTH 8
+#define UDP_HEADER_LENGTH 8
+#define TCP_HEADER_LENGTH 20
+
+#define MAX_VLAN_TAGS 2
+#define MAX_IP6_EXTENSION_HEADERS 8
+
+#define ETH_TYPE_IP4 0x0008     // 0x0800 in network order
+#define ETH_TYPE_IP6 0xDD86     // 0x86DD in network order
+#define ETH_TYPE_8021Q 0x0081   // 0x8100 in network order
+#define ETH_TYPE_8021AD 0xA888  // 0x88A8 in network order
+
+#define IP4_OFF_MASK 0xFF1F     // Fragment offset in network order
+#define IP4_MF_MASK 0x0020      // More fragments in network order
+
+#define PROTO_HOPOPTS 0
+#define PROTO_TCP 6
+#define PROTO_UDP 17
+#define PROTO_ROUTING 43
+#define PROTO_FRAGMENT 44
+#define PROTO_AH 51
+#define PROTO_NONE 59
+#define PROTO_DSTOPTS 60
+
+#define PARSE_ETH 0x01
+#define PARSE_IP4 0x02
+#define PARSE_IP6 0x04
+#define PARSE_UDP 0x08
+#define PARSE_TCP 0x10
+
+typedef struct _PARSE_RESULT {
+    UINT32 Flags;
+    UINT32 NetworkOffset;
+    UINT32 TransportOffset;
+} PARSE_RESULT;
+
+typedef struct _FRAME {
+    UCHAR *Va;
+    UINT32 DataLength;
+} FRAME;
+
+//
+// A frame with known parse results. The headers start at the EtherType, and
+// the bytes before it and any bytes not listed are zero.
+//
+typedef struct _KNOWN_FRAME {
+    CONST CHAR *Name;
+    UCHAR Headers[48];
+    UINT32 DataLength;
+    PARSE_RESULT Result;
+} KNOWN_FRAME;
+
+typedef
+BOOLEAN
+PARSE_FAST_ROUTINE(
+    _In_ CONST UCHAR *Va,
+    _In_ UINT32 Length,
+    _Out_ PARSE_RESULT *Result
+    );
+
+#define DEFAULT_FRAME_COUNT 4096
+#define DEFAULT_ITERATIONS 2000
+#define DEFAULT_RUNS 3
+#define FRAME_BUFFER_LENGTH 128
+
+CONST CHAR *UsageText =
+"Usage: parsebench [-frames <count>] [-iterations <count>] [-runs <count>]"
+"\n"
+"\nMeasures the average time to classify one frame's headers, for a mix of UDP"
+"\nframes only and for a mix of UDP, TCP, ARP, IPv4 with options and short frames."
+"\n";
+
+//
+// The results XdpParseFrame produces for these frames. XdpParseFrame does not
+// read the IPv4 header length, so IPv4 options are parsed as the transport
+// header, and stops after two VLAN tags.
+//
+static CONST KNOWN_FRAME KnownFrames[] = {
+    {
+        "ipv4 udp",
+        { 0x08, 0x00, 0x45, 0, 0, 0, 0, 0, 0, 0, 0, PROTO_UDP },
+        42, { PARSE_ETH | PARSE_IP4 | PARSE_UDP, 14, 34 }
+    },
+    {
+        "ipv4 tcp",
+        { 0x08, 0x00, 0x45, 0, 0, 0, 0, 0, 0, 0, 0, PROTO_TCP },
+        54, { PARSE_ETH | PARSE_IP4 | PARSE_TCP, 14, 34 }
+    },
+    {
+        "ipv4 tcp truncated",
+        { 0x08, 0x00, 0x45, 0, 0, 0, 0, 0, 0, 0, 0, PROTO_TCP },
+        53, { PARSE_ETH | PARSE_IP4, 14, 0 }
+    },
+    {
+        "ipv4 truncated",
+        { 0x08, 0x00, 0x45, 0, 0, 0, 0, 0, 0, 0, 0, PROTO_UDP },
+        33, { PARSE_ETH, 14, 0 }
+    },
+    {
+        "ipv4 options",
+        { 0x08, 0x00, 0x46, 0, 0, 0, 0, 0, 0, 0, 0, PROTO_UDP },
+        42, { PARSE_ETH | PARSE_IP4 | PARSE_UDP, 14, 34 }
+    },
+    {
+        "ipv4 first fragment",
+        { 0x08, 0x00, 0x45, 0, 0, 0, 0, 0, 0x20, 0, 0, PROTO_UDP },
+        42, { PARSE_ETH | PARSE_IP4 | PARSE_UDP, 14, 34 }
+    },
+    {
+        "ipv4 later fragment",
+        { 0x08, 0x00, 0x45, 0, 0, 0, 0, 0, 0x20, 0x01, 0, PROTO_UDP },
+        42, { PARSE_ETH | PARSE_IP4, 14, 0 }
+    },
+    {
+        "802.1q ipv4 udp",
+        { 0x81, 0x00, 0, 1, 0x08, 0x00, 0x45, 0, 0, 0, 0, 0, 0, 0, 0, PROTO_UDP },
+        46, { PARSE_ETH | PARSE_IP4 | PARSE_UDP, 18, 38 }
+    },
+    {
+        "802.1ad ipv4 udp",
+        {
+            0x88, 0xA8, 0, 1, 0x81, 0x00, 0, 1, 0x08, 0x00, 0x45, 0, 0, 0, 0, 0,
+            0, 0, 0, PROTO_UDP
+        },
+        50, { PARSE_ETH | PARSE_IP4 | PARSE_UDP, 22, 42 }
+    },
+    {
+        "three vlan tags",
+        { 0x81, 0x00, 0, 1, 0x81, 0x00, 0, 1, 0x81, 0x00, 0, 1, 0x08, 0x00, 0x45 },
+        64, { PARSE_ETH, 22, 0 }
+    },
+    {
+        "ipv6 udp",
+        { 0x86, 0xDD, 0x60, 0, 0, 0, 0, 0, PROTO_UDP },
+        62, { PARSE_ETH | PARSE_IP6 | PARSE_UDP, 14, 54 }
+    },
+    {
+        "ipv6 hop-by-hop udp",
+        {
+            0x86, 0xDD, 0x60, 0, 0, 0, 0, 0, PROTO_HOPOPTS, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, PROTO_UDP
+        },
+        70, { PARSE_ETH | PARSE_IP6 | PARSE_UDP, 14, 62 }
+    },
+    {
+        "ipv6 later fragment",
+        {
+            0x86, 0xDD, 0x60, 0, 0, 0, 0, 0, PROTO_FRAGMENT, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, PROTO_UDP, 0, 0, 0x08
+        },
+        70, { PARSE_ETH | PARSE_IP6, 14, 0 }
+    },
+    {
+        "arp",
+        { 0x08, 0x06 },
+        42, { PARSE_ETH, 14, 0 }
+    },
+    {
+        "runt",
+        { 0x08, 0x00 },
+        13, { 0, 0, 0 }
+    },
+};
+
+static
+UINT16
+ReadUint16(
+    _In_ CONST UCHAR *Va
+    )
+{
+    UINT16 Value;
+    memcpy(&Value, Va, sizeof(Value));
+    return Value;
+}
+
+static
+UINT32
+ReadUint32(
+    _In_ CONST UCHAR *Va
+    )
+{
+    UINT32 Value;
+    memcpy(&Value, Va, sizeof(Value));
+    return Value;
+}
+
+static
+BOOLEAN
+IsIp6ExtensionHeader(
+    _In_ UINT8 NextHeader
+    )
+{
+    return
+        NextHeader == PROTO_HOPOPTS || NextHeader == PROTO_ROUTING ||
+        NextHeader == PROTO_FRAGMENT || NextHeader == PROTO_DSTOPTS || NextHeader == PROTO_AH;
+}
+
+static
+VOID
+ParseTransport(
+    _In_ UINT32 Length,
+    _In_ UINT8 IpProto,
+    _In_ UINT32 Offset,
+    _Inout_ PARSE_RESULT *Result
+    )
+{
+    if (IpProto == PROTO_UDP) {
+        if (Length >= Offset + UDP_HEADER_LENGTH) {
+            Result->Flags |= PARSE_UDP;
+            Result->TransportOffset = Offset;
+        }
+    } else if (IpProto == PROTO_TCP) {
+        if (Length >= Offset + TCP_HEADER_LENGTH) {
+            Result->Flags |= PARSE_TCP;
+            Result->TransportOffset = Offset;
+        }
+    }
+}
+
+//
+// Mirrors the contiguous path of XdpParseFrame.
+//
+static
+VOID
+ParseScalar(
+    _In_ CONST UCHAR *Va,
+    _In_ UINT32 Length,
+    _Out_ PARSE_RESULT *Result
+    )
+{
+    UINT32 Offset = 0;
+    UINT32 TagCount = 0;
+    UINT32 HeaderCount = 0;
+    UINT16 EthType;
+    UINT8 IpProto;
+
+    ZeroMemory(Result, sizeof(*Result));
+
+    if (Length < ETH_HEADER_LENGTH) {
+        return;
+    }
+    Result->Flags |= PARSE_ETH;
+    EthType = ReadUint16(&Va[12]);
+    Offset += ETH_HEADER_LENGTH;
+
+    while (TagCount < MAX_VLAN_TAGS && (EthType == ETH_TYPE_8021Q || EthType == ETH_TYPE_8021AD)) {
+        if (Length < Offset + VLAN_TAG_LENGTH) {
+            return;
+        }
+        EthType = ReadUint16(&Va[Offset + 2]);
+        Offset += VLAN_TAG_LENGTH;
+        TagCount++;
+    }
+
+    Result->NetworkOffset = Offset;
+
+    if (EthType == ETH_TYPE_IP4) {
+        if (Length < Offset + IP4_HEADER_LENGTH) {
+            return;
+        }
+        Result->Flags |= PARSE_IP4;
+        IpProto = Va[Offset + 9];
+        if ((ReadUint16(&Va[Offset + 6]) & IP4_OFF_MASK) != 0) {
+            IpProto = PROTO_NONE;
+        }
+        Offset += IP4_HEADER_LENGTH;
+    } else if (EthType == ETH_TYPE_IP6) {
+        if (Length < Offset + IP6_HEADER_LENGTH) {
+            return;
+        }
+        Result->Flags |= PARSE_IP6;
+        IpProto = Va[Offset + 6];
+        Offset += IP6_HEADER_LENGTH;
+
+        while (IsIp6ExtensionHeader(IpProto)) {
+            UINT32 HeaderLength;
+
+            if (HeaderCount++ == MAX_IP6_EXTENSION_HEADERS) {
+                IpProto = PROTO_NONE;
+                break;
+            }
+            if (Length < Offset + IP6_EXTENSION_HEADER_MIN_LENGTH) {
+                return;
+            }
+
+            if (IpProto == PROTO_FRAGMENT) {
+                HeaderLength = IP6_EXTENSION_HEADER_MIN_LENGTH;
+                IpProto =
+                    (ReadUint16(&Va[Offset + 2]) & 0xF8FF) != 0 ? PROTO_NONE : Va[Offset];
+            } else if (IpProto == PROTO_AH) {
+                HeaderLength = (Va[Offset + 1] + 2) * 4;
+                IpProto = Va[Offset];
+            } else {
+                HeaderLength = (Va[Offset + 1] + 1) * 8;
+                IpProto = Va[Offset];
+            }
+
+            if (Length < Offset + HeaderLength) {
+                return;
+            }
+            Offset += HeaderLength;
+        }
+    } else {
+        return;
+    }
+
+    ParseTransport(Length, IpProto, Offset, Result);
+}
+
+#if defined(_M_AMD64)
+
+//
+// Classifies the EtherType, IPv4 version and header length, IPv4 fragment
+// fields and IPv6 version with one 16-byte load at the EtherType.
+//
+static
+BOOLEAN
+ParseFastSse2(
+    _In_ CONST UCHAR *Va,
+    _In_ UINT32 Length,
+    _Out_ PARSE_RESULT *Result
+    )
+{
+    //
+    // Bytes 0-1 are the EtherType, byte 2 the IP version, and bytes 8-9 the
+    // IPv4 fragment fields with the don't fragment flag masked.
+    //
+    CONST __m128i Ip4Mask =
+        _mm_setr_epi8(-1, -1, -1, 0, 0, 0, 0, 0, (CHAR)0xBF, -1, 0, 0, 0, 0, 0, 0);
+    CONST __m128i Ip4Value =
+        _mm_setr_epi8(0x08, 0x00, 0x45, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    CONST __m128i Ip6Mask =
+        _mm_setr_epi8(-1, -1, (CHAR)0xF0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    CONST __m128i Ip6Value =
+        _mm_setr_epi8((CHAR)0x86, (CHAR)0xDD, 0x60, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    __m128i Header;
+    UINT8 IpProto;
+
+    if (Length < 12 + sizeof(Header)) {
+        return FALSE;
+    }
+
+    Header = _mm_loadu_si128((CONST __m128i *)&Va[12]);
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(Header, Ip4Mask), Ip4Value)) == 0xFFFF &&
+        Length >= ETH_HEADER_LENGTH + IP4_HEADER_LENGTH) {
+        IpProto = Va[ETH_HEADER_LENGTH + 9];
+        Result->Flags = PARSE_ETH | PARSE_IP4;
+        Result->NetworkOffset = ETH_HEADER_LENGTH;
+        Result->TransportOffset = 0;
+        ParseTransport(Length, IpProto, ETH_HEADER_LENGTH + IP4_HEADER_LENGTH, Result);
+        return TRUE;
+    }
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(Header, Ip6Mask), Ip6Value)) == 0xFFFF &&
+        Length >= ETH_HEADER_LENGTH + IP6_HEADER_LENGTH) {
+        IpProto = Va[ETH_HEADER_LENGTH + 6];
+        if (IsIp6ExtensionHeader(IpProto)) {
+            return FALSE;
+        }
+        Result->Flags = PARSE_ETH | PARSE_IP6;
+        Result->NetworkOffset = ETH_HEADER_LENGTH;
+        Result->TransportOffset = 0;
+        ParseTransport(Length, IpProto, ETH_HEADER_LENGTH + IP6_HEADER_LENGTH, Result);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+#endif
+
+//
+// Classifies the EtherType and IP version with one 4-byte load at the
+// EtherType, followed by a load of the IPv4 fragment fields.
+//
+static
+BOOLEAN
+ParseFastWideLoad(
+    _In_ CONST UCHAR *Va,
+    _In_ UINT32 Length,
+    _Out_ PARSE_RESULT *Result
+    )
+{
+    UINT32 Word;
+    UINT8 IpProto;
+
+    if (Length < ETH_HEADER_LENGTH + IP4_HEADER_LENGTH) {
+        return FALSE;
+    }
+
+    Word = ReadUint32(&Va[12]);
+
+    if ((Word & 0x00FFFFFF) == 0x00450008 &&
+        (ReadUint16(&Va[ETH_HEADER_LENGTH + 6]) & (IP4_OFF_MASK | IP4_MF_MASK)) == 0) {
+        IpProto = Va[ETH_HEADER_LENGTH + 9];
+        Result->Flags = PARSE_ETH | PARSE_IP4;
+        Result->NetworkOffset = ETH_HEADER_LENGTH;
+        Result->TransportOffset = 0;
+        ParseTransport(Length, IpProto, ETH_HEADER_LENGTH + IP4_HEADER_LENGTH, Result);
+        return TRUE;
+    }
+
+    if ((Word & 0x00F0FFFF) == 0x0060DD86 && Length >= ETH_HEADER_LENGTH + IP6_HEADER_LENGTH) {
+        IpProto = Va[ETH_HEADER_LENGTH + 6];
+        if (IsIp6ExtensionHeader(IpProto)) {
+            return FALSE;
+        }
+        Result->Flags = PARSE_ETH | PARSE_IP6;
+        Result->NetworkOffset = ETH_HEADER_LENGTH;
+        Result->TransportOffset = 0;
+        ParseTransport(Length, IpProto, ETH_HEADER_LENGTH + IP6_HEADER_LENGTH, Result);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static
+VOID
+Parse(
+    _In_opt_ PARSE_FAST_ROUTINE *ParseFast,
+    _In_ CONST FRAME *Frame,
+    _Out_ PARSE_RESULT *Result
+    )
+{
+    if (ParseFast == NULL || !ParseFast(Frame->Va, Frame->DataLength, Result)) {
+        ParseScalar(Frame->Va, Frame->DataLength, Result);
+    }
+}
+
+static UINT32 RandomState = 7;
+
+static
+UINT32
+Random(
+    VOID
+    )
+{
+    RandomState ^= RandomState << 13;
+    RandomState ^= RandomState >> 17;
+    RandomState ^= RandomState << 5;
+    return RandomState;
+}
+
+//
+// Builds a frame at a random offset within its buffer. The mixed frames are
+// 3/8 IPv4, 3/8 IPv6, 1/8 ARP and 1/8 unknown EtherTypes; a quarter of the IP
+// frames are TCP, half of the last IPv4 eighth carry options, and one in six
+// frames is truncated to a random length.
+//
+static
+VOID
+BuildFrame(
+    _Out_writes_bytes_(FRAME_BUFFER_LENGTH) UCHAR *Buffer,
+    _In_ BOOLEAN UdpOnly,
+    _Out_ FRAME *Frame
+    )
+{
+    UCHAR *Va = Buffer + Random() % 8;
+    UINT32 Kind = UdpOnly ? (Random() % 2) * 3 : Random() % 8;
+    BOOLEAN Udp = UdpOnly || (Random() % 4) != 0;
+
+    for (UINT32 i = 0; i < FRAME_BUFFER_LENGTH; i++) {
+        Buffer[i] = (UCHAR)Random();
+    }
+
+    if (Kind < 3) {
+        Va[12] = 0x08;
+        Va[13] = 0x00;
+        Va[14] = (Kind == 2 && !UdpOnly && Random() % 2) ? 0x46 : 0x45;
+        Va[20] = 0x40;
+        Va[21] = 0x00;
+        Va[23] = Udp ? PROTO_UDP : PROTO_TCP;
+    } else if (Kind < 6) {
+        Va[12] = 0x86;
+        Va[13] = 0xDD;
+        Va[14] = 0x60;
+        Va[20] = Udp ? PROTO_UDP : PROTO_TCP;
+    } else if (Kind == 6) {
+        Va[12] = 0x08;
+        Va[13] = 0x06;
+    } else {
+        Va[12] = 0x88;
+    }
+
+    Frame->Va = Va;
+    Frame->DataLength = (UdpOnly || Random() % 6) ? 100 : Random() % 80;
+}
+
+static
+BOOLEAN
+CheckKnownFrames(
+    _In_ CONST CHAR *Name,
+    _In_opt_ PARSE_FAST_ROUTINE *ParseFast
+    )
+{
+    UCHAR Buffer[FRAME_BUFFER_LENGTH];
+    FRAME Frame;
+    PARSE_RESULT Result;
+
+    for (UINT32 i = 0; i < RTL_NUMBER_OF(KnownFrames); i++) {
+        CONST KNOWN_FRAME *Known = &KnownFrames[i];
+
+        ZeroMemory(Buffer, sizeof(Buffer));
+        memcpy(&Buffer[12], Known->Headers, sizeof(Known->Headers));
+        Frame.Va = Buffer;
+        Frame.DataLength = Known->DataLength;
+
+        Parse(ParseFast, &Frame, &Result);
+
+        if (Result.Flags != Known->Result.Flags ||
+            Result.NetworkOffset != Known->Result.NetworkOffset ||
+            Result.TransportOffset != Known->Result.TransportOffset) {
+            fprintf(
+                stderr, "Error: %s results differ from XdpParseFrame for %s\n", Name,
+                Known->Name);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static
+UINT64
+HashResults(
+    _In_opt_ PARSE_FAST_ROUTINE *ParseFast,
+    _In_ CONST FRAME *Frames,
+    _In_ UINT32 FrameCount
+    )
+{
+    UINT64 Hash = 1469598103934665603ull;
+
+    for (UINT32 i = 0; i < FrameCount; i++) {
+        PARSE_RESULT Result;
+
+        Parse(ParseFast, &Frames[i], &Result);
+        Hash = (Hash ^ Result.Flags) * 1099511628211ull;
+        Hash = (Hash ^ Result.NetworkOffset) * 1099511628211ull;
+        Hash = (Hash ^ Result.TransportOffset) * 1099511628211ull;
+    }
+
+    return Hash;
+}
+
+static
+DOUBLE
+Measure(
+    _In_opt_ PARSE_FAST_ROUTINE *ParseFast,
+    _In_ CONST FRAME *Frames,
+    _In_ UINT32 FrameCount,
+    _In_ UINT32 Iterations
+    )
+{
+    LARGE_INTEGER Frequency;
+    LARGE_INTEGER Start;
+    LARGE_INTEGER End;
+    volatile UINT32 Sink = 0;
+
+    QueryPerformanceFrequency(&Frequency);
+    QueryPerformanceCounter(&Start);
+
+    for (UINT32 Iteration = 0; Iteration < Iterations; Iteration++) {
+        for (UINT32 i = 0; i < FrameCount; i++) {
+            PARSE_RESULT Result;
+
+            Parse(ParseFast, &Frames[i], &Result);
+            Sink += Result.Flags + Result.TransportOffset;
+        }
+    }
+
+    QueryPerformanceCounter(&End);
+
+    return
+        (DOUBLE)(End.QuadPart - Start.QuadPart) * 1e9 /
+            ((DOUBLE)Frequency.QuadPart * Iterations * FrameCount);
+}
+
+int
+__cdecl
+main(
+    _In_ int argc,
+    _In_reads_(argc) char **argv
+    )
+{
+    struct {
+        CONST CHAR *Name;
+        PARSE_FAST_ROUTINE *ParseFast;
+    } Variants[] = {
+        { "scalar", NULL },
+#if defined(_M_AMD64)
+        { "sse2", ParseFastSse2 },
+#endif
+        { "wide load", ParseFastWideLoad },
+    };
+    UINT32 FrameCount = DEFAULT_FRAME_COUNT;
+    UINT32 Iterations = DEFAULT_ITERATIONS;
+    UINT32 Runs = DEFAULT_RUNS;
+    UCHAR *Buffers = NULL;
+    FRAME *Frames = NULL;
+    int Result = EXIT_FAILURE;
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && !strcmp(argv[i], "-frames")) {
+            FrameCount = atoi(argv[++i]);
+        } else if (i + 1 < argc && !strcmp(argv[i], "-iterations")) {
+            Iterations = atoi(argv[++i]);
+        } else if (i + 1 < argc && !strcmp(argv[i], "-runs")) {
+            Runs = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "%s", UsageText);
+            goto Exit;
+        }
+    }
+
+    if (FrameCount == 0 || Iterations == 0 || Runs == 0) {
+        fprintf(stderr, "%s", UsageText);
+        goto Exit;
+    }
+
+    for (UINT32 v = 0; v < RTL_NUMBER_OF(Variants); v++) {
+        if (!CheckKnownFrames(Variants[v].Name, Variants[v].ParseFast)) {
+            goto Exit;
+        }
+    }
+
+    Buffers = malloc((SIZE_T)FrameCount * FRAME_BUFFER_LENGTH);
+    Frames = malloc((SIZE_T)FrameCount * sizeof(*Frames));
+    if (Buffers == NULL || Frames == NULL) {
+        fprintf(stderr, "Error: out of memory\n");
+        goto Exit;
+    }
+
+    for (UINT32 Mix = 0; Mix < 2; Mix++) {
+        BOOLEAN UdpOnly = (Mix == 0);
+        UINT64 ExpectedHash;
+
+        for (UINT32 i = 0; i < FrameCount; i++) {
+            BuildFrame(&Buffers[(SIZE_T)i * FRAME_BUFFER_LENGTH], UdpOnly, &Frames[i]);
+        }
+
+        ExpectedHash = HashResults(NULL, Frames, FrameCount);
+
+        for (UINT32 v = 0; v < RTL_NUMBER_OF(Variants); v++) {
+            if (HashResults(Variants[v].ParseFast, Frames, FrameCount) != ExpectedHash) {
+                fprintf(stderr, "Error: %s results differ from scalar\n", Variants[v].Name);
+                goto Exit;
+            }
+        }
+
+        printf("%s:\n", UdpOnly ? "UDP only" : "mixed");
+
+        for (UINT32 v = 0; v < RTL_NUMBER_OF(Variants); v++) {
+            printf("    %-10s", Variants[v].Name);
+            for (UINT32 Run = 0; Run < Runs; Run++) {
+                printf(
+                    " %6.2f",
+                    Measure(Variants[v].ParseFast, Frames, FrameCount, Iterations));
+            }
+            printf(" ns/frame\n");
+        }
+    }
+
+    Result = EXIT_SUCCESS;
+
+Exit:
+
+    free(Frames);
+    free(Buffers);
+
+    return Result;
+}
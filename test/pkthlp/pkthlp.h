@@ -15,6 +15,8 @@ EXTERN_C_START
 #define ETHERNET_MAC_SIZE 6
 #define ETHERNET_TYPE_IPV4 0x0800
 #define ETHERNET_TYPE_IPV6 0x86dd
+#define ETHERNET_TYPE_802_1Q 0x8100
+#define ETHERNET_TYPE_802_1AD 0x88a8
 
 typedef struct _ETHERNET_ADDRESS {
     UCHAR Bytes[ETHERNET_MAC_SIZE];
@@ -29,6 +31,11 @@ typedef struct _ETHERNET_HEADER {
     };
 } ETHERNET_HEADER;
 
+typedef struct _VLAN_TAG {
+    UINT16 Tag;                 // Priority, DEI and VLAN ID.
+    UINT16 Type;                // EtherType of the payload.
+} VLAN_TAG;
+
 #define IPV4_VERSION 4
 
 typedef struct _IPV4_HEADER {
@@ -90,6 +97,19 @@ typedef struct _UDP_HDR {
     UINT16 uh_sum;
 } UDP_HDR;
 
+typedef struct _TCP_HDR {
+    UINT16 th_sport;
+    UINT16 th_dport;
+    UINT32 th_seq;
+    UINT32 th_ack;
+    UINT8 th_x2 : 4;
+    UINT8 th_len : 4;
+    UINT8 th_flags;
+    UINT16 th_win;
+    UINT16 th_sum;
+    UINT16 th_urp;
+} TCP_HDR;
+
 typedef union {
     IN_ADDR Ipv4;
     IN6_ADDR Ipv6;
@@ -133,6 +153,29 @@ PktBuildUdpFrame(
 
 #define UDP_HEADER_STORAGE UDP_HEADER_BACKFILL(AF_INET6)
 
+_Success_(return != FALSE)
+BOOLEAN
+PktBuildTcpFrame(
+    _Out_ VOID *Buffer,
+    _Inout_ UINT32 *BufferSize,
+    _In_ CONST UCHAR *Payload,
+    _In_ UINT16 PayloadLength,
+    _In_ CONST ETHERNET_ADDRESS *EthernetDestination,
+    _In_ CONST ETHERNET_ADDRESS *EthernetSource,
+    _In_ ADDRESS_FAMILY AddressFamily,
+    _In_ CONST VOID *IpDestination,
+    _In_ CONST VOID *IpSource,
+    _In_ UINT16 PortDestination,
+    _In_ UINT16 PortSource,
+    _In_ UINT8 TcpFlags
+    );
+
+#define TCP_HEADER_BACKFILL(AddressFamily) \
+    (sizeof(ETHERNET_HEADER) + sizeof(TCP_HDR) + \
+        ((AddressFamily == AF_INET) ? sizeof(IPV4_HEADER) : sizeof(IPV6_HEADER)))
+
+#define TCP_HEADER_STORAGE TCP_HEADER_BACKFILL(AF_INET6)
+
 BOOLEAN
 PktStringToInetAddressA(
     _Out_ INET_ADDR *InetAddr,